@@ -345,9 +345,9 @@ dnsname_to_dn(zone_register_t *zr, dns_name_t *name, dns_name_t *zone,
 		CHECK(dns_to_ldap_dn_escape(mctx, dns_str, &escaped_name));
 		CHECK(str_cat_char(target, "idnsName="));
 		CHECK(str_cat_char(target, escaped_name));
-		/* 
-		 * Modification of following line can affect modify_ldap_common().
-		 * See line with: char *zone_dn = strstr(str_buf(owner_dn),", ") + 1;  
+		/*
+		 * Modification of following line can affect
+		 * ldap_zone_dn_from_owner().
 		 */
 		CHECK(str_cat_char(target, ", "));
 	}
@@ -361,20 +361,70 @@ cleanup:
 	return result;
 }
 
+/*
+ * Perfect hash of attribute names which are frequent in DNS entries:
+ * "<mnemonic>Record" for every RR type known to BIND and attributes which
+ * do not hold any record. It is built once by ldap_attrhash_init() and read
+ * without locking afterwards. Slot holds index of key + 1 or 0 if empty.
+ */
+#define ATTRHASH_SIZE		8192	/* power of 2 */
+#define ATTRHASH_MAXKEYS	255
+#define ATTRHASH_SEEDS		1024
+
+typedef struct attrhash_key {
+	char			name[LDAP_ATTR_FORMATSIZE];
+	unsigned int		len;
+	isc_result_t		result;	/* of ldap_attribute_to_rdatatype() */
+	dns_rdatatype_t		rdtype;
+} attrhash_key_t;
+
+static attrhash_key_t attrhash_keys[ATTRHASH_MAXKEYS];
+static unsigned int attrhash_count;
+static unsigned char attrhash_slots[ATTRHASH_SIZE];
+static isc_uint32_t attrhash_seed;
+static isc_boolean_t attrhash_ready = ISC_FALSE;
+
+/* Attributes without records which are present in most entries. */
+static const char * const attrhash_norecord[] = {
+	"objectClass", "idnsName", "dnsTTL", "dnsClass", "idnsZoneActive",
+	"idnsSOAmName", "idnsSOArName", "idnsSOAserial", "idnsSOArefresh",
+	"idnsSOAretry", "idnsSOAexpire", "idnsSOAminimum",
+	"idnsUpdatePolicy", "idnsAllowQuery", "idnsAllowTransfer",
+	"idnsAllowSyncPTR", "idnsAllowDynUpdate", "idnsForwardPolicy",
+	"idnsForwarders", "idnsSecInlineSigning", "idnsServerId",
+	"idnsSubstitutionVariable", "entryUUID", "entryCSN",
+	"modifyTimestamp", "createTimestamp", NULL
+};
+
 /**
- * Convert attribute name to dns_rdatatype.
+ * Case-insensitive FNV-1a hash of \0 terminated string.
  *
- * @param[in]  ldap_attribute String with attribute name terminated by \0.
- * @param[out] rdtype
+ * @param[out] lenp Length of the string.
  */
-isc_result_t
-ldap_attribute_to_rdatatype(const char *ldap_attribute, dns_rdatatype_t *rdtype)
+static inline isc_uint32_t ATTR_NONNULLS
+attrhash_hash(isc_uint32_t seed, const char *name, unsigned int *lenp)
+{
+	isc_uint32_t hash = 2166136261U ^ seed;
+	const unsigned char *c;
+
+	for (c = (const unsigned char *)name; *c != '\0'; c++) {
+		hash ^= tolower(*c);
+		hash *= 16777619U;
+	}
+	*lenp = c - (const unsigned char *)name;
+
+	return hash;
+}
+
+/**
+ * Convert attribute name to dns_rdatatype without the hash table.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+attribute_to_rdatatype(const char *ldap_attribute, unsigned int len,
+		       dns_rdatatype_t *rdtype)
 {
-	isc_result_t result;
-	unsigned len;
 	isc_consttextregion_t region;
 
-	len = strlen(ldap_attribute);
 	if (len <= LDAP_RDATATYPE_SUFFIX_LEN)
 		return ISC_R_UNEXPECTEDEND;
 
@@ -392,8 +442,127 @@ ldap_attribute_to_rdatatype(const char *ldap_attribute, dns_rdatatype_t *rdtype)
 	} else
 		return ISC_R_UNEXPECTED;
 
-	result = dns_rdatatype_fromtext(rdtype, (isc_textregion_t *)&region);
-	if (result != ISC_R_SUCCESS)
+	return dns_rdatatype_fromtext(rdtype, (isc_textregion_t *)&region);
+}
+
+static void ATTR_NONNULLS
+attrhash_addkey(const char *name)
+{
+	attrhash_key_t *key;
+
+	if (attrhash_count >= ATTRHASH_MAXKEYS)
+		return;
+	key = &attrhash_keys[attrhash_count];
+	if (isc_string_copy(key->name, sizeof(key->name), name)
+	    != ISC_R_SUCCESS)
+		return;
+	key->len = strlen(key->name);
+	key->result = attribute_to_rdatatype(key->name, key->len,
+					     &key->rdtype);
+	attrhash_count++;
+}
+
+/**
+ * Build perfect hash of attribute names from the RR type table in BIND.
+ * Seeds are tried until all names fall into distinct slots. If no seed
+ * works, the table is not used and names are converted as before.
+ *
+ * @warning Not thread-safe, it has to be called once at plugin load.
+ */
+void
+ldap_attrhash_init(void)
+{
+	char text[DNS_RDATATYPE_FORMATSIZE + LDAP_RDATATYPE_SUFFIX_LEN];
+	isc_buffer_t buffer;
+	isc_region_t region;
+	unsigned int rdtype;
+	unsigned int i;
+	unsigned int len;
+	isc_uint32_t slot;
+	isc_boolean_t collision;
+	const char * const *name;
+
+	attrhash_ready = ISC_FALSE;
+	attrhash_count = 0;
+	for (rdtype = 1; rdtype <= 0xffff; rdtype++) {
+		isc_buffer_init(&buffer, text, sizeof(text) - 1);
+		if (dns_rdatatype_totext(rdtype, &buffer) != ISC_R_SUCCESS)
+			continue;
+		isc_buffer_usedregion(&buffer, &region);
+		text[region.length] = '\0';
+		/* Types without mnemonic are printed as TYPE<number>. */
+		if (strncmp(text, "TYPE", 4) == 0 &&
+		    isdigit((unsigned char)text[4]))
+			continue;
+		if (isc_string_append(text, sizeof(text),
+				      LDAP_RDATATYPE_SUFFIX) != ISC_R_SUCCESS)
+			continue;
+		attrhash_addkey(text);
+	}
+	for (name = attrhash_norecord; *name != NULL; name++)
+		attrhash_addkey(*name);
+
+	for (attrhash_seed = 0; attrhash_seed < ATTRHASH_SEEDS;
+	     attrhash_seed++) {
+		memset(attrhash_slots, 0, sizeof(attrhash_slots));
+		collision = ISC_FALSE;
+		for (i = 0; i < attrhash_count && collision == ISC_FALSE; i++) {
+			slot = attrhash_hash(attrhash_seed,
+					     attrhash_keys[i].name, &len)
+			       & (ATTRHASH_SIZE - 1);
+			if (attrhash_slots[slot] != 0)
+				collision = ISC_TRUE;
+			else
+				attrhash_slots[slot] = i + 1;
+		}
+		if (collision == ISC_FALSE) {
+			attrhash_ready = ISC_TRUE;
+			log_debug(1, "attribute name hash built: %u names, "
+				  "seed %u", attrhash_count, attrhash_seed);
+			return;
+		}
+	}
+	log_debug(1, "attribute name hash not built: no suitable seed");
+}
+
+/**
+ * Convert attribute name to dns_rdatatype.
+ *
+ * Names known at plugin load are resolved with single probe into perfect
+ * hash table, see ldap_attrhash_init(). Other names, e.g.
+ * "UnknownRecord;TYPE65333", are parsed.
+ *
+ * @param[in]  ldap_attribute String with attribute name terminated by \0.
+ * @param[out] rdtype
+ */
+isc_result_t
+ldap_attribute_to_rdatatype(const char *ldap_attribute, dns_rdatatype_t *rdtype)
+{
+	isc_result_t result;
+	unsigned int len;
+	isc_uint32_t hash;
+	unsigned char slot;
+	const attrhash_key_t *key;
+
+	if (attrhash_ready == ISC_TRUE) {
+		hash = attrhash_hash(attrhash_seed, ldap_attribute, &len);
+		slot = attrhash_slots[hash & (ATTRHASH_SIZE - 1)];
+		if (slot != 0) {
+			key = &attrhash_keys[slot - 1];
+			if (key->len == len &&
+			    strcasecmp(key->name, ldap_attribute) == 0) {
+				if (key->result == ISC_R_SUCCESS)
+					*rdtype = key->rdtype;
+				return key->result;
+			}
+		}
+	} else {
+		len = strlen(ldap_attribute);
+	}
+
+	result = attribute_to_rdatatype(ldap_attribute, len, rdtype);
+	if (result != ISC_R_SUCCESS && result != ISC_R_UNEXPECTEDEND &&
+	    result != ISC_R_UNEXPECTED)
 		log_error_r("dns_rdatatype_fromtext() failed for attribute '%s'",
 			    ldap_attribute);
 
@@ -36,6 +36,8 @@ isc_result_t dn_want_zone(const char * const prefix, const char * const dn,
 isc_result_t dnsname_to_dn(zone_register_t *zr, dns_name_t *name, dns_name_t *zone,
 			   ld_string_t *target) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+void ldap_attrhash_init(void);
+
 isc_result_t ldap_attribute_to_rdatatype(const char *ldap_record,
 				      dns_rdatatype_t *rdtype) ATTR_NONNULLS ATTR_CHECKRESULT;
 
@@ -10,6 +10,7 @@
 
 #include <isc/buffer.h>
 #include <isc/commandline.h>
+#include <isc/file.h>
 #include <isc/hash.h>
 #include <isc/lib.h>
 #include <isc/mem.h>
@@ -21,6 +22,8 @@
 #include <dns/diff.h>
 #include <dns/dyndb.h>
 #include <dns/dbiterator.h>
+#include <dns/callbacks.h>
+#include <dns/rbt.h>
 #include <dns/rdata.h>
 #include <dns/rdataclass.h>
 #include <dns/rdatalist.h>
@@ -30,6 +33,7 @@
 #include <dns/result.h>
 #include <dns/soa.h>
 #include <dns/types.h>
+#include <dns/zone.h>
 
 #include <string.h> /* For memcpy */
 
@@ -39,6 +43,7 @@
 #include "ldap_convert.h"
 #include "log.h"
 #include "util.h"
+#include "zone.h"
 #include "zone_register.h"
 
 #ifdef HAVE_VISIBILITY
@@ -51,6 +56,9 @@
 #define VALID_LDAPDB(ldapdb) \
 	((ldapdb) != NULL && (ldapdb)->common.impmagic == LDAPDB_MAGIC)
 
+/* Data for names in ldapdb->confirmed; dns_rbt_findname() ignores NULL. */
+#define CONFIRMED_NAME_MARK ((void *)1)
+
 struct ldapdb {
 	dns_db_t			common;
 	isc_refcount_t			refs;
@@ -77,6 +85,29 @@ struct ldapdb {
 	 * The purpose is to detect moment when the new version is closed.
 	 * That is the right time for unlocking newversion_lock. */
 	dns_dbversion_t			*newversion;
+
+	/**
+	 * LDAP modifications done in newversion. Changes of one name
+	 * are written to LDAP as a single modify operation.
+	 * It is guarded by newversion_lock, see ldap_modbatch_flush(). */
+	ldap_modbatch_t			*modbatch;
+
+	/**
+	 * Names confirmed by data from LDAP since the RBTDB was pre-loaded
+	 * from snapshot. NULL if RBTDB doesn't contain provisional data.
+	 * See ldapdb_snapshot_load() and ldapdb_provisional_sweep(). */
+	dns_rbt_t			*confirmed;
+	isc_mutex_t			confirmed_lock;
+
+	/**
+	 * Load callbacks of internal RBTDB used during initial
+	 * synchronization with LDAP. Valid only if bulkload_active is set.
+	 * See ldapdb_bulkload_begin() and ldapdb_bulkload_end().
+	 * Load mode operations are done with newversion_lock held so they
+	 * cannot interleave with changes done in a new version. */
+	dns_rdatacallbacks_t		bulkload_callbacks;
+	isc_boolean_t			bulkload_active;
+	isc_mutex_t			bulkload_lock;
 };
 
 dns_db_t * ATTR_NONNULLS
@@ -151,10 +182,20 @@ cleanup:
 	}
 	str_destroy(&file_name);
 #endif
+	if (ldapdb->confirmed != NULL)
+		dns_rbt_destroy(&ldapdb->confirmed);
+	ldap_modbatch_destroy(&ldapdb->modbatch);
+	if (ldapdb->bulkload_active == ISC_TRUE)
+		(void)dns_db_endload(ldapdb->rbtdb,
+				     &ldapdb->bulkload_callbacks);
 	dns_db_detach(&ldapdb->rbtdb);
 	dns_name_free(&ldapdb->common.origin, ldapdb->common.mctx);
 	RUNTIME_CHECK(isc_mutex_destroy(&ldapdb->newversion_lock)
 		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_mutex_destroy(&ldapdb->confirmed_lock)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_mutex_destroy(&ldapdb->bulkload_lock)
+		      == ISC_R_SUCCESS);
 	isc_mem_putanddetach(&ldapdb->common.mctx, ldapdb, sizeof(*ldapdb));
 }
 
@@ -304,6 +345,14 @@ attachversion(dns_db_t *db, dns_dbversion_t *source,
 /**
  * @brief Close LDAPDB and internal RBTDB version.
  *
+ * LDAP modifications staged in the new version are written when the SOA
+ * record is changed, i.e. before the change is journaled and the result
+ * is reported to the client, see ldap_modbatch_stage(). Nothing is written
+ * to LDAP here. Pending modifications are dropped if the new version is
+ * rolled back. Modifications still pending at commit are a bug: they are
+ * reported and the version is rolled back so RBTDB does not contain data
+ * which are not in LDAP.
+ *
  * @see newversion for related warnings and examples.
  */
 static void
@@ -311,9 +360,23 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, isc_boolean_t commit)
 {
 	ldapdb_t *ldapdb = (ldapdb_t *)db;
 	dns_dbversion_t *closed_version = *versionp;
+	char zone_name[DNS_NAME_FORMATSIZE];
 
 	REQUIRE(VALID_LDAPDB(ldapdb));
 
+	if (closed_version == ldapdb->newversion) {
+		if (commit == ISC_TRUE &&
+		    ldap_modbatch_isempty(ldapdb->modbatch) == ISC_FALSE) {
+			dns_name_format(&ldapdb->common.origin,
+					zone_name, sizeof(zone_name));
+			log_bug("zone '%s': changes were not written to LDAP "
+				"before commit, rolling back the version; "
+				"journal can be out of sync, run `rndc reload`",
+				zone_name);
+			commit = ISC_FALSE;
+		}
+		ldap_modbatch_discard(ldapdb->modbatch);
+	}
 	dns_db_closeversion(ldapdb->rbtdb, versionp, commit);
 	if (closed_version == ldapdb->newversion) {
 		ldapdb->newversion = NULL;
@@ -435,6 +498,38 @@ allrdatasets(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	return dns_db_allrdatasets(ldapdb->rbtdb, node, version, now, iteratorp);
 }
 
+/**
+ * Get batch for LDAP modifications done in 'version'.
+ *
+ * @return NULL if 'version' is not the new version and modifications have to
+ *         be written to LDAP immediately.
+ */
+static ldap_modbatch_t *
+ldapdb_modbatch(ldapdb_t *ldapdb, dns_dbversion_t *version)
+{
+	if (version != NULL && version == ldapdb->newversion)
+		return ldapdb->modbatch;
+
+	return NULL;
+}
+
+/**
+ * Write LDAP modifications staged in the new version so far.
+ *
+ * Written modifications stay in LDAP even if the version is rolled back
+ * later. RBTDB receives them again from LDAP via SyncRepl.
+ */
+isc_result_t
+ldapdb_flush(dns_db_t *db, dns_dbversion_t *version)
+{
+	ldapdb_t *ldapdb = (ldapdb_t *) db;
+
+	REQUIRE(VALID_LDAPDB(ldapdb));
+	REQUIRE(version == ldapdb->newversion);
+
+	return ldap_modbatch_flush(ldapdb->ldap_inst, ldapdb->modbatch);
+}
+
 /* TODO: Add 'tainted' flag to the LDAP instance if something went wrong. */
 static isc_result_t
 addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
@@ -458,7 +553,8 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	CHECK(ldapdb_name_fromnode(node, dns_fixedname_name(&fname)));
 	result = dns_rdatalist_fromrdataset(rdataset, &rdlist);
 	INSIST(result == ISC_R_SUCCESS);
-	CHECK(write_to_ldap(dns_fixedname_name(&fname), zname, ldapdb->ldap_inst, rdlist));
+	CHECK(write_to_ldap(dns_fixedname_name(&fname), zname, ldapdb->ldap_inst,
+			    rdlist, ldapdb_modbatch(ldapdb, version)));
 
 cleanup:
 	return result;
@@ -543,7 +639,8 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	INSIST(result == ISC_R_SUCCESS);
 	CHECK(ldapdb_name_fromnode(node, dns_fixedname_name(&fname)));
 	CHECK(remove_values_from_ldap(dns_fixedname_name(&fname), zname, ldapdb->ldap_inst,
-				      rdlist, empty_node));
+				      rdlist, empty_node,
+				      ldapdb_modbatch(ldapdb, version)));
 
 cleanup:
 	if (result == ISC_R_SUCCESS)
@@ -580,6 +677,11 @@ deleterdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	CHECK(node_isempty(ldapdb->rbtdb, node, version, 0, &empty_node));
 	CHECK(ldapdb_name_fromnode(node, dns_fixedname_name(&fname)));
 
+	/* Changes staged so far have to be written before the entry
+	 * or attribute is removed. */
+	if (version == ldapdb->newversion)
+		CHECK(ldap_modbatch_flush(ldapdb->ldap_inst, ldapdb->modbatch));
+
 	if (empty_node == ISC_TRUE) {
 		CHECK(remove_entry_from_ldap(dns_fixedname_name(&fname), zname,
 					     ldapdb->ldap_inst));
@@ -951,6 +1053,8 @@ ldapdb_create(isc_mem_t *mctx, dns_name_t *name, dns_dbtype_t type,
 	ldapdb_t *ldapdb = NULL;
 	isc_result_t result;
 	isc_boolean_t lock_ready = ISC_FALSE;
+	isc_boolean_t confirmed_lock_ready = ISC_FALSE;
+	isc_boolean_t bulkload_lock_ready = ISC_FALSE;
 
 	/* Database instance name. */
 	REQUIRE(type == LDAP_DB_TYPE);
@@ -964,6 +1068,10 @@ ldapdb_create(isc_mem_t *mctx, dns_name_t *name, dns_dbtype_t type,
 	isc_mem_attach(mctx, &ldapdb->common.mctx);
 	CHECK(isc_mutex_init(&ldapdb->newversion_lock));
 	lock_ready = ISC_TRUE;
+	CHECK(isc_mutex_init(&ldapdb->confirmed_lock));
+	confirmed_lock_ready = ISC_TRUE;
+	CHECK(isc_mutex_init(&ldapdb->bulkload_lock));
+	bulkload_lock_ready = ISC_TRUE;
 	dns_name_init(&ldapdb->common.origin, NULL);
 	isc_ondestroy_init(&ldapdb->common.ondest);
 
@@ -981,6 +1089,7 @@ ldapdb_create(isc_mem_t *mctx, dns_name_t *name, dns_dbtype_t type,
 
 	CHECK(dns_db_create(mctx, "rbt", name, dns_dbtype_zone,
 			    dns_rdataclass_in, 0, NULL, &ldapdb->rbtdb));
+	CHECK(ldap_modbatch_create(mctx, &ldapdb->modbatch));
 
 	*dbp = (dns_db_t *)ldapdb;
 
@@ -991,6 +1100,15 @@ cleanup:
 		if (lock_ready == ISC_TRUE)
 			RUNTIME_CHECK(isc_mutex_destroy(&ldapdb->newversion_lock)
 				      == ISC_R_SUCCESS);
+		if (confirmed_lock_ready == ISC_TRUE)
+			RUNTIME_CHECK(isc_mutex_destroy(&ldapdb->confirmed_lock)
+				      == ISC_R_SUCCESS);
+		if (bulkload_lock_ready == ISC_TRUE)
+			RUNTIME_CHECK(isc_mutex_destroy(&ldapdb->bulkload_lock)
+				      == ISC_R_SUCCESS);
+		ldap_modbatch_destroy(&ldapdb->modbatch);
+		if (ldapdb->rbtdb != NULL)
+			dns_db_detach(&ldapdb->rbtdb);
 		if (dns_name_dynamic(&ldapdb->common.origin))
 			dns_name_free(&ldapdb->common.origin, mctx);
 
@@ -1001,6 +1119,357 @@ cleanup:
 	return result;
 }
 
+/**
+ * Pre-load internal RBTDB with data from snapshot written by
+ * ldapdb_snapshot_dump(). Loaded data are provisional: names which are not
+ * confirmed by ldapdb_provisional_confirm() are removed from the database
+ * by ldapdb_provisional_sweep().
+ *
+ * @pre Internal RBTDB is empty, i.e. no data from LDAP were added to it yet.
+ *
+ * @retval ISC_R_SUCCESS       Snapshot was loaded.
+ * @retval ISC_R_FILENOTFOUND  Snapshot doesn't exist, database is untouched.
+ * @retval others              Snapshot is unusable. The database may contain
+ *                             partial data which are still provisional.
+ */
+isc_result_t
+ldapdb_snapshot_load(dns_db_t *db, const char *filename)
+{
+	ldapdb_t *ldapdb = (ldapdb_t *) db;
+	isc_result_t result;
+
+	REQUIRE(VALID_LDAPDB(ldapdb));
+
+	if (isc_file_exists(filename) == ISC_FALSE)
+		return ISC_R_FILENOTFOUND;
+
+	LOCK(&ldapdb->confirmed_lock);
+	INSIST(ldapdb->confirmed == NULL);
+	result = dns_rbt_create(ldapdb->common.mctx, NULL, NULL,
+				&ldapdb->confirmed);
+	UNLOCK(&ldapdb->confirmed_lock);
+	if (result != ISC_R_SUCCESS)
+		return result;
+
+	return dns_db_load3(ldapdb->rbtdb, filename, dns_masterformat_raw, 0);
+}
+
+/**
+ * Write current content of internal RBTDB to a file in raw format.
+ * The file can be used by ldapdb_snapshot_load() during next start.
+ */
+isc_result_t
+ldapdb_snapshot_dump(dns_db_t *db, const char *filename)
+{
+	ldapdb_t *ldapdb = (ldapdb_t *) db;
+	dns_dbversion_t *version = NULL;
+	isc_result_t result;
+
+	REQUIRE(VALID_LDAPDB(ldapdb));
+
+	dns_db_currentversion(ldapdb->rbtdb, &version);
+	result = dns_db_dump2(ldapdb->rbtdb, version, filename,
+			      dns_masterformat_raw);
+	dns_db_closeversion(ldapdb->rbtdb, &version, ISC_FALSE);
+
+	return result;
+}
+
+/**
+ * Mark name as present in LDAP so ldapdb_provisional_sweep() will not remove
+ * it. This is no-op if the database doesn't contain provisional data.
+ */
+isc_result_t
+ldapdb_provisional_confirm(dns_db_t *db, dns_name_t *name)
+{
+	ldapdb_t *ldapdb = (ldapdb_t *) db;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(VALID_LDAPDB(ldapdb));
+
+	LOCK(&ldapdb->confirmed_lock);
+	if (ldapdb->confirmed != NULL) {
+		result = dns_rbt_addname(ldapdb->confirmed, name,
+					 CONFIRMED_NAME_MARK);
+		if (result == ISC_R_EXISTS)
+			result = ISC_R_SUCCESS;
+	}
+	UNLOCK(&ldapdb->confirmed_lock);
+
+	return result;
+}
+
+/**
+ * Find out if database contains data loaded from snapshot which were not
+ * confirmed or accepted yet.
+ */
+isc_boolean_t
+ldapdb_isprovisional(dns_db_t *db)
+{
+	ldapdb_t *ldapdb = (ldapdb_t *) db;
+	isc_boolean_t provisional;
+
+	REQUIRE(VALID_LDAPDB(ldapdb));
+
+	LOCK(&ldapdb->confirmed_lock);
+	provisional = ISC_TF(ldapdb->confirmed != NULL);
+	UNLOCK(&ldapdb->confirmed_lock);
+
+	return provisional;
+}
+
+/**
+ * Remove all names loaded from snapshot which were not confirmed by data
+ * from LDAP and stop tracking confirmed names.
+ * Nothing is written to LDAP, modification is done in internal RBTDB only.
+ *
+ * Zone which is already served from the snapshot gets incremented SOA serial
+ * and the change is written to its journal.
+ *
+ * @pre Initial synchronization with LDAP is done.
+ *
+ * @param[in]  zone     Raw zone if it is already loaded, NULL otherwise.
+ * @param[out] removedp Number of removed names.
+ * @param[out] serialp  New SOA serial, it is valid only if zone was
+ *                      not NULL and *removedp > 0.
+ */
+isc_result_t
+ldapdb_provisional_sweep(dns_db_t *db, dns_zone_t *zone,
+			 unsigned int *removedp, isc_uint32_t *serialp)
+{
+	ldapdb_t *ldapdb = (ldapdb_t *) db;
+	isc_result_t result;
+	dns_dbversion_t *version = NULL;
+	dns_dbiterator_t *iter = NULL;
+	dns_dbnode_t *node = NULL;
+	dns_rdatasetiter_t *rds_iter = NULL;
+	dns_rdataset_t rdataset;
+	dns_diff_t diff;
+	dns_difftuple_t *last_tuple = NULL;
+	void *data = NULL;
+	unsigned int removed = 0;
+	DECLARE_BUFFERED_NAME(name);
+
+	REQUIRE(VALID_LDAPDB(ldapdb));
+	REQUIRE(removedp != NULL);
+	REQUIRE(serialp != NULL);
+
+	INIT_BUFFERED_NAME(name);
+	dns_rdataset_init(&rdataset);
+	dns_diff_init(ldapdb->common.mctx, &diff);
+
+	if (ldapdb_isprovisional(db) == ISC_FALSE)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+
+	/* Open version blocks all other writers until the sweep is done. */
+	CHECK(newversion(db, &version));
+	CHECK(dns_db_createiterator(ldapdb->rbtdb, 0, &iter));
+	for (result = dns_dbiterator_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = dns_dbiterator_next(iter)) {
+		CHECK(dns_dbiterator_current(iter, &node, &name));
+		LOCK(&ldapdb->confirmed_lock);
+		result = dns_rbt_findname(ldapdb->confirmed, &name, 0, NULL,
+					  &data);
+		UNLOCK(&ldapdb->confirmed_lock);
+		if (result != ISC_R_SUCCESS) {
+			last_tuple = ISC_LIST_TAIL(diff.tuples);
+			CHECK(dns_db_allrdatasets(ldapdb->rbtdb, node, version,
+						  0, &rds_iter));
+			for (result = dns_rdatasetiter_first(rds_iter);
+			     result == ISC_R_SUCCESS;
+			     result = dns_rdatasetiter_next(rds_iter)) {
+				dns_rdatasetiter_current(rds_iter, &rdataset);
+				result = rdataset_to_diff(ldapdb->common.mctx,
+							  DNS_DIFFOP_DEL, &name,
+							  &rdataset, &diff);
+				dns_rdataset_disassociate(&rdataset);
+				CHECK(result);
+			}
+			if (result != ISC_R_NOMORE)
+				goto cleanup;
+			dns_rdatasetiter_destroy(&rds_iter);
+			if (ISC_LIST_TAIL(diff.tuples) != last_tuple)
+				++removed;
+		}
+		dns_db_detachnode(ldapdb->rbtdb, &node);
+		INIT_BUFFERED_NAME(name);
+	}
+	if (result != ISC_R_NOMORE)
+		goto cleanup;
+	dns_dbiterator_destroy(&iter);
+
+	if (zone != NULL && !EMPTY(diff.tuples)) {
+		CHECK(zone_soaserial_addtuple(ldapdb->common.mctx, db, version,
+					      &diff, serialp));
+		CHECK(zone_journal_adddiff(ldapdb->common.mctx, zone, &diff));
+	}
+	CHECK(dns_diff_apply(&diff, ldapdb->rbtdb, version));
+	closeversion(db, &version, ISC_TRUE);
+	if (zone != NULL && removed > 0)
+		dns_zone_markdirty(zone);
+
+	LOCK(&ldapdb->confirmed_lock);
+	dns_rbt_destroy(&ldapdb->confirmed);
+	UNLOCK(&ldapdb->confirmed_lock);
+
+cleanup:
+	if (dns_rdataset_isassociated(&rdataset))
+		dns_rdataset_disassociate(&rdataset);
+	if (rds_iter != NULL)
+		dns_rdatasetiter_destroy(&rds_iter);
+	if (node != NULL)
+		dns_db_detachnode(ldapdb->rbtdb, &node);
+	if (iter != NULL)
+		dns_dbiterator_destroy(&iter);
+	if (version != NULL)
+		closeversion(db, &version, ISC_FALSE);
+	dns_diff_clear(&diff);
+	*removedp = removed;
+	return result;
+}
+
+/**
+ * Accept all data loaded from snapshot as current and stop tracking
+ * confirmed names. This is used instead of ldapdb_provisional_sweep()
+ * when synchronization was resumed from a cookie so LDAP server reported
+ * only changed and deleted entries.
+ */
+void
+ldapdb_provisional_accept(dns_db_t *db)
+{
+	ldapdb_t *ldapdb = (ldapdb_t *) db;
+
+	REQUIRE(VALID_LDAPDB(ldapdb));
+
+	LOCK(&ldapdb->confirmed_lock);
+	if (ldapdb->confirmed != NULL)
+		dns_rbt_destroy(&ldapdb->confirmed);
+	UNLOCK(&ldapdb->confirmed_lock);
+}
+
+/**
+ * Switch internal RBTDB to load mode so data received during initial
+ * synchronization with LDAP can be added by ldapdb_bulkload_add() without
+ * the overhead of versions and diffs.
+ *
+ * @pre Internal RBTDB was not loaded yet, i.e. it was not pre-loaded
+ *      from snapshot.
+ *
+ * @retval ISC_R_SUCCESS  Load mode is active.
+ * @retval ISC_R_IGNORE   RBTDB contains provisional data from snapshot,
+ *                        load mode cannot be used.
+ */
+isc_result_t
+ldapdb_bulkload_begin(dns_db_t *db)
+{
+	ldapdb_t *ldapdb = (ldapdb_t *) db;
+	isc_result_t result;
+	isc_boolean_t provisional;
+
+	REQUIRE(VALID_LDAPDB(ldapdb));
+
+	LOCK(&ldapdb->confirmed_lock);
+	provisional = ISC_TF(ldapdb->confirmed != NULL);
+	UNLOCK(&ldapdb->confirmed_lock);
+	if (provisional == ISC_TRUE)
+		return ISC_R_IGNORE;
+
+	LOCK(&ldapdb->newversion_lock);
+	LOCK(&ldapdb->bulkload_lock);
+	INSIST(ldapdb->bulkload_active == ISC_FALSE);
+	dns_rdatacallbacks_init(&ldapdb->bulkload_callbacks);
+	result = dns_db_beginload(ldapdb->rbtdb, &ldapdb->bulkload_callbacks);
+	if (result == ISC_R_SUCCESS)
+		ldapdb->bulkload_active = ISC_TRUE;
+	UNLOCK(&ldapdb->bulkload_lock);
+	UNLOCK(&ldapdb->newversion_lock);
+
+	return result;
+}
+
+/**
+ * Add all rdatasets for a name directly to internal RBTDB in load mode.
+ * Only names which do not exist in RBTDB yet can be added this way,
+ * data for existing names have to be merged using a diff.
+ *
+ * @pre No version of the database is open by the caller.
+ *
+ * @retval ISC_R_SUCCESS  Data were added.
+ * @retval ISC_R_IGNORE   Load mode is not active, nothing was added.
+ * @retval ISC_R_EXISTS   Name already exists in RBTDB, nothing was added.
+ * @retval others         Errors from RBTDB. Part of the data could be added.
+ */
+isc_result_t
+ldapdb_bulkload_add(dns_db_t *db, dns_name_t *name,
+		    ldapdb_rdatalist_t *rdatalist)
+{
+	ldapdb_t *ldapdb = (ldapdb_t *) db;
+	isc_result_t result = ISC_R_SUCCESS;
+	dns_dbnode_t *node = NULL;
+	dns_rdatalist_t *rdlist;
+	dns_rdataset_t rdataset;
+
+	REQUIRE(VALID_LDAPDB(ldapdb));
+
+	dns_rdataset_init(&rdataset);
+
+	LOCK(&ldapdb->newversion_lock);
+	LOCK(&ldapdb->bulkload_lock);
+	if (ldapdb->bulkload_active == ISC_FALSE)
+		CLEANUP_WITH(ISC_R_IGNORE);
+
+	result = dns_db_findnode(ldapdb->rbtdb, name, ISC_FALSE, &node);
+	if (result == ISC_R_SUCCESS) {
+		dns_db_detachnode(ldapdb->rbtdb, &node);
+		CLEANUP_WITH(ISC_R_EXISTS);
+	} else if (result != ISC_R_NOTFOUND) {
+		goto cleanup;
+	}
+
+	for (rdlist = HEAD(*rdatalist);
+	     rdlist != NULL;
+	     rdlist = NEXT(rdlist, link)) {
+		CHECK(dns_rdatalist_tordataset(rdlist, &rdataset));
+		result = ldapdb->bulkload_callbacks.add(
+				ldapdb->bulkload_callbacks.add_private,
+				name, &rdataset);
+		dns_rdataset_disassociate(&rdataset);
+		CHECK(result);
+	}
+
+cleanup:
+	UNLOCK(&ldapdb->bulkload_lock);
+	UNLOCK(&ldapdb->newversion_lock);
+	return result;
+}
+
+/**
+ * Finish load mode started by ldapdb_bulkload_begin(). All data added
+ * by ldapdb_bulkload_add() become part of the current RBTDB version.
+ * This is no-op if load mode is not active.
+ */
+isc_result_t
+ldapdb_bulkload_end(dns_db_t *db)
+{
+	ldapdb_t *ldapdb = (ldapdb_t *) db;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(VALID_LDAPDB(ldapdb));
+
+	LOCK(&ldapdb->newversion_lock);
+	LOCK(&ldapdb->bulkload_lock);
+	if (ldapdb->bulkload_active == ISC_TRUE) {
+		result = dns_db_endload(ldapdb->rbtdb,
+					&ldapdb->bulkload_callbacks);
+		ldapdb->bulkload_active = ISC_FALSE;
+	}
+	UNLOCK(&ldapdb->bulkload_lock);
+	UNLOCK(&ldapdb->newversion_lock);
+
+	return result;
+}
+
 static void
 library_init(void)
 {
@@ -1008,6 +1477,7 @@ library_init(void)
                 " compiled at " __TIME__ " " __DATE__
                 ", compiler " __VERSION__);
        cfg_init_types();
+       ldap_attrhash_init();
 }
 
 /*
@@ -8,6 +8,7 @@
 #include <dns/diff.h>
 #include <dns/types.h>
 
+#include "types.h"
 #include "util.h"
 
 /* values shared by all LDAP database instances */
@@ -29,4 +30,42 @@ ldapdb_associate(isc_mem_t *mctx, dns_name_t *name, dns_dbtype_t type,
 dns_db_t *
 ldapdb_get_rbtdb(dns_db_t *db) ATTR_NONNULLS;
 
+isc_result_t
+ldapdb_snapshot_load(dns_db_t *db, const char *filename)
+		     ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+ldapdb_snapshot_dump(dns_db_t *db, const char *filename)
+		     ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+ldapdb_provisional_confirm(dns_db_t *db, dns_name_t *name)
+			   ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_boolean_t
+ldapdb_isprovisional(dns_db_t *db) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+ldapdb_provisional_sweep(dns_db_t *db, dns_zone_t *zone,
+			 unsigned int *removedp, isc_uint32_t *serialp)
+			 ATTR_NONNULL(1,3,4) ATTR_CHECKRESULT;
+
+void
+ldapdb_provisional_accept(dns_db_t *db) ATTR_NONNULLS;
+
+isc_result_t
+ldapdb_flush(dns_db_t *db, dns_dbversion_t *version)
+	     ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+ldapdb_bulkload_begin(dns_db_t *db) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+ldapdb_bulkload_add(dns_db_t *db, dns_name_t *name,
+		    ldapdb_rdatalist_t *rdatalist)
+		    ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+ldapdb_bulkload_end(dns_db_t *db) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 #endif /* LDAP_DRIVER_H_ */
@@ -8,17 +8,22 @@
 #include <dns/types.h>
 
 #include <isc/int.h>
+#include <isc/md5.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
 #include <isc/region.h>
 #include <isc/types.h>
 #include <isc/util.h>
 
 #define LDAP_DEPRECATED 1
 #include <ldap.h>
+#include <string.h>
+#include <strings.h>
 
 #include "ldap_convert.h"
 #include "ldap_entry.h"
 #include "mldap.h"
-#include "metadb.h"
+#include "rrtemplate.h"
 #include "str.h"
 #include "util.h"
 #include "zone_register.h"
@@ -34,17 +39,13 @@ ldap_entry_parseclass(ldap_entry_t *entry, ldap_entryclass_t *class);
 
 /* Represents values associated with LDAP attribute */
 static void ATTR_NONNULLS
-ldap_valuelist_destroy(isc_mem_t *mctx, ldap_valuelist_t *values)
+ldap_valuelist_destroy(isc_mem_t *mctx, ldap_attribute_t *attr)
 {
-	ldap_value_t *value, *next;
-
-	value = HEAD(*values);
-	while (value != NULL) {
-		next = NEXT(value, link);
-		UNLINK(*values, value, link);
-		SAFE_MEM_PUT_PTR(mctx, value);
-		value = next;
-	}
+	INIT_LIST(attr->values);
+	SAFE_MEM_PUT(mctx, attr->valuemem,
+		     attr->nvalues * sizeof(*attr->valuemem));
+	attr->valuemem = NULL;
+	attr->nvalues = 0;
 }
 
 static void ATTR_NONNULLS
@@ -56,8 +57,8 @@ ldap_attributelist_destroy(isc_mem_t *mctx, ldap_attributelist_t *attrlist)
         while (attr != NULL) {
                 next = NEXT(attr, link);
                 UNLINK(*attrlist, attr, link);
-		ldap_valuelist_destroy(mctx, &attr->values);
-                ldap_value_free(attr->ldap_values);
+		ldap_valuelist_destroy(mctx, attr);
+                ldap_value_free_len(attr->ldap_values);
                 ldap_memfree(attr->name);
                 SAFE_MEM_PUT_PTR(mctx, attr);
                 attr = next;
@@ -69,23 +70,33 @@ ldap_attr_create(isc_mem_t *mctx, LDAP *ld, LDAPMessage *ldap_entry,
 		 ldap_attribute_t *attr)
 {
 	isc_result_t result;
-	char **values;
+	struct berval **values;
 	ldap_value_t *val;
+	unsigned int count;
 
 	REQUIRE(ld != NULL);
 	REQUIRE(ldap_entry != NULL);
 	REQUIRE(attr != NULL);
 
-	values = ldap_get_values(ld, ldap_entry, attr->name);
+	/* Values are taken over from libldap without copying. libldap
+	 * terminates each value by NUL so they can be used as strings and
+	 * their lengths are known without strlen(). */
+	values = ldap_get_values_len(ld, ldap_entry, attr->name);
 	/* TODO: proper ldap error handling */
 	if (values == NULL)
 		return ISC_R_FAILURE;
 
+	count = ldap_count_values_len(values);
+	if (count > 0)
+		CHECKED_MEM_GET(mctx, attr->valuemem,
+				count * sizeof(*attr->valuemem));
+	attr->nvalues = count;
 	attr->ldap_values = values;
 
-	for (unsigned int i = 0; values[i] != NULL; i++) {
-		CHECKED_MEM_GET_PTR(mctx, val);
-		val->value = values[i];
+	for (unsigned int i = 0; i < count; i++) {
+		val = &attr->valuemem[i];
+		val->value = values[i]->bv_val;
+		val->length = values[i]->bv_len;
 		INIT_LINK(val, link);
 
 		APPEND(attr->values, val, link);
@@ -94,8 +105,7 @@ ldap_attr_create(isc_mem_t *mctx, LDAP *ld, LDAPMessage *ldap_entry,
 	return ISC_R_SUCCESS;
 
 cleanup:
-	ldap_valuelist_destroy(mctx, &attr->values);
-	ldap_value_free(values);
+	ldap_value_free_len(values);
 
 	return result;
 }
@@ -120,15 +130,10 @@ ldap_entry_init(isc_mem_t *mctx, ldap_entry_t **entryp) {
 	INIT_BUFFERED_NAME(entry->fqdn);
 	INIT_BUFFERED_NAME(entry->zone_name);
 
-	CHECKED_MEM_GET(mctx, entry->rdata_target_mem, DNS_RDATA_MAXLENGTH);
-	CHECK(isc_lex_create(mctx, TOKENSIZ, &entry->lex));
-
 	*entryp = entry;
+	return ISC_R_SUCCESS;
 
 cleanup:
-	if (result != ISC_R_SUCCESS)
-		ldap_entry_destroy(&entry);
-
 	return result;
 }
 
@@ -148,7 +153,7 @@ ldap_entry_reconstruct(isc_mem_t *mctx, mldapdb_t *mldap, struct berval *uuid,
 	isc_result_t result;
 	ldap_entry_t *entry = NULL;
 	ld_string_t *str = NULL;
-	metadb_node_t *node = NULL;
+	mldap_node_t *node = NULL;
 
 	CHECK(str_new(mctx, &str));
 	result = mldap_entry_read(mldap, uuid, &node);
@@ -173,7 +178,7 @@ ldap_entry_reconstruct(isc_mem_t *mctx, mldapdb_t *mldap, struct berval *uuid,
 cleanup:
 	if (result != ISC_R_SUCCESS)
 		ldap_entry_destroy(&entry);
-	metadb_node_close(&node);
+	mldap_node_close(&node);
 	str_destroy(&str);
 	return result;
 }
@@ -275,13 +280,6 @@ ldap_entry_destroy(ldap_entry_t **entryp)
 		dns_name_free(&entry->fqdn, entry->mctx);
 	if (dns_name_dynamic(&entry->zone_name))
 		dns_name_free(&entry->zone_name, entry->mctx);
-	if (entry->lex != NULL) {
-		isc_lex_close(entry->lex);
-		isc_lex_destroy(&entry->lex);
-	}
-	if (entry->rdata_target_mem != NULL)
-		SAFE_MEM_PUT(entry->mctx, entry->rdata_target_mem,
-			     DNS_RDATA_MAXLENGTH);
 	str_destroy(&entry->logname);
 
 	MEM_PUT_AND_DETACH(entry);
@@ -289,6 +287,74 @@ ldap_entry_destroy(ldap_entry_t **entryp)
 	*entryp = NULL;
 }
 
+/**
+ * Estimate amount of memory held by the entry. Human-readable name
+ * from ldap_entry_logname() is not included so the result
+ * does not change during entry lifetime.
+ */
+size_t
+ldap_entry_size(const ldap_entry_t *entry)
+{
+	ldap_attribute_t *attr;
+	ldap_value_t *value;
+	size_t size;
+
+	REQUIRE(entry != NULL);
+
+	size = sizeof(*entry);
+	if (entry->dn != NULL)
+		size += strlen(entry->dn) + 1;
+	if (entry->uuid != NULL)
+		size += sizeof(*entry->uuid) + entry->uuid->bv_len;
+	for (attr = HEAD(entry->attrs);
+	     attr != NULL;
+	     attr = NEXT(attr, link)) {
+		size += sizeof(*attr) + strlen(attr->name) + 1;
+		for (value = HEAD(attr->values);
+		     value != NULL;
+		     value = NEXT(value, link))
+			size += sizeof(*value) + sizeof(struct berval *)
+				+ sizeof(struct berval) + value->length + 1;
+	}
+
+	return size;
+}
+
+/**
+ * Compute digest of entry DN and all attributes except 'skip_attr'.
+ * Equal digests mean that entries differ at most in values of 'skip_attr',
+ * as long as the LDAP server sends attributes in the same order.
+ */
+void
+ldap_entry_digest(const ldap_entry_t *entry, const char *skip_attr,
+		  unsigned char digest[ISC_MD5_DIGESTLENGTH])
+{
+	isc_md5_t md5;
+	ldap_attribute_t *attr;
+	ldap_value_t *value;
+
+	isc_md5_init(&md5);
+	if (entry->dn != NULL)
+		isc_md5_update(&md5, (unsigned char *)entry->dn,
+			       strlen(entry->dn) + 1);
+	for (attr = HEAD(entry->attrs);
+	     attr != NULL;
+	     attr = NEXT(attr, link)) {
+		if (strcasecmp(attr->name, skip_attr) == 0)
+			continue;
+		isc_md5_update(&md5, (unsigned char *)attr->name,
+			       strlen(attr->name) + 1);
+		for (value = HEAD(attr->values);
+		     value != NULL;
+		     value = NEXT(value, link))
+			isc_md5_update(&md5, (unsigned char *)value->value,
+				       value->length + 1);
+		/* empty value terminates the list */
+		isc_md5_update(&md5, (unsigned char *)"", 1);
+	}
+	isc_md5_final(&md5, digest);
+}
+
 isc_result_t
 ldap_entry_getvalues(const ldap_entry_t *entry, const char *attrname,
 		     ldap_valuelist_t *values)
@@ -480,40 +546,34 @@ ldap_entry_parseclass(ldap_entry_t *entry, ldap_entryclass_t *class)
 }
 
 isc_result_t
-ldap_attr_firstvalue(ldap_attribute_t *attr, ld_string_t *str)
+ldap_attr_firstvalue(ldap_attribute_t *attr, const ldap_value_t **valuep)
 {
 	REQUIRE(attr != NULL);
-	REQUIRE(str != NULL);
+	REQUIRE(valuep != NULL);
 
 	attr->lastval = NULL;
-	return ldap_attr_nextvalue(attr, str);
+	return ldap_attr_nextvalue(attr, valuep);
 }
 
 isc_result_t
-ldap_attr_nextvalue(ldap_attribute_t *attr, ld_string_t *str)
+ldap_attr_nextvalue(ldap_attribute_t *attr, const ldap_value_t **valuep)
 {
-	isc_result_t result;
 	ldap_value_t *value;
 
 	REQUIRE(attr != NULL);
-        REQUIRE(str != NULL);
-
-	str_clear(str);
+	REQUIRE(valuep != NULL);
 
 	if (attr->lastval == NULL)
 		value = HEAD(attr->values);
 	else
 		value = NEXT(attr->lastval, link);
 
-	if (value != NULL)
-		attr->lastval = value;
-	else
+	if (value == NULL)
 		return ISC_R_NOMORE;
 
-	CHECK(str_init_char(str, value->value));
-
-cleanup:
-	return result;
+	attr->lastval = value;
+	*valuep = value;
+	return ISC_R_SUCCESS;
 }
 
 dns_ttl_t
@@ -608,3 +668,126 @@ cleanup:
 	str_destroy(&str);
 	return "<failed to obtain LDAP entry identifier>";
 }
+
+struct ldap_parsectx_pool {
+	isc_mem_t			*mctx;
+	isc_mutex_t			lock;
+	ISC_LIST(ldap_parsectx_t)	free;
+};
+
+static void
+ldap_parsectx_destroy(isc_mem_t *mctx, ldap_parsectx_t **pctxp) {
+	ldap_parsectx_t *pctx = *pctxp;
+
+	if (pctx == NULL)
+		return;
+
+	if (pctx->lex != NULL)
+		isc_lex_destroy(&pctx->lex);
+	SAFE_MEM_PUT(mctx, pctx->rdata_target_mem, DNS_RDATA_MAXLENGTH);
+	rrtemplate_cache_destroy(&pctx->tmpl_cache);
+	SAFE_MEM_PUT_PTR(mctx, pctx);
+
+	*pctxp = NULL;
+}
+
+/**
+ * Create pool of parsing contexts. Contexts are allocated on demand so
+ * the pool holds as many of them as there were concurrent parsers.
+ */
+isc_result_t
+ldap_parsectx_pool_create(isc_mem_t *mctx, ldap_parsectx_pool_t **poolp) {
+	isc_result_t result;
+	ldap_parsectx_pool_t *pool = NULL;
+
+	REQUIRE(poolp != NULL && *poolp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, pool);
+	ZERO_PTR(pool);
+	result = isc_mutex_init(&pool->lock);
+	if (result != ISC_R_SUCCESS) {
+		SAFE_MEM_PUT_PTR(mctx, pool);
+		goto cleanup;
+	}
+	isc_mem_attach(mctx, &pool->mctx);
+	INIT_LIST(pool->free);
+
+	*poolp = pool;
+
+cleanup:
+	return result;
+}
+
+void
+ldap_parsectx_pool_destroy(ldap_parsectx_pool_t **poolp) {
+	ldap_parsectx_pool_t *pool;
+	ldap_parsectx_t *pctx;
+
+	REQUIRE(poolp != NULL);
+
+	pool = *poolp;
+	if (pool == NULL)
+		return;
+
+	while ((pctx = HEAD(pool->free)) != NULL) {
+		UNLINK(pool->free, pctx, link);
+		ldap_parsectx_destroy(pool->mctx, &pctx);
+	}
+	DESTROYLOCK(&pool->lock);
+	MEM_PUT_AND_DETACH(pool);
+
+	*poolp = NULL;
+}
+
+/**
+ * Get parsing context for exclusive use. It has to be returned
+ * using ldap_parsectx_put().
+ */
+isc_result_t
+ldap_parsectx_get(ldap_parsectx_pool_t *pool, ldap_parsectx_t **pctxp) {
+	isc_result_t result;
+	ldap_parsectx_t *pctx = NULL;
+
+	REQUIRE(pctxp != NULL && *pctxp == NULL);
+
+	LOCK(&pool->lock);
+	pctx = HEAD(pool->free);
+	if (pctx != NULL)
+		UNLINK(pool->free, pctx, link);
+	UNLOCK(&pool->lock);
+
+	if (pctx == NULL) {
+		CHECKED_MEM_GET_PTR(pool->mctx, pctx);
+		ZERO_PTR(pctx);
+		INIT_LINK(pctx, link);
+		CHECKED_MEM_GET(pool->mctx, pctx->rdata_target_mem,
+				DNS_RDATA_MAXLENGTH);
+		CHECK(isc_lex_create(pool->mctx, TOKENSIZ, &pctx->lex));
+		CHECK(rrtemplate_cache_create(pool->mctx, &pctx->tmpl_cache));
+	}
+
+	*pctxp = pctx;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	ldap_parsectx_destroy(pool->mctx, &pctx);
+	return result;
+}
+
+void
+ldap_parsectx_put(ldap_parsectx_pool_t *pool, ldap_parsectx_t **pctxp) {
+	ldap_parsectx_t *pctx;
+
+	REQUIRE(pctxp != NULL);
+
+	pctx = *pctxp;
+	if (pctx == NULL)
+		return;
+
+	isc_lex_close(pctx->lex);
+	LOCK(&pool->lock);
+	APPEND(pool->free, pctx, link);
+	UNLOCK(&pool->lock);
+
+	*pctxp = NULL;
+}
@@ -6,6 +6,7 @@
 #define _LD_LDAP_ENTRY_H_
 
 #include <isc/lex.h>
+#include <isc/md5.h>
 #include <dns/types.h>
 
 #include "fwd_register.h"
@@ -16,11 +17,13 @@
 #define LDAP_DEPRECATED 1
 #include <ldap.h>
 
-/* Represents values associated with LDAP attribute */
+/* Represents values associated with LDAP attribute. Value points directly
+ * to memory returned by libldap, it is always NUL-terminated. */
 typedef struct ldap_value ldap_value_t;
 typedef ISC_LIST(ldap_value_t) ldap_valuelist_t;
 struct ldap_value {
         char                    *value;
+        size_t                  length;
         ISC_LINK(ldap_value_t)      link;
 };
 
@@ -42,20 +45,32 @@ struct ldap_entry {
 	ldap_attributelist_t	attrs;
 	ISC_LINK(ldap_entry_t)	link;
 
-	/* Parsing. */
-	isc_lex_t		*lex;
-	isc_buffer_t		rdata_target;
-	unsigned char		*rdata_target_mem;
-
 	/* Human-readable identifier. It has to be accessed via
 	 * ldap_entry_logname(). */
 	ld_string_t		*logname;
 };
 
+/* Scratch space for parsing of rdata in text form. Contexts are taken from
+ * ldap_parsectx_pool_t for duration of parsing so entries do not need
+ * to carry their own lexer and 64 kB rdata buffer. Compiled record
+ * templates are cached in the context as well. */
+typedef struct ldap_parsectx ldap_parsectx_t;
+typedef struct ldap_parsectx_pool ldap_parsectx_pool_t;
+struct ldap_parsectx {
+	isc_lex_t		*lex;
+	isc_buffer_t		rdata_target;
+	unsigned char		*rdata_target_mem;
+	rrtemplate_cache_t	*tmpl_cache;
+	ISC_LINK(ldap_parsectx_t)	link;
+};
+
 /* Represents LDAP attribute and it's values */
 struct ldap_attribute {
 	char			*name;
-	char			**ldap_values;
+	struct berval		**ldap_values;
+	/* All values of the attribute are allocated in a single array. */
+	ldap_value_t		*valuemem;
+	unsigned int		nvalues;
 	ldap_value_t		*lastval;
 	ldap_valuelist_t	values;
 	ISC_LINK(ldap_attribute_t)	link;
@@ -86,6 +101,13 @@ ldap_entry_reconstruct(isc_mem_t *mctx, mldapdb_t *mldap, struct berval *uuid,
 void
 ldap_entry_destroy(ldap_entry_t **entryp) ATTR_NONNULLS;
 
+size_t
+ldap_entry_size(const ldap_entry_t *entry) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+ldap_entry_digest(const ldap_entry_t *entry, const char *skip_attr,
+		  unsigned char digest[ISC_MD5_DIGESTLENGTH]) ATTR_NONNULLS;
+
 isc_result_t
 ldap_entry_getvalues(const ldap_entry_t *entry, const char *attrname,
 		     ldap_valuelist_t *values) ATTR_NONNULLS ATTR_CHECKRESULT;
@@ -109,16 +131,16 @@ ldap_entry_getfakesoa(ldap_entry_t *entry, const char *fake_mname,
 		      ld_string_t *target) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 isc_result_t
-ldap_attr_firstvalue(ldap_attribute_t *attr, ld_string_t *str) ATTR_NONNULLS ATTR_CHECKRESULT;
+ldap_attr_firstvalue(ldap_attribute_t *attr, const ldap_value_t **valuep) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 /*
  * ldap_attr_nextvalue
  *
- * Returns pointer to value in case of success, NULL if no other val is
- * available
+ * Returns pointer to value in case of success, ISC_R_NOMORE if no other val
+ * is available. Value is not copied and it is valid as long as the entry.
  */
 isc_result_t
-ldap_attr_nextvalue(ldap_attribute_t *attr, ld_string_t *value) ATTR_NONNULLS ATTR_CHECKRESULT;
+ldap_attr_nextvalue(ldap_attribute_t *attr, const ldap_value_t **valuep) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 dns_ttl_t
 ldap_entry_getttl(ldap_entry_t *entry, const settings_set_t * settings) ATTR_NONNULLS ATTR_CHECKRESULT;
@@ -126,4 +148,16 @@ ldap_entry_getttl(ldap_entry_t *entry, const settings_set_t * settings) ATTR_NON
 const char *
 ldap_entry_logname(ldap_entry_t * const entry) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+ldap_parsectx_pool_create(isc_mem_t *mctx, ldap_parsectx_pool_t **poolp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+ldap_parsectx_pool_destroy(ldap_parsectx_pool_t **poolp) ATTR_NONNULLS;
+
+isc_result_t
+ldap_parsectx_get(ldap_parsectx_pool_t *pool, ldap_parsectx_t **pctxp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+ldap_parsectx_put(ldap_parsectx_pool_t *pool, ldap_parsectx_t **pctxp) ATTR_NONNULLS;
+
 #endif /* !_LD_LDAP_ENTRY_H_ */
@@ -6,6 +6,7 @@
 
 #include <dns/dyndb.h>
 #include <dns/diff.h>
+#include <dns/fixedname.h>
 #include <dns/journal.h>
 #include <dns/rbt.h>
 #include <dns/rdata.h>
@@ -25,7 +26,9 @@
 #include <dns/update.h>
 
 #include <isc/buffer.h>
+#include <isc/condition.h>
 #include <isc/dir.h>
+#include <isc/file.h>
 #include <isc/int.h>
 #include <isc/mem.h>
 #include <isc/mutex.h>
@@ -35,21 +38,23 @@
 #include <isc/thread.h>
 #include <isc/time.h>
 #include <isc/util.h>
+#include <isc/ht.h>
 #include <isc/netaddr.h>
 #include <isc/parseint.h>
 #include <isc/refcount.h>
 #include <isc/timer.h>
 #include <isc/serial.h>
+#include <isc/stdio.h>
 #include <isc/string.h>
 
 #include <isccfg/cfg.h>
 #include <isccfg/grammar.h>
 
 #include <alloca.h>
+#include <arpa/inet.h>
 #define LDAP_DEPRECATED 1
 #include <ldap.h>
 #include <limits.h>
-#include <regex.h>
 #include <sasl/sasl.h>
 #include <signal.h>
 #include <stddef.h>
@@ -58,6 +63,7 @@
 #include <strings.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <uuid/uuid.h>
 
 #include "acl.h"
 #include "empty_zones.h"
@@ -70,8 +76,9 @@
 #include "ldap_helper.h"
 #include "lock.h"
 #include "log.h"
-#include "metadb.h"
 #include "mldap.h"
+#include "rrschema.h"
+#include "rrtemplate.h"
 #include "semaphore.h"
 #include "settings.h"
 #include "str.h"
@@ -105,16 +112,32 @@
  * isc_task_beginexclusive() and then return back via isc_task_endexclusive()!
  *
  * ldap_connection_t structure represents connection to the LDAP database and
- * per-connection specific data. Access is controlled via
- * ldap_connection_t->lock and ldap_pool_t->conn_semaphore. Each read
- * or write access to ldap_connection_t structure (except create/destroy)
- * must acquire the semaphore and the lock.
+ * per-connection specific data. Idle connections are linked in
+ * ldap_pool_t->idle which is protected by ldap_pool_t->lock. A connection
+ * taken from the idle list by ldap_pool_getconnection() is owned exclusively
+ * by the caller until it is returned by ldap_pool_putconnection(), so
+ * no other lock is needed to access it (except create/destroy).
+ * Connection statistics are protected by ldap_pool_t->lock.
+ *
+ * LDAP modifications are queued in ldap_writeq_t. A writer which finds
+ * no active leader, or an idle connection in the pool, becomes a leader:
+ * it borrows one connection from the pool and sends queued modifications
+ * without waiting for individual results, until its own modification
+ * is done. Other writers wait on ldap_writeq_t->cond until their operation
+ * is completed or they can lead the next round. Operations for the same DN
+ * are never in flight at the same time.
  */
 
 typedef struct ldap_connection  ldap_connection_t;
 typedef struct ldap_pool	ldap_pool_t;
 typedef struct ldap_auth_pair	ldap_auth_pair_t;
 typedef struct settings		settings_t;
+typedef struct ldap_writeop	ldap_writeop_t;
+typedef struct ldap_writeq	ldap_writeq_t;
+typedef struct ldap_wbop	ldap_wbop_t;
+typedef struct serial_wbzone	serial_wbzone_t;
+typedef struct deps_zone	deps_zone_t;
+typedef struct snapshot_zone	snapshot_zone_t;
 
 /* Authentication method. */
 typedef enum ldap_auth {
@@ -129,6 +152,88 @@ struct ldap_auth_pair {
 	char *name;	/* String representation used in configuration file */
 };
 
+/* Maximal number of LDAP modifications in flight on one connection. */
+#define LDAP_WRITE_PIPELINE_MAX	64
+
+/* LDAP modification submitted by ldap_modify_do(). */
+struct ldap_writeop {
+	const char		*dn;
+	LDAPMod			**mods;
+	isc_boolean_t		delete_node;
+	const char		*operation_str;
+	int			msgid;		/* -1 = not in flight */
+	isc_boolean_t		send;		/* (re)send in this round */
+	isc_boolean_t		sent;		/* waiting for result */
+	isc_boolean_t		adding;		/* entry is being created */
+	isc_boolean_t		retried;
+	isc_boolean_t		offline;	/* LDAP server is unreachable */
+	isc_boolean_t		done;		/* guarded by ldap_writeq_t->lock */
+	isc_result_t		result;
+	ISC_LINK(ldap_writeop_t)	link;
+};
+
+struct ldap_writeq {
+	isc_mutex_t		lock;
+	isc_condition_t		cond;	/* broadcast when operations complete */
+	unsigned int		leaders; /* writers sending a round */
+	ISC_LIST(ldap_writeop_t)	queue;
+	ISC_LIST(ldap_writeop_t)	inflight; /* picked by some leader */
+};
+
+/* Modification which waits for LDAP server, see ldap_writebehind_add(). */
+struct ldap_wbop {
+	char			*dn;
+	LDAPMod			**mods;		/* private copy */
+	isc_boolean_t		delete_node;
+	isc_time_t		queued;
+	ISC_LINK(ldap_wbop_t)	link;
+};
+
+/* Zone which waits for SOA serial write-back, see ldap_serial_writeback(). */
+struct serial_wbzone {
+	dns_fixedname_t		name;
+	ISC_LINK(serial_wbzone_t)	link;
+};
+
+/* Zone with changed default TTL, see ldap_deps_refresh(). */
+struct deps_zone {
+	dns_fixedname_t		name;
+	ISC_LINK(deps_zone_t)	link;
+};
+typedef ISC_LIST(deps_zone_t)	deps_zone_list_t;
+
+/* Deleted zone with snapshot which could not be removed,
+ * see zone_snapshot_remove(). */
+struct snapshot_zone {
+	dns_fixedname_t		name;
+	ISC_LINK(snapshot_zone_t)	link;
+};
+
+/* Entries re-read by ldap_deps_refresh() which wait for being sent. */
+typedef ISC_LIST(ldap_entry_t)	deps_entry_list_t;
+
+/* Maximal number of entries re-read before they are sent to zones. */
+#define LDAP_DEPS_BATCH		128
+
+/**
+ * Changes of one owner name staged while a new version of ldapdb is open.
+ * See ldap_modbatch_stage() and ldap_modbatch_flush().
+ */
+struct ldap_modbatch {
+	isc_mem_t		*mctx;
+	dns_fixedname_t		owner;
+	dns_fixedname_t		zone;
+	ld_string_t		*dn;		/* DN of the owner */
+	dns_diff_t		diff;		/* changes in original order */
+	isc_boolean_t		delete_node;	/* owner has no data left */
+};
+
+/* Consecutive staged changes with the same operation and RR type. */
+typedef struct ldap_modgroup {
+	dns_rdatalist_t		rdlist;
+	int			mod_op;
+} ldap_modgroup_t;
+
 /* These are typedefed in ldap_helper.h */
 struct ldap_instance {
 	isc_mem_t		*mctx;
@@ -149,6 +254,9 @@ struct ldap_instance {
 	/* krb5 kinit mutex */
 	isc_mutex_t		kinit_lock;
 
+	/* LDAP modifications waiting for pipelined execution */
+	ldap_writeq_t		writeq;
+
 	isc_task_t		*task;
 	isc_thread_t		watcher;
 	isc_boolean_t		exiting;
@@ -163,20 +271,89 @@ struct ldap_instance {
 
 	sync_ctx_t		*sctx;
 	mldapdb_t		*mldapdb;
+
+	/* Lexers and rdata buffers shared by all parsers. */
+	ldap_parsectx_pool_t	*parsectx_pool;
+
+	/* RR types with own attribute in LDAP schema. */
+	rrschema_t		*rrschema;
+
+	/* Entries with templates which use each substitution variable. */
+	rrtemplate_deps_t	*tmpl_deps;
+
+	/* Changes of default TTL and fake_mname which were not propagated
+	 * to records yet, see ldap_deps_refresh(). */
+	isc_mutex_t		deps_lock;
+	deps_zone_list_t	deps_zones;
+	isc_boolean_t		deps_mname;
+
+	/* Deleted zones with stale snapshots which must not be pre-loaded,
+	 * see zone_snapshot_remove(). Accessed only from inst->task. */
+	ISC_LIST(snapshot_zone_t)	snapshot_stale;
+
+	/* Periodic closing of idle connections, see ldap_pool_reap(). */
+	isc_timer_t		*pool_timer;
+
+	/* Delayed SOA serial write-back, see ldap_serial_writeback(). */
+	isc_timer_t		*serial_timer;
+	isc_mutex_t		serial_lock;
+	isc_boolean_t		serial_timer_armed;
+	ISC_LIST(serial_wbzone_t)	serial_queue;
+
+	/* Modifications made while LDAP server was unreachable,
+	 * see ldap_writebehind_add(). Modifications are sent with wb_send
+	 * locked for reading, the queue is replayed with wb_send locked
+	 * for writing, see ldap_modify_do(). */
+	isc_rwlock_t		wb_send;
+	isc_mutex_t		wb_lock;
+	isc_uint32_t		wb_limit;	/* 0 = write-behind disabled */
+	unsigned int		wb_count;
+	ISC_LIST(ldap_wbop_t)	wb_queue;
+	isc_timer_t		*wb_timer;
+	/* A queued modification was lost or dropped and zone data were not
+	 * re-read from LDAP, so zone snapshots do not match the SyncRepl
+	 * cookie. Protected by wb_lock. */
+	isc_boolean_t		wb_lost;
+
+	/* SyncRepl cookie from the last data synchronization which reached
+	 * refreshDone. It is used for delta refresh after reconnection
+	 * and after restart, see ldap_sync_state_save().
+	 * Accessed only from the watcher thread and from events it waits for. */
+	struct berval		sync_cookie;
+	/* Current data synchronization was started with a cookie. */
+	isc_boolean_t		sync_resumed;
+	/* Current refresh used present phase so entries which were not
+	 * reported are dead. */
+	isc_boolean_t		sync_presents;
+	/* An entry received in current data synchronization session
+	 * was not processed so the cookie must not be stored. */
+	isc_boolean_t		sync_skipped;
+	/* Cookie and metaLDAP were restored from state saved during
+	 * the last shutdown, see ldap_sync_state_load(). */
+	isc_boolean_t		sync_restored;
 };
 
 struct ldap_pool {
 	isc_mem_t		*mctx;
-	/* List of LDAP connections. */
-	unsigned int		connections; /* number of connections */
-	semaphore_t		conn_semaphore;
+	ldap_instance_t		*inst;
+	/* List of LDAP connections, NULL for slots which are not open. */
+	unsigned int		connections; /* maximal number of connections */
+	unsigned int		min;	/* number of connections kept open */
+	unsigned int		open;	/* number of open connections */
+	unsigned int		opening; /* connections being opened */
+	isc_uint32_t		idle_timeout; /* seconds, 0 = never close */
 	ldap_connection_t	**conns;
 
+	/* Idle connections, least recently used first. */
+	isc_mutex_t		lock;
+	isc_condition_t		cond;
+	ISC_LIST(ldap_connection_t) idle;
+	unsigned int		waiting; /* threads waiting for connection */
 };
 
 struct ldap_connection {
 	isc_mem_t		*mctx;
-	isc_mutex_t		lock;
+	ISC_LINK(ldap_connection_t) link;
 
 	LDAP			*handle;
 	int			msgid;
@@ -184,8 +361,30 @@ struct ldap_connection {
 	/* For reconnection logic. */
 	isc_time_t		next_reconnect;
 	unsigned int		tries;
+
+	/* Owner-private counters, moved to statistics when the connection
+	 * is returned to the pool. */
+	isc_time_t		acquired;
+	isc_time_t		released;
+	unsigned int		new_errors;
+	unsigned int		new_reconnects;
+
+	/* Statistics, see ldap_pool_log(). */
+	unsigned int		uses;
+	isc_uint64_t		wait_time;	/* microseconds */
+	isc_uint64_t		wait_max;	/* microseconds */
+	isc_uint64_t		use_time;	/* microseconds */
+	isc_uint64_t		latency_avg;	/* microseconds */
+	unsigned int		errors;
+	unsigned int		reconnects;
 };
 
+/* How long ldap_pool_getconnection() waits for an idle connection
+ * before it opens a new one. */
+static const isc_interval_t pool_grow_wait = { 0, 50000000 }; /* 50 ms */
+/* Period of attempts to write queued modifications to LDAP. */
+static const isc_interval_t writebehind_interval = { 5, 0 };
+
 /* Supported authentication types. */
 const ldap_auth_pair_t supported_ldap_auth[] = {
 	{ AUTH_NONE,	"none"		},
@@ -200,6 +399,8 @@ extern const settings_set_t settings_default_set;
 static const setting_t settings_local_default[] = {
 	{ "uri",			no_default_string	},
 	{ "connections",		no_default_uint		},
+	{ "connections_min",		no_default_uint		},
+	{ "connection_idle_timeout",	no_default_uint		},
 	{ "reconnect_interval",		no_default_uint		},
 	{ "timeout",			no_default_uint		},
 	{ "base",			no_default_string	},
@@ -220,6 +421,13 @@ static const setting_t settings_local_default[] = {
 	{ "dyn_update",			no_default_boolean	},
 	{ "verbose_checks",		no_default_boolean	},
 	{ "directory",			no_default_string	},
+	{ "warm_start",			no_default_boolean	},
+	{ "record_batch_size",		no_default_uint		},
+	{ "sync_queue_limit",		no_default_uint		},
+	{ "sync_queue_high_watermark",	no_default_uint		},
+	{ "sync_queue_low_watermark",	no_default_uint		},
+	{ "serial_writeback_interval",	no_default_uint		},
+	{ "write_behind_limit",		no_default_uint		},
 	{ "nsec3param",			default_string("0 0 0 00")	}, /* NSEC only */
 	/* Defaults for forwarding here must be overridden by values from
 	 * from named.conf (i.e. copied to inst->local_settings)
@@ -240,7 +448,9 @@ dyndb_ldap_conf_clauses[] = {
 	{ "auth_method",        &cfg_type_qstring,	0	},
 	{ "base",               &cfg_type_qstring,	0	},
 	{ "bind_dn",            &cfg_type_qstring,	0	},
+	{ "connection_idle_timeout", &cfg_type_uint32,	0	},
 	{ "connections",        &cfg_type_uint32,	0	},
+	{ "connections_min",    &cfg_type_uint32,	0	},
 	{ "directory",          &cfg_type_qstring,	0	},
 	{ "dyn_update",         &cfg_type_boolean,	0	},
 	{ "fake_mname",         &cfg_type_qstring,	0	},
@@ -249,16 +459,23 @@ dyndb_ldap_conf_clauses[] = {
 	{ "ldap_hostname",      &cfg_type_qstring,	0	},
 	{ "password",           &cfg_type_sstring,	0	},
 	{ "reconnect_interval", &cfg_type_uint32,	0	},
+	{ "record_batch_size",  &cfg_type_uint32,	0	},
 	{ "sasl_auth_name",     &cfg_type_qstring,	0	},
 	{ "sasl_mech",          &cfg_type_qstring,	0	},
 	{ "sasl_password",      &cfg_type_qstring,	0	},
 	{ "sasl_realm",         &cfg_type_qstring,	0	},
 	{ "sasl_user",          &cfg_type_qstring,	0	},
+	{ "serial_writeback_interval", &cfg_type_uint32, 0	},
 	{ "server_id",          &cfg_type_qstring,	0	},
 	{ "sync_ptr",           &cfg_type_boolean,	0	},
+	{ "sync_queue_high_watermark", &cfg_type_uint32, 0	},
+	{ "sync_queue_limit",   &cfg_type_uint32,	0	},
+	{ "sync_queue_low_watermark", &cfg_type_uint32,	0	},
 	{ "timeout",            &cfg_type_uint32,	0	},
 	{ "uri",                &cfg_type_qstring,	0	},
 	{ "verbose_checks",     &cfg_type_boolean,	0	},
+	{ "warm_start",         &cfg_type_boolean,	0	},
+	{ "write_behind_limit", &cfg_type_uint32,	0	},
 	{ NULL,			NULL,			0	}
 };
 
@@ -310,13 +527,18 @@ static void destroy_ldap_connection(ldap_connection_t **ldap_connp) ATTR_NONNULL
 static isc_result_t findrdatatype_or_create(isc_mem_t *mctx,
 		ldapdb_rdatalist_t *rdatalist, dns_rdataclass_t rdclass,
 		dns_rdatatype_t rdtype, dns_ttl_t ttl, dns_rdatalist_t **rdlistp) ATTR_NONNULLS ATTR_CHECKRESULT;
-static isc_result_t add_soa_record(isc_mem_t *mctx, dns_name_t *origin,
-		ldap_entry_t *entry, dns_ttl_t ttl, ldapdb_rdatalist_t *rdatalist,
+static isc_result_t add_soa_record(isc_mem_t *mctx, ldap_parsectx_t *pctx,
+		dns_name_t *origin, ldap_entry_t *entry, dns_ttl_t ttl,
+		ldapdb_rdatalist_t *rdatalist,
 		const char *fake_mname) ATTR_NONNULLS ATTR_CHECKRESULT;
-static isc_result_t parse_rdata(isc_mem_t *mctx, ldap_entry_t *entry,
+static isc_result_t parse_rdata(isc_mem_t *mctx, ldap_parsectx_t *pctx,
 		dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
 		dns_name_t *origin, const char *rdata_text,
 		dns_rdata_t **rdatap) ATTR_NONNULLS ATTR_CHECKRESULT;
+static isc_result_t parse_rdata_len(isc_mem_t *mctx, ldap_parsectx_t *pctx,
+		dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
+		dns_name_t *origin, const char *rdata_text, size_t length,
+		dns_rdata_t **rdatap) ATTR_NONNULLS ATTR_CHECKRESULT;
 static isc_result_t
 ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 			    ldap_instance_t *const inst,
@@ -324,8 +546,9 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 			    ATTR_NONNULL(1,3,4) ATTR_CHECKRESULT;
 
 static isc_result_t
-ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
-		   const settings_set_t * const settings,
+ldap_parse_rrentry(isc_mem_t *mctx, ldap_parsectx_t *pctx, ldap_entry_t *entry,
+		   dns_name_t *origin, const settings_set_t * const settings,
+		   rrtemplate_deps_t *tmpl_deps,
 		   ldapdb_rdatalist_t *rdatalist) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 static isc_result_t ldap_connect(ldap_instance_t *ldap_inst,
@@ -351,9 +574,22 @@ static isc_result_t ldap_rdata_to_char_array(isc_mem_t *mctx,
 static void free_char_array(isc_mem_t *mctx, char ***valsp) ATTR_NONNULLS;
 static isc_result_t modify_ldap_common(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst,
 		dns_rdatalist_t *rdlist, int mod_op, isc_boolean_t delete_node) ATTR_NONNULLS ATTR_CHECKRESULT;
+static void ldap_serial_writeback_flush(ldap_instance_t *inst) ATTR_NONNULLS;
+static isc_result_t ldap_serial_writeback(ldap_instance_t *inst,
+		dns_name_t *zone, isc_uint32_t serial)
+		ATTR_NONNULLS ATTR_CHECKRESULT;
+static void ldap_serial_writeback_action(isc_task_t *task,
+		isc_event_t *event) ATTR_NONNULLS;
+static void ldap_writebehind_flush(ldap_instance_t *inst) ATTR_NONNULLS;
+static isc_result_t syncrepl_update(ldap_instance_t *inst,
+		ldap_entry_t **entryp, int chgtype)
+		ATTR_NONNULLS ATTR_CHECKRESULT;
+static void ldap_writebehind_action(isc_task_t *task,
+		isc_event_t *event) ATTR_NONNULLS;
 
 /* Functions for maintaining pool of LDAP connections */
 static isc_result_t ldap_pool_create(isc_mem_t *mctx, unsigned int connections,
+		unsigned int min, isc_uint32_t idle_timeout,
 		ldap_pool_t **poolp) ATTR_NONNULLS ATTR_CHECKRESULT;
 static void ldap_pool_destroy(ldap_pool_t **poolp);
 static isc_result_t ldap_pool_getconnection(ldap_pool_t *pool,
@@ -362,21 +598,40 @@ static void ldap_pool_putconnection(ldap_pool_t *pool,
 		ldap_connection_t ** conn) ATTR_NONNULLS;
 static isc_result_t ldap_pool_connect(ldap_pool_t *pool,
 		ldap_instance_t *ldap_inst) ATTR_NONNULLS ATTR_CHECKRESULT;
+static void ldap_pool_log(ldap_pool_t *pool) ATTR_NONNULLS;
+static isc_boolean_t ldap_pool_hasidle(ldap_pool_t *pool)
+		ATTR_NONNULLS ATTR_CHECKRESULT;
+static void ldap_pool_reap_action(isc_task_t *task,
+		isc_event_t *event) ATTR_NONNULLS;
 
 /* Persistent updates watcher */
 static isc_threadresult_t
 ldap_syncrepl_watcher(isc_threadarg_t arg) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-zone_master_reconfigure_nsec3param(settings_set_t *zone_settings,
+zone_master_reconfigure_nsec3param(ldap_instance_t *inst,
+				   settings_set_t *zone_settings,
 				   dns_zone_t *secure);
 
+static isc_result_t ATTR_NONNULLS
+zone_snapshots_save(ldap_instance_t *inst);
+
+static void ATTR_NONNULLS
+ldap_sync_state_save(ldap_instance_t *inst);
+
+static void ATTR_NONNULLS
+ldap_sync_state_load(ldap_instance_t *inst);
+
+static void ATTR_NONNULLS
+ldap_sync_cookie_drop(ldap_instance_t *inst);
+
 #define PRINT_BUFF_SIZE 10 /* for unsigned int 2^32 */
 isc_result_t
 validate_local_instance_settings(ldap_instance_t *inst, settings_set_t *set) {
 	isc_result_t result;
 
 	isc_uint32_t uint;
+	isc_uint32_t uint2;
 	const char *sasl_mech = NULL;
 	const char *sasl_user = NULL;
 	const char *sasl_realm = NULL;
@@ -419,7 +674,7 @@ validate_local_instance_settings(ldap_instance_t *inst, settings_set_t *set) {
 	/* Make sure that working directory exists */
 	CHECK(fs_dirs_create(dir_name));
 
-	/* Set timer for deadlock detection inside semaphore_wait_timed . */
+	/* Set timer for deadlock detection inside ldap_pool_getconnection(). */
 	CHECK(setting_get_uint("timeout", set, &uint));
 	if (conn_wait_timeout.seconds < uint*SEM_WAIT_TIMEOUT_MUL)
 		conn_wait_timeout.seconds = uint*SEM_WAIT_TIMEOUT_MUL;
@@ -430,6 +685,34 @@ validate_local_instance_settings(ldap_instance_t *inst, settings_set_t *set) {
 		/* watcher needs one and update_*() requests second connection */
 		CLEANUP_WITH(ISC_R_RANGE);
 	}
+	CHECK(setting_get_uint("connections_min", set, &uint2));
+	if (uint2 < 2) {
+		log_error("at least two connections have to be kept open");
+		CLEANUP_WITH(ISC_R_RANGE);
+	} else if (uint2 > uint) {
+		log_error("connections_min (%u) must not be greater "
+			  "than connections (%u)", uint2, uint);
+		CLEANUP_WITH(ISC_R_RANGE);
+	}
+
+	CHECK(setting_get_uint("record_batch_size", set, &uint));
+	if (uint < 1) {
+		log_error("record_batch_size has to be at least 1");
+		CLEANUP_WITH(ISC_R_RANGE);
+	}
+
+	CHECK(setting_get_uint("sync_queue_limit", set, &uint));
+	if (uint < 1) {
+		log_error("sync_queue_limit has to be at least 1");
+		CLEANUP_WITH(ISC_R_RANGE);
+	}
+	CHECK(setting_get_uint("sync_queue_high_watermark", set, &uint));
+	CHECK(setting_get_uint("sync_queue_low_watermark", set, &uint2));
+	if (uint2 > uint) {
+		log_error("sync_queue_low_watermark cannot be higher than "
+			  "sync_queue_high_watermark");
+		CLEANUP_WITH(ISC_R_RANGE);
+	}
 
 	/* Select authentication method. */
 	CHECK(setting_get_str("auth_method", set, &auth_method_str));
@@ -537,6 +820,12 @@ new_ldap_instance(isc_mem_t *mctx, const char *db_name, const char *parameters,
 	isc_buffer_t *forwarders_list = NULL;
 	const char *forward_policy = NULL;
 	isc_uint32_t connections;
+	isc_uint32_t connections_min;
+	isc_uint32_t idle_timeout;
+	isc_interval_t reap_interval;
+	isc_uint32_t queue_limit;
+	isc_uint32_t queue_high;
+	isc_uint32_t queue_low;
 	char settings_name[PRINT_BUFF_SIZE];
 	ldap_globalfwd_handleez_t *gfwdevent = NULL;
 	const char *server_id = NULL;
@@ -650,21 +939,72 @@ new_ldap_instance(isc_mem_t *mctx, const char *db_name, const char *parameters,
 	};
 
 	CHECK(setting_get_uint("connections", ldap_inst->local_settings, &connections));
+	CHECK(setting_get_uint("connections_min", ldap_inst->local_settings,
+			       &connections_min));
+	CHECK(setting_get_uint("connection_idle_timeout",
+			       ldap_inst->local_settings, &idle_timeout));
+
+	CHECK(setting_get_uint("sync_queue_limit", ldap_inst->local_settings,
+			       &queue_limit));
+	CHECK(setting_get_uint("sync_queue_high_watermark",
+			       ldap_inst->local_settings, &queue_high));
+	CHECK(setting_get_uint("sync_queue_low_watermark",
+			       ldap_inst->local_settings, &queue_low));
+	sync_concurr_limit_set(ldap_inst->sctx, queue_limit,
+			       (size_t)queue_high * 1024 * 1024,
+			       (size_t)queue_low * 1024 * 1024);
 
 	CHECK(zr_create(mctx, ldap_inst, ldap_inst->server_ldap_settings,
 			&ldap_inst->zone_register));
 	CHECK(fwdr_create(ldap_inst->mctx, &ldap_inst->fwd_register));
 	CHECK(mldap_new(mctx, &ldap_inst->mldapdb));
+	CHECK(rrschema_create(mctx, &ldap_inst->rrschema));
+	CHECK(rrtemplate_deps_create(mctx, &ldap_inst->tmpl_deps));
+	CHECK(isc_mutex_init(&ldap_inst->deps_lock));
+	INIT_LIST(ldap_inst->deps_zones);
+	INIT_LIST(ldap_inst->snapshot_stale);
+	CHECK(ldap_parsectx_pool_create(mctx, &ldap_inst->parsectx_pool));
 
 	CHECK(isc_mutex_init(&ldap_inst->kinit_lock));
-
-	CHECK(ldap_pool_create(mctx, connections, &ldap_inst->pool));
+	CHECK(isc_mutex_init(&ldap_inst->writeq.lock));
+	CHECK(isc_condition_init(&ldap_inst->writeq.cond));
+	INIT_LIST(ldap_inst->writeq.queue);
+	INIT_LIST(ldap_inst->writeq.inflight);
+	CHECK(isc_mutex_init(&ldap_inst->serial_lock));
+	INIT_LIST(ldap_inst->serial_queue);
+	CHECK(isc_timer_create(dctx->timermgr, isc_timertype_inactive,
+			       NULL, NULL, ldap_inst->task,
+			       ldap_serial_writeback_action, ldap_inst,
+			       &ldap_inst->serial_timer));
+	CHECK(isc_rwlock_init(&ldap_inst->wb_send, 0, 0));
+	CHECK(isc_mutex_init(&ldap_inst->wb_lock));
+	INIT_LIST(ldap_inst->wb_queue);
+	CHECK(setting_get_uint("write_behind_limit", ldap_inst->local_settings,
+			       &ldap_inst->wb_limit));
+	if (ldap_inst->wb_limit > 0)
+		CHECK(isc_timer_create(dctx->timermgr, isc_timertype_ticker,
+				       NULL, &writebehind_interval,
+				       ldap_inst->task,
+				       ldap_writebehind_action, ldap_inst,
+				       &ldap_inst->wb_timer));
+
+	CHECK(ldap_pool_create(mctx, connections, connections_min,
+			       idle_timeout, &ldap_inst->pool));
 	CHECK(ldap_pool_connect(ldap_inst->pool, ldap_inst));
+	if (connections_min < connections && idle_timeout > 0) {
+		isc_interval_set(&reap_interval, idle_timeout, 0);
+		CHECK(isc_timer_create(dctx->timermgr, isc_timertype_ticker,
+				       NULL, &reap_interval, ldap_inst->task,
+				       ldap_pool_reap_action, ldap_inst,
+				       &ldap_inst->pool_timer));
+	}
 
 	/* Register new DNS DB implementation. */
 	CHECK(dns_db_register(ldap_inst->db_name, &ldapdb_associate, ldap_inst,
 			      mctx, &ldap_inst->db_imp));
 
+	ldap_sync_state_load(ldap_inst);
+
 	/* Start the watcher thread */
 	result = isc_thread_create(ldap_syncrepl_watcher, ldap_inst,
 				   &ldap_inst->watcher);
@@ -722,6 +1062,8 @@ void
 destroy_ldap_instance(ldap_instance_t **ldap_instp)
 {
 	ldap_instance_t *ldap_inst;
+	deps_zone_t *depszone;
+	snapshot_zone_t *snapzone;
 
 	REQUIRE(ldap_instp != NULL);
 
@@ -734,12 +1076,50 @@ destroy_ldap_instance(ldap_instance_t **ldap_instp)
 		ldap_inst->watcher = 0;
 	}
 
+	if (ldap_inst->pool_timer != NULL)
+		isc_timer_detach(&ldap_inst->pool_timer);
+
+	/* Write serials which wait for the timer. */
+	if (ldap_inst->serial_timer != NULL) {
+		isc_timer_detach(&ldap_inst->serial_timer);
+		ldap_serial_writeback_flush(ldap_inst);
+	}
+
+	/* Last attempt to write modifications made while LDAP was down. */
+	if (ldap_inst->wb_timer != NULL)
+		isc_timer_detach(&ldap_inst->wb_timer);
+	if (ldap_inst->wb_limit > 0)
+		ldap_writebehind_flush(ldap_inst);
+
+	/* Zone data contain changes which are not in LDAP: without cookie
+	 * the next start does full data synchronization which replaces
+	 * data from snapshots with data from LDAP. */
+	if (ldap_inst->wb_lost == ISC_TRUE) {
+		log_info("write-behind: some modifications were not written "
+			 "to LDAP: next start of instance '%s' will do full "
+			 "data synchronization", ldap_inst->db_name);
+		ldap_sync_cookie_drop(ldap_inst);
+	}
+	/* Cookie is usable only together with snapshots of all zones. */
+	if (zone_snapshots_save(ldap_inst) == ISC_R_SUCCESS)
+		ldap_sync_state_save(ldap_inst);
 	/* Unregister all zones already registered in BIND. */
 	zr_destroy(&ldap_inst->zone_register);
 	fwdr_destroy(&ldap_inst->fwd_register);
 	mldap_destroy(&ldap_inst->mldapdb);
+	ldap_parsectx_pool_destroy(&ldap_inst->parsectx_pool);
 
 	ldap_pool_destroy(&ldap_inst->pool);
+	rrschema_destroy(&ldap_inst->rrschema);
+	rrtemplate_deps_destroy(&ldap_inst->tmpl_deps);
+	while ((depszone = HEAD(ldap_inst->deps_zones)) != NULL) {
+		UNLINK(ldap_inst->deps_zones, depszone, link);
+		SAFE_MEM_PUT_PTR(ldap_inst->mctx, depszone);
+	}
+	while ((snapzone = HEAD(ldap_inst->snapshot_stale)) != NULL) {
+		UNLINK(ldap_inst->snapshot_stale, snapzone, link);
+		SAFE_MEM_PUT_PTR(ldap_inst->mctx, snapzone);
+	}
 	if (ldap_inst->db_imp != NULL)
 		dns_db_unregister(&ldap_inst->db_imp);
 	if (ldap_inst->view != NULL)
@@ -750,12 +1130,20 @@ destroy_ldap_instance(ldap_instance_t **ldap_instp)
 		isc_task_detach(&ldap_inst->task);
 
 	DESTROYLOCK(&ldap_inst->kinit_lock);
+	DESTROYLOCK(&ldap_inst->writeq.lock);
+	RUNTIME_CHECK(isc_condition_destroy(&ldap_inst->writeq.cond)
+		      == ISC_R_SUCCESS);
+	DESTROYLOCK(&ldap_inst->serial_lock);
+	DESTROYLOCK(&ldap_inst->wb_lock);
+	isc_rwlock_destroy(&ldap_inst->wb_send);
+	DESTROYLOCK(&ldap_inst->deps_lock);
 
 	settings_set_free(&ldap_inst->global_settings);
 	settings_set_free(&ldap_inst->local_settings);
 	settings_set_free(&ldap_inst->server_ldap_settings);
 
 	sync_ctx_free(&ldap_inst->sctx);
+	ber_memfree(ldap_inst->sync_cookie.bv_val);
 	/* zero out error counter (and do nothing other than that) */
 	ldap_instance_untaint_finish(ldap_inst,
 				     ldap_instance_untaint_start(ldap_inst));
@@ -781,12 +1169,7 @@ new_ldap_connection(ldap_pool_t *pool, ldap_connection_t **ldap_connp)
 
 	CHECKED_MEM_GET_PTR(pool->mctx, ldap_conn);
 	ZERO_PTR(ldap_conn);
-
-	result = isc_mutex_init(&ldap_conn->lock);
-	if (result != ISC_R_SUCCESS) {
-		SAFE_MEM_PUT_PTR(pool->mctx, ldap_conn);
-		return result;
-	}
+	ISC_LINK_INIT(ldap_conn, link);
 
 	isc_mem_attach(pool->mctx, &ldap_conn->mctx);
 
@@ -811,7 +1194,6 @@ destroy_ldap_connection(ldap_connection_t **ldap_connp)
 	if (ldap_conn == NULL)
 		return;
 
-	DESTROYLOCK(&ldap_conn->lock);
 	if (ldap_conn->handle != NULL)
 		ldap_unbind_ext_s(ldap_conn->handle, NULL, NULL);
 
@@ -958,6 +1340,458 @@ cleanup:
 	return result;
 }
 
+static isc_boolean_t ATTR_NONNULLS
+zone_isloaded(dns_zone_t *zone) {
+	dns_db_t *db = NULL;
+
+	if (dns_zone_getdb(zone, &db) != ISC_R_SUCCESS)
+		return ISC_FALSE;
+	dns_db_detach(&db);
+	return ISC_TRUE;
+}
+
+/**
+ * Find out if changes in a zone have to be written to its journal and have
+ * to increment SOA serial, i.e. if the zone is served already. Zones
+ * pre-loaded from snapshot are served before the initial synchronization
+ * with LDAP is finished.
+ */
+static isc_boolean_t ATTR_NONNULLS
+zone_isserved(dns_zone_t *raw, sync_state_t sync_state) {
+	return ISC_TF(sync_state == sync_finished || zone_isloaded(raw));
+}
+
+/**
+ * Find out if snapshot of a zone could not be removed when the zone
+ * was deleted.
+ */
+static isc_boolean_t ATTR_NONNULLS
+zone_snapshot_isstale(ldap_instance_t *inst, dns_name_t *name) {
+	snapshot_zone_t *snapzone;
+
+	for (snapzone = HEAD(inst->snapshot_stale);
+	     snapzone != NULL;
+	     snapzone = NEXT(snapzone, link)) {
+		if (dns_name_equal(dns_fixedname_name(&snapzone->name), name))
+			return ISC_TRUE;
+	}
+	return ISC_FALSE;
+}
+
+/**
+ * Remove snapshot of a zone which was deleted from LDAP so it cannot be
+ * pre-loaded if the zone is created again, see zone_snapshot_load().
+ * Zone with snapshot which cannot be removed is remembered
+ * and zone_snapshot_load() refuses the snapshot.
+ */
+static void ATTR_NONNULLS
+zone_snapshot_remove(ldap_instance_t *inst, dns_name_t *name) {
+	isc_result_t result;
+	isc_result_t remove_result;
+	ld_string_t *file_name = NULL;
+	snapshot_zone_t *snapzone = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	CHECK(zr_get_zone_path(inst->mctx, ldap_instance_getsettings_local(inst),
+			       name, "raw.snapshot", &file_name));
+	result = fs_file_remove(str_buf(file_name));
+	if (result == ISC_R_SUCCESS ||
+	    zone_snapshot_isstale(inst, name) == ISC_TRUE)
+		goto cleanup;
+	remove_result = result;
+
+	CHECKED_MEM_GET_PTR(inst->mctx, snapzone);
+	ZERO_PTR(snapzone);
+	dns_fixedname_init(&snapzone->name);
+	CHECK(dns_name_copy(name, dns_fixedname_name(&snapzone->name),
+			    NULL));
+	INIT_LINK(snapzone, link);
+	APPEND(inst->snapshot_stale, snapzone, link);
+	snapzone = NULL;
+	result = remove_result;
+
+cleanup:
+	if (result != ISC_R_SUCCESS) {
+		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+		log_error_r("zone '%s': unable to remove snapshot of deleted "
+			    "zone", zone_name);
+	}
+	SAFE_MEM_PUT_PTR(inst->mctx, snapzone);
+	str_destroy(&file_name);
+}
+
+/**
+ * Pre-load database of a new zone from snapshot saved during last shutdown
+ * if warm_start is enabled. Loaded data are provisional until the initial
+ * synchronization with LDAP is done, see zone_snapshot_sweep().
+ *
+ * Failure is not fatal, all data will be fetched from LDAP anyway
+ * because restored cookie is dropped.
+ */
+static void ATTR_NONNULLS
+zone_snapshot_load(ldap_instance_t *inst, dns_zone_t *raw) {
+	isc_result_t result;
+	ld_string_t *file_name = NULL;
+	dns_db_t *ldapdb = NULL;
+	isc_boolean_t warm_start;
+
+	CHECK(setting_get_bool("warm_start", inst->local_settings,
+			       &warm_start));
+	if (warm_start == ISC_FALSE)
+		goto cleanup;
+
+	CHECK(zr_get_zone_path(inst->mctx, ldap_instance_getsettings_local(inst),
+			       dns_zone_getorigin(raw), "raw.snapshot",
+			       &file_name));
+	/* zone was deleted and created again */
+	if (zone_snapshot_isstale(inst, dns_zone_getorigin(raw)) == ISC_TRUE) {
+		dns_zone_log(raw, ISC_LOG_WARNING, "snapshot '%s' of deleted "
+			     "zone was not removed, ignoring it",
+			     str_buf(file_name));
+		CLEANUP_WITH(ISC_R_IGNORE);
+	}
+	CHECK(zr_get_zone_dbs(inst->zone_register, dns_zone_getorigin(raw),
+			      &ldapdb, NULL));
+	CHECK(ldapdb_snapshot_load(ldapdb, str_buf(file_name)));
+	dns_zone_log(raw, ISC_LOG_INFO, "pre-loaded provisional data "
+		     "from snapshot '%s'", str_buf(file_name));
+
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_FILENOTFOUND) {
+		if (result != ISC_R_IGNORE)
+			dns_zone_log(raw, ISC_LOG_ERROR, "unable to load "
+				     "snapshot '%s': %s", (file_name != NULL) ?
+				     str_buf(file_name) : "<NULL>",
+				     isc_result_totext(result));
+		/* Unchanged records would not be sent again by LDAP server
+		 * if synchronization was resumed from restored cookie. */
+		ldap_sync_cookie_drop(inst);
+		inst->sync_skipped = ISC_TRUE;
+	}
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	str_destroy(&file_name);
+}
+
+/**
+ * Remove all provisional data pre-loaded by zone_snapshot_load()
+ * which were not confirmed by the initial synchronization with LDAP.
+ * Zone which was served from the snapshot gets new SOA serial.
+ *
+ * Synchronization resumed from a cookie does not report unchanged entries
+ * so all pre-loaded data are kept: deleted entries were removed
+ * explicitly or by dead node detection.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_snapshot_sweep(ldap_instance_t *inst, dns_name_t *name) {
+	isc_result_t result;
+	dns_db_t *ldapdb = NULL;
+	dns_zone_t *raw = NULL;
+	isc_boolean_t served;
+	unsigned int removed = 0;
+	isc_uint32_t serial = 0;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	CHECK(zr_get_zone_dbs(inst->zone_register, name, &ldapdb, NULL));
+	if (inst->sync_resumed == ISC_TRUE) {
+		ldapdb_provisional_accept(ldapdb);
+		goto cleanup;
+	}
+	CHECK(zr_get_zone_ptr(inst->zone_register, name, &raw, NULL));
+	served = zone_isloaded(raw);
+	CHECK(ldapdb_provisional_sweep(ldapdb, served ? raw : NULL,
+				       &removed, &serial));
+	if (removed > 0) {
+		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+		log_info("zone '%s': %u names from snapshot are not present "
+			 "in LDAP anymore, removed", zone_name, removed);
+		if (served == ISC_TRUE &&
+		    ldap_serial_writeback(inst, name, serial) != ISC_R_SUCCESS)
+			dns_zone_log(raw, ISC_LOG_ERROR,
+				     "serial (%u) write back to LDAP failed",
+				     serial);
+	}
+
+cleanup:
+	if (result != ISC_R_SUCCESS) {
+		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+		log_error_r("zone '%s': unable to remove stale data "
+			    "loaded from snapshot", zone_name);
+	}
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	return result;
+}
+
+/**
+ * Switch database of a new zone to load mode so records received during
+ * the initial synchronization can be added without versions and diffs.
+ * Zones pre-loaded from snapshot stay in normal mode.
+ *
+ * Failure is not fatal, records will be added using diffs.
+ */
+static void ATTR_NONNULLS
+zone_bulkload_begin(ldap_instance_t *inst, dns_zone_t *raw) {
+	isc_result_t result;
+	dns_db_t *ldapdb = NULL;
+
+	CHECK(zr_get_zone_dbs(inst->zone_register, dns_zone_getorigin(raw),
+			      &ldapdb, NULL));
+	CHECK(ldapdb_bulkload_begin(ldapdb));
+
+cleanup:
+	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+		dns_zone_log(raw, ISC_LOG_DEBUG(1), "unable to start bulk "
+			     "load: %s", isc_result_totext(result));
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+}
+
+/**
+ * Commit all records added in load mode since zone_bulkload_begin().
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+zone_bulkload_end(ldap_instance_t *inst, dns_name_t *name) {
+	isc_result_t result;
+	dns_db_t *ldapdb = NULL;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	CHECK(zr_get_zone_dbs(inst->zone_register, name, &ldapdb, NULL));
+	CHECK(ldapdb_bulkload_end(ldapdb));
+
+cleanup:
+	if (result != ISC_R_SUCCESS) {
+		dns_name_format(name, zone_name, DNS_NAME_FORMATSIZE);
+		log_error_r("zone '%s': unable to finish bulk load", zone_name);
+	}
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	return result;
+}
+
+/**
+ * Save content of all zones to snapshots if warm_start is enabled
+ * so the next start can use them, see zone_snapshot_load().
+ * Snapshots are not saved before the initial synchronization with LDAP
+ * is finished because incomplete data would replace the previous snapshot.
+ *
+ * @retval ISC_R_SUCCESS Snapshots of all zones were saved.
+ * @retval ISC_R_IGNORE  Snapshots are disabled or not saved yet.
+ * @retval others        Some snapshots were not saved.
+ */
+static isc_result_t ATTR_NONNULLS
+zone_snapshots_save(ldap_instance_t *inst) {
+	isc_result_t result;
+	isc_result_t failure = ISC_R_SUCCESS;
+	rbt_iterator_t *iter = NULL;
+	ld_string_t *file_name = NULL;
+	dns_db_t *ldapdb = NULL;
+	isc_boolean_t warm_start;
+	sync_state_t sync_state;
+	DECLARE_BUFFERED_NAME(name);
+
+	if (inst->zone_register == NULL || inst->sctx == NULL ||
+	    inst->local_settings == NULL)
+		return ISC_R_IGNORE;
+	result = setting_get_bool("warm_start", inst->local_settings,
+				  &warm_start);
+	if (result != ISC_R_SUCCESS || warm_start == ISC_FALSE)
+		return ISC_R_IGNORE;
+	sync_state_get(inst->sctx, &sync_state);
+	if (sync_state != sync_finished)
+		return ISC_R_IGNORE;
+
+	INIT_BUFFERED_NAME(name);
+	for (result = zr_rbt_iter_init(inst->zone_register, &iter, &name);
+	     result == ISC_R_SUCCESS;
+	     dns_name_reset(&name), result = rbt_iter_next(&iter, &name)) {
+		CHECK(zr_get_zone_path(inst->mctx,
+				       ldap_instance_getsettings_local(inst),
+				       &name, "raw.snapshot", &file_name));
+		CHECK(zr_get_zone_dbs(inst->zone_register, &name, &ldapdb,
+				      NULL));
+		result = ldapdb_snapshot_dump(ldapdb, str_buf(file_name));
+		if (result != ISC_R_SUCCESS) {
+			log_error_r("unable to save snapshot '%s'",
+				    str_buf(file_name));
+			failure = result;
+		}
+		dns_db_detach(&ldapdb);
+		str_destroy(&file_name);
+	}
+
+cleanup:
+	if (result == ISC_R_NOMORE || result == ISC_R_NOTFOUND)
+		result = failure;
+	else if (result != ISC_R_SUCCESS)
+		log_error_r("unable to save zone snapshots for instance '%s'",
+			    inst->db_name);
+	rbt_iter_stop(&iter);
+	if (ldapdb != NULL)
+		dns_db_detach(&ldapdb);
+	str_destroy(&file_name);
+	return result;
+}
+
+/** Format identifier at the beginning of file with SyncRepl state. */
+static const char sync_state_magic[] = "bind-dyndb-ldap sync state 1";
+
+/** Longest SyncRepl cookie which is saved, real cookies are much shorter.
+ *  It limits allocation when a damaged file is read. */
+#define SYNC_STATE_COOKIE_MAXLEN	65536
+
+/**
+ * Get path to file with SyncRepl state in the instance working directory.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_sync_state_path(ldap_instance_t *inst, const char *suffix,
+		     ld_string_t **pathp) {
+	isc_result_t result;
+	const char *dir_name = NULL;
+	ld_string_t *path = NULL;
+
+	CHECK(setting_get_str("directory", inst->local_settings, &dir_name));
+	CHECK(str_new(inst->mctx, &path));
+	CHECK(str_cat_char(path, dir_name));
+	CHECK(str_cat_char(path, "sync.state"));
+	CHECK(str_cat_char(path, suffix));
+
+	*pathp = path;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	str_destroy(&path);
+	return result;
+}
+
+/**
+ * Save SyncRepl cookie together with metaLDAP content it belongs to so
+ * the next start can resume data synchronization from the cookie,
+ * see ldap_sync_state_load().
+ *
+ * The state is consistent with zone snapshots only if all events received
+ * before the cookie were processed.
+ *
+ * @pre Snapshots of all zones were saved, watcher thread is not running.
+ */
+static void ATTR_NONNULLS
+ldap_sync_state_save(ldap_instance_t *inst) {
+	isc_result_t result;
+	ld_string_t *tmp_name = NULL;
+	ld_string_t *file_name = NULL;
+	FILE *fp = NULL;
+	isc_uint32_t len;
+
+	if (inst->sync_cookie.bv_val == NULL || inst->mldapdb == NULL)
+		return;
+	if (sync_queue_isempty(inst->sctx) == ISC_FALSE) {
+		log_info("some changes from LDAP were not processed before "
+			 "shutdown: next start of instance '%s' will do "
+			 "full data synchronization", inst->db_name);
+		return;
+	}
+	if (inst->sync_cookie.bv_len > SYNC_STATE_COOKIE_MAXLEN)
+		CLEANUP_WITH(ISC_R_RANGE);
+	len = inst->sync_cookie.bv_len;
+
+	CHECK(ldap_sync_state_path(inst, ".tmp", &tmp_name));
+	CHECK(ldap_sync_state_path(inst, "", &file_name));
+	CHECK(isc_stdio_open(str_buf(tmp_name), "w", &fp));
+	CHECK(isc_stdio_write(sync_state_magic, sizeof(sync_state_magic), 1,
+			      fp, NULL));
+	CHECK(isc_stdio_write(&len, sizeof(len), 1, fp, NULL));
+	CHECK(isc_stdio_write(inst->sync_cookie.bv_val, len, 1, fp, NULL));
+	CHECK(mldap_dump(inst->mldapdb, fp));
+	CHECK(isc_stdio_flush(fp));
+	CHECK(isc_stdio_sync(fp));
+	result = isc_stdio_close(fp);
+	fp = NULL;
+	CHECK(result);
+	CHECK(isc_file_rename(str_buf(tmp_name), str_buf(file_name)));
+	log_debug(1, "SyncRepl state for instance '%s' saved to '%s'",
+		  inst->db_name, str_buf(file_name));
+
+cleanup:
+	if (fp != NULL)
+		(void)isc_stdio_close(fp);
+	if (result != ISC_R_SUCCESS) {
+		log_error_r("unable to save SyncRepl state for instance '%s': "
+			    "next start will do full data synchronization",
+			    inst->db_name);
+		if (tmp_name != NULL)
+			(void)fs_file_remove(str_buf(tmp_name));
+	}
+	str_destroy(&tmp_name);
+	str_destroy(&file_name);
+}
+
+/**
+ * Restore SyncRepl cookie and metaLDAP saved by ldap_sync_state_save()
+ * if warm_start is enabled. Zones and records are not created from
+ * the state: zone entries are fetched again before the data synchronization
+ * is resumed and records are pre-loaded from zone snapshots.
+ *
+ * The file is removed after reading because it becomes stale as soon as
+ * new changes are received from LDAP.
+ *
+ * Failure is not fatal, data synchronization will start from scratch.
+ */
+static void ATTR_NONNULLS
+ldap_sync_state_load(ldap_instance_t *inst) {
+	isc_result_t result;
+	ld_string_t *file_name = NULL;
+	FILE *fp = NULL;
+	char magic[sizeof(sync_state_magic)];
+	isc_uint32_t len;
+	struct berval cookie = { 0, NULL };
+	isc_boolean_t warm_start;
+
+	CHECK(setting_get_bool("warm_start", inst->local_settings,
+			       &warm_start));
+	if (warm_start == ISC_FALSE)
+		goto cleanup;
+
+	CHECK(ldap_sync_state_path(inst, "", &file_name));
+	if (isc_file_exists(str_buf(file_name)) == ISC_FALSE)
+		goto cleanup;
+	CHECK(isc_stdio_open(str_buf(file_name), "r", &fp));
+	CHECK(isc_stdio_read(magic, sizeof(magic), 1, fp, NULL));
+	if (memcmp(magic, sync_state_magic, sizeof(magic)) != 0)
+		CLEANUP_WITH(ISC_R_BADDB);
+	CHECK(isc_stdio_read(&len, sizeof(len), 1, fp, NULL));
+	if (len == 0 || len > SYNC_STATE_COOKIE_MAXLEN)
+		CLEANUP_WITH(ISC_R_BADDB);
+	cookie.bv_val = ber_memalloc(len);
+	if (cookie.bv_val == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+	cookie.bv_len = len;
+	CHECK(isc_stdio_read(cookie.bv_val, len, 1, fp, NULL));
+	CHECK(mldap_restore(inst->mldapdb, fp));
+
+	inst->sync_cookie = cookie;
+	BER_BVZERO(&cookie);
+	inst->sync_restored = ISC_TRUE;
+	log_info("SyncRepl state for instance '%s' restored from '%s'",
+		 inst->db_name, str_buf(file_name));
+
+cleanup:
+	if (result == ISC_R_EOF)
+		result = ISC_R_UNEXPECTEDEND;
+	if (result != ISC_R_SUCCESS)
+		log_error_r("unable to restore SyncRepl state for instance "
+			    "'%s' from '%s': full data synchronization "
+			    "will be done", inst->db_name,
+			    (file_name != NULL) ? str_buf(file_name) : "<NULL>");
+	if (fp != NULL)
+		(void)isc_stdio_close(fp);
+	if (file_name != NULL)
+		(void)fs_file_remove(str_buf(file_name));
+	ber_memfree(cookie.bv_val);
+	str_destroy(&file_name);
+}
+
 /*
  * Create a new zone with origin 'name'. The zone will be added to the
  * ldap_inst->view.
@@ -1025,6 +1859,10 @@ create_zone(ldap_instance_t * const inst, const char * const dn,
 	}
 
 	CHECK(zr_add_zone(inst->zone_register, ldapdb, raw, secure, dn));
+	if (sync_state == sync_datainit && ldapdb == NULL) {
+		zone_snapshot_load(inst, raw);
+		zone_bulkload_begin(inst, raw);
+	}
 
 	*rawp = raw;
 	*securep = secure;
@@ -1193,7 +2031,7 @@ activate_zone(isc_task_t *task, ldap_instance_t *inst, dns_name_t *name) {
 	if (secure != NULL) {
 		CHECK(zr_get_zone_settings(inst->zone_register, name,
 					   &zone_settings));
-		CHECK(zone_master_reconfigure_nsec3param(zone_settings,
+		CHECK(zone_master_reconfigure_nsec3param(inst, zone_settings,
 							 secure));
 	}
 
@@ -1230,10 +2068,17 @@ activate_zones(isc_task_t *task, ldap_instance_t *inst) {
 		result = setting_get_bool("active", settings, &active);
 		INSIST(result == ISC_R_SUCCESS);
 
+		/* Records from initial synchronization have to be committed
+		 * and stale data from snapshot must not be served. */
+		result = zone_bulkload_end(inst, &name);
+		if (result == ISC_R_SUCCESS)
+			result = zone_snapshot_sweep(inst, &name);
+
 		++total_cnt;
 		if (active == ISC_TRUE) {
 			++active_cnt;
-			result = activate_zone(task, inst, &name);
+			if (result == ISC_R_SUCCESS)
+				result = activate_zone(task, inst, &name);
 			if (result == ISC_R_SUCCESS)
 				++published_cnt;
 			result = fwd_configure_zone(settings, inst, &name);
@@ -1503,14 +2348,23 @@ ldap_parse_serverconfigentry(ldap_entry_t *entry, ldap_instance_t *inst)
 						inst->server_ldap_settings,
 						"idnsSOAmName",
 						entry);
-	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+	if (result == ISC_R_SUCCESS) {
+		/* SOA records are rendered again by ldap_deps_refresh() */
+		LOCK(&inst->deps_lock);
+		inst->deps_mname = ISC_TRUE;
+		UNLOCK(&inst->deps_lock);
+	} else if (result != ISC_R_IGNORE)
 		goto cleanup;
 
 	result = setting_update_from_ldap_entry("substitutionvariable_ipalocation",
 						inst->server_ldap_settings,
 						"idnsSubstitutionVariable;ipalocation",
 						entry);
-	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
+	if (result == ISC_R_SUCCESS)
+		/* records are rendered again by ldap_deps_refresh() */
+		CHECK(rrtemplate_deps_invalidate(inst->tmpl_deps,
+					"substitutionvariable_ipalocation"));
+	else if (result != ISC_R_IGNORE)
 		goto cleanup;
 
 cleanup:
@@ -1727,8 +2581,167 @@ cleanup:
 #undef MAX_SERIAL_LENGTH
 }
 
+/**
+ * Replace SOA serial in LDAP and remember the serial so the change
+ * notification caused by the write can be recognized.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_serial_write(ldap_instance_t *inst, dns_name_t *zone,
+		  isc_uint32_t serial)
+{
+	isc_result_t result;
+
+	CHECK(zr_serial_setwritten(inst->zone_register, zone, serial));
+	CHECK(ldap_replace_serial(inst, zone, serial));
+
+cleanup:
+	return result;
+}
+
+/**
+ * Write SOA serials of all zones waiting for write-back to LDAP.
+ */
+static void ATTR_NONNULLS
+ldap_serial_writeback_flush(ldap_instance_t *inst)
+{
+	isc_result_t result;
+	serial_wbzone_t *wbzone;
+	ISC_LIST(serial_wbzone_t) queue;
+	isc_uint32_t serial;
+	char zone_name[DNS_NAME_FORMATSIZE];
+
+	INIT_LIST(queue);
+	LOCK(&inst->serial_lock);
+	ISC_LIST_APPENDLIST(queue, inst->serial_queue, link);
+	inst->serial_timer_armed = ISC_FALSE;
+	UNLOCK(&inst->serial_lock);
+
+	while ((wbzone = HEAD(queue)) != NULL) {
+		UNLINK(queue, wbzone, link);
+		/* Zone could have been deleted in the meantime. */
+		result = zr_serial_takepending(inst->zone_register,
+					       dns_fixedname_name(&wbzone->name),
+					       &serial);
+		if (result == ISC_R_SUCCESS) {
+			result = ldap_serial_write(inst,
+					dns_fixedname_name(&wbzone->name),
+					serial);
+			if (result != ISC_R_SUCCESS) {
+				dns_name_format(dns_fixedname_name(&wbzone->name),
+						zone_name, sizeof(zone_name));
+				log_error_r("zone '%s': serial (%u) write back "
+					    "to LDAP failed", zone_name, serial);
+			}
+		}
+		SAFE_MEM_PUT_PTR(inst->mctx, wbzone);
+	}
+}
+
+static void ATTR_NONNULLS
+ldap_serial_writeback_action(isc_task_t *task, isc_event_t *event)
+{
+	ldap_instance_t *inst = event->ev_arg;
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+	ldap_serial_writeback_flush(inst);
+}
+
+/**
+ * Write new SOA serial of the zone back to LDAP.
+ *
+ * The write is delayed by serial_writeback_interval seconds so a burst of
+ * changes in one zone results in a single write of the latest serial.
+ * Delayed writes are done in the instance task, so at most one serial write
+ * per zone is in progress. Zero interval writes the serial immediately.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_serial_writeback(ldap_instance_t *inst, dns_name_t *zone,
+		      isc_uint32_t serial)
+{
+	isc_result_t result;
+	isc_uint32_t interval_sec;
+	isc_interval_t interval;
+	isc_time_t expires;
+	isc_boolean_t queued = ISC_FALSE;
+	serial_wbzone_t *wbzone = NULL;
+
+	CHECK(setting_get_uint("serial_writeback_interval",
+			       inst->local_settings, &interval_sec));
+	if (interval_sec == 0)
+		return ldap_serial_write(inst, zone, serial);
+
+	CHECKED_MEM_GET_PTR(inst->mctx, wbzone);
+	dns_fixedname_init(&wbzone->name);
+	ISC_LINK_INIT(wbzone, link);
+	CHECK(dns_name_copy(zone, dns_fixedname_name(&wbzone->name), NULL));
+
+	CHECK(zr_serial_setpending(inst->zone_register, zone, serial,
+				   &queued));
+	if (queued == ISC_TRUE)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+
+	LOCK(&inst->serial_lock);
+	APPEND(inst->serial_queue, wbzone, link);
+	wbzone = NULL;
+	result = ISC_R_SUCCESS;
+	if (inst->serial_timer_armed == ISC_FALSE) {
+		isc_interval_set(&interval, interval_sec, 0);
+		result = isc_time_nowplusinterval(&expires, &interval);
+		if (result == ISC_R_SUCCESS)
+			result = isc_timer_reset(inst->serial_timer,
+						 isc_timertype_once, &expires,
+						 NULL, ISC_TRUE);
+		if (result == ISC_R_SUCCESS)
+			inst->serial_timer_armed = ISC_TRUE;
+	}
+	UNLOCK(&inst->serial_lock);
+
+	if (result != ISC_R_SUCCESS) {
+		log_error_r("unable to schedule serial write back to LDAP, "
+			    "writing immediately");
+		ldap_serial_writeback_flush(inst);
+		result = ISC_R_SUCCESS;
+	}
+
+cleanup:
+	if (wbzone != NULL)
+		SAFE_MEM_PUT_PTR(inst->mctx, wbzone);
+	return result;
+}
+
+/**
+ * Detect change notification for zone entry caused only by our own
+ * serial write-back, see zr_serial_isecho().
+ */
+static isc_boolean_t ATTR_NONNULLS
+zone_entry_isecho(ldap_instance_t *inst, ldap_entry_t *entry,
+		  const unsigned char digest[ISC_MD5_DIGESTLENGTH])
+{
+	ldap_valuelist_t values;
+	isc_uint32_t serial;
+	sync_state_t sync_state;
+
+	/* Initial synchronization has to confirm all data. */
+	sync_state_get(inst->sctx, &sync_state);
+	if (sync_state != sync_finished)
+		return ISC_FALSE;
+
+	if (ldap_entry_getvalues(entry, "idnsSOAserial", &values)
+	    != ISC_R_SUCCESS || HEAD(values) == NULL)
+		return ISC_FALSE;
+	if (isc_parse_uint32(&serial, HEAD(values)->value, 10)
+	    != ISC_R_SUCCESS)
+		return ISC_FALSE;
+
+	return zr_serial_isecho(inst->zone_register, &entry->fqdn, serial,
+				digest);
+}
+
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-zone_master_reconfigure_nsec3param(settings_set_t *zone_settings,
+zone_master_reconfigure_nsec3param(ldap_instance_t *inst,
+				   settings_set_t *zone_settings,
 				   dns_zone_t *secure) {
 	isc_mem_t *mctx = NULL;
 	isc_result_t result;
@@ -1736,18 +2749,18 @@ zone_master_reconfigure_nsec3param(settings_set_t *zone_settings,
 	dns_rdata_nsec3param_t nsec3p_rr;
 	dns_name_t *origin = NULL;
 	const char *nsec3p_str = NULL;
-	ldap_entry_t *fake_entry = NULL;
+	ldap_parsectx_t *pctx = NULL;
 
 	REQUIRE(secure != NULL);
 
 	mctx = dns_zone_getmctx(secure);
 	origin = dns_zone_getorigin(secure);
-	CHECK(ldap_entry_init(mctx, &fake_entry));
+	CHECK(ldap_parsectx_get(inst->parsectx_pool, &pctx));
 
 	CHECK(setting_get_str("nsec3param", zone_settings, &nsec3p_str));
 	dns_zone_log(secure, ISC_LOG_INFO,
 		     "reconfiguring NSEC3PARAM to '%s'", nsec3p_str);
-	CHECK(parse_rdata(mctx, fake_entry, dns_rdataclass_in,
+	CHECK(parse_rdata(mctx, pctx, dns_rdataclass_in,
 			  dns_rdatatype_nsec3param, origin, nsec3p_str,
 			  &nsec3p_rdata));
 	CHECK(dns_rdata_tostruct(nsec3p_rdata, &nsec3p_rr, NULL));
@@ -1761,8 +2774,40 @@ cleanup:
 		isc_mem_put(mctx, nsec3p_rdata->data, nsec3p_rdata->length);
 		SAFE_MEM_PUT_PTR(mctx, nsec3p_rdata);
 	}
-	if (fake_entry != NULL)
-		ldap_entry_destroy(&fake_entry);
+	ldap_parsectx_put(inst->parsectx_pool, &pctx);
+	return result;
+}
+
+/**
+ * Remember that default TTL of a zone changed so records without own TTL
+ * are updated by ldap_deps_refresh().
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_deps_ttl_changed(ldap_instance_t *inst, dns_name_t *zone_name) {
+	isc_result_t result;
+	deps_zone_t *depszone = NULL;
+
+	LOCK(&inst->deps_lock);
+	for (depszone = HEAD(inst->deps_zones);
+	     depszone != NULL;
+	     depszone = NEXT(depszone, link)) {
+		if (dns_name_equal(dns_fixedname_name(&depszone->name),
+				   zone_name))
+			CLEANUP_WITH(ISC_R_SUCCESS);
+	}
+
+	CHECKED_MEM_GET_PTR(inst->mctx, depszone);
+	ZERO_PTR(depszone);
+	dns_fixedname_init(&depszone->name);
+	CHECK(dns_name_copy(zone_name, dns_fixedname_name(&depszone->name),
+			    NULL));
+	INIT_LINK(depszone, link);
+	APPEND(inst->deps_zones, depszone, link);
+	depszone = NULL;
+
+cleanup:
+	UNLOCK(&inst->deps_lock);
+	SAFE_MEM_PUT_PTR(inst->mctx, depszone);
 	return result;
 }
 
@@ -1771,10 +2816,13 @@ cleanup:
  *
  * @param[in]  raw Raw zone backed by LDAP database. In-line secure zone
  *                 will be reconfigured as necessary.
+ * @param[in]  new_zone Zone was just created so it has no records yet.
  */
-static isc_result_t ATTR_NONNULL(1,2,3,5) ATTR_CHECKRESULT
-zone_master_reconfigure(ldap_entry_t *entry, settings_set_t *zone_settings,
-			dns_zone_t *raw, dns_zone_t *secure, isc_task_t *task) {
+static isc_result_t ATTR_NONNULL(1,2,3,4,6) ATTR_CHECKRESULT
+zone_master_reconfigure(ldap_instance_t *inst, ldap_entry_t *entry,
+			settings_set_t *zone_settings, dns_zone_t *raw,
+			dns_zone_t *secure, isc_task_t *task,
+			isc_boolean_t new_zone) {
 	isc_result_t result;
 	ldap_valuelist_t values;
 	isc_mem_t *mctx = NULL;
@@ -1806,9 +2854,11 @@ zone_master_reconfigure(ldap_entry_t *entry, settings_set_t *zone_settings,
 
 	result = setting_update_from_ldap_entry("default_ttl", zone_settings,
 					        "DNSdefaultTTL", entry);
-	if (result == ISC_R_SUCCESS)
-		log_bug("default TTL cannot be changed at run-time");
-	else if (result != ISC_R_IGNORE)
+	if (result == ISC_R_SUCCESS) {
+		if (new_zone == ISC_FALSE)
+			CHECK(ldap_deps_ttl_changed(inst,
+						    dns_zone_getorigin(raw)));
+	} else if (result != ISC_R_IGNORE)
 		goto cleanup;
 
 	result = setting_update_from_ldap_entry("update_policy", zone_settings,
@@ -1896,7 +2946,8 @@ zone_master_reconfigure(ldap_entry_t *entry, settings_set_t *zone_settings,
 							"nsec3paramRecord",
 							entry);
 		if (result == ISC_R_SUCCESS)
-			CHECK(zone_master_reconfigure_nsec3param(zone_settings,
+			CHECK(zone_master_reconfigure_nsec3param(inst,
+								 zone_settings,
 								 secure));
 		else if (result == ISC_R_IGNORE)
 			result = ISC_R_SUCCESS;
@@ -1947,14 +2998,19 @@ zone_sync_apex(const ldap_instance_t * const inst,
 	dns_dbnode_t *node = NULL;
 	dns_difftuple_t *soa_tuple = NULL;
 	isc_uint32_t curr_serial;
+	ldap_parsectx_t *pctx = NULL;
 
 	REQUIRE(ldap_writeback != NULL);
 
 	INIT_LIST(rdatalist);
 	*ldap_writeback = ISC_FALSE; /* GCC */
 
-	CHECK(ldap_parse_rrentry(inst->mctx, entry, &name,
-				 zone_settings, &rdatalist));
+	CHECK(ldap_parsectx_get(inst->parsectx_pool, &pctx));
+	result = ldap_parse_rrentry(inst->mctx, pctx, entry, &name,
+				    zone_settings, inst->tmpl_deps, &rdatalist);
+	ldap_parsectx_put(inst->parsectx_pool, &pctx);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
 
 	CHECK(dns_db_getoriginnode(rbtdb, &node));
 	result = dns_db_allrdatasets(rbtdb, node, version, 0,
@@ -2084,6 +3140,7 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 	isc_boolean_t ldap_writeback;
 	isc_boolean_t data_changed = ISC_FALSE; /* GCC */
 	isc_uint32_t new_serial;
+	unsigned char digest[ISC_MD5_DIGESTLENGTH];
 
 	dns_db_t *rbtdb = NULL;
 	dns_db_t *ldapdb = NULL;
@@ -2097,6 +3154,13 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 
 	dns_diff_init(inst->mctx, &diff);
 
+	ldap_entry_digest(entry, "idnsSOAserial", digest);
+	if (olddb == NULL && zone_entry_isecho(inst, entry, digest)) {
+		log_debug(5, "%s: only SOA serial written by us changed, "
+			  "skipping", ldap_entry_logname(entry));
+		return ISC_R_SUCCESS;
+	}
+
 	run_exclusive_enter(inst, &lock_state);
 
 	result = ldap_entry_getvalues(entry, "idnsSecInlineSigning", &values);
@@ -2132,7 +3196,8 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 
 	CHECK(zr_get_zone_settings(inst->zone_register, &entry->fqdn,
 				   &zone_settings));
-	CHECK(zone_master_reconfigure(entry, zone_settings, raw, secure, task));
+	CHECK(zone_master_reconfigure(inst, entry, zone_settings, raw, secure,
+				      task, new_zone));
 	result = fwd_parse_ldap(entry, zone_settings);
 	if (result != ISC_R_SUCCESS && result != ISC_R_IGNORE)
 		goto cleanup;
@@ -2144,6 +3209,7 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 			     ldapdb, rbtdb, version, zone_settings,
 			     &diff, &new_serial, &ldap_writeback,
 			     &data_changed));
+	CHECK(ldapdb_provisional_confirm(ldapdb, &entry->fqdn));
 
 #if RBTDB_DEBUG >= 2
 	dns_diff_print(&diff, stdout);
@@ -2153,7 +3219,7 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 	if (ldap_writeback == ISC_TRUE) {
 		dns_zone_log(raw, ISC_LOG_DEBUG(5), "writing new zone serial "
 			     "%u to LDAP", new_serial);
-		result = ldap_replace_serial(inst, &entry->fqdn, new_serial);
+		result = ldap_serial_writeback(inst, &entry->fqdn, new_serial);
 		if (result != ISC_R_SUCCESS)
 			dns_zone_log(raw, ISC_LOG_ERROR,
 				     "serial (%u) write back to LDAP failed",
@@ -2161,7 +3227,7 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 	}
 
 	if (!EMPTY(diff.tuples)) {
-		if (sync_state == sync_finished && new_zone == ISC_FALSE) {
+		if (new_zone == ISC_FALSE && zone_isserved(raw, sync_state)) {
 			/* write the transaction to journal */
 			CHECK(zone_journal_adddiff(inst->mctx, raw, &diff));
 		}
@@ -2189,8 +3255,9 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 		goto cleanup;
 	CHECK(setting_get_bool("active", zone_settings, &isactive));
 
-	/* Do zone load only if the initial LDAP synchronization is done. */
-	if (sync_state != sync_finished)
+	/* Do zone load only if the initial LDAP synchronization is done
+	 * or if the zone was pre-loaded from snapshot. */
+	if (sync_state != sync_finished && !ldapdb_isprovisional(ldapdb))
 		goto cleanup;
 
 	toview = (want_secure == ISC_TRUE) ? secure : raw;
@@ -2208,6 +3275,7 @@ ldap_parse_master_zoneentry(ldap_entry_t * const entry, dns_db_t * const olddb,
 		dns_zone_log(toview, ISC_LOG_INFO, "zone deactivated "
 			     "and removed from view");
 	}
+	CHECK(zr_set_entry_digest(inst->zone_register, &entry->fqdn, digest));
 
 cleanup:
 	dns_diff_clear(&diff);
@@ -2333,100 +3401,6 @@ free_rdatalist(isc_mem_t *mctx, dns_rdatalist_t *rdlist)
 	}
 }
 
-/**
- * Replace occurrences of \{variable_name\} with respective strings from
- * settings tree. Remaining parts of the original string are just copied
- * into the output.
- *
- * Double-escaped strings \\{ \\} do not trigger substitution.
- * Nested references will expand only innermost variable: \{\{var1\}\}
- * Non-matching parentheses and other garbage will be copied verbatim
- * without trigerring an error.
- *
- * @retval  ISC_R_SUCCESS  Output string is valid. Caller must deallocate output.
- * @retval  ISC_R_IGNORE   Some variables used in the template are not defined
- *                         in settings tree. Substitution was terminated
- *                         prematurely and output is not available.
- * @retval  others         Unexpected errors.
- */
-static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_substitute_rr_template(isc_mem_t *mctx, const settings_set_t * set,
-			    ld_string_t *orig_val, ld_string_t **output) {
-	isc_result_t result;
-	regex_t regex;
-	regmatch_t matches[3];
-	size_t processed = 0;
-	char *tmp = NULL;
-	const char *setting_name;
-	setting_t *setting;
-	ld_string_t *replaced = NULL;
-
-	/* match \{variable_name\} in the text
-	 * \{ and \} must not be double-escaped like \\{ or \\} */
-	if (regcomp(&regex,
-		    "\\(^\\|[^\\]\\)" /* character preceding \{ = matches[1] */
-		    "\\\\{"
-		    "\\([a-zA-Z0-9_-]\\+\\)" /* variable name = matches[2] */
-		    "\\\\}",
-		    0) != 0)
-		CLEANUP_WITH(ISC_R_UNEXPECTED);
-
-	CHECK(str_new(mctx, &replaced));
-	CHECKED_MEM_STRDUP(mctx, str_buf(orig_val), tmp);
-
-	while (regexec(&regex, tmp + processed,
-		       sizeof(matches)/sizeof(regmatch_t),
-		       matches, 0) == 0)
-	{
-		/* derelativize offsets to make sure they
-		 * always start from tmp instead of tmp + processed */
-		for (size_t i = 0; i < sizeof(matches)/sizeof(regmatch_t); i++) {
-			matches[i].rm_so += processed;
-			matches[i].rm_eo += processed;
-		}
-		/* copy verbatim part of the string which precedes the \{ */
-		CHECK(str_cat_char_len(replaced,
-				       tmp + processed,
-				       matches[1].rm_eo - processed));
-
-		/* find value for given variable name in settings tree */
-		setting_name = tmp + matches[2].rm_so;
-		tmp[matches[2].rm_eo] = '\0';
-		setting = NULL;
-		result = setting_find(setting_name, set, isc_boolean_true,
-				      isc_boolean_true, &setting);
-		if (result != ISC_R_SUCCESS) {
-			log_debug(3, "setting '%s' is not defined so it "
-				  "cannot be substituted into template '%s'",
-				  setting_name, str_buf(orig_val));
-			CLEANUP_WITH(ISC_R_IGNORE);
-		}
-		if (setting->type != ST_STRING) {
-			log_bug("setting '%s' it not string so it cannot be "
-				"substituted", setting_name);
-			CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
-		}
-		CHECK(str_cat_char(replaced, setting->value.value_char));
-
-		/* end offset of previous match = matches[0].rm_eo */
-		processed = matches[0].rm_eo;
-	};
-
-	/* copy remaining part of the string */
-	CHECK(str_cat_char(replaced, tmp + processed));
-
-	*output = replaced;
-	replaced = NULL;
-	result = ISC_R_SUCCESS;
-
-cleanup:
-	if (tmp != NULL)
-		isc_mem_free(mctx, tmp);
-
-	str_destroy(&replaced);
-	return result;
-}
-
 /**
  * Substitute strings into idnsTemplateAttributes
  * and parse results into list of rdatas.
@@ -2434,6 +3408,10 @@ cleanup:
  * idnsTemplateAttribute must have exactly one sub-type like "TXTRecord"
  * (e.g. "idnsTemplateAttribute;TXTRecord"). The sub-type specifies target type.
  *
+ * Templates are compiled only once and kept in the parsing context.
+ * UUID of the entry is recorded in dependency index for all variables used
+ * by its templates, see ldap_deps_refresh().
+ *
  * @warning Substitution currently works only for *Record attributes
  *          and cannot be used for anything else.
  *
@@ -2444,15 +3422,17 @@ cleanup:
  *                         do not have defined values. Ignore output.
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_parse_rrentry_template(isc_mem_t *mctx, ldap_entry_t *entry,
-			    dns_name_t *origin,
+ldap_parse_rrentry_template(isc_mem_t *mctx, ldap_parsectx_t *pctx,
+			    ldap_entry_t *entry, dns_name_t *origin,
 			    const settings_set_t * const settings,
+			    rrtemplate_deps_t *tmpl_deps,
 			    ldapdb_rdatalist_t *rdatalist)
 {
 	isc_result_t result;
 	ldap_attribute_t *attr;
-	ld_string_t *orig_val = NULL;
+	const ldap_value_t *orig_val;
 	ld_string_t *new_val = NULL;
+	const rrtemplate_t *tmpl = NULL;
 	dns_rdata_t *rdata = NULL;
 	dns_rdataclass_t rdclass;
 	dns_ttl_t ttl;
@@ -2462,7 +3442,7 @@ ldap_parse_rrentry_template(isc_mem_t *mctx, ldap_entry_t *entry,
 	static const char prefix[] = "idnsTemplateAttribute;";
 	static const char prefix_len = sizeof(prefix) - 1;
 
-	CHECK(str_new(mctx, &orig_val));
+	CHECK(str_new(mctx, &new_val));
 	rdclass = ldap_entry_getrdclass(entry);
 	ttl = ldap_entry_getttl(entry, settings);
 
@@ -2481,17 +3461,23 @@ ldap_parse_rrentry_template(isc_mem_t *mctx, ldap_entry_t *entry,
 
 		CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass,
 					      rdtype, ttl, &rdlist));
-		for (result = ldap_attr_firstvalue(attr, orig_val);
+		for (result = ldap_attr_firstvalue(attr, &orig_val);
 		     result == ISC_R_SUCCESS;
-		     result = ldap_attr_nextvalue(attr, orig_val)) {
-			str_destroy(&new_val);
-			CHECK(ldap_substitute_rr_template(mctx, settings,
-							  orig_val, &new_val));
+		     result = ldap_attr_nextvalue(attr, &orig_val)) {
+			tmpl = NULL;
+			CHECK(rrtemplate_cache_get(pctx->tmpl_cache,
+						   orig_val->value, &tmpl));
+			/* dependency has to be known before the variables
+			 * are read, otherwise a change could be missed */
+			CHECK(rrtemplate_deps_add(tmpl_deps, tmpl,
+						  entry->uuid));
+			CHECK(rrtemplate_render(tmpl, settings, new_val));
 			log_debug(10, "%s: substituted '%s' '%s' -> '%s'",
 				  ldap_entry_logname(entry), attr->name,
-				  str_buf(orig_val), str_buf(new_val));
-			CHECK(parse_rdata(mctx, entry, rdclass, rdtype, origin,
-					  str_buf(new_val), &rdata));
+				  orig_val->value, str_buf(new_val));
+			CHECK(parse_rdata_len(mctx, pctx, rdclass, rdtype,
+					      origin, str_buf(new_val),
+					      str_len(new_val), &rdata));
 			APPEND(rdlist->rdata, rdata, link);
 			rdata = NULL;
 			did_something = ISC_TRUE;
@@ -2499,7 +3485,6 @@ ldap_parse_rrentry_template(isc_mem_t *mctx, ldap_entry_t *entry,
 	}
 
 cleanup:
-	str_destroy(&orig_val);
 	str_destroy(&new_val);
 	if (result == ISC_R_NOMORE || result == ISC_R_SUCCESS)
 		result = did_something ? ISC_R_SUCCESS : ISC_R_IGNORE;
@@ -2520,9 +3505,9 @@ cleanup:
  * @param rdatalist[in,out]
  */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
-		   const settings_set_t * const settings,
-		   ldapdb_rdatalist_t *rdatalist)
+ldap_parse_rrentry(isc_mem_t *mctx, ldap_parsectx_t *pctx, ldap_entry_t *entry,
+		   dns_name_t *origin, const settings_set_t * const settings,
+		   rrtemplate_deps_t *tmpl_deps, ldapdb_rdatalist_t *rdatalist)
 {
 	isc_result_t result;
 	dns_rdataclass_t rdclass;
@@ -2532,7 +3517,7 @@ ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
 	dns_rdatalist_t *rdlist = NULL;
 	ldap_attribute_t *attr;
 	const char *data_str = "<NULL data>";
-	ld_string_t *data_buf = NULL;
+	const ldap_value_t *value = NULL;
 	const char *fake_mname;
 
 	REQUIRE(EMPTY(*rdatalist));
@@ -2541,13 +3526,14 @@ ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
 	rdclass = ldap_entry_getrdclass(entry);
 	if ((entry->class & LDAP_ENTRYCLASS_MASTER) != 0) {
 		CHECK(setting_get_str("fake_mname", settings, &fake_mname));
-		CHECK(add_soa_record(mctx, origin, entry, ttl, rdatalist,
+		CHECK(add_soa_record(mctx, pctx, origin, entry, ttl, rdatalist,
 				     fake_mname));
 	}
 
 	if ((entry->class & LDAP_ENTRYCLASS_TEMPLATE) != 0) {
-		result = ldap_parse_rrentry_template(mctx, entry, origin,
-						     settings, rdatalist);
+		result = ldap_parse_rrentry_template(mctx, pctx, entry, origin,
+						     settings, tmpl_deps,
+						     rdatalist);
 		if (result == ISC_R_SUCCESS)
 			/* successful substitution overrides all constants */
 			return result;
@@ -2555,19 +3541,19 @@ ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
 			goto cleanup;
 	}
 
-	CHECK(str_new(mctx, &data_buf));
 	for (result = ldap_entry_firstrdtype(entry, &attr, &rdtype);
 	     result == ISC_R_SUCCESS;
 	     result = ldap_entry_nextrdtype(entry, &attr, &rdtype)) {
 
 		CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass,
 					      rdtype, ttl, &rdlist));
-		for (result = ldap_attr_firstvalue(attr, data_buf);
+		for (result = ldap_attr_firstvalue(attr, &value);
 		     result == ISC_R_SUCCESS;
-		     result = ldap_attr_nextvalue(attr, data_buf)) {
-			CHECK(parse_rdata(mctx, entry, rdclass,
-					  rdtype, origin,
-					  str_buf(data_buf), &rdata));
+		     result = ldap_attr_nextvalue(attr, &value)) {
+			/* values are parsed in place without any copy */
+			CHECK(parse_rdata_len(mctx, pctx, rdclass,
+					      rdtype, origin, value->value,
+					      value->length, &rdata));
 			APPEND(rdlist->rdata, rdata, link);
 			rdata = NULL;
 		}
@@ -2578,20 +3564,18 @@ ldap_parse_rrentry(isc_mem_t *mctx, ldap_entry_t *entry, dns_name_t *origin,
 	if (result != ISC_R_NOMORE)
 		goto cleanup;
 
-	str_destroy(&data_buf);
 	return ISC_R_SUCCESS;
 
 cleanup:
-	if (data_buf != NULL && str_len(data_buf) != 0)
-		data_str = str_buf(data_buf);
+	if (value != NULL && value->length != 0)
+		data_str = value->value;
 	log_error_r("failed to parse RR entry: %s: data '%s'",
 		    ldap_entry_logname(entry), data_str);
-	str_destroy(&data_buf);
 	return result;
 }
 
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-add_soa_record(isc_mem_t *mctx, dns_name_t *origin,
+add_soa_record(isc_mem_t *mctx, ldap_parsectx_t *pctx, dns_name_t *origin,
 	       ldap_entry_t *entry, dns_ttl_t ttl, ldapdb_rdatalist_t *rdatalist,
 	       const char *fake_mname)
 {
@@ -2605,7 +3589,7 @@ add_soa_record(isc_mem_t *mctx, dns_name_t *origin,
 
 	CHECK(ldap_entry_getfakesoa(entry, fake_mname, string));
 	rdclass = ldap_entry_getrdclass(entry);
-	CHECK(parse_rdata(mctx, entry, rdclass, dns_rdatatype_soa, origin,
+	CHECK(parse_rdata(mctx, pctx, rdclass, dns_rdatatype_soa, origin,
 			  str_buf(string), &rdata));
 
 	CHECK(findrdatatype_or_create(mctx, rdatalist, rdclass, dns_rdatatype_soa,
@@ -2621,18 +3605,100 @@ cleanup:
 	return result;
 }
 
+/**
+ * Convert text of the most frequent RR types directly to wire format,
+ * without the master file lexer. Only values which the lexer would return
+ * as a single token without any transformation are handled here.
+ *
+ * @retval ISC_R_SUCCESS      Wire format is in target.
+ * @retval ISC_R_NOTFOUND     Value has to be parsed by dns_rdata_fromtext().
+ */
+static isc_result_t ATTR_NONNULL(4,6) ATTR_CHECKRESULT
+parse_rdata_fast(dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
+		 dns_name_t *origin, const char *text, size_t length,
+		 isc_buffer_t *target)
+{
+	unsigned char addr[16];
+	isc_buffer_t source;
+	dns_name_t name;
+	const char *base = text;
+
+	/* Whitespace, quotes, escapes, comments and parentheses
+	 * need the lexer. */
+	if (length == 0 || strpbrk(text, " \t\r\n\"\\;()") != NULL) {
+		/* ... except TXT with single quoted string. The lexer
+		 * refuses line breaks inside of quoted string. */
+		if (rdtype != dns_rdatatype_txt || length < 3 ||
+		    text[0] != '"' || text[length - 1] != '"' ||
+		    memchr(text + 1, '"', length - 2) != NULL ||
+		    memchr(text + 1, '\\', length - 2) != NULL ||
+		    memchr(text + 1, '\r', length - 2) != NULL ||
+		    memchr(text + 1, '\n', length - 2) != NULL)
+			return ISC_R_NOTFOUND;
+		base = text + 1;
+		length -= 2;
+	}
+
+	switch (rdtype) {
+	case dns_rdatatype_a:
+		if (rdclass != dns_rdataclass_in ||
+		    inet_pton(AF_INET, text, addr) != 1 ||
+		    isc_buffer_availablelength(target) < 4)
+			return ISC_R_NOTFOUND;
+		isc_buffer_putmem(target, addr, 4);
+		return ISC_R_SUCCESS;
+
+	case dns_rdatatype_aaaa:
+		if (rdclass != dns_rdataclass_in ||
+		    inet_pton(AF_INET6, text, addr) != 1 ||
+		    isc_buffer_availablelength(target) < 16)
+			return ISC_R_NOTFOUND;
+		isc_buffer_putmem(target, addr, 16);
+		return ISC_R_SUCCESS;
+
+	case dns_rdatatype_ptr:
+	case dns_rdatatype_cname:
+		/* "@" and relative names depend on the origin. */
+		if (strcmp(text, "@") == 0)
+			return ISC_R_NOTFOUND;
+		DE_CONST(text, source.base);
+		isc_buffer_init(&source, source.base, length);
+		isc_buffer_add(&source, length);
+		dns_name_init(&name, NULL);
+		if (dns_name_fromtext(&name, &source,
+				      (origin != NULL) ? origin : dns_rootname,
+				      0, target) != ISC_R_SUCCESS)
+			return ISC_R_NOTFOUND;
+		return ISC_R_SUCCESS;
+
+	case dns_rdatatype_txt:
+		if (length > 255 ||
+		    isc_buffer_availablelength(target) < length + 1)
+			return ISC_R_NOTFOUND;
+		isc_buffer_putuint8(target, (isc_uint8_t)length);
+		isc_buffer_putmem(target, (const unsigned char *)base,
+				  length);
+		return ISC_R_SUCCESS;
+
+	default:
+		return ISC_R_NOTFOUND;
+	}
+}
+
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-parse_rdata(isc_mem_t *mctx, ldap_entry_t *entry,
-	    dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
-	    dns_name_t *origin, const char *rdata_text, dns_rdata_t **rdatap)
+parse_rdata_len(isc_mem_t *mctx, ldap_parsectx_t *pctx,
+		dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
+		dns_name_t *origin, const char *rdata_text, size_t length,
+		dns_rdata_t **rdatap)
 {
 	isc_result_t result;
 	isc_consttextregion_t text;
 	isc_buffer_t lex_buffer;
 	isc_region_t rdatamem;
 	dns_rdata_t *rdata;
+	isc_boolean_t lex_open = ISC_FALSE;
 
-	REQUIRE(entry != NULL);
+	REQUIRE(pctx != NULL);
 	REQUIRE(rdata_text != NULL);
 	REQUIRE(rdatap != NULL);
 
@@ -2640,36 +3706,45 @@ parse_rdata(isc_mem_t *mctx, ldap_entry_t *entry,
 	rdatamem.base = NULL;
 
 	text.base = rdata_text;
-	text.length = strlen(text.base);
+	text.length = length;
 
-	isc_buffer_init(&lex_buffer, (char *)text.base, text.length);
-	isc_buffer_add(&lex_buffer, text.length);
-	isc_buffer_setactive(&lex_buffer, text.length);
+	isc_buffer_init(&pctx->rdata_target, pctx->rdata_target_mem,
+			DNS_RDATA_MAXLENGTH);
+	result = parse_rdata_fast(rdclass, rdtype, origin, text.base,
+				  text.length, &pctx->rdata_target);
+	if (result != ISC_R_SUCCESS) {
+		isc_buffer_clear(&pctx->rdata_target);
 
-	CHECK(isc_lex_openbuffer(entry->lex, &lex_buffer));
+		isc_buffer_init(&lex_buffer, (char *)text.base, text.length);
+		isc_buffer_add(&lex_buffer, text.length);
+		isc_buffer_setactive(&lex_buffer, text.length);
 
-	isc_buffer_init(&entry->rdata_target, entry->rdata_target_mem,
-			DNS_RDATA_MAXLENGTH);
-	CHECK(dns_rdata_fromtext(NULL, rdclass, rdtype, entry->lex, origin,
-				 0, mctx, &entry->rdata_target, NULL));
+		CHECK(isc_lex_openbuffer(pctx->lex, &lex_buffer));
+		lex_open = ISC_TRUE;
+		CHECK(dns_rdata_fromtext(NULL, rdclass, rdtype, pctx->lex,
+					 origin, 0, mctx, &pctx->rdata_target,
+					 NULL));
+	}
 
 	CHECKED_MEM_GET_PTR(mctx, rdata);
 	dns_rdata_init(rdata);
 
-	rdatamem.length = isc_buffer_usedlength(&entry->rdata_target);
+	rdatamem.length = isc_buffer_usedlength(&pctx->rdata_target);
 	CHECKED_MEM_GET(mctx, rdatamem.base, rdatamem.length);
 
-	memcpy(rdatamem.base, isc_buffer_base(&entry->rdata_target),
+	memcpy(rdatamem.base, isc_buffer_base(&pctx->rdata_target),
 	       rdatamem.length);
 	dns_rdata_fromregion(rdata, rdclass, rdtype, &rdatamem);
 
-	isc_lex_close(entry->lex);
+	if (lex_open == ISC_TRUE)
+		isc_lex_close(pctx->lex);
 
 	*rdatap = rdata;
 	return ISC_R_SUCCESS;
 
 cleanup:
-	isc_lex_close(entry->lex);
+	if (lex_open == ISC_TRUE)
+		isc_lex_close(pctx->lex);
 	SAFE_MEM_PUT_PTR(mctx, rdata);
 	if (rdatamem.base != NULL)
 		isc_mem_put(mctx, rdatamem.base, rdatamem.length);
@@ -2677,6 +3752,15 @@ cleanup:
 	return result;
 }
 
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+parse_rdata(isc_mem_t *mctx, ldap_parsectx_t *pctx,
+	    dns_rdataclass_t rdclass, dns_rdatatype_t rdtype,
+	    dns_name_t *origin, const char *rdata_text, dns_rdata_t **rdatap)
+{
+	return parse_rdata_len(mctx, pctx, rdclass, rdtype, origin, rdata_text,
+			       strlen(rdata_text), rdatap);
+}
+
 /* FIXME: Tested with SASL/GSSAPI/KRB5 only */
 static int ATTR_NONNULL(3) ATTR_CHECKRESULT
 ldap_sasl_interact(LDAP *ld, unsigned flags, void *defaults, void *sin)
@@ -2936,6 +4020,12 @@ force_reconnect:
 
 	ldap_conn->tries = 0;
 
+	/* Writes use trial and error without the schema. */
+	result = rrschema_load(ldap_inst->rrschema, ldap_conn->handle);
+	if (result != ISC_R_SUCCESS)
+		log_error_r("unable to read DNS record attributes from LDAP "
+			    "schema");
+
 	return ISC_R_SUCCESS;
 
 cleanup:
@@ -2947,7 +4037,7 @@ handle_connection_error(ldap_instance_t *ldap_inst, ldap_connection_t *ldap_conn
 			isc_boolean_t force)
 {
 	int ret;
-	int err_code;
+	int err_code = LDAP_OTHER;
 	isc_result_t result = ISC_R_FAILURE;
 
 	REQUIRE(ldap_conn != NULL);
@@ -2985,156 +4075,754 @@ reconnect:
 		if (ldap_conn->handle == NULL && force == ISC_FALSE)
 			log_error("connection to the LDAP server was lost");
 		result = ldap_connect(ldap_inst, ldap_conn, force);
-		if (result == ISC_R_SUCCESS)
+		if (result == ISC_R_SUCCESS) {
+			ldap_conn->new_reconnects++;
 			log_info("successfully reconnected to LDAP server");
+		}
 		break;
 	}
 
+	if (err_code != LDAP_NO_SUCH_OBJECT)
+		ldap_conn->new_errors++;
 	return result;
 }
 
 /**
- * Apply LDAP modifications.
- *
- * @retval ISC_R_SUCCESS
- * @retval DNS_R_UNKNOWN = LDAP_OBJECT_CLASS_VIOLATION
- *                       or LDAP_INSUFFICIENT_ACCESS. Most likely an attribute
- *                       for a DNS RR type cannot be added because it is not
- *                       present in the LDAP schema.
+ * Send LDAP modification without waiting for the result.
  */
-isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_modify_do(ldap_instance_t *ldap_inst, const char *dn, LDAPMod **mods,
-		isc_boolean_t delete_node)
+static void ATTR_NONNULLS
+ldap_writeop_send(ldap_connection_t *ldap_conn, ldap_writeop_t *op)
 {
-	int ret;
-	int err_code;
-	const char *operation_str;
-	isc_boolean_t once = ISC_FALSE;
-	isc_result_t result;
-	ldap_connection_t *ldap_conn = NULL;
-
-	REQUIRE(dn != NULL);
-	REQUIRE(mods != NULL);
-	REQUIRE(ldap_inst != NULL);
-
-	/* Any mod_op can be ORed with LDAP_MOD_BVALUES. */
-	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_ADD)
-		operation_str = "modifying(add)";
-	else if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_DELETE)
-		operation_str = "modifying(del)";
-	else if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_REPLACE)
-		operation_str = "modifying(replace)";
-	else {
-		operation_str = "modifying(unknown operation)";
-		log_bug("%s: 0x%x", operation_str, mods[0]->mod_op);
-		CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
-	}
-
-	CHECK(ldap_pool_getconnection(ldap_inst->pool, &ldap_conn));
-	if (ldap_conn->handle == NULL) {
-		/*
-		 * handle can be NULL when the first connection to LDAP wasn't
-		 * successful
-		 * TODO: handle this case inside ldap_pool_getconnection()?
-		 */
-retry:
-		once = ISC_TRUE;
-		CHECK(handle_connection_error(ldap_inst, ldap_conn, ISC_FALSE));
-	}
-
-	if (delete_node) {
-		log_debug(2, "deleting whole node: '%s'", dn);
-		ret = ldap_delete_ext_s(ldap_conn->handle, dn, NULL, NULL);
-	} else {
-		log_debug(2, "writing to '%s': %s", dn, operation_str);
-		ret = ldap_modify_ext_s(ldap_conn->handle, dn, mods, NULL, NULL);
-	}
-
-	result = (ret == LDAP_SUCCESS) ? ISC_R_SUCCESS : ISC_R_FAILURE;
-	if (ret == LDAP_SUCCESS)
-		goto cleanup;
-
-	LDAP_OPT_CHECK(ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
-			&err_code), "ldap_modify_do(%s) failed to obtain ldap error code",
-			operation_str);
+	int ret = LDAP_SERVER_DOWN;
+	int i;
+	LDAPMod **new_mods;
+	char *obj_str[] = { "idnsRecord", NULL };
+	LDAPMod obj_class = {
+		0, "objectClass", { .modv_strvals = obj_str },
+	};
 
-	/* If there is no object yet, create it with an ldap add operation. */
-	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_ADD &&
-	     err_code == LDAP_NO_SUCH_OBJECT) {
-		int i;
-		LDAPMod **new_mods;
-		char *obj_str[] = { "idnsRecord", NULL };
-		LDAPMod obj_class = {
-			0, "objectClass", { .modv_strvals = obj_str },
-		};
+	op->send = ISC_FALSE;
+	op->sent = ISC_TRUE;
+	op->msgid = -1;
+	if (ldap_conn->handle == NULL)
+		return;
 
+	if (op->adding == ISC_TRUE) {
 		/*
 		 * Create a new array of LDAPMod structures. We will change
 		 * the mod_op member of each one to 0 (but preserve
 		 * LDAP_MOD_BVALUES. Additionally, we also need to specify
 		 * the objectClass attribute.
 		 */
-		for (i = 0; mods[i]; i++)
-			mods[i]->mod_op &= LDAP_MOD_BVALUES;
+		for (i = 0; op->mods[i]; i++)
+			op->mods[i]->mod_op &= LDAP_MOD_BVALUES;
 		new_mods = alloca((i + 2) * sizeof(LDAPMod *));
-		memcpy(new_mods, mods, i * sizeof(LDAPMod *));
+		memcpy(new_mods, op->mods, i * sizeof(LDAPMod *));
 		new_mods[i] = &obj_class;
 		new_mods[i + 1] = NULL;
 
-		ret = ldap_add_ext_s(ldap_conn->handle, dn, new_mods, NULL, NULL);
-		result = (ret == LDAP_SUCCESS) ? ISC_R_SUCCESS : ISC_R_FAILURE;
-		if (ret == LDAP_SUCCESS)
-			goto cleanup;
-		LDAP_OPT_CHECK(ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
-				&err_code),
-				"ldap_modify_do(add) failed to obtain ldap error code");
-		operation_str = "adding";
+		ret = ldap_add_ext(ldap_conn->handle, op->dn, new_mods,
+				   NULL, NULL, &op->msgid);
+	} else if (op->delete_node == ISC_TRUE) {
+		log_debug(2, "deleting whole node: '%s'", op->dn);
+		ret = ldap_delete_ext(ldap_conn->handle, op->dn, NULL, NULL,
+				      &op->msgid);
+	} else {
+		log_debug(2, "writing to '%s': %s", op->dn, op->operation_str);
+		ret = ldap_modify_ext(ldap_conn->handle, op->dn, op->mods,
+				      NULL, NULL, &op->msgid);
 	}
+	if (ret != LDAP_SUCCESS)
+		op->msgid = -1;
+}
 
-	log_ldap_error(ldap_conn->handle, "while %s entry '%s'", operation_str, dn);
-	/* attempt to manipulate attribute failed - likely a unknown RR type */
-	if (err_code == LDAP_OBJECT_CLASS_VIOLATION
-	    || err_code == LDAP_INSUFFICIENT_ACCESS) /* this is for 389 DS */
-		CLEANUP_WITH(DNS_R_UNKNOWN);
+/**
+ * @return ISC_TRUE if modifications do not delete any values, i.e. missing
+ *         entry can be created from them.
+ */
+static isc_boolean_t ATTR_NONNULLS
+ldap_mods_addonly(LDAPMod **mods)
+{
+	unsigned int i;
 
-	/* do not error out if we are trying to delete an
-	 * unexisting attribute */
-	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) != LDAP_MOD_DELETE ||
-	    err_code != LDAP_NO_SUCH_ATTRIBUTE) {
-		result = ISC_R_FAILURE;
-		if (once == ISC_FALSE) {
-			log_error("retrying LDAP operation (%s) on entry '%s'",
-				  operation_str, dn);
-			goto retry;
-		}
+	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) != LDAP_MOD_ADD)
+		return ISC_FALSE;
+	for (i = 1; mods[i] != NULL; i++) {
+		if ((mods[i]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_DELETE)
+			return ISC_FALSE;
 	}
 
-cleanup:
-	ldap_pool_putconnection(ldap_inst->pool, &ldap_conn);
-
-	return result;
+	return ISC_TRUE;
 }
 
-void ATTR_NONNULLS
-ldap_mod_free(isc_mem_t *mctx, LDAPMod **changep)
+/**
+ * Wait for result of LDAP modification sent by ldap_writeop_send() and
+ * decide what to do next. Operation which should be sent again
+ * has op->send set to ISC_TRUE, otherwise op->result is final.
+ *
+ * @param[out] err_code LDAP result code of the operation.
+ *
+ * @return ISC_TRUE if connection has to be checked before the operation
+ *         is sent again.
+ */
+static isc_boolean_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_writeop_finish(ldap_connection_t *ldap_conn, ldap_writeop_t *op,
+		    int *err_code)
 {
-	LDAPMod *change;
+	LDAPMessage *res = NULL;
+	int ret;
 
-	REQUIRE(changep != NULL);
+	op->sent = ISC_FALSE;
+	*err_code = LDAP_SERVER_DOWN;
+	if (ldap_conn->handle == NULL) {
+		op->result = ISC_R_NOTCONNECTED;
+		op->offline = ISC_TRUE;
+		return ISC_FALSE;
+	}
 
-	change = *changep;
-	if (change == NULL)
-		return;
+	if (op->msgid != -1) {
+		/* default timeout is LDAP_OPT_TIMEOUT set in ldap_connect() */
+		ret = ldap_result(ldap_conn->handle, op->msgid, LDAP_MSG_ALL,
+				  NULL, &res);
+		if (ret > 0) {
+			ret = ldap_parse_result(ldap_conn->handle, res,
+						err_code, NULL, NULL, NULL,
+						NULL, 1);
+			if (ret != LDAP_SUCCESS)
+				*err_code = ret;
+		} else {
+			if (ret == 0)
+				ldap_abandon_ext(ldap_conn->handle, op->msgid,
+						 NULL, NULL);
+			(void)ldap_get_option(ldap_conn->handle,
+					      LDAP_OPT_RESULT_CODE, err_code);
+		}
+		op->msgid = -1;
+	} else {
+		(void)ldap_get_option(ldap_conn->handle, LDAP_OPT_RESULT_CODE,
+				      err_code);
+	}
 
-	free_char_array(mctx, &change->mod_values);
-	if (change->mod_type != NULL)
-		SAFE_MEM_PUT(mctx, change->mod_type, LDAP_ATTR_FORMATSIZE);
-	SAFE_MEM_PUT_PTR(mctx, change);
+	if (*err_code == LDAP_SUCCESS) {
+		op->result = ISC_R_SUCCESS;
+		return ISC_FALSE;
+	}
+	op->result = ISC_R_FAILURE;
 
-	*changep = NULL;
-}
+	/* If there is no object yet, create it with an ldap add operation. */
+	if (op->adding == ISC_FALSE && ldap_mods_addonly(op->mods) &&
+	    *err_code == LDAP_NO_SUCH_OBJECT) {
+		op->adding = ISC_TRUE;
+		op->send = ISC_TRUE;
+		return ISC_FALSE;
+	}
+	if (op->adding == ISC_TRUE)
+		op->operation_str = "adding";
 
-isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+	log_ldap_error(ldap_conn->handle, "while %s entry '%s'",
+		       op->operation_str, op->dn);
+	/* attempt to manipulate attribute failed - likely a unknown RR type */
+	if (*err_code == LDAP_OBJECT_CLASS_VIOLATION
+	    || *err_code == LDAP_INSUFFICIENT_ACCESS) { /* this is for 389 DS */
+		op->result = DNS_R_UNKNOWN;
+		return ISC_FALSE;
+	}
+
+	/* do not error out if we are trying to delete an
+	 * unexisting attribute */
+	if ((op->mods[0]->mod_op & ~LDAP_MOD_BVALUES) != LDAP_MOD_DELETE ||
+	    *err_code != LDAP_NO_SUCH_ATTRIBUTE) {
+		if (op->retried == ISC_FALSE) {
+			log_error("retrying LDAP operation (%s) on entry '%s'",
+				  op->operation_str, op->dn);
+			op->retried = ISC_TRUE;
+			op->adding = ISC_FALSE;
+			op->send = ISC_TRUE;
+			return ISC_TRUE;
+		}
+	}
+	return ISC_FALSE;
+}
+
+/**
+ * Execute LDAP modifications on one connection. All operations are sent
+ * before waiting for the first result so their round trips overlap.
+ * Operations which have to be re-sent (entry creation, retry after
+ * connection error) are sent together in the next pass.
+ *
+ * @pre Operations modify distinct DNs.
+ */
+static void ATTR_NONNULLS
+ldap_writeq_round(ldap_instance_t *ldap_inst, ldap_writeop_t **ops,
+		  unsigned int count)
+{
+	isc_result_t result;
+	ldap_connection_t *ldap_conn = NULL;
+	isc_boolean_t resend;
+	int err_code;
+	int reconnect_err;
+	unsigned int i;
+
+	CHECK(ldap_pool_getconnection(ldap_inst->pool, &ldap_conn));
+	if (ldap_conn->handle == NULL) {
+		/*
+		 * handle can be NULL when the first connection to LDAP wasn't
+		 * successful
+		 * TODO: handle this case inside ldap_pool_getconnection()?
+		 */
+		CHECK(handle_connection_error(ldap_inst, ldap_conn, ISC_FALSE));
+	}
+
+	do {
+		for (i = 0; i < count; i++)
+			if (ops[i]->send == ISC_TRUE)
+				ldap_writeop_send(ldap_conn, ops[i]);
+
+		resend = ISC_FALSE;
+		reconnect_err = LDAP_SUCCESS;
+		for (i = 0; i < count; i++) {
+			if (ops[i]->sent == ISC_FALSE)
+				continue;
+			if (ldap_writeop_finish(ldap_conn, ops[i], &err_code)
+			    == ISC_TRUE && reconnect_err == LDAP_SUCCESS)
+				reconnect_err = err_code;
+			if (ops[i]->send == ISC_TRUE)
+				resend = ISC_TRUE;
+		}
+
+		if (reconnect_err != LDAP_SUCCESS) {
+			/* let handle_connection_error() see the error which
+			 * caused the retry, not the last result received */
+			if (ldap_conn->handle != NULL)
+				(void)ldap_set_option(ldap_conn->handle,
+						      LDAP_OPT_RESULT_CODE,
+						      &reconnect_err);
+			CHECK(handle_connection_error(ldap_inst, ldap_conn,
+						      ISC_FALSE));
+		}
+	} while (resend == ISC_TRUE);
+
+cleanup:
+	if (result != ISC_R_SUCCESS) {
+		for (i = 0; i < count; i++) {
+			if (ops[i]->send == ISC_TRUE) {
+				ops[i]->send = ISC_FALSE;
+				ops[i]->result = result;
+				/* reconnection failed */
+				ops[i]->offline = ISC_TF(ldap_conn != NULL &&
+						ldap_conn->handle == NULL);
+			}
+		}
+	}
+	ldap_pool_putconnection(ldap_inst->pool, &ldap_conn);
+}
+
+/**
+ * Take operations for the next round from the write queue: up to
+ * LDAP_WRITE_PIPELINE_MAX operations in queue order, skipping operations
+ * for a DN which has an older operation in the queue or in flight.
+ * This keeps order of modifications for each DN even if multiple rounds
+ * are sent in parallel. Picked operations are moved to the in-flight list.
+ *
+ * @pre writeq->lock is held.
+ */
+static unsigned int ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_writeq_pick(ldap_writeq_t *writeq, ldap_writeop_t **ops)
+{
+	ldap_writeop_t *op;
+	ldap_writeop_t *next;
+	ldap_writeop_t *prev;
+	isc_boolean_t blocked;
+	unsigned int count = 0;
+	unsigned int i;
+
+	for (op = HEAD(writeq->queue);
+	     op != NULL && count < LDAP_WRITE_PIPELINE_MAX;
+	     op = next) {
+		next = NEXT(op, link);
+		blocked = ISC_FALSE;
+		for (prev = HEAD(writeq->queue);
+		     prev != op && blocked == ISC_FALSE;
+		     prev = NEXT(prev, link))
+			blocked = ISC_TF(strcmp(prev->dn, op->dn) == 0);
+		for (prev = HEAD(writeq->inflight);
+		     prev != NULL && blocked == ISC_FALSE;
+		     prev = NEXT(prev, link))
+			blocked = ISC_TF(strcmp(prev->dn, op->dn) == 0);
+		if (blocked == ISC_TRUE)
+			continue;
+		UNLINK(writeq->queue, op, link);
+		APPEND(writeq->inflight, op, link);
+		ops[count++] = op;
+	}
+
+	return count;
+}
+
+/**
+ * Send LDAP modification to LDAP server.
+ *
+ * Modifications from concurrent callers are pipelined, see ldap_writeq_t.
+ * A caller which finds no round in progress sends queued modifications
+ * on one connection until its own modification is done and then hands
+ * the queue over to other callers. Another round is started in parallel
+ * only if there is an idle connection for it. The call returns when
+ * the modification was applied or failed.
+ *
+ * @param[out] offlinep ISC_TRUE if the modification failed because
+ *                      LDAP server is not reachable.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_modify_send(ldap_instance_t *ldap_inst, const char *dn, LDAPMod **mods,
+		 isc_boolean_t delete_node, isc_boolean_t *offlinep)
+{
+	isc_result_t result;
+	ldap_writeq_t *writeq;
+	ldap_writeop_t op;
+	ldap_writeop_t *ops[LDAP_WRITE_PIPELINE_MAX];
+	unsigned int count;
+	unsigned int i;
+
+	REQUIRE(dn != NULL);
+	REQUIRE(mods != NULL);
+	REQUIRE(ldap_inst != NULL);
+
+	*offlinep = ISC_FALSE;
+	writeq = &ldap_inst->writeq;
+	ZERO_PTR(&op);
+	op.dn = dn;
+	op.mods = mods;
+	op.delete_node = delete_node;
+	op.msgid = -1;
+	op.send = ISC_TRUE;
+	op.result = ISC_R_FAILURE;
+	ISC_LINK_INIT(&op, link);
+
+	/* Any mod_op can be ORed with LDAP_MOD_BVALUES. */
+	if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_ADD)
+		op.operation_str = "modifying(add)";
+	else if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_DELETE)
+		op.operation_str = "modifying(del)";
+	else if ((mods[0]->mod_op & ~LDAP_MOD_BVALUES) == LDAP_MOD_REPLACE)
+		op.operation_str = "modifying(replace)";
+	else {
+		op.operation_str = "modifying(unknown operation)";
+		log_bug("%s: 0x%x", op.operation_str, mods[0]->mod_op);
+		CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
+	}
+
+	LOCK(&writeq->lock);
+	APPEND(writeq->queue, &op, link);
+	while (op.done == ISC_FALSE) {
+		if (writeq->leaders > 0 &&
+		    ldap_pool_hasidle(ldap_inst->pool) == ISC_FALSE) {
+			WAIT(&writeq->cond, &writeq->lock);
+			continue;
+		}
+		/* Everything pickable might be blocked by rounds in flight,
+		 * including our own operation. */
+		count = ldap_writeq_pick(writeq, ops);
+		if (count == 0) {
+			WAIT(&writeq->cond, &writeq->lock);
+			continue;
+		}
+		writeq->leaders++;
+		UNLOCK(&writeq->lock);
+		ldap_writeq_round(ldap_inst, ops, count);
+		LOCK(&writeq->lock);
+		for (i = 0; i < count; i++) {
+			UNLINK(writeq->inflight, ops[i], link);
+			ops[i]->done = ISC_TRUE;
+		}
+		writeq->leaders--;
+		BROADCAST(&writeq->cond);
+	}
+	UNLOCK(&writeq->lock);
+	result = op.result;
+	*offlinep = op.offline;
+
+cleanup:
+	return result;
+}
+
+static void ATTR_NONNULLS
+ldap_wbop_destroy(isc_mem_t *mctx, ldap_wbop_t **wbopp)
+{
+	ldap_wbop_t *wbop = *wbopp;
+	unsigned int i;
+
+	if (wbop->mods != NULL) {
+		for (i = 0; wbop->mods[i] != NULL; i++)
+			ldap_mod_free(mctx, &wbop->mods[i]);
+		isc_mem_free(mctx, wbop->mods);
+	}
+	if (wbop->dn != NULL)
+		isc_mem_free(mctx, wbop->dn);
+	SAFE_MEM_PUT_PTR(mctx, wbop);
+	*wbopp = NULL;
+}
+
+/**
+ * Queue LDAP modification which could not be sent because LDAP server
+ * is not reachable. Modifications are sent in the original order
+ * once the server is reachable again, see ldap_writebehind_replay().
+ *
+ * @pre inst->wb_lock is held.
+ *
+ * @retval ISC_R_SUCCESS Modification was queued.
+ * @retval ISC_R_QUOTA   Queue is full, modification has to be refused.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_writebehind_add(ldap_instance_t *inst, const char *dn, LDAPMod **mods,
+		     isc_boolean_t delete_node)
+{
+	isc_result_t result;
+	isc_mem_t *mctx = inst->mctx;
+	ldap_wbop_t *wbop = NULL;
+	LDAPMod *change;
+	unsigned int count;
+	unsigned int i;
+	unsigned int j;
+
+	if (inst->wb_count >= inst->wb_limit) {
+		log_error("LDAP server is not reachable and %u modifications "
+			  "are waiting for it already: refusing change of "
+			  "'%s'; consider raising 'write_behind_limit'",
+			  inst->wb_count, dn);
+		return ISC_R_QUOTA;
+	}
+
+	CHECKED_MEM_GET_PTR(mctx, wbop);
+	ZERO_PTR(wbop);
+	ISC_LINK_INIT(wbop, link);
+	CHECKED_MEM_STRDUP(mctx, dn, wbop->dn);
+	wbop->delete_node = delete_node;
+	CHECK(isc_time_now(&wbop->queued));
+
+	for (count = 0; mods[count] != NULL; count++)
+		;
+	CHECKED_MEM_ALLOCATE(mctx, wbop->mods, (count + 1) * sizeof(LDAPMod *));
+	memset(wbop->mods, 0, (count + 1) * sizeof(LDAPMod *));
+	for (i = 0; i < count; i++) {
+		CHECK(ldap_mod_create(mctx, &wbop->mods[i]));
+		change = wbop->mods[i];
+		change->mod_op = mods[i]->mod_op;
+		CHECK(isc_string_copy(change->mod_type, LDAP_ATTR_FORMATSIZE,
+				      mods[i]->mod_type));
+		if (mods[i]->mod_values == NULL)
+			continue;
+		for (j = 0; mods[i]->mod_values[j] != NULL; j++)
+			;
+		CHECKED_MEM_ALLOCATE(mctx, change->mod_values,
+				     (j + 1) * sizeof(char *));
+		memset(change->mod_values, 0, (j + 1) * sizeof(char *));
+		for (j = 0; mods[i]->mod_values[j] != NULL; j++)
+			CHECKED_MEM_STRDUP(mctx, mods[i]->mod_values[j],
+					   change->mod_values[j]);
+	}
+
+	if (EMPTY(inst->wb_queue))
+		log_error("LDAP server is not reachable: modifications will "
+			  "be written to LDAP when the connection is "
+			  "restored");
+	log_debug(1, "write-behind: queued modification of '%s'", dn);
+	APPEND(inst->wb_queue, wbop, link);
+	inst->wb_count++;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (wbop != NULL)
+		ldap_wbop_destroy(mctx, &wbop);
+	return result;
+}
+
+/**
+ * Re-read entry which was not modified because queued modification
+ * was dropped and apply it to its zone like a modification received
+ * from syncrepl. Zone data which were changed by the dropped modification
+ * are reverted to the state in LDAP.
+ *
+ * Only record entries are re-applied: zone objects are processed
+ * synchronously with the syncrepl watcher which cannot be done from
+ * a task.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_writebehind_resync(ldap_instance_t *inst, const char *dn)
+{
+	isc_result_t result;
+	int ret;
+	int chgtype = LDAP_SYNC_CAPI_MODIFY;
+	char *attrs[] = { "*", "entryUUID", NULL };
+	ldap_connection_t *conn = NULL;
+	LDAPMessage *res = NULL;
+	LDAPMessage *msg;
+	struct berval **values = NULL;
+	char uuid_str[sizeof("01234567-89ab-cdef-0123-456789abcdef")];
+	uuid_t uuid_buf;
+	struct berval uuid = { .bv_len = sizeof(uuid_buf),
+			       .bv_val = (char *)uuid_buf };
+	ldap_entry_t *entry = NULL;
+	isc_boolean_t iszone;
+
+	CHECK(ldap_pool_getconnection(inst->pool, &conn));
+	if (conn->handle == NULL)
+		CLEANUP_WITH(ISC_R_NOTCONNECTED);
+
+	ret = ldap_search_ext_s(conn->handle, dn, LDAP_SCOPE_BASE,
+				"(objectClass=*)", attrs, 0, NULL, NULL,
+				NULL, LDAP_NO_LIMIT, &res);
+	if (ret == LDAP_NO_SUCH_OBJECT) {
+		/* remove records added by the dropped modification */
+		CHECK(ldap_entry_init(inst->mctx, &entry));
+		entry->class = LDAP_ENTRYCLASS_RR;
+		entry->dn = ber_strdup(dn);
+		if (entry->dn == NULL)
+			CLEANUP_WITH(ISC_R_NOMEMORY);
+		CHECK(dn_to_dnsname(inst->mctx, dn, &entry->fqdn,
+				    &entry->zone_name, &iszone));
+		if (iszone == ISC_TRUE)
+			CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
+		chgtype = LDAP_SYNC_CAPI_DELETE;
+	} else if (ret != LDAP_SUCCESS) {
+		log_ldap_error(conn->handle, "unable to read entry '%s'", dn);
+		CLEANUP_WITH(ISC_R_FAILURE);
+	} else {
+		msg = ldap_first_entry(conn->handle, res);
+		if (msg == NULL)
+			CLEANUP_WITH(ISC_R_NOTFOUND);
+		values = ldap_get_values_len(conn->handle, msg, "entryUUID");
+		if (values == NULL || values[0] == NULL ||
+		    values[0]->bv_len != sizeof(uuid_str) - 1)
+			CLEANUP_WITH(ISC_R_NOTFOUND);
+		memcpy(uuid_str, values[0]->bv_val, sizeof(uuid_str) - 1);
+		uuid_str[sizeof(uuid_str) - 1] = '\0';
+		if (uuid_parse(uuid_str, uuid_buf) != 0)
+			CLEANUP_WITH(ISC_R_UNEXPECTEDTOKEN);
+		CHECK(ldap_entry_parse(inst->mctx, conn->handle, msg, &uuid,
+				       &entry));
+		if ((entry->class & LDAP_ENTRYCLASS_RR) == 0 ||
+		    (entry->class & LDAP_ENTRYCLASS_MASTER) != 0)
+			CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
+	}
+	/* Do not wait for free slot in syncrepl queue: the caller can be
+	 * a task which has to process queued events. Number of re-read
+	 * entries is limited by write_behind_limit. */
+	CHECK(syncrepl_update(inst, &entry, chgtype));
+
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		log_error_r("write-behind: unable to re-read entry '%s' "
+			    "from LDAP: zone data might not match LDAP, "
+			    "run `rndc reload`", dn);
+	ldap_entry_destroy(&entry);
+	if (values != NULL)
+		ldap_value_free_len(values);
+	if (res != NULL)
+		ldap_msgfree(res);
+	ldap_pool_putconnection(inst->pool, &conn);
+	return result;
+}
+
+/**
+ * Send queued modifications to LDAP server in the original order.
+ *
+ * A queued modification can conflict with changes made by others
+ * while the server was not reachable, e.g. a value to be deleted
+ * is not present anymore. LDAP server refuses such modification,
+ * it is logged and dropped. Data in LDAP win in that case: the entry
+ * is re-read from LDAP and applied to the zone again, see
+ * ldap_writebehind_resync().
+ *
+ * @pre inst->wb_send is locked for writing and inst->wb_lock is held.
+ *
+ * @retval ISC_R_SUCCESS      Queue is empty.
+ * @retval ISC_R_NOTCONNECTED LDAP server is still not reachable.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_writebehind_replay(ldap_instance_t *inst)
+{
+	isc_result_t result;
+	ldap_wbop_t *wbop;
+	isc_boolean_t offline;
+	isc_time_t now;
+	unsigned int written = 0;
+	unsigned int conflicts = 0;
+
+	while ((wbop = HEAD(inst->wb_queue)) != NULL) {
+		result = ldap_modify_send(inst, wbop->dn, wbop->mods,
+					  wbop->delete_node, &offline);
+		if (offline == ISC_TRUE) {
+			if (written + conflicts > 0)
+				log_info("write-behind: %u modifications "
+					 "written to LDAP before the connection "
+					 "was lost again, %u are waiting",
+					 written + conflicts, inst->wb_count);
+			return ISC_R_NOTCONNECTED;
+		}
+		if (result == ISC_R_SUCCESS) {
+			written++;
+		} else {
+			conflicts++;
+			if (isc_time_now(&now) != ISC_R_SUCCESS)
+				now = wbop->queued;
+			log_error_r("write-behind: modification of '%s' queued "
+				    "%u seconds ago conflicts with LDAP "
+				    "content and was dropped", wbop->dn,
+				    (unsigned int)(isc_time_microdiff(&now,
+						&wbop->queued) / 1000000));
+			/* without re-read the next start has to do full
+			 * data synchronization, see destroy_ldap_instance() */
+			if (inst->exiting == ISC_TRUE ||
+			    ldap_writebehind_resync(inst, wbop->dn)
+			    != ISC_R_SUCCESS)
+				inst->wb_lost = ISC_TRUE;
+		}
+		UNLINK(inst->wb_queue, wbop, link);
+		inst->wb_count--;
+		ldap_wbop_destroy(inst->mctx, &wbop);
+	}
+
+	if (written + conflicts > 0)
+		log_info("write-behind: LDAP server is reachable again, "
+			 "%u queued modifications written, %u dropped",
+			 written, conflicts);
+	return ISC_R_SUCCESS;
+}
+
+/**
+ * Write queued modifications at shutdown. Modifications which cannot be
+ * written are lost and their number is logged. Zone data still contain
+ * them so inst->wb_lost is set.
+ */
+static void ATTR_NONNULLS
+ldap_writebehind_flush(ldap_instance_t *inst)
+{
+	ldap_wbop_t *wbop;
+
+	RWLOCK(&inst->wb_send, isc_rwlocktype_write);
+	LOCK(&inst->wb_lock);
+	if (ldap_writebehind_replay(inst) != ISC_R_SUCCESS) {
+		log_error("write-behind: LDAP server is not reachable, "
+			  "%u queued modifications are lost", inst->wb_count);
+		inst->wb_lost = ISC_TRUE;
+	}
+	while ((wbop = HEAD(inst->wb_queue)) != NULL) {
+		UNLINK(inst->wb_queue, wbop, link);
+		ldap_wbop_destroy(inst->mctx, &wbop);
+	}
+	inst->wb_count = 0;
+	UNLOCK(&inst->wb_lock);
+	RWUNLOCK(&inst->wb_send, isc_rwlocktype_write);
+}
+
+static void ATTR_NONNULLS
+ldap_writebehind_action(isc_task_t *task, isc_event_t *event)
+{
+	ldap_instance_t *inst = event->ev_arg;
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+	RWLOCK(&inst->wb_send, isc_rwlocktype_write);
+	LOCK(&inst->wb_lock);
+	if (!EMPTY(inst->wb_queue))
+		(void)ldap_writebehind_replay(inst);
+	UNLOCK(&inst->wb_lock);
+	RWUNLOCK(&inst->wb_send, isc_rwlocktype_write);
+}
+
+/**
+ * Apply LDAP modifications.
+ *
+ * The call returns when the modification was applied or failed.
+ *
+ * If write_behind_limit is non-zero, modifications which cannot be sent
+ * because LDAP server is not reachable are queued and reported as
+ * successful, so DNS updates are not refused during short outages.
+ * While the queue is not empty, all new modifications are queued behind
+ * older ones to keep their order.
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval DNS_R_UNKNOWN = LDAP_OBJECT_CLASS_VIOLATION
+ *                       or LDAP_INSUFFICIENT_ACCESS. Most likely an attribute
+ *                       for a DNS RR type cannot be added because it is not
+ *                       present in the LDAP schema.
+ * @retval ISC_R_QUOTA   LDAP server is not reachable and write-behind
+ *                       queue is full.
+ */
+isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_modify_do(ldap_instance_t *ldap_inst, const char *dn, LDAPMod **mods,
+		isc_boolean_t delete_node)
+{
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_boolean_t offline = ISC_FALSE;
+	isc_boolean_t queued;
+
+	REQUIRE(dn != NULL);
+	REQUIRE(mods != NULL);
+	REQUIRE(ldap_inst != NULL);
+
+	if (ldap_inst->wb_limit == 0)
+		return ldap_modify_send(ldap_inst, dn, mods, delete_node,
+					&offline);
+
+	/* Concurrent modifications are sent in parallel but the queue
+	 * cannot be replayed until all of them are sent or queued. */
+	RWLOCK(&ldap_inst->wb_send, isc_rwlocktype_read);
+	LOCK(&ldap_inst->wb_lock);
+	queued = ISC_TF(!EMPTY(ldap_inst->wb_queue));
+	UNLOCK(&ldap_inst->wb_lock);
+	if (queued == ISC_FALSE) {
+		result = ldap_modify_send(ldap_inst, dn, mods, delete_node,
+					  &offline);
+		if (result != ISC_R_SUCCESS && offline == ISC_TRUE) {
+			LOCK(&ldap_inst->wb_lock);
+			result = ldap_writebehind_add(ldap_inst, dn, mods,
+						      delete_node);
+			UNLOCK(&ldap_inst->wb_lock);
+		}
+	}
+	RWUNLOCK(&ldap_inst->wb_send, isc_rwlocktype_read);
+	if (queued == ISC_FALSE)
+		return result;
+
+	/* Older modifications are waiting: send them first or queue
+	 * this one behind them. Nothing else is sent in the meantime. */
+	RWLOCK(&ldap_inst->wb_send, isc_rwlocktype_write);
+	LOCK(&ldap_inst->wb_lock);
+	if (ldap_writebehind_replay(ldap_inst) != ISC_R_SUCCESS)
+		offline = ISC_TRUE;
+	else
+		result = ldap_modify_send(ldap_inst, dn, mods, delete_node,
+					  &offline);
+	if (offline == ISC_TRUE)
+		result = ldap_writebehind_add(ldap_inst, dn, mods, delete_node);
+	UNLOCK(&ldap_inst->wb_lock);
+	RWUNLOCK(&ldap_inst->wb_send, isc_rwlocktype_write);
+
+	return result;
+}
+
+void ATTR_NONNULLS
+ldap_mod_free(isc_mem_t *mctx, LDAPMod **changep)
+{
+	LDAPMod *change;
+
+	REQUIRE(changep != NULL);
+
+	change = *changep;
+	if (change == NULL)
+		return;
+
+	free_char_array(mctx, &change->mod_values);
+	if (change->mod_type != NULL)
+		SAFE_MEM_PUT(mctx, change->mod_type, LDAP_ATTR_FORMATSIZE);
+	SAFE_MEM_PUT_PTR(mctx, change);
+
+	*changep = NULL;
+}
+
+isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
 ldap_mod_create(isc_mem_t *mctx, LDAPMod **changep)
 {
 	LDAPMod *change = NULL;
@@ -3348,42 +5036,360 @@ cleanup:
 #undef SET_LDAP_MOD
 }
 
+/**
+ * Get DN of the zone from DN of a record owned by the zone.
+ * Zone apex is stored in the zone entry, i.e. for zone apex
+ * the owner DN is the zone DN.
+ *
+ * @param[in] apex Owner is the zone apex. It cannot be distinguished
+ *                 from other names by DN syntax.
+ */
+static const char * ATTR_NONNULLS
+ldap_zone_dn_from_owner(const char *owner_dn, isc_boolean_t apex)
+{
+	const char *p;
+
+	if (apex == ISC_TRUE)
+		return owner_dn;
+
+	/* Skip the first RDN, DNs received from LDAP do not have to contain
+	 * whitespace after separator like DNs from dnsname_to_dn(). */
+	for (p = owner_dn; *p != '\0'; p++) {
+		if (*p == '\\' && *(p + 1) != '\0')
+			p++;
+		else if (*p == ',')
+			break;
+	}
+	if (*p == '\0')
+		return owner_dn;
+
+	p++;
+	while (*p == ' ')
+		p++;
+	return p;
+}
+
+/**
+ * Translate owner name to DN and find settings of the zone
+ * which contains the owner.
+ *
+ * @retval DNS_R_NOTAUTH The zone is not active in this instance.
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-modify_ldap_common(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst,
-		   dns_rdatalist_t *rdlist, int mod_op, isc_boolean_t delete_node)
+modify_ldap_target(ldap_instance_t *ldap_inst, dns_name_t *owner,
+		   dns_name_t *zone, ld_string_t *owner_dn,
+		   settings_set_t **zone_settingsp)
+{
+	isc_result_t result;
+	isc_mem_t *mctx = ldap_inst->mctx;
+	dns_name_t zone_name;
+	const char *zone_dn = NULL;
+	isc_boolean_t apex = dns_name_equal(owner, zone);
+
+	dns_name_init(&zone_name, NULL);
+	/* Hot owner names skip all conversions between names and DNs. */
+	if (apex == ISC_FALSE) {
+		result = zr_get_owner_dn(ldap_inst->zone_register, zone, owner,
+					 owner_dn);
+		if (result == ISC_R_SUCCESS) {
+			zone_dn = ldap_zone_dn_from_owner(str_buf(owner_dn),
+							  ISC_FALSE);
+			goto settings;
+		}
+	}
+
+	/*
+	 * Find parent zone entry and check if Dynamic Update is allowed.
+	 */
+	CHECK(dnsname_to_dn(ldap_inst->zone_register, owner, zone, owner_dn));
+	zone_dn = ldap_zone_dn_from_owner(str_buf(owner_dn), apex);
+
+	/* DN of zone apex is DN of the zone from zone register. */
+	if (apex == ISC_FALSE) {
+		CHECK(dn_to_dnsname(mctx, zone_dn, &zone_name, NULL, NULL));
+		INSIST(dns_name_equal(zone, &zone_name) == ISC_TRUE);
+
+		result = zr_set_owner_dn(ldap_inst->zone_register, zone, owner,
+					 str_buf(owner_dn), ISC_FALSE);
+		if (result != ISC_R_SUCCESS)
+			log_debug(1, "unable to cache DN '%s': %s",
+				  str_buf(owner_dn), isc_result_totext(result));
+	}
+
+settings:
+	result = zr_get_zone_settings(ldap_inst->zone_register, zone,
+				      zone_settingsp);
+	if (result != ISC_R_SUCCESS) {
+		if (result == ISC_R_NOTFOUND)
+			log_debug(3, "update refused: "
+				  "active zone '%s' not found", zone_dn);
+		CLEANUP_WITH(DNS_R_NOTAUTH);
+	}
+
+cleanup:
+	if (dns_name_dynamic(&zone_name))
+		dns_name_free(&zone_name, mctx);
+
+	return result;
+}
+
+/**
+ * Write change of one RR set to LDAP entry 'dn'.
+ *
+ * Named attribute like "URIRecord" is used if LDAP schema defines it,
+ * "UnknownRecord;TYPE256" otherwise. If the LDAP server refuses the change,
+ * try the other attribute once. The refusal might be caused by access control
+ * for this particular entry so it does not change the schema table.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+modify_ldap_rdlist(ldap_instance_t *ldap_inst, const char *dn,
+		   dns_rdatalist_t *rdlist, int mod_op,
+		   isc_boolean_t delete_node)
 {
 	isc_result_t result;
 	isc_mem_t *mctx = ldap_inst->mctx;
-	ld_string_t *owner_dn = NULL;
 	LDAPMod *change[3] = { NULL };
+	isc_boolean_t unknown_type;
+	unsigned int attempts = 0;
+
+	if (mod_op == LDAP_MOD_ADD) {
+		/* for now always replace the ttl on add */
+		CHECK(ldap_rdttl_to_ldapmod(mctx, rdlist, &change[1]));
+	}
+
+	unknown_type = !rrschema_hasattr(ldap_inst->rrschema, rdlist->type);
+	do {
+		ldap_mod_free(mctx, &change[0]);
+		CHECK(ldap_rdatalist_to_ldapmod(mctx, rdlist, &change[0],
+						mod_op, unknown_type));
+		result = ldap_modify_do(ldap_inst, dn, change, delete_node);
+		unknown_type = !unknown_type; /* try again with other type */
+	} while (result == DNS_R_UNKNOWN && ++attempts < 2);
+
+cleanup:
+	ldap_mod_free(mctx, &change[0]);
+	ldap_mod_free(mctx, &change[1]);
+
+	return result;
+}
+
+/**
+ * Keep the PTR records of corresponding A/AAAA records synchronized.
+ * Changes of other RR types are ignored.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+modify_ldap_syncptr(ldap_instance_t *ldap_inst, dns_name_t *owner,
+		    settings_set_t *zone_settings, const char *zone_dn,
+		    dns_rdatalist_t *rdlist, int mod_op)
+{
+	isc_result_t result;
 	isc_boolean_t zone_sync_ptr;
-	char **vals = NULL;
-	dns_name_t zone_name;
-	char *zone_dn = NULL;
-	settings_set_t *zone_settings = NULL;
+	dns_rdata_t *rdata;
+	isc_buffer_t buffer;
+	char ip_str[INET6_ADDRSTRLEN + 1];
 	int af; /* address family */
-	isc_boolean_t unknown_type = ISC_FALSE;
+
+	if (rdlist->type != dns_rdatatype_a &&
+	    rdlist->type != dns_rdatatype_aaaa)
+		return ISC_R_SUCCESS;
 
 	/*
-	 * Find parent zone entry and check if Dynamic Update is allowed.
-	 * @todo Try the cache first and improve split: SOA records are problematic.
+	 * Look for zone "idnsAllowSyncPTR" attribute. If attribute do not exist,
+	 * use global plugin configuration: option "sync_ptr"
 	 */
-	dns_name_init(&zone_name, NULL);
-	CHECK(str_new(mctx, &owner_dn));
+	CHECK(setting_get_bool("sync_ptr", zone_settings, &zone_sync_ptr));
+	if (!zone_sync_ptr) {
+		log_debug(3, "sync PTR is disabled for zone '%s'", zone_dn);
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	}
+	log_debug(3, "sync PTR is enabled for zone '%s'", zone_dn);
+
+	af = (rdlist->type == dns_rdatatype_a) ? AF_INET : AF_INET6;
+	for (rdata = HEAD(rdlist->rdata);
+	     rdata != NULL;
+	     rdata = NEXT(rdata, link)) {
+		isc_buffer_init(&buffer, ip_str, sizeof(ip_str) - 1);
+		CHECK(dns_rdata_totext(rdata, NULL, &buffer));
+		ip_str[isc_buffer_usedlength(&buffer)] = '\0';
+
+		result = sync_ptr_init(ldap_inst->mctx, ldap_inst->sctx,
+				       ldap_inst->view->zonetable,
+				       ldap_inst->zone_register, owner, af,
+				       ip_str, rdlist->ttl, mod_op);
+		/* Silently ignore cases where the reverse zone does not exist,
+		 * does not accept dynamic updates, or is not managed by this
+		 * driver instance. */
+		if (result != ISC_R_NOTFOUND &&
+		    result != ISC_R_NOPERM &&
+		    result != DNS_R_NOTAUTHORITATIVE)
+			CHECK(result);
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+modify_ldap_common(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst,
+		   dns_rdatalist_t *rdlist, int mod_op, isc_boolean_t delete_node)
+{
+	isc_result_t result;
+	ld_string_t *owner_dn = NULL;
+	settings_set_t *zone_settings = NULL;
+
+	CHECK(str_new(ldap_inst->mctx, &owner_dn));
+	CHECK(modify_ldap_target(ldap_inst, owner, zone, owner_dn,
+				 &zone_settings));
+
+	if (rdlist->type == dns_rdatatype_soa && mod_op == LDAP_MOD_DELETE)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+
+	if (rdlist->type == dns_rdatatype_soa) {
+		result = modify_soa_record(ldap_inst, str_buf(owner_dn),
+					   HEAD(rdlist->rdata));
+		goto cleanup;
+	}
+
+	CHECK(modify_ldap_rdlist(ldap_inst, str_buf(owner_dn), rdlist, mod_op,
+				 delete_node));
+	CHECK(modify_ldap_syncptr(ldap_inst, owner, zone_settings,
+				  ldap_zone_dn_from_owner(str_buf(owner_dn),
+							  dns_name_equal(owner, zone)),
+				  rdlist, mod_op));
+
+cleanup:
+	str_destroy(&owner_dn);
+
+	return result;
+}
+
+isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_modbatch_create(isc_mem_t *mctx, ldap_modbatch_t **batchp)
+{
+	isc_result_t result;
+	ldap_modbatch_t *batch = NULL;
+
+	REQUIRE(batchp != NULL && *batchp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, batch);
+	ZERO_PTR(batch);
+	isc_mem_attach(mctx, &batch->mctx);
+	dns_fixedname_init(&batch->owner);
+	dns_fixedname_init(&batch->zone);
+	dns_diff_init(mctx, &batch->diff);
+	CHECK(str_new(mctx, &batch->dn));
+
+	*batchp = batch;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	ldap_modbatch_destroy(&batch);
+	return result;
+}
+
+void ATTR_NONNULLS
+ldap_modbatch_destroy(ldap_modbatch_t **batchp)
+{
+	ldap_modbatch_t *batch;
+
+	REQUIRE(batchp != NULL);
+
+	batch = *batchp;
+	if (batch == NULL)
+		return;
+
+	dns_diff_clear(&batch->diff);
+	str_destroy(&batch->dn);
+	MEM_PUT_AND_DETACH(batch);
+
+	*batchp = NULL;
+}
+
+/**
+ * Drop all staged changes without writing them to LDAP.
+ */
+void ATTR_NONNULLS
+ldap_modbatch_discard(ldap_modbatch_t *batch)
+{
+	dns_diff_clear(&batch->diff);
+	batch->delete_node = ISC_FALSE;
+}
+
+/**
+ * Check whether the batch contains changes which were not written to LDAP.
+ */
+isc_boolean_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_modbatch_isempty(ldap_modbatch_t *batch)
+{
+	return ISC_LIST_EMPTY(batch->diff.tuples);
+}
+
+/**
+ * Write all changes staged in the batch to LDAP and empty the batch.
+ *
+ * Changes are sent as one LDAP modify operation which is applied
+ * atomically by the LDAP server. If the combined operation fails, e.g.
+ * because one of RR types is not present in LDAP schema, changes are
+ * written again one RR set at a time so each of them gets the same
+ * handling as changes written by modify_ldap_common().
+ */
+isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_modbatch_flush(ldap_instance_t *ldap_inst, ldap_modbatch_t *batch)
+{
+	isc_result_t result;
+	isc_mem_t *mctx = batch->mctx;
+	settings_set_t *zone_settings = NULL;
+	ldap_modgroup_t *groups = NULL;
+	ldap_modgroup_t *group = NULL;
+	ldap_modgroup_t *last_add = NULL;
+	LDAPMod **mods = NULL;
+	dns_difftuple_t *tuple;
+	dns_difftuple_t *prev;
+	const char *dn = str_buf(batch->dn);
+	const char *zone_dn = NULL;
+	unsigned int count = 0;
+	unsigned int i;
 
-	CHECK(dnsname_to_dn(ldap_inst->zone_register, owner, zone, owner_dn));
-	zone_dn = strstr(str_buf(owner_dn),", ");
+	if (ISC_LIST_EMPTY(batch->diff.tuples))
+		return ISC_R_SUCCESS;
 
-	if (zone_dn == NULL) { /* SOA record; owner = zone => owner_dn = zone_dn */
-		zone_dn = (char *)str_buf(owner_dn);
-	} else {
-		zone_dn += 1; /* skip whitespace */
+	zone_dn = ldap_zone_dn_from_owner(dn,
+			dns_name_equal(dns_fixedname_name(&batch->owner),
+				       dns_fixedname_name(&batch->zone)));
+
+	/* Consecutive changes with the same operation and RR type
+	 * form one RR set. */
+	for (tuple = HEAD(batch->diff.tuples), prev = NULL;
+	     tuple != NULL;
+	     prev = tuple, tuple = NEXT(tuple, link)) {
+		if (prev == NULL || prev->op != tuple->op ||
+		    prev->rdata.type != tuple->rdata.type)
+			count++;
+	}
+	CHECKED_MEM_ALLOCATE(mctx, groups, count * sizeof(*groups));
+	for (tuple = HEAD(batch->diff.tuples), prev = NULL;
+	     tuple != NULL;
+	     prev = tuple, tuple = NEXT(tuple, link)) {
+		if (prev == NULL || prev->op != tuple->op ||
+		    prev->rdata.type != tuple->rdata.type) {
+			group = (group == NULL) ? groups : group + 1;
+			dns_rdatalist_init(&group->rdlist);
+			group->rdlist.rdclass = tuple->rdata.rdclass;
+			group->rdlist.type = tuple->rdata.type;
+			if (tuple->op == DNS_DIFFOP_ADD) {
+				group->mod_op = LDAP_MOD_ADD;
+				last_add = group;
+			} else {
+				group->mod_op = LDAP_MOD_DELETE;
+			}
+		}
+		group->rdlist.ttl = tuple->ttl;
+		APPEND(group->rdlist.rdata, &tuple->rdata, link);
 	}
 
-	CHECK(dn_to_dnsname(mctx, zone_dn, &zone_name, NULL, NULL));
-	INSIST(dns_name_equal(zone, &zone_name) == ISC_TRUE);
-
-	result = zr_get_zone_settings(ldap_inst->zone_register, &zone_name,
+	result = zr_get_zone_settings(ldap_inst->zone_register,
+				      dns_fixedname_name(&batch->zone),
 				      &zone_settings);
 	if (result != ISC_R_SUCCESS) {
 		if (result == ISC_R_NOTFOUND)
@@ -3392,81 +5398,136 @@ modify_ldap_common(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_in
 		CLEANUP_WITH(DNS_R_NOTAUTH);
 	}
 
-	if (rdlist->type == dns_rdatatype_soa && mod_op == LDAP_MOD_DELETE)
-		CLEANUP_WITH(ISC_R_SUCCESS);
-
-	if (rdlist->type == dns_rdatatype_soa) {
-		result = modify_soa_record(ldap_inst, str_buf(owner_dn),
-					   HEAD(rdlist->rdata));
-		goto cleanup;
+	if (count > 1 || batch->delete_node == ISC_TRUE) {
+		CHECKED_MEM_ALLOCATE(mctx, mods, (count + 2) * sizeof(*mods));
+		memset(mods, 0, (count + 2) * sizeof(*mods));
+		for (i = 0; i < count; i++)
+			CHECK(ldap_rdatalist_to_ldapmod(mctx, &groups[i].rdlist,
+					&mods[i], groups[i].mod_op,
+					!rrschema_hasattr(ldap_inst->rrschema,
+							  groups[i].rdlist.type)));
+		/* for now always replace the ttl on add */
+		if (last_add != NULL)
+			CHECK(ldap_rdttl_to_ldapmod(mctx, &last_add->rdlist,
+						    &mods[count]));
+
+		result = ldap_modify_do(ldap_inst, dn, mods,
+					batch->delete_node);
+		if (result == ISC_R_SUCCESS) {
+			for (i = 0; i < count; i++)
+				CHECK(modify_ldap_syncptr(ldap_inst,
+						dns_fixedname_name(&batch->owner),
+						zone_settings, zone_dn,
+						&groups[i].rdlist,
+						groups[i].mod_op));
+			goto cleanup;
+		} else if (batch->delete_node == ISC_TRUE) {
+			goto cleanup;
+		}
+		log_debug(2, "writing %u RR set changes to '%s' one by one",
+			  count, dn);
 	}
 
-	if (mod_op == LDAP_MOD_ADD) {
-		/* for now always replace the ttl on add */
-		CHECK(ldap_rdttl_to_ldapmod(mctx, rdlist, &change[1]));
+	for (i = 0; i < count; i++) {
+		CHECK(modify_ldap_rdlist(ldap_inst, dn, &groups[i].rdlist,
+					 groups[i].mod_op, ISC_FALSE));
+		CHECK(modify_ldap_syncptr(ldap_inst,
+					  dns_fixedname_name(&batch->owner),
+					  zone_settings, zone_dn,
+					  &groups[i].rdlist, groups[i].mod_op));
 	}
 
-	/* First, try to store data into named attribute like "URIRecord".
-	 * If that fails, try to store the data into "UnknownRecord;TYPE256". */
-	unknown_type = ISC_FALSE;
-	do {
-		ldap_mod_free(mctx, &change[0]);
-		CHECK(ldap_rdatalist_to_ldapmod(mctx, rdlist, &change[0],
-						mod_op, unknown_type));
-		result = ldap_modify_do(ldap_inst, str_buf(owner_dn), change,
-					delete_node);
-		unknown_type = !unknown_type; /* try again with unknown type */
-	} while (result == DNS_R_UNKNOWN && unknown_type == ISC_TRUE);
+cleanup:
+	if (mods != NULL) {
+		for (i = 0; i <= count; i++)
+			ldap_mod_free(mctx, &mods[i]);
+		isc_mem_free(mctx, mods);
+	}
+	if (groups != NULL)
+		isc_mem_free(mctx, groups);
+	ldap_modbatch_discard(batch);
 
-	/* Keep the PTR of corresponding A/AAAA record synchronized. */
-	if (rdlist->type == dns_rdatatype_a || rdlist->type == dns_rdatatype_aaaa) {
-		/*
-		 * Look for zone "idnsAllowSyncPTR" attribute. If attribute do not exist,
-		 * use global plugin configuration: option "sync_ptr"
-		 */
+	return result;
+}
 
-		CHECK(setting_get_bool("sync_ptr", zone_settings, &zone_sync_ptr));
-		if (!zone_sync_ptr) {
-			log_debug(3, "sync PTR is disabled for zone '%s'", zone_dn);
-			CLEANUP_WITH(ISC_R_SUCCESS);
-		}
-		log_debug(3, "sync PTR is enabled for zone '%s'", zone_dn);
+/**
+ * Stage change of one RR set. Staged changes of one owner name are written
+ * to LDAP together by ldap_modbatch_flush(). A change of another owner name
+ * flushes the batch first.
+ *
+ * Changes of SOA record are not staged. DNS UPDATE processing changes
+ * the SOA serial after all other changes, so the batch is flushed before
+ * the update is journaled and LDAP errors are reported to the client.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_modbatch_stage(ldap_instance_t *ldap_inst, ldap_modbatch_t *batch,
+		    dns_name_t *owner, dns_name_t *zone,
+		    dns_rdatalist_t *rdlist, int mod_op,
+		    isc_boolean_t delete_node)
+{
+	isc_result_t result = ISC_R_SUCCESS;
+	settings_set_t *zone_settings = NULL;
+	dns_difftuple_t *tuple = NULL;
+	dns_rdata_t *rdata;
+	dns_diffop_t op;
+
+	if (!ISC_LIST_EMPTY(batch->diff.tuples) &&
+	    (rdlist->type == dns_rdatatype_soa ||
+	     !dns_name_equal(owner, dns_fixedname_name(&batch->owner))))
+		CHECK(ldap_modbatch_flush(ldap_inst, batch));
+
+	if (rdlist->type == dns_rdatatype_soa)
+		return modify_ldap_common(owner, zone, ldap_inst, rdlist,
+					  mod_op, delete_node);
+
+	if (ISC_LIST_EMPTY(batch->diff.tuples)) {
+		CHECK(modify_ldap_target(ldap_inst, owner, zone, batch->dn,
+					 &zone_settings));
+		CHECK(dns_name_copy(owner, dns_fixedname_name(&batch->owner),
+				    NULL));
+		CHECK(dns_name_copy(zone, dns_fixedname_name(&batch->zone),
+				    NULL));
+	}
 
-		af = (rdlist->type == dns_rdatatype_a) ? AF_INET : AF_INET6;
-		/* Following call will not work if A/AAAA records are unknown. */
-		result = sync_ptr_init(mctx, ldap_inst->view->zonetable,
-				       ldap_inst->zone_register, owner, af,
-				       change[0]->mod_values[0], rdlist->ttl,
-				       mod_op);
-		/* Silently ignore cases where the reverse zone does not exist,
-		 * does not accept dynamic updates, or is not managed by this
-		 * driver instance. */
-		if (result == ISC_R_NOTFOUND ||
-		    result == ISC_R_NOPERM ||
-		    result == DNS_R_NOTAUTHORITATIVE)
-			result = ISC_R_SUCCESS;
+	op = (mod_op == LDAP_MOD_ADD) ? DNS_DIFFOP_ADD : DNS_DIFFOP_DEL;
+	for (rdata = HEAD(rdlist->rdata);
+	     rdata != NULL;
+	     rdata = NEXT(rdata, link)) {
+		CHECK(dns_difftuple_create(batch->mctx, op, owner, rdlist->ttl,
+					   rdata, &tuple));
+		dns_diff_append(&batch->diff, &tuple);
 	}
+	batch->delete_node = delete_node;
 
 cleanup:
-	str_destroy(&owner_dn);
-	ldap_mod_free(mctx, &change[0]);
-	ldap_mod_free(mctx, &change[1]);
-	free_char_array(mctx, &vals);
-	dns_name_free(&zone_name, mctx);
-
 	return result;
 }
 
+/**
+ * Add RR set to LDAP. The change is staged in 'batch' if it is not NULL.
+ */
 isc_result_t
-write_to_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst, dns_rdatalist_t *rdlist)
+write_to_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst,
+	      dns_rdatalist_t *rdlist, ldap_modbatch_t *batch)
 {
+	if (batch != NULL)
+		return ldap_modbatch_stage(ldap_inst, batch, owner, zone,
+					   rdlist, LDAP_MOD_ADD, ISC_FALSE);
 	return modify_ldap_common(owner, zone, ldap_inst, rdlist, LDAP_MOD_ADD, ISC_FALSE);
 }
 
+/**
+ * Remove RR set from LDAP. The change is staged in 'batch' if it is not NULL.
+ */
 isc_result_t
 remove_values_from_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst,
-		 dns_rdatalist_t *rdlist, isc_boolean_t delete_node)
+		 dns_rdatalist_t *rdlist, isc_boolean_t delete_node,
+		 ldap_modbatch_t *batch)
 {
+	if (batch != NULL)
+		return ldap_modbatch_stage(ldap_inst, batch, owner, zone,
+					   rdlist, LDAP_MOD_DELETE,
+					   delete_node);
 	return modify_ldap_common(owner, zone, ldap_inst, rdlist, LDAP_MOD_DELETE,
 				  delete_node);
 }
@@ -3548,22 +5609,38 @@ cleanup:
 
 
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_pool_create(isc_mem_t *mctx, unsigned int connections, ldap_pool_t **poolp)
+ldap_pool_create(isc_mem_t *mctx, unsigned int connections, unsigned int min,
+		 isc_uint32_t idle_timeout, ldap_pool_t **poolp)
 {
 	ldap_pool_t *pool;
 	isc_result_t result;
 
 	REQUIRE(poolp != NULL && *poolp == NULL);
+	REQUIRE(min <= connections);
 
 	CHECKED_MEM_GET(mctx, pool, sizeof(*pool));
 	ZERO_PTR(pool);
+	ISC_LIST_INIT(pool->idle);
+
+	result = isc_mutex_init(&pool->lock);
+	if (result != ISC_R_SUCCESS) {
+		SAFE_MEM_PUT_PTR(mctx, pool);
+		return result;
+	}
+	result = isc_condition_init(&pool->cond);
+	if (result != ISC_R_SUCCESS) {
+		DESTROYLOCK(&pool->lock);
+		SAFE_MEM_PUT_PTR(mctx, pool);
+		return result;
+	}
 	isc_mem_attach(mctx, &pool->mctx);
-	
-	CHECK(semaphore_init(&pool->conn_semaphore, connections));
+
 	CHECKED_MEM_GET(mctx, pool->conns,
 			connections * sizeof(ldap_connection_t *));
 	memset(pool->conns, 0, connections * sizeof(ldap_connection_t *));
 	pool->connections = connections;
+	pool->min = min;
+	pool->idle_timeout = idle_timeout;
 
 	*poolp = pool;
 
@@ -3588,6 +5665,7 @@ ldap_pool_destroy(ldap_pool_t **poolp)
 		return;
 
 	if (pool->conns != NULL) {
+		ldap_pool_log(pool);
 		for (i = 0; i < pool->connections; i++) {
 			ldap_conn = pool->conns[i];
 			if (ldap_conn != NULL)
@@ -3598,41 +5676,204 @@ ldap_pool_destroy(ldap_pool_t **poolp)
 			     pool->connections * sizeof(ldap_connection_t *));
 	}
 
-	semaphore_destroy(&pool->conn_semaphore);
+	DESTROYLOCK(&pool->lock);
+	RUNTIME_CHECK(isc_condition_destroy(&pool->cond) == ISC_R_SUCCESS);
 
 	MEM_PUT_AND_DETACH(pool);
 	*poolp = NULL;
 }
 
+/**
+ * Log statistics for each connection in the pool so the 'connections'
+ * parameter can be tuned.
+ */
+static void
+ldap_pool_log(ldap_pool_t *pool) {
+	ldap_connection_t *ldap_conn;
+	unsigned int i;
+
+	LOCK(&pool->lock);
+	log_info("LDAP connection pool: %u connections open (%u-%u)",
+		 pool->open, pool->min, pool->connections);
+	for (i = 0; i < pool->connections; i++) {
+		ldap_conn = pool->conns[i];
+		if (ldap_conn == NULL)
+			continue;
+		log_info("LDAP connection %u: used %u times, waited %"
+			 ISC_PRINT_QUADFORMAT "u ms (maximum %"
+			 ISC_PRINT_QUADFORMAT "u ms), in use %"
+			 ISC_PRINT_QUADFORMAT "u ms, average latency %"
+			 ISC_PRINT_QUADFORMAT "u ms, %u errors, %u reconnects",
+			 i, ldap_conn->uses, ldap_conn->wait_time / 1000,
+			 ldap_conn->wait_max / 1000, ldap_conn->use_time / 1000,
+			 ldap_conn->latency_avg / 1000, ldap_conn->errors,
+			 ldap_conn->reconnects);
+	}
+	UNLOCK(&pool->lock);
+}
+
+/**
+ * Open a new connection to the LDAP server.
+ *
+ * @param[in] connected ISC_TRUE if the connection is useful only if
+ *                      the LDAP server is reachable right now.
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-ldap_pool_getconnection(ldap_pool_t *pool, ldap_connection_t ** conn)
+ldap_pool_open(ldap_pool_t *pool, isc_boolean_t connected,
+	       ldap_connection_t **ldap_connp)
 {
+	isc_result_t result;
 	ldap_connection_t *ldap_conn = NULL;
+
+	CHECK(new_ldap_connection(pool, &ldap_conn));
+	result = ldap_connect(pool->inst, ldap_conn, ISC_FALSE);
+	/* Continue even if LDAP server is down */
+	if (result == ISC_R_SUCCESS ||
+	    (connected == ISC_FALSE &&
+	     (result == ISC_R_NOTCONNECTED || result == ISC_R_TIMEDOUT))) {
+		RUNTIME_CHECK(isc_time_now(&ldap_conn->released)
+			      == ISC_R_SUCCESS);
+		*ldap_connp = ldap_conn;
+		return ISC_R_SUCCESS;
+	}
+
+cleanup:
+	destroy_ldap_connection(&ldap_conn);
+	return result;
+}
+
+/**
+ * Store connection to a free slot in the pool.
+ *
+ * @pre Caller holds pool->lock and the pool has a free slot.
+ */
+static void ATTR_NONNULLS
+ldap_pool_insert(ldap_pool_t *pool, ldap_connection_t *ldap_conn)
+{
 	unsigned int i;
+
+	for (i = 0; i < pool->connections; i++) {
+		if (pool->conns[i] == NULL)
+			break;
+	}
+	INSIST(i < pool->connections);
+	pool->conns[i] = ldap_conn;
+	pool->open++;
+}
+
+/**
+ * Take a connection from the list of idle connections. Connected
+ * connections with the lowest average latency are preferred, ties go to the
+ * least recently used connection.
+ *
+ * @pre Caller holds pool->lock and the list of idle connections is not empty.
+ */
+static ldap_connection_t * ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_pool_takeidle(ldap_pool_t *pool)
+{
+	ldap_connection_t *ldap_conn;
+	ldap_connection_t *best;
+
+	best = ISC_LIST_HEAD(pool->idle);
+	INSIST(best != NULL);
+	for (ldap_conn = ISC_LIST_NEXT(best, link);
+	     ldap_conn != NULL;
+	     ldap_conn = ISC_LIST_NEXT(ldap_conn, link)) {
+		if (ldap_conn->handle == NULL)
+			continue;
+		if (best->handle == NULL ||
+		    ldap_conn->latency_avg < best->latency_avg)
+			best = ldap_conn;
+	}
+	ISC_LIST_UNLINK(pool->idle, best, link);
+
+	return best;
+}
+
+/**
+ * Get a connection from the pool.
+ *
+ * A caller which does not get an idle connection within pool_grow_wait
+ * opens a new connection if the pool has less than 'connections'
+ * connections. Other callers keep waiting for connections returned
+ * to the pool in the meantime.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_pool_getconnection(ldap_pool_t *pool, ldap_connection_t ** conn)
+{
+	ldap_connection_t *ldap_conn = NULL;
+	isc_time_t start;
+	isc_time_t abs_timeout;
+	isc_time_t grow_time;
+	isc_time_t *deadline;
+	isc_boolean_t grow = ISC_TRUE;
+	isc_uint64_t wait;
 	isc_result_t result;
 
 	REQUIRE(pool != NULL);
 	REQUIRE(conn != NULL && *conn == NULL);
-	ldap_conn = *conn;
 
-	CHECK(semaphore_wait_timed(&pool->conn_semaphore, &conn_wait_timeout));
-	/* Following assertion is necessary to convince clang static analyzer
-	 * that the loop is always entered. */
-	REQUIRE(pool->connections > 0);
-	for (i = 0; i < pool->connections; i++) {
-		ldap_conn = pool->conns[i];
-		if (isc_mutex_trylock(&ldap_conn->lock) == ISC_R_SUCCESS)
-			break;
+	CHECK(isc_time_now(&start));
+	CHECK(isc_time_add(&start, &conn_wait_timeout, &abs_timeout));
+	CHECK(isc_time_add(&start, &pool_grow_wait, &grow_time));
+
+	LOCK(&pool->lock);
+	while (ldap_conn == NULL && ISC_LIST_EMPTY(pool->idle)) {
+		if (grow == ISC_TRUE &&
+		    pool->open + pool->opening < pool->connections)
+			deadline = &grow_time;
+		else
+			deadline = &abs_timeout;
+
+		pool->waiting++;
+		result = WAITUNTIL(&pool->cond, &pool->lock, deadline);
+		pool->waiting--;
+		if (result == ISC_R_SUCCESS || !ISC_LIST_EMPTY(pool->idle))
+			continue;
+		if (deadline == &abs_timeout) {
+			UNLOCK(&pool->lock);
+			goto cleanup;
+		}
+
+		/* Open one connection at most, the bind can take a while. */
+		grow = ISC_FALSE;
+		if (pool->open + pool->opening >= pool->connections)
+			continue;
+		pool->opening++;
+		UNLOCK(&pool->lock);
+		result = ldap_pool_open(pool, ISC_TRUE, &ldap_conn);
+		LOCK(&pool->lock);
+		pool->opening--;
+		if (result == ISC_R_SUCCESS) {
+			ldap_pool_insert(pool, ldap_conn);
+			log_debug(1, "LDAP connection pool grown to %u "
+				  "connections", pool->open);
+		} else {
+			log_error_r("failed to open additional LDAP "
+				    "connection");
+			ldap_conn = NULL;
+		}
 	}
+	if (ldap_conn == NULL)
+		ldap_conn = ldap_pool_takeidle(pool);
 
-	RUNTIME_CHECK(ldap_conn != NULL);
+	if (isc_time_now(&ldap_conn->acquired) != ISC_R_SUCCESS)
+		ldap_conn->acquired = start;
+	wait = isc_time_microdiff(&ldap_conn->acquired, &start);
+	ldap_conn->uses++;
+	ldap_conn->wait_time += wait;
+	if (wait > ldap_conn->wait_max)
+		ldap_conn->wait_max = wait;
+	UNLOCK(&pool->lock);
 
 	*conn = ldap_conn;
+	result = ISC_R_SUCCESS;
 
 cleanup:
 	if (result != ISC_R_SUCCESS) {
 		log_error("timeout in ldap_pool_getconnection(): try to raise "
 				"'connections' parameter; potential deadlock?");
+		ldap_pool_log(pool);
 	}
 	return result;
 }
@@ -3642,16 +5883,114 @@ ldap_pool_putconnection(ldap_pool_t *pool, ldap_connection_t **conn)
 {
 	REQUIRE(conn != NULL);
 	ldap_connection_t *ldap_conn = *conn;
+	isc_time_t now;
+	isc_uint64_t used = 0;
 
 	if (ldap_conn == NULL)
 		return;
 
-	UNLOCK(&ldap_conn->lock);
-	semaphore_signal(&pool->conn_semaphore);
+	if (isc_time_now(&now) == ISC_R_SUCCESS) {
+		used = isc_time_microdiff(&now, &ldap_conn->acquired);
+		ldap_conn->released = now;
+	}
+
+	LOCK(&pool->lock);
+	ldap_conn->use_time += used;
+	/* Exponential moving average with weight 1/8 for the last use. */
+	if (ldap_conn->uses <= 1)
+		ldap_conn->latency_avg = used;
+	else
+		ldap_conn->latency_avg = ldap_conn->latency_avg
+					 - ldap_conn->latency_avg / 8
+					 + used / 8;
+	ldap_conn->errors += ldap_conn->new_errors;
+	ldap_conn->reconnects += ldap_conn->new_reconnects;
+	ldap_conn->new_errors = 0;
+	ldap_conn->new_reconnects = 0;
+
+	ISC_LIST_APPEND(pool->idle, ldap_conn, link);
+	if (pool->waiting > 0)
+		SIGNAL(&pool->cond);
+	UNLOCK(&pool->lock);
 
 	*conn = NULL;
 }
 
+/**
+ * Find out if a connection can be taken from the pool without waiting
+ * and without delaying other threads waiting for a connection.
+ */
+static isc_boolean_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_pool_hasidle(ldap_pool_t *pool)
+{
+	isc_boolean_t hasidle;
+
+	LOCK(&pool->lock);
+	hasidle = ISC_TF(!ISC_LIST_EMPTY(pool->idle) && pool->waiting == 0);
+	UNLOCK(&pool->lock);
+
+	return hasidle;
+}
+
+/**
+ * Close connections which were idle for more than 'connection_idle_timeout'
+ * seconds. At least 'connections_min' connections are kept open.
+ */
+static void ATTR_NONNULLS
+ldap_pool_reap(ldap_pool_t *pool)
+{
+	ldap_connection_t *ldap_conn;
+	ldap_connection_t *next;
+	ISC_LIST(ldap_connection_t) closed;
+	isc_time_t now;
+	unsigned int i;
+
+	if (pool->idle_timeout == 0 || isc_time_now(&now) != ISC_R_SUCCESS)
+		return;
+
+	ISC_LIST_INIT(closed);
+	LOCK(&pool->lock);
+	/* Idle list is ordered by time when connections were returned. */
+	for (ldap_conn = ISC_LIST_HEAD(pool->idle);
+	     ldap_conn != NULL && pool->open > pool->min;
+	     ldap_conn = next) {
+		next = ISC_LIST_NEXT(ldap_conn, link);
+		if (isc_time_microdiff(&now, &ldap_conn->released)
+		    < (isc_uint64_t)pool->idle_timeout * 1000000)
+			break;
+
+		ISC_LIST_UNLINK(pool->idle, ldap_conn, link);
+		for (i = 0; i < pool->connections; i++) {
+			if (pool->conns[i] == ldap_conn)
+				pool->conns[i] = NULL;
+		}
+		pool->open--;
+		ISC_LIST_APPEND(closed, ldap_conn, link);
+	}
+	UNLOCK(&pool->lock);
+
+	while ((ldap_conn = ISC_LIST_HEAD(closed)) != NULL) {
+		ISC_LIST_UNLINK(closed, ldap_conn, link);
+		log_debug(1, "closing LDAP connection idle for more than "
+			  "%u seconds", pool->idle_timeout);
+		destroy_ldap_connection(&ldap_conn);
+	}
+}
+
+static void ATTR_NONNULLS
+ldap_pool_reap_action(isc_task_t *task, isc_event_t *event)
+{
+	ldap_instance_t *inst = event->ev_arg;
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+	ldap_pool_reap(inst->pool);
+}
+
+/**
+ * Open 'connections_min' connections.
+ */
 static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
 ldap_pool_connect(ldap_pool_t *pool, ldap_instance_t *ldap_inst)
 {
@@ -3659,25 +5998,23 @@ ldap_pool_connect(ldap_pool_t *pool, ldap_instance_t *ldap_inst)
 	ldap_connection_t *ldap_conn;
 	unsigned int i;
 
-	for (i = 0; i < pool->connections; i++) {
+	pool->inst = ldap_inst;
+	for (i = 0; i < pool->min; i++) {
 		ldap_conn = NULL;
-		CHECK(new_ldap_connection(pool, &ldap_conn));
-		result = ldap_connect(ldap_inst, ldap_conn, ISC_FALSE);
-		/* Continue even if LDAP server is down */
-		if (result != ISC_R_NOTCONNECTED && result != ISC_R_TIMEDOUT &&
-		    result != ISC_R_SUCCESS) {
-			goto cleanup;
-		}
-		pool->conns[i] = ldap_conn;
+		CHECK(ldap_pool_open(pool, ISC_FALSE, &ldap_conn));
+		ldap_pool_insert(pool, ldap_conn);
+		ISC_LIST_APPEND(pool->idle, ldap_conn, link);
 	}
 
 	return ISC_R_SUCCESS;
 
 cleanup:
 	log_error_r("couldn't establish connection in LDAP connection pool");
+	ISC_LIST_INIT(pool->idle);
 	for (i = 0; i < pool->connections; i++) {
 		destroy_ldap_connection(&pool->conns[i]);
 	}
+	pool->open = 0;
 	return result;
 }
 
@@ -3720,6 +6057,7 @@ update_zone(isc_task_t *task, isc_event_t *event)
 
 	if (SYNCREPL_DEL(pevent->chgtype)) {
 		CHECK(ldap_delete_zone2(inst, &entry->fqdn, ISC_TRUE));
+		zone_snapshot_remove(inst, &entry->fqdn);
 	} else {
 		if (entry->class & LDAP_ENTRYCLASS_MASTER)
 			CHECK(ldap_parse_master_zoneentry(entry, NULL, inst,
@@ -3732,7 +6070,7 @@ update_zone(isc_task_t *task, isc_event_t *event)
 	}
 
 cleanup:
-	sync_concurr_limit_signal(inst->sctx);
+	sync_concurr_limit_signal(inst->sctx, pevent);
 	sync_event_signal(inst->sctx, pevent);
 	if (dns_name_dynamic(&prevname))
 		dns_name_free(&prevname, inst->mctx);
@@ -3766,7 +6104,7 @@ update_config(isc_task_t * task, isc_event_t *event)
 	CHECK(ldap_parse_configentry(entry, inst));
 
 cleanup:
-	sync_concurr_limit_signal(inst->sctx);
+	sync_concurr_limit_signal(inst->sctx, pevent);
 	sync_event_signal(inst->sctx, pevent);
 
 	if (result != ISC_R_SUCCESS)
@@ -3796,7 +6134,7 @@ update_serverconfig(isc_task_t * task, isc_event_t *event)
 	CHECK(ldap_parse_serverconfigentry(entry, inst));
 
 cleanup:
-	sync_concurr_limit_signal(inst->sctx);
+	sync_concurr_limit_signal(inst->sctx, pevent);
 	sync_event_signal(inst->sctx, pevent);
 
 	if (result != ISC_R_SUCCESS)
@@ -3811,32 +6149,60 @@ cleanup:
 }
 
 /**
- * @brief Update record in cache.
+ * Record change received from LDAP which waits for application
+ * to the zone database.
+ */
+typedef struct record_update record_update_t;
+struct record_update {
+	ldap_syncreplevent_t	*pevent;
+	ldapdb_rdatalist_t	rdatalist;
+	isc_boolean_t		pending;
+};
+
+/**
+ * @brief Apply a batch of record changes to a single zone.
  *
- * If it exists it is replaced with newer version.
+ * All changes share one new version of the zone database. In sync_finished
+ * state and for zones served from snapshot the whole batch is covered by
+ * single SOA serial increment, single journal transaction and single serial
+ * write-back to LDAP.
  *
- * @param task Task indentifier.
- * @param event Internal data of type ldap_syncreplevent_t.
+ * Changes are applied in the order they were received from LDAP so
+ * each change sees results of all previous changes in the batch.
+ *
+ * During initial synchronization records for names which do not exist
+ * in the zone yet are added directly in load mode without any diff,
+ * see ldapdb_bulkload_add().
+ *
+ * @param[in] zone_name Name of the zone all changes belong to.
+ * @param[in] updates   Array of parsed changes. Only pending changes are
+ *                      applied, applied changes are not pending anymore
+ *                      if they were added in load mode.
+ * @param[in] count     Number of changes in the array.
  */
-static void ATTR_NONNULLS
-update_record(isc_task_t *task, isc_event_t *event)
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+update_record_batch(ldap_instance_t *inst, dns_name_t *zone_name,
+		    record_update_t *updates, unsigned int count)
 {
-	/* syncrepl event */
-	ldap_syncreplevent_t *pevent = (ldap_syncreplevent_t *)event;
 	isc_result_t result;
-	ldap_instance_t *inst = pevent->inst;
-	isc_mem_t *mctx;
-	settings_set_t *zone_settings = NULL;
+	isc_mem_t *mctx = inst->mctx;
 	dns_zone_t *raw = NULL;
 	dns_zone_t *secure = NULL;
 	isc_boolean_t zone_found = ISC_FALSE;
 	isc_boolean_t zone_reloaded = ISC_FALSE;
 	isc_uint32_t serial;
-	ldap_entry_t *entry = pevent->entry;
+	ldap_syncreplevent_t *pevent = NULL;
+	ldap_entry_t *entry = NULL;
+	unsigned int i;
+	unsigned int pending;
+	isc_boolean_t bulkload;
+	isc_boolean_t served;
 
 	dns_db_t *rbtdb = NULL;
 	dns_db_t *ldapdb = NULL;
 	dns_diff_t diff;
+	dns_diff_t entry_diff;
+	dns_difftuple_t *tuple = NULL;
 
 	dns_dbversion_t *version = NULL; /* version is shared between rbtdb and ldapdb */
 	dns_dbnode_t *node = NULL; /* node is shared between rbtdb and ldapdb */
@@ -3844,105 +6210,101 @@ update_record(isc_task_t *task, isc_event_t *event)
 
 	sync_state_t sync_state;
 
-	mctx = pevent->mctx;
-	dns_diff_init(mctx, &diff);
-
-#ifdef RBTDB_DEBUG
-	static unsigned int count = 0;
-#endif
-
-	/* Structure to be stored in the cache. */
-	ldapdb_rdatalist_t rdatalist;
-	INIT_LIST(rdatalist);
+	REQUIRE(count > 0);
 
-	/* Convert domain name from text to struct dns_name_t. */
-	dns_name_t prevname;
-	dns_name_t prevorigin;
-	dns_name_init(&prevname, NULL);
-	dns_name_init(&prevorigin, NULL);
+	dns_diff_init(mctx, &diff);
+	dns_diff_init(mctx, &entry_diff);
 
-	REQUIRE(inst != NULL);
-	CHECK(zr_get_zone_ptr(inst->zone_register, &entry->zone_name, &raw, &secure));
+	CHECK(zr_get_zone_ptr(inst->zone_register, zone_name, &raw, &secure));
 	zone_found = ISC_TRUE;
 
 update_restart:
 	rbtdb = NULL;
 	ldapdb = NULL;
-	zone_settings = NULL;
-	ldapdb_rdatalist_destroy(mctx, &rdatalist);
-	CHECK(zr_get_zone_dbs(inst->zone_register, &entry->zone_name, &ldapdb, &rbtdb));
-	CHECK(dns_db_newversion(ldapdb, &version));
-
-	CHECK(dns_db_findnode(rbtdb, &entry->fqdn, ISC_TRUE, &node));
-	result = dns_db_allrdatasets(rbtdb, node, version, 0, &rbt_rds_iterator);
-	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
-		goto cleanup;
-
-
-	/* This code is disabled because we don't have UUID->DN database yet.
-	    || SYNCREPL_MODDN(pevent->chgtype)) { */
-	if (SYNCREPL_DEL(pevent->chgtype)) {
-		log_debug(5, "syncrepl_update: removing name from rbtdb, "
-			  "%s", ldap_entry_logname(entry));
-		/* Do nothing. rdatalist is initialized to empty list,
-		 * so resulting diff will remove all the data from node. */
+	CHECK(zr_get_zone_dbs(inst->zone_register, zone_name, &ldapdb, &rbtdb));
+	sync_state_get(inst->sctx, &sync_state);
+	/* Load mode is used only for a leading run of changes so all changes
+	 * applied using diff are still applied after the loaded ones.
+	 * Zones served from snapshot are never modified in load mode. */
+	bulkload = ISC_TF(sync_state == sync_datainit &&
+			  !zone_isserved(raw, sync_state));
+	pending = 0;
+	for (i = 0; i < count; i++) {
+		pevent = updates[i].pevent;
+		if (updates[i].pending == ISC_FALSE)
+			continue;
+		if (bulkload == ISC_TRUE && !SYNCREPL_DEL(pevent->chgtype)) {
+			result = ldapdb_bulkload_add(ldapdb, &pevent->entry->fqdn,
+						     &updates[i].rdatalist);
+			if (result == ISC_R_SUCCESS) {
+				updates[i].pending = ISC_FALSE;
+				continue;
+			} else if (result != ISC_R_IGNORE &&
+				   result != ISC_R_EXISTS) {
+				/* Partially loaded data will be fixed by diff. */
+				log_debug(1, "bulk load failed for %s: %s",
+					  ldap_entry_logname(pevent->entry),
+					  isc_result_totext(result));
+			}
+		}
+		bulkload = ISC_FALSE;
+		pending++;
+		if (!SYNCREPL_DEL(pevent->chgtype))
+			CHECK(ldapdb_provisional_confirm(ldapdb,
+							 &pevent->entry->fqdn));
 	}
+	if (pending == 0)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	CHECK(dns_db_newversion(ldapdb, &version));
 
-	/* TODO: double check correctness before replacing ldap_query() with
-	 *       data from *event */
-	/* This code is disabled because we don't have UUID->DN database yet.
-	if (SYNCREPL_MODDN(pevent->chgtype)) {
-		// remove previous name only if it was inside DNS subtree //
-		if (dn_to_dnsname(mctx, pevent->prevdn, &prevname, &prevorigin)
-				== ISC_R_SUCCESS) {
-			log_debug(5, "syncrepl_update: removing name from cache, dn: '%s'",
-					  pevent->prevdn);
-			cache = NULL;
-			zone = NULL;
-			rbtdb = NULL;
-			CHECK(zr_get_zone_ptr(inst->zone_register, &prevname, &zone));
-			result = dns_zone_getdb(zone, &rbtdb);
-			REQUIRE(result == ISC_R_SUCCESS);
-
-			result = zr_get_zone_cache(inst->zone_register, &prevname, &cache);
-			if (result == ISC_R_SUCCESS)
-				CHECK(discard_from_cache(cache, &prevname));
-			else if (result != ISC_R_NOTFOUND)
-				goto cleanup;
-
-		} else {
-			log_debug(5, "syncrepl_update: old name wasn't managed "
-					"by plugin, dn '%s'", pevent->prevdn);
+	for (i = 0; i < count; i++) {
+		if (updates[i].pending == ISC_FALSE)
+			continue;
+		pevent = updates[i].pevent;
+		entry = pevent->entry;
+
+		if (SYNCREPL_DEL(pevent->chgtype)) {
+			log_debug(5, "syncrepl_update: removing name from rbtdb, "
+				  "%s", ldap_entry_logname(entry));
+			/* Do nothing. rdatalist is initialized to empty list,
+			 * so resulting diff will remove all the data from node. */
 		}
-	}
-	*/
 
-	if (SYNCREPL_ADD(pevent->chgtype) || SYNCREPL_MOD(pevent->chgtype)) {
-		/* Parse new data from LDAP. */
-		log_debug(5, "syncrepl_update: updating name in rbtdb, "
-			  "%s", ldap_entry_logname(entry));
-		CHECK(zr_get_zone_settings(inst->zone_register,
-					   &entry->zone_name, &zone_settings));
-		CHECK(ldap_parse_rrentry(mctx, entry, &entry->zone_name,
-					 zone_settings, &rdatalist));
-	}
+		CHECK(dns_db_findnode(rbtdb, &entry->fqdn, ISC_TRUE, &node));
+		result = dns_db_allrdatasets(rbtdb, node, version, 0,
+					     &rbt_rds_iterator);
+		if (result == ISC_R_SUCCESS) {
+			CHECK(diff_ldap_rbtdb(mctx, &entry->fqdn,
+					      &updates[i].rdatalist,
+					      rbt_rds_iterator, &entry_diff));
+			dns_rdatasetiter_destroy(&rbt_rds_iterator);
+		} else if (result != ISC_R_NOTFOUND) {
+			goto cleanup;
+		}
+		dns_db_detachnode(rbtdb, &node);
 
-	if (rbt_rds_iterator != NULL) {
-		CHECK(diff_ldap_rbtdb(mctx, &entry->fqdn, &rdatalist,
-				      rbt_rds_iterator, &diff));
-		dns_rdatasetiter_destroy(&rbt_rds_iterator);
+		/* Subsequent changes in the batch have to see this one. */
+		CHECK(dns_diff_apply(&entry_diff, rbtdb, version));
+		while ((tuple = HEAD(entry_diff.tuples)) != NULL) {
+			ISC_LIST_UNLINK(entry_diff.tuples, tuple, link);
+			dns_diff_appendminimal(&diff, &tuple);
+		}
 	}
 
 	sync_state_get(inst->sctx, &sync_state);
+	served = zone_isserved(raw, sync_state);
 	/* No real change in RR data -> do not increment SOA serial. */
 	if (HEAD(diff.tuples) != NULL) {
-		if (sync_state == sync_finished) {
+		if (served == ISC_TRUE) {
 			CHECK(zone_soaserial_addtuple(mctx, ldapdb, version,
-						      &diff, &serial));
+						      &entry_diff, &serial));
+			CHECK(dns_diff_apply(&entry_diff, rbtdb, version));
+			ISC_LIST_APPENDLIST(diff.tuples, entry_diff.tuples,
+					    link);
 			dns_zone_log(raw, ISC_LOG_DEBUG(5),
 				     "writing new zone serial %u to LDAP",
 				     serial);
-			result = ldap_replace_serial(inst, &entry->zone_name, serial);
+			result = ldap_serial_writeback(inst, zone_name, serial);
 			if (result != ISC_R_SUCCESS)
 				dns_zone_log(raw, ISC_LOG_ERROR,
 					     "serial (%u) write back to LDAP failed",
@@ -3954,28 +6316,23 @@ update_restart:
 #else
 		dns_diff_print(&diff, NULL);
 #endif
-		if (sync_state == sync_finished) {
+		if (served == ISC_TRUE) {
 			/* write the transaction to journal */
 			CHECK(zone_journal_adddiff(inst->mctx, raw, &diff));
 		}
 		/* commit */
-		CHECK(dns_diff_apply(&diff, rbtdb, version));
 		dns_db_closeversion(ldapdb, &version, ISC_TRUE);
 		dns_zone_markdirty(raw);
 	}
 
 	/* Check if the zone is loaded or not.
 	 * No other function above returns DNS_R_NOTLOADED. */
-	if (sync_state == sync_finished)
+	if (served == ISC_TRUE)
 		result = dns_zone_getserial2(raw, &serial);
 
 cleanup:
-#ifdef RBTDB_DEBUG
-	if (++count % 100 == 0)
-		log_info("update_record: %u entries processed; inuse: %zd",
-			 count, isc_mem_inuse(mctx));
-#endif
 	dns_diff_clear(&diff);
+	dns_diff_clear(&entry_diff);
 	if (rbt_rds_iterator != NULL)
 		dns_rdatasetiter_destroy(&rbt_rds_iterator);
 	if (node != NULL)
@@ -3989,6 +6346,7 @@ cleanup:
 		dns_db_detach(&ldapdb);
 	if (result != ISC_R_SUCCESS && zone_found && !zone_reloaded &&
 	   (result == DNS_R_NOTLOADED || result == DNS_R_BADZONE)) {
+		entry = updates[0].pevent->entry;
 		dns_zone_log(raw, ISC_LOG_DEBUG(1),
 			     "reloading invalid zone after a change; "
 			     "reload triggered by change in %s",
@@ -3999,7 +6357,7 @@ cleanup:
 			result = load_zone(raw, ISC_TRUE);
 		if (result == ISC_R_SUCCESS || result == DNS_R_UPTODATE ||
 		    result == DNS_R_DYNAMIC || result == DNS_R_CONTINUE) {
-			/* zone reload succeeded, fire current event again */
+			/* zone reload succeeded, apply current batch again */
 			log_debug(1, "restarting update_record after zone reload "
 				     "caused by change in %s",
 				     ldap_entry_logname(entry));
@@ -4014,31 +6372,317 @@ cleanup:
 				    ldap_entry_logname(entry),
 				    dns_result_totext(result));
 		}
-
-	} else if (result != ISC_R_SUCCESS) {
-		/* error other than invalid zone */
-		log_error_r("update_record (syncrepl) failed, %s change type "
-			    "0x%x. Records can be outdated, run `rndc reload`",
-			    ldap_entry_logname(entry), pevent->chgtype);
 	}
 
-	sync_concurr_limit_signal(inst->sctx);
-	if (dns_name_dynamic(&prevname))
-		dns_name_free(&prevname, inst->mctx);
-	if (dns_name_dynamic(&prevorigin))
-		dns_name_free(&prevorigin, inst->mctx);
+	if (raw != NULL)
+		dns_zone_detach(&raw);
+	if (secure != NULL)
+		dns_zone_detach(&secure);
+	return result;
+}
+
+/**
+ * Release record change and the event which carried it.
+ * Each event holds a reference to the task it was sent to.
+ */
+static void ATTR_NONNULLS
+update_record_free(isc_task_t *task, record_update_t *update) {
+	ldap_syncreplevent_t *pevent = update->pevent;
+	ldap_instance_t *inst = pevent->inst;
+	isc_mem_t *mctx = pevent->mctx;
+	isc_event_t *event = (isc_event_t *)pevent;
+#ifdef RBTDB_DEBUG
+	static unsigned int count = 0;
+
+	if (++count % 100 == 0)
+		log_info("update_record: %u entries processed; inuse: %zd",
+			 count, isc_mem_inuse(mctx));
+#endif
 
-	if (raw != NULL)
-		dns_zone_detach(&raw);
-	if (secure != NULL)
-		dns_zone_detach(&secure);
-	ldapdb_rdatalist_destroy(mctx, &rdatalist);
+	sync_concurr_limit_signal(inst->sctx, pevent);
+	ldapdb_rdatalist_destroy(mctx, &update->rdatalist);
 	if (pevent->prevdn != NULL)
 		isc_mem_free(mctx, pevent->prevdn);
-	ldap_entry_destroy(&entry);
+	ldap_entry_destroy(&pevent->entry);
 	isc_mem_detach(&mctx);
 	isc_event_free(&event);
 	isc_task_detach(&task);
+	update->pevent = NULL;
+}
+
+/**
+ * Drop queued changes which are superseded by a newer change
+ * of the same LDAP entry (entryUUID) for the same DNS name in the same zone.
+ * Each change carries complete state of the entry so applying only
+ * the newest one gives the same result.
+ *
+ * Changes for the same entry with different DNS names or zones (i.e. rename)
+ * are kept because each of them modifies different node. Zone tasks can be
+ * shared by multiple zones so the zone has to be compared, too.
+ */
+static void ATTR_NONNULLS
+update_record_coalesce(isc_task_t *task, ldap_instance_t *inst,
+		       isc_eventlist_t *events)
+{
+	isc_result_t result;
+	dns_rbt_t *newest = NULL;
+	dns_rbtnode_t *node = NULL;
+	isc_event_t *event = NULL;
+	isc_event_t *prev = NULL;
+	ldap_syncreplevent_t *pevent = NULL;
+	ldap_syncreplevent_t *newer = NULL;
+	struct berval *uuid = NULL;
+	record_update_t superseded;
+	unsigned int dropped = 0;
+
+	if (HEAD(*events) == ISC_LIST_TAIL(*events))
+		return;
+
+	CHECK(dns_rbt_create(inst->mctx, NULL, NULL, &newest));
+	/* Walk from the newest change to the oldest one. */
+	for (event = ISC_LIST_TAIL(*events); event != NULL; event = prev) {
+		prev = ISC_LIST_PREV(event, ev_link);
+		pevent = (ldap_syncreplevent_t *)event;
+		uuid = pevent->entry->uuid;
+		if (uuid == NULL)
+			continue;
+
+		node = NULL;
+		result = dns_rbt_findnode(newest, &pevent->entry->fqdn, NULL,
+					  &node, NULL, 0, NULL, NULL);
+		if (result == ISC_R_SUCCESS) {
+			newer = node->data;
+			if (dns_name_equal(&newer->entry->zone_name,
+					   &pevent->entry->zone_name) &&
+			    newer->entry->uuid->bv_len == uuid->bv_len &&
+			    memcmp(newer->entry->uuid->bv_val, uuid->bv_val,
+				   uuid->bv_len) == 0) {
+				log_debug(5, "update_record: change type 0x%x "
+					  "for %s superseded by newer change",
+					  pevent->chgtype,
+					  ldap_entry_logname(pevent->entry));
+				ISC_LIST_UNLINK(*events, event, ev_link);
+				superseded.pevent = pevent;
+				INIT_LIST(superseded.rdatalist);
+				update_record_free(task, &superseded);
+				dropped++;
+				continue;
+			}
+			node->data = pevent;
+		} else {
+			CHECK(dns_rbt_addname(newest, &pevent->entry->fqdn,
+					      pevent));
+		}
+	}
+
+cleanup:
+	if (newest != NULL)
+		dns_rbt_destroy(&newest);
+	if (result != ISC_R_SUCCESS)
+		log_debug(1, "update_record: unable to coalesce changes: %s",
+			  isc_result_totext(result));
+	else if (dropped > 0)
+		log_debug(1, "update_record: %u superseded changes dropped",
+			  dropped);
+}
+
+/**
+ * Keep DN cache in the zone register consistent with LDAP. Names of
+ * deleted entries are dropped. DNs of changed entries replace DNs computed
+ * from owner names. Initial synchronization does not fill the cache,
+ * it is filled by writes to LDAP.
+ */
+static void ATTR_NONNULLS
+ldap_update_owner_dn(ldap_instance_t *inst, dns_name_t *zone_name,
+		     ldap_syncreplevent_t *pevent, sync_state_t sync_state)
+{
+	isc_result_t result;
+	ldap_entry_t *entry = pevent->entry;
+
+	if (dns_name_equal(&entry->fqdn, zone_name))
+		return;
+
+	if (SYNCREPL_DEL(pevent->chgtype)) {
+		zr_del_owner_dn(inst->zone_register, zone_name, &entry->fqdn);
+	} else if (sync_state == sync_finished && entry->dn != NULL) {
+		result = zr_set_owner_dn(inst->zone_register, zone_name,
+					 &entry->fqdn, entry->dn, ISC_TRUE);
+		if (result != ISC_R_SUCCESS)
+			log_debug(1, "unable to cache DN of %s: %s",
+				  ldap_entry_logname(entry),
+				  isc_result_totext(result));
+	}
+}
+
+/**
+ * Parse and apply up to record_batch_size changes belonging to the same
+ * zone as the first event in the list. Processed events are removed
+ * from the list and freed, order of the remaining events is preserved.
+ *
+ * If the batch as a whole cannot be applied the changes are applied
+ * one by one so a single bad change does not block the others.
+ */
+static void ATTR_NONNULLS
+update_record_chunk(isc_task_t *task, ldap_instance_t *inst,
+		    isc_eventlist_t *events, isc_uint32_t batch_size)
+{
+	isc_result_t result;
+	isc_result_t settings_result;
+	isc_mem_t *mctx = inst->mctx;
+	record_update_t single;
+	record_update_t *updates = NULL;
+	unsigned int count = 0;
+	unsigned int i;
+	isc_event_t *event = NULL;
+	isc_event_t *next = NULL;
+	ldap_syncreplevent_t *pevent = NULL;
+	settings_set_t *zone_settings = NULL;
+	ldap_parsectx_t *pctx = NULL;
+	sync_state_t sync_state;
+	DECLARE_BUFFERED_NAME(zone_name);
+
+	INIT_BUFFERED_NAME(zone_name);
+	pevent = (ldap_syncreplevent_t *)HEAD(*events);
+	dns_name_copy(&pevent->entry->zone_name, &zone_name, NULL);
+
+	for (event = HEAD(*events);
+	     event != NULL && count < batch_size;
+	     event = NEXT(event, ev_link)) {
+		pevent = (ldap_syncreplevent_t *)event;
+		if (dns_name_equal(&pevent->entry->zone_name, &zone_name))
+			count++;
+	}
+
+	updates = isc_mem_get(mctx, count * sizeof(*updates));
+	if (updates == NULL) {
+		/* Fall back to one change at a time. */
+		updates = &single;
+		count = 1;
+	}
+
+	i = 0;
+	for (event = HEAD(*events); event != NULL && i < count; event = next) {
+		next = NEXT(event, ev_link);
+		pevent = (ldap_syncreplevent_t *)event;
+		if (!dns_name_equal(&pevent->entry->zone_name, &zone_name))
+			continue;
+		ISC_LIST_UNLINK(*events, event, ev_link);
+		updates[i].pevent = pevent;
+		INIT_LIST(updates[i].rdatalist);
+		updates[i].pending = ISC_FALSE;
+		i++;
+	}
+	INSIST(i == count);
+
+	/* Parse new data from LDAP before a new version of zone database
+	 * is opened. The open version would block all other writers
+	 * to the zone database for no reason. */
+	settings_result = zr_get_zone_settings(inst->zone_register, &zone_name,
+					       &zone_settings);
+	/* One parsing context serves all changes in the batch. */
+	if (settings_result == ISC_R_SUCCESS)
+		settings_result = ldap_parsectx_get(inst->parsectx_pool, &pctx);
+	sync_state_get(inst->sctx, &sync_state);
+	for (i = 0; i < count; i++) {
+		pevent = updates[i].pevent;
+		ldap_update_owner_dn(inst, &zone_name, pevent, sync_state);
+		result = settings_result;
+		if (result == ISC_R_SUCCESS &&
+		    (SYNCREPL_ADD(pevent->chgtype) ||
+		     SYNCREPL_MOD(pevent->chgtype))) {
+			log_debug(5, "syncrepl_update: updating name in rbtdb, "
+				  "%s", ldap_entry_logname(pevent->entry));
+			result = ldap_parse_rrentry(mctx, pctx, pevent->entry,
+						    &zone_name, zone_settings,
+						    inst->tmpl_deps,
+						    &updates[i].rdatalist);
+		}
+		if (result == ISC_R_SUCCESS)
+			updates[i].pending = ISC_TRUE;
+		else
+			log_error_r("update_record (syncrepl) failed, %s change "
+				    "type 0x%x. Records can be outdated, "
+				    "run `rndc reload`",
+				    ldap_entry_logname(pevent->entry),
+				    pevent->chgtype);
+	}
+	ldap_parsectx_put(inst->parsectx_pool, &pctx);
+
+	if (settings_result == ISC_R_SUCCESS) {
+		result = update_record_batch(inst, &zone_name, updates, count);
+		if (result != ISC_R_SUCCESS && count > 1) {
+			log_debug(1, "update_record: batch of %u changes "
+				  "failed, applying changes one by one", count);
+			for (i = 0; i < count; i++) {
+				if (updates[i].pending == ISC_FALSE)
+					continue;
+				result = update_record_batch(inst, &zone_name,
+							     &updates[i], 1);
+				if (result != ISC_R_SUCCESS)
+					log_error_r("update_record (syncrepl) "
+						    "failed, %s change type "
+						    "0x%x. Records can be "
+						    "outdated, run `rndc reload`",
+						    ldap_entry_logname(
+							updates[i].pevent->entry),
+						    updates[i].pevent->chgtype);
+			}
+		} else if (result != ISC_R_SUCCESS) {
+			log_error_r("update_record (syncrepl) failed, %s change "
+				    "type 0x%x. Records can be outdated, "
+				    "run `rndc reload`",
+				    ldap_entry_logname(updates[0].pevent->entry),
+				    updates[0].pevent->chgtype);
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		update_record_free(task, &updates[i]);
+	if (updates != &single)
+		isc_mem_put(mctx, updates, count * sizeof(*updates));
+}
+
+/**
+ * @brief Update records in cache.
+ *
+ * Record changes queued in the task at the time of the call are processed
+ * together, up to the first other event from LDAP. Changes behind a sync
+ * barrier are left in the task so the barrier is not passed before all
+ * changes sent in front of it are applied. Only the newest change for each
+ * entry and DNS name is applied, see update_record_coalesce(). Changes are
+ * grouped per zone and each group is applied to the zone database in batches
+ * of record_batch_size changes. Relative order of changes within a zone
+ * is preserved.
+ *
+ * @param task Task indentifier.
+ * @param event Internal data of type ldap_syncreplevent_t.
+ */
+static void ATTR_NONNULLS
+update_record(isc_task_t *task, isc_event_t *event)
+{
+	ldap_syncreplevent_t *pevent = (ldap_syncreplevent_t *)event;
+	ldap_instance_t *inst = pevent->inst;
+	isc_eventlist_t events;
+	isc_uint32_t batch_size;
+	isc_result_t result;
+
+	REQUIRE(inst != NULL);
+
+	ISC_LIST_INIT(events);
+	ISC_LIST_APPEND(events, event, ev_link);
+	/* Pick up record changes waiting in this task in front of
+	 * any other event from LDAP, e.g. a sync barrier. */
+	sync_event_unsendhead(inst->sctx, task, LDAPDB_EVENT_SYNCREPL_RECORD,
+			      &events);
+	update_record_coalesce(task, inst, &events);
+
+	result = setting_get_uint("record_batch_size", inst->local_settings,
+				  &batch_size);
+	if (result != ISC_R_SUCCESS || batch_size == 0)
+		batch_size = 1;
+
+	while (!EMPTY(events))
+		update_record_chunk(task, inst, &events, batch_size);
 }
 
 isc_result_t
@@ -4161,7 +6805,9 @@ syncrepl_update(ldap_instance_t *inst, ldap_entry_t **entryp, int chgtype)
 	}
 
 	pevent = (ldap_syncreplevent_t *)isc_event_allocate(inst->mctx,
-				inst, LDAPDB_EVENT_SYNCREPL_UPDATE,
+				inst->sctx, (action == update_record) ?
+					LDAPDB_EVENT_SYNCREPL_RECORD :
+					LDAPDB_EVENT_SYNCREPL_UPDATE,
 				action, NULL,
 				sizeof(ldap_syncreplevent_t));
 
@@ -4176,6 +6822,7 @@ syncrepl_update(ldap_instance_t *inst, ldap_entry_t **entryp, int chgtype)
 	pevent->prevdn = NULL;
 	pevent->chgtype = chgtype;
 	pevent->entry = entry;
+	pevent->size = ldap_entry_size(entry);
 
 	/* Lock syncrepl queue to prevent zone, config and resource records
 	 * from racing with each other. */
@@ -4190,7 +6837,6 @@ cleanup:
 			    ldap_entry_logname(entry));
 	if (pevent != NULL) {
 		/* Event was not sent */
-		sync_concurr_limit_signal(inst->sctx);
 		if (pevent->mctx != NULL)
 			isc_mem_detach(&pevent->mctx);
 		ldap_entry_destroy(entryp);
@@ -4270,6 +6916,352 @@ ldap_sync_search_reference (
 	return LDAP_SUCCESS;
 }
 
+/**
+ * Remove SyncRepl cookie stored in LDAP instance so the next data
+ * synchronization will not be incremental.
+ */
+static void ATTR_NONNULLS
+ldap_sync_cookie_drop(ldap_instance_t *inst) {
+	ber_memfree(inst->sync_cookie.bv_val);
+	BER_BVZERO(&inst->sync_cookie);
+}
+
+/**
+ * Replace SyncRepl cookie stored in LDAP instance with a copy of given cookie.
+ * Stored cookie is removed if the new cookie is empty.
+ */
+static void ATTR_NONNULLS
+ldap_sync_cookie_store(ldap_instance_t *inst, struct berval *cookie) {
+	ldap_sync_cookie_drop(inst);
+
+	if (cookie->bv_val == NULL)
+		return;
+
+	if (ber_dupbv(&inst->sync_cookie, cookie) == NULL) {
+		BER_BVZERO(&inst->sync_cookie);
+		log_error("unable to store SyncRepl cookie: next data "
+			  "synchronization will not be incremental");
+	}
+}
+
+/**
+ * Mark entry which was reported as unchanged by LDAP server as alive in
+ * current metaLDAP generation, i.e. prevent its deletion in dead node
+ * detection after refreshDone.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_sync_entry_present(ldap_instance_t *inst, struct berval *entryUUID) {
+	isc_result_t result;
+
+	inst->sync_presents = ISC_TRUE;
+
+	CHECK(mldap_newversion(inst->mldapdb));
+	result = mldap_entry_present(inst->mldapdb, entryUUID);
+	mldap_closeversion(inst->mldapdb, ISC_TF(result == ISC_R_SUCCESS));
+	if (result == ISC_R_NOTFOUND)
+		log_error("entry reported as unchanged by LDAP server "
+			  "is not known to instance '%s': "
+			  "rndc reload might be necessary", inst->db_name);
+
+cleanup:
+	return result;
+}
+
+/**
+ * Get DN of LDAP entry represented by metaLDAP node. DNs received from LDAP
+ * are preferred, DNs of other entries are computed from their names.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_deps_entry_dn(ldap_instance_t *inst, mldap_node_t *node,
+		   ld_string_t *dn) {
+	isc_result_t result;
+	ldap_entryclass_t class;
+	const char *zone_dn = NULL;
+	DECLARE_BUFFERED_NAME(fqdn);
+	DECLARE_BUFFERED_NAME(zone_name);
+
+	INIT_BUFFERED_NAME(fqdn);
+	INIT_BUFFERED_NAME(zone_name);
+
+	CHECK(mldap_class_get(node, &class));
+	CHECK(mldap_dnsname_get(node, &fqdn, &zone_name));
+	if ((class & LDAP_ENTRYCLASS_MASTER) != 0) {
+		CHECK(zr_get_zone_dn(inst->zone_register, &fqdn, &zone_dn));
+		str_clear(dn);
+		CHECK(str_cat_char(dn, zone_dn));
+	} else {
+		result = zr_get_owner_dn(inst->zone_register, &zone_name,
+					 &fqdn, dn);
+		if (result == ISC_R_NOTFOUND)
+			result = dnsname_to_dn(inst->zone_register, &fqdn,
+					       &zone_name, dn);
+	}
+
+cleanup:
+	return result;
+}
+
+/**
+ * Re-read one entry which depends on changed settings from LDAP
+ * and append it to entries which wait for ldap_deps_send().
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_deps_refresh_entry(ldap_instance_t *inst, ldap_connection_t *conn,
+			struct berval *uuid, deps_entry_list_t *entries) {
+	isc_result_t result;
+	int ret;
+	char *attrs[] = { "*", NULL };
+	LDAPMessage *res = NULL;
+	LDAPMessage *msg;
+	mldap_node_t *node = NULL;
+	ld_string_t *dn = NULL;
+	ldap_entry_t *entry = NULL;
+
+	result = mldap_entry_read(inst->mldapdb, uuid, &node);
+	if (result == ISC_R_NOTFOUND) {
+		/* entry was deleted in the meantime */
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	} else if (result != ISC_R_SUCCESS) {
+		goto cleanup;
+	}
+	CHECK(str_new(inst->mctx, &dn));
+	CHECK(ldap_deps_entry_dn(inst, node, dn));
+
+	ret = ldap_search_ext_s(conn->handle, str_buf(dn), LDAP_SCOPE_BASE,
+				"(objectClass=*)", attrs, 0, NULL, NULL,
+				NULL, LDAP_NO_LIMIT, &res);
+	if (ret == LDAP_NO_SUCH_OBJECT) {
+		/* deletion is handled by syncrepl */
+		log_debug(5, "entry '%s' depending on settings was deleted",
+			  str_buf(dn));
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	} else if (ret != LDAP_SUCCESS) {
+		log_ldap_error(conn->handle, "unable to read entry '%s'",
+			       str_buf(dn));
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+	msg = ldap_first_entry(conn->handle, res);
+	if (msg == NULL)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+
+	CHECK(ldap_entry_parse(inst->mctx, conn->handle, msg, uuid, &entry));
+	APPEND(*entries, entry, link);
+	entry = NULL;
+
+cleanup:
+	if (result != ISC_R_SUCCESS)
+		log_error_r("unable to read entry '%s' after "
+			    "settings change: records can be outdated, "
+			    "run `rndc reload`",
+			    (dn != NULL) ? str_buf(dn) : "<unknown entry>");
+	ldap_entry_destroy(&entry);
+	str_destroy(&dn);
+	mldap_node_close(&node);
+	if (res != NULL)
+		ldap_msgfree(res);
+	return result;
+}
+
+/**
+ * Send entries re-read by ldap_deps_refresh_entry() to their zones like
+ * modifications received from syncrepl.
+ *
+ * The connection is returned to the pool before waiting for free space
+ * in the syncrepl queue. Zone tasks which drain the queue can need
+ * a connection from the pool to write their changes to LDAP.
+ */
+static void ATTR_NONNULLS
+ldap_deps_send(ldap_instance_t *inst, ldap_connection_t **connp,
+	       deps_entry_list_t *entries) {
+	isc_result_t result = ISC_R_SUCCESS;
+	ldap_entry_t *entry;
+	unsigned int failed = 0;
+
+	ldap_pool_putconnection(inst->pool, connp);
+	while ((entry = HEAD(*entries)) != NULL) {
+		UNLINK(*entries, entry, link);
+		/* do not wait for the queue again during shutdown */
+		if (result == ISC_R_SUCCESS)
+			result = sync_concurr_limit_wait(inst->sctx);
+		if (result != ISC_R_SUCCESS ||
+		    syncrepl_update(inst, &entry, LDAP_SYNC_CAPI_MODIFY)
+		    != ISC_R_SUCCESS)
+			failed++;
+		ldap_entry_destroy(&entry);
+	}
+	if (failed > 0)
+		log_error("unable to update records from %u entries after "
+			  "settings change: records can be outdated, "
+			  "run `rndc reload`", failed);
+}
+
+/**
+ * Find out if records of metaLDAP node depend on changed default TTL
+ * of a zone or on changed fake_mname.
+ */
+static isc_boolean_t ATTR_NONNULLS
+ldap_deps_inherits(mldap_node_t *node, deps_zone_list_t *zones,
+		   isc_boolean_t mname) {
+	ldap_entryclass_t class;
+	deps_zone_t *depszone;
+	DECLARE_BUFFERED_NAME(fqdn);
+	DECLARE_BUFFERED_NAME(zone_name);
+
+	INIT_BUFFERED_NAME(fqdn);
+	INIT_BUFFERED_NAME(zone_name);
+
+	if (mldap_class_get(node, &class) != ISC_R_SUCCESS)
+		return ISC_FALSE;
+	/* SOA record of zone entry is rendered again when the zone entry
+	 * is processed, including its default TTL */
+	if ((class & LDAP_ENTRYCLASS_MASTER) != 0)
+		return mname;
+	if ((class & LDAP_ENTRYCLASS_RR) == 0 || EMPTY(*zones) ||
+	    mldap_defaultttl_get(node) == ISC_FALSE)
+		return ISC_FALSE;
+	if (mldap_dnsname_get(node, &fqdn, &zone_name) != ISC_R_SUCCESS)
+		return ISC_FALSE;
+
+	for (depszone = HEAD(*zones);
+	     depszone != NULL;
+	     depszone = NEXT(depszone, link)) {
+		if (dns_name_equal(dns_fixedname_name(&depszone->name),
+				   &zone_name))
+			return ISC_TRUE;
+	}
+	return ISC_FALSE;
+}
+
+/**
+ * Render again records from entries which depend on settings changed
+ * by configuration or zone object update:
+ * - entries with templates which use changed substitution variables,
+ *   recorded in dependency index;
+ * - entries without own TTL in zones with changed default TTL
+ *   and zone entries after change of fake_mname, found in metaLDAP.
+ * Only these entries are re-read from LDAP, records in all other entries
+ * stay untouched. Updates of records are batched per zone
+ * by update_record(). Entries are re-read in batches of LDAP_DEPS_BATCH
+ * and the pooled connection is released before a batch is queued,
+ * see ldap_deps_send().
+ *
+ * It has to be called from the syncrepl watcher thread after the
+ * configuration event was processed, i.e. in the same order
+ * as other changes received from LDAP.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ldap_deps_refresh(ldap_instance_t *inst) {
+	isc_result_t result;
+	isc_ht_t *uuids = NULL;
+	isc_ht_iter_t *iter = NULL;
+	mldap_iter_t *mldap_iter = NULL;
+	mldap_node_t *node = NULL;
+	ldap_connection_t *conn = NULL;
+	deps_zone_list_t zones;
+	deps_zone_t *depszone;
+	deps_entry_list_t entries;
+	ldap_entry_t *entry;
+	unsigned int pending = 0;
+	isc_boolean_t mname;
+	unsigned char *key;
+	size_t key_len;
+	char uuid_buf[16];
+	struct berval uuid = { .bv_len = sizeof(uuid_buf),
+			       .bv_val = uuid_buf };
+
+	INIT_LIST(zones);
+	INIT_LIST(entries);
+	LOCK(&inst->deps_lock);
+	ISC_LIST_APPENDLIST(zones, inst->deps_zones, link);
+	mname = inst->deps_mname;
+	inst->deps_mname = ISC_FALSE;
+	UNLOCK(&inst->deps_lock);
+
+	result = rrtemplate_deps_pending(inst->tmpl_deps, &uuids);
+	if (result == ISC_R_NOTFOUND && EMPTY(zones) && mname == ISC_FALSE)
+		return ISC_R_SUCCESS;
+	else if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
+		goto cleanup;
+
+	if (uuids != NULL) {
+		log_debug(1, "substitution variables changed: rendering "
+			  "templates in %u entries again",
+			  isc_ht_count(uuids));
+		CHECK(isc_ht_iter_create(uuids, &iter));
+		for (result = isc_ht_iter_first(iter);
+		     result == ISC_R_SUCCESS;
+		     result = isc_ht_iter_next(iter)) {
+			if (inst->exiting)
+				CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+			isc_ht_iter_currentkey(iter, &key, &key_len);
+			if (key_len != uuid.bv_len)
+				continue;
+			memcpy(uuid.bv_val, key, key_len);
+			if (conn == NULL)
+				CHECK(ldap_pool_getconnection(inst->pool,
+							      &conn));
+			(void)ldap_deps_refresh_entry(inst, conn, &uuid,
+						      &entries);
+			if (++pending >= LDAP_DEPS_BATCH) {
+				ldap_deps_send(inst, &conn, &entries);
+				pending = 0;
+			}
+		}
+		if (result != ISC_R_NOMORE)
+			goto cleanup;
+		ldap_deps_send(inst, &conn, &entries);
+		pending = 0;
+	}
+
+	if (EMPTY(zones) && mname == ISC_FALSE)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+
+	log_debug(1, "default TTL or fake_mname changed: updating records "
+		  "which inherited them");
+	for (result = mldap_iter_entries_start(inst->mldapdb, &mldap_iter,
+					       &node);
+	     result == ISC_R_SUCCESS;
+	     result = mldap_iter_entries_next(inst->mldapdb, &mldap_iter,
+					      &node)) {
+		if (inst->exiting)
+			CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+		if (ldap_deps_inherits(node, &zones, mname) == ISC_TRUE) {
+			mldap_uuid_get(node, &uuid);
+			if (conn == NULL)
+				CHECK(ldap_pool_getconnection(inst->pool,
+							      &conn));
+			(void)ldap_deps_refresh_entry(inst, conn, &uuid,
+						      &entries);
+			if (++pending >= LDAP_DEPS_BATCH) {
+				ldap_deps_send(inst, &conn, &entries);
+				pending = 0;
+			}
+		}
+		mldap_node_close(&node);
+	}
+	if (result == ISC_R_NOMORE)
+		result = ISC_R_SUCCESS;
+	ldap_deps_send(inst, &conn, &entries);
+
+cleanup:
+	mldap_node_close(&node);
+	mldap_iter_destroy(&mldap_iter);
+	if (iter != NULL)
+		isc_ht_iter_destroy(&iter);
+	if (uuids != NULL)
+		isc_ht_destroy(&uuids);
+	while ((depszone = HEAD(zones)) != NULL) {
+		UNLINK(zones, depszone, link);
+		SAFE_MEM_PUT_PTR(inst->mctx, depszone);
+	}
+	while ((entry = HEAD(entries)) != NULL) {
+		UNLINK(entries, entry, link);
+		ldap_entry_destroy(&entry);
+	}
+	ldap_pool_putconnection(inst->pool, &conn);
+	return result;
+}
+
 /*
  * Called when an entry is returned by ldap_sync_init()/ldap_sync_poll().
  * If phase is LDAP_SYNC_CAPI_ADD or LDAP_SYNC_CAPI_MODIFY,
@@ -4277,6 +7269,9 @@ ldap_sync_search_reference (
  * the complete view of the entry should be in the LDAPMessage.
  * If phase is LDAP_SYNC_CAPI_PRESENT or LDAP_SYNC_CAPI_DELETE,
  * only the DN should be in the LDAPMessage.
+ *
+ * LDAP_SYNC_CAPI_PRESENT is returned only for refresh resumed from a cookie
+ * and it marks entry which did not change since the cookie was issued.
  */
 int ldap_sync_search_entry (
 	ldap_sync_t			*ls,
@@ -4288,21 +7283,31 @@ int ldap_sync_search_entry (
 	ldap_entry_t *old_entry = NULL;
 	ldap_entry_t *new_entry = NULL;
 	isc_result_t result;
-	metadb_node_t *node = NULL;
+	mldap_node_t *node = NULL;
 	isc_boolean_t mldap_open = ISC_FALSE;
 	isc_boolean_t modrdn = ISC_FALSE;
+	isc_boolean_t synchronous = ISC_FALSE;
 
 #ifdef RBTDB_DEBUG
 	static unsigned int count = 0;
 #endif
 
-	if (inst->exiting)
+	if (inst->exiting) {
+		/* cookie received with this entry must not be stored */
+		inst->sync_skipped = ISC_TRUE;
 		return LDAP_SUCCESS;
+	}
 
-	CHECK(mldap_newversion(inst->mldapdb));
-	mldap_open = ISC_TRUE;
+	if (phase == LDAP_SYNC_CAPI_PRESENT) {
+		/* entry did not change since the cookie was issued */
+		result = ldap_sync_entry_present(inst, entryUUID);
+		if (result != ISC_R_SUCCESS) {
+			log_error_r("ldap_sync_search_entry failed");
+			inst->sync_skipped = ISC_TRUE;
+		}
+		return LDAP_SUCCESS;
+	}
 
-	CHECK(sync_concurr_limit_wait(inst->sctx));
 	log_debug(20, "ldap_sync_search_entry phase: %x", phase);
 
 	/* MODIFY can be rename: get old name from metaDB */
@@ -4339,10 +7344,19 @@ int ldap_sync_search_entry (
 					ldap_entry_logname(new_entry));
 		}
 	}
+
+	/* Entry is parsed before waiting for a free slot so parsing overlaps
+	 * with processing of already queued events in zone tasks. */
+	CHECK(sync_concurr_limit_wait(inst->sctx));
+	CHECK(mldap_newversion(inst->mldapdb));
+	mldap_open = ISC_TRUE;
+
 	if (phase == LDAP_SYNC_CAPI_DELETE || modrdn == ISC_TRUE) {
 		/* delete old entry from zone and metaDB */
 		CHECK(syncrepl_update(inst, &old_entry, LDAP_SYNC_CAPI_DELETE));
 		CHECK(mldap_entry_delete(inst->mldapdb, entryUUID));
+		/* renamed entry records its templates again when parsed */
+		rrtemplate_deps_del(inst->tmpl_deps, entryUUID);
 	}
 	if (phase == LDAP_SYNC_CAPI_ADD || phase == LDAP_SYNC_CAPI_MODIFY) {
 		/* store new state into metaDB */
@@ -4353,13 +7367,21 @@ int ldap_sync_search_entry (
 			CHECK(mldap_dnsname_store(&new_entry->fqdn,
 						  &new_entry->zone_name, node));
 		/* commit new entry into metaLDAP DB before something breaks */
-		metadb_node_close(&node);
+		mldap_node_close(&node);
 		mldap_closeversion(inst->mldapdb, ISC_TRUE);
 		mldap_open = ISC_FALSE;
+		synchronous = ISC_TF((new_entry->class
+				      & (LDAP_ENTRYCLASS_CONFIG
+					 | LDAP_ENTRYCLASS_SERVERCONFIG
+					 | LDAP_ENTRYCLASS_MASTER)) != 0);
 		/* re-add entry under new DN, if necessary */
 		CHECK(syncrepl_update(inst, &new_entry,
 		                      (modrdn == ISC_TRUE)
 					      ? LDAP_SYNC_CAPI_ADD : phase));
+		/* configuration and zone objects were processed
+		 * synchronously so changed settings are in effect */
+		if (synchronous == ISC_TRUE)
+			CHECK(ldap_deps_refresh(inst));
 	}
 	if (phase != LDAP_SYNC_CAPI_ADD && phase != LDAP_SYNC_CAPI_MODIFY &&
 	    phase != LDAP_SYNC_CAPI_DELETE) {
@@ -4374,14 +7396,14 @@ int ldap_sync_search_entry (
 #endif
 
 cleanup:
-	metadb_node_close(&node);
+	mldap_node_close(&node);
 	if (mldap_open == ISC_TRUE)
 		/* commit metaDB changes if the syncrepl event was sent */
 		mldap_closeversion(inst->mldapdb, ISC_TF(result == ISC_R_SUCCESS));
 	if (result != ISC_R_SUCCESS) {
 		log_error_r("ldap_sync_search_entry failed");
-		sync_concurr_limit_signal(inst->sctx);
 		/* TODO: Add 'tainted' flag to the LDAP instance. */
+		inst->sync_skipped = ISC_TRUE;
 	}
 	ldap_entry_destroy(&old_entry);
 	ldap_entry_destroy(&new_entry);
@@ -4392,6 +7414,45 @@ cleanup:
 	return LDAP_SUCCESS;
 }
 
+/**
+ * Find out if syncInfo message which finished refresh stage belongs
+ * to present phase (RFC 4533 section 2.5), i.e. if all entries which
+ * were not reported as present or changed are deleted.
+ *
+ * OpenLDAP reports the final message as LDAP_SYNC_CAPI_DONE regardless
+ * of its phase so the message itself has to be inspected.
+ */
+static isc_boolean_t
+ldap_sync_msg_ispresent(LDAP *ld, LDAPMessage *msg) {
+	char *oid = NULL;
+	struct berval *data = NULL;
+	BerElement *ber = NULL;
+	ber_len_t len;
+	isc_boolean_t present = ISC_FALSE;
+
+	if (ld == NULL || msg == NULL)
+		return ISC_FALSE;
+	if (ldap_parse_intermediate(ld, msg, &oid, &data, NULL, 0)
+	    != LDAP_SUCCESS)
+		goto cleanup;
+	if (oid == NULL || strcmp(oid, LDAP_SYNC_INFO) != 0 || data == NULL)
+		goto cleanup;
+	ber = ber_init(data);
+	if (ber == NULL)
+		goto cleanup;
+	present = ISC_TF(ber_peek_tag(ber, &len)
+			 == LDAP_TAG_SYNC_REFRESH_PRESENT);
+
+cleanup:
+	if (ber != NULL)
+		ber_free(ber, 1);
+	if (data != NULL)
+		ber_bvfree(data);
+	if (oid != NULL)
+		ldap_memfree(oid);
+	return present;
+}
+
 /**
  * Called when specific intermediate/final messages are returned
  * by ldap_sync_init()/ldap_sync_poll().
@@ -4416,21 +7477,48 @@ int ldap_sync_intermediate (
 
 	isc_result_t	result;
 	ldap_instance_t *inst = ls->ls_private;
-	metadb_iter_t *mldap_iter = NULL;
+	mldap_iter_t *mldap_iter = NULL;
 	char entryUUID_buf[16];
 	struct berval entryUUID = { .bv_len = sizeof(entryUUID_buf),
 				    .bv_val = entryUUID_buf };
 	sync_state_t state;
-
-	UNUSED(msg);
-	UNUSED(syncUUIDs);
+	int i;
 
 	if (inst->exiting)
 		goto cleanup;
 
 	log_debug(1, "ldap_sync_intermediate 0x%x", phase);
-	if (phase != LDAP_SYNC_CAPI_DONE)
+	switch (phase) {
+	case LDAP_SYNC_CAPI_PRESENTS:
+		inst->sync_presents = ISC_TRUE;
+		goto cleanup;
+
+	case LDAP_SYNC_CAPI_PRESENTS_IDSET:
+	case LDAP_SYNC_CAPI_DELETES_IDSET:
+		for (i = 0;
+		     syncUUIDs != NULL && syncUUIDs[i].bv_val != NULL;
+		     i++) {
+			if (syncUUIDs[i].bv_len != sizeof(entryUUID_buf)) {
+				log_bug("syncUUIDs contain invalid UUID");
+				continue;
+			}
+			if (phase == LDAP_SYNC_CAPI_PRESENTS_IDSET)
+				ldap_sync_search_entry(ls, NULL, &syncUUIDs[i],
+						       LDAP_SYNC_CAPI_PRESENT);
+			else
+				ldap_sync_search_entry(ls, NULL, &syncUUIDs[i],
+						       LDAP_SYNC_CAPI_DELETE);
+		}
+		goto cleanup;
+
+	case LDAP_SYNC_CAPI_DONE:
+		if (ldap_sync_msg_ispresent(ls->ls_ld, msg) == ISC_TRUE)
+			inst->sync_presents = ISC_TRUE;
+		break;
+
+	default:
 		goto cleanup;
+	}
 
 	sync_state_get(inst->sctx, &state);
 	if (state == sync_datainit) {
@@ -4442,6 +7530,18 @@ int ldap_sync_intermediate (
 		}
 	}
 
+	/* Refresh resumed from a cookie might use refreshDeletes phase
+	 * where unchanged entries are not reported at all, i.e. entries
+	 * from older generations are not necessarily dead. Deleted entries
+	 * were reported explicitly in that case. Refresh in present phase
+	 * is detected from its messages, not from reported entries,
+	 * because no entry might be present at all. */
+	if (inst->sync_resumed == ISC_TRUE && inst->sync_presents == ISC_FALSE) {
+		log_debug(1, "refresh for instance '%s' reported only changes, "
+			  "skipping dead node detection", inst->db_name);
+		goto store_cookie;
+	}
+
 	for (result = mldap_iter_deadnodes_start(inst->mldapdb, &mldap_iter,
 						 &entryUUID);
 	     result == ISC_R_SUCCESS;
@@ -4451,8 +7551,20 @@ int ldap_sync_intermediate (
 				       LDAP_SYNC_CAPI_DELETE);
 
 	}
-	if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE)
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE) {
 		log_error_r("mldap_iter_deadnodes_* failed, run rndc reload");
+		goto cleanup;
+	}
+
+store_cookie:
+	/* All changes up to this point were processed so next reconnection
+	 * can continue from here. */
+	if (inst->sync_skipped == ISC_FALSE)
+		ldap_sync_cookie_store(inst, &ls->ls_cookie);
+	else
+		log_error("some entries from LDAP were not processed: next "
+			  "data synchronization for instance '%s' will not be "
+			  "incremental", inst->db_name);
 
 cleanup:
 	return LDAP_SUCCESS;
@@ -4482,11 +7594,18 @@ int ATTR_NONNULLS ATTR_CHECKRESULT ldap_sync_search_result (
 
 	/* This place can be reached only if:
 	 * a) initial config synchronization is done
-	 * b) config is re-synchronized after reconnect to LDAP */
+	 * b) config is re-synchronized after reconnect to LDAP
+	 * c) zones were fetched before resuming data synchronization
+	 *    from restored state, see ldap_syncrepl_watcher() */
 	sync_state_get(inst->sctx, &state);
-	INSIST(state == sync_configinit || state == sync_finished);
+	INSIST(state == sync_configinit || state == sync_datainit
+	       || state == sync_finished);
 
-	if (state == sync_configinit) {
+	if (state == sync_datainit) {
+		log_info("LDAP zones for instance '%s' synchronized",
+			 inst->db_name);
+		goto cleanup;
+	} else if (state == sync_configinit) {
 		result = sync_barrier_wait(inst->sctx, inst);
 		if (result != ISC_R_SUCCESS) {
 			log_error_r("%s: sync_barrier_wait() failed for "
@@ -4591,6 +7710,10 @@ cleanup:
  * @param[in]  mode          LDAP_SYNC_REFRESH_AND_PERSIST
  *                           or LDAP_SYNC_REFRESH_ONLY
  *
+ * LDAP_SYNC_REFRESH_AND_PERSIST session is resumed from the cookie stored
+ * by previous session (if any) so only changes are transferred after
+ * reconnection.
+ *
  * @retval ISC_R_SUCCESS      LDAP_SYNC_REFRESH_ONLY mode finished,
  *                            all events were sent (not necessarily processed)
  * @retval ISC_R_NOTCONNECTED Unable to start SyncRepl session.
@@ -4632,6 +7755,23 @@ ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
 		goto cleanup;
 	}
 
+	if (mode == LDAP_SYNC_REFRESH_AND_PERSIST) {
+		/* The cookie is handed over to this session. It will be stored
+		 * again only if this session reaches refreshDone,
+		 * so any failure before that leads to full refresh. */
+		if (inst->sync_skipped == ISC_TRUE)
+			ldap_sync_cookie_drop(inst);
+		inst->sync_skipped = ISC_FALSE;
+		inst->sync_resumed = ISC_TF(inst->sync_cookie.bv_val != NULL);
+		inst->sync_presents = ISC_FALSE;
+		ldap_sync->ls_cookie = inst->sync_cookie;
+		BER_BVZERO(&inst->sync_cookie);
+		if (inst->sync_resumed == ISC_TRUE)
+			log_info("resuming LDAP data synchronization "
+				 "for instance '%s' from stored cookie",
+				 inst->db_name);
+	}
+
 	ret = ldap_sync_init(ldap_sync, mode);
 	/* TODO: error handling, set tainted flag & do full reload? */
 	if (ret != LDAP_SUCCESS) {
@@ -4658,6 +7798,13 @@ ldap_sync_doit(ldap_instance_t *inst, ldap_connection_t *conn,
 	}
 
 cleanup:
+	/* Remember the latest cookie received in persist phase
+	 * unless it covers an entry which was not processed. */
+	if (inst->sync_skipped == ISC_TRUE)
+		ldap_sync_cookie_drop(inst);
+	else if (ldap_sync != NULL && mode == LDAP_SYNC_REFRESH_AND_PERSIST &&
+		 inst->sync_cookie.bv_val != NULL)
+		ldap_sync_cookie_store(inst, &ldap_sync->ls_cookie);
 	ldap_sync_cleanup(&ldap_sync);
 	return result;
 }
@@ -4697,6 +7844,7 @@ ldap_syncrepl_watcher(isc_threadarg_t arg)
 	CHECK(ldap_pool_getconnection(inst->pool, &conn));
 
 	while (!inst->exiting) {
+		inst->sync_skipped = ISC_FALSE;
 		sync_state_get(inst->sctx, &state);
 		if (state != sync_finished) {
 			sync_state_reset(inst->sctx);
@@ -4724,6 +7872,23 @@ ldap_syncrepl_watcher(isc_threadarg_t arg)
 		log_info("LDAP data for instance '%s' are being synchronized, "
 			 "please ignore message 'all zones loaded'",
 			 inst->db_name);
+		if (inst->sync_restored == ISC_TRUE) {
+			/* Unchanged entries are not sent again when resuming
+			 * from the restored cookie but zones and templates
+			 * have to be configured. Records are pre-loaded
+			 * from zone snapshots. */
+			inst->sync_restored = ISC_FALSE;
+			result = ldap_sync_doit(inst, conn,
+						"(objectClass=idnsZone)"
+						"(objectClass=idnsForwardZone)"
+						"(objectClass=idnsTemplateObject)",
+						LDAP_SYNC_REFRESH_ONLY);
+			if (result != ISC_R_SUCCESS) {
+				log_error_r("LDAP zone synchronization failed");
+				ldap_sync_cookie_drop(inst);
+				goto retry;
+			}
+		}
 		result = ldap_sync_doit(inst, conn,
 				        "(|(objectClass=idnsZone)"
 					"  (objectClass=idnsForwardZone)"
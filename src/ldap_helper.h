@@ -53,11 +53,12 @@ ldap_delete_zone2(ldap_instance_t *inst, dns_name_t *name, isc_boolean_t lock)
 
 /* Functions for writing to LDAP. */
 isc_result_t write_to_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst,
-		dns_rdatalist_t *rdlist) ATTR_NONNULLS;
+		dns_rdatalist_t *rdlist, ldap_modbatch_t *batch) ATTR_NONNULL(1,2,3,4);
 
 isc_result_t
 remove_values_from_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst,
-		dns_rdatalist_t *rdlist, isc_boolean_t delete_node) ATTR_NONNULLS;
+		dns_rdatalist_t *rdlist, isc_boolean_t delete_node,
+		ldap_modbatch_t *batch) ATTR_NONNULL(1,2,3,4);
 
 isc_result_t
 remove_rdtype_from_ldap(dns_name_t *owner, dns_name_t *zone,
@@ -67,6 +68,21 @@ remove_rdtype_from_ldap(dns_name_t *owner, dns_name_t *zone,
 isc_result_t
 remove_entry_from_ldap(dns_name_t *owner, dns_name_t *zone, ldap_instance_t *ldap_inst) ATTR_NONNULLS;
 
+isc_result_t
+ldap_modbatch_create(isc_mem_t *mctx, ldap_modbatch_t **batchp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+ldap_modbatch_destroy(ldap_modbatch_t **batchp) ATTR_NONNULLS;
+
+void
+ldap_modbatch_discard(ldap_modbatch_t *batch) ATTR_NONNULLS;
+
+isc_boolean_t
+ldap_modbatch_isempty(ldap_modbatch_t *batch) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+ldap_modbatch_flush(ldap_instance_t *ldap_inst, ldap_modbatch_t *batch) ATTR_NONNULLS ATTR_CHECKRESULT;
+
 isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
 ldap_mod_create(isc_mem_t *mctx, LDAPMod **changep);
 
@@ -3,60 +3,467 @@
  *
  * Meta-database for LDAP-specific information which are not represented in
  * DNS data.
+ *
+ * Entries are stored in open-addressing hash table keyed by raw LDAP entry
+ * UUID (RFC 4530). Each slot is a fixed-size record, only FQDN and zone name
+ * are allocated separately (in one piece) for entries which have them.
+ *
+ * Changes are staged in a version opened by mldap_newversion() and applied
+ * to the table by mldap_closeversion(commit = ISC_TRUE). Readers always see
+ * the committed state.
+ *
+ * Used slots are linked into one of two lists: 'seen' slots have the current
+ * generation number, 'unseen' slots have an older one. Generation bump
+ * appends all seen slots to the unseen list so dead node iteration
+ * visits only candidates for dead nodes.
  */
 
 #include <ldap.h>
+#include <limits.h>
 #include <stddef.h>
-#include <uuid/uuid.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <isc/boolean.h>
+#include <isc/buffer.h>
 #include <isc/int.h>
-#include <isc/net.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
 #include <isc/refcount.h>
 #include <isc/result.h>
+#include <isc/rwlock.h>
 #include <isc/util.h>
 #include <isc/serial.h>
+#include <isc/stdio.h>
 
-#include <dns/db.h>
-#include <dns/dbiterator.h>
-#include <dns/enumclass.h>
+#include <dns/compress.h>
+#include <dns/fixedname.h>
 #include <dns/name.h>
 #include <dns/types.h>
-#include <dns/update.h>
 
 #include "ldap_entry.h"
-#include "metadb.h"
 #include "mldap.h"
 #include "util.h"
 
-/* name "ldap.uuid." */
-static unsigned char uuid_rootname_ndata[]
-	= { 4, 'u', 'u', 'i', 'd', 4, 'l', 'd', 'a', 'p', 0 };
-static unsigned char uuid_rootname_offsets[] = { 0, 5, 10 };
-static dns_name_t uuid_rootname =
-{
-	DNS_NAME_MAGIC,
-	uuid_rootname_ndata,
-	sizeof(uuid_rootname_ndata),
-	sizeof(uuid_rootname_offsets),
-	DNS_NAMEATTR_READONLY | DNS_NAMEATTR_ABSOLUTE,
-	uuid_rootname_offsets,
-	NULL,
-	{ (void *)-1, (void *)-1 },
-	{ NULL, NULL }
+/* RFC 4530 section 2.1 format */
+#define MLDAP_UUID_LEN		16
+
+/* initial number of slots in the table, has to be power of 2 */
+#define MLDAP_TABLE_MINSIZE	1024
+
+/* end of slot list */
+#define MLDAP_NOSLOT		UINT_MAX
+
+/* size of fixed part of one entry in file written by mldap_dump():
+ * UUID, class, defaultttl, FQDN length and zone name length */
+#define MLDAP_DUMP_HDRLEN	(MLDAP_UUID_LEN + 4)
+
+typedef enum {
+	mldap_slot_empty = 0,
+	mldap_slot_used,
+	mldap_slot_deleted	/* tombstone, keeps probe sequences intact */
+} mldap_slotstate_t;
+
+/**
+ * Fixed-size metaLDAP record.
+ */
+typedef struct mldap_record {
+	unsigned char		uuid[MLDAP_UUID_LEN];
+	isc_uint32_t		generation;
+	/** Neighbors in seen or unseen list, valid only in used slots. */
+	unsigned int		prev;
+	unsigned int		next;
+	unsigned char		fqdn_len;
+	unsigned char		zone_len;
+	ldap_entryclass_t	class;
+	unsigned char		state;	/**< mldap_slotstate_t */
+	/** Entry has no dNSTTL so records use default TTL of the zone. */
+	unsigned char		defaultttl;
+	/** FQDN immediately followed by zone name, both in uncompressed wire
+	 *  format. NULL if the entry does not represent a DNS name. */
+	unsigned char		*names;
+} mldap_record_t;
+
+STATIC_ASSERT(DNS_NAME_MAXWIRE <= 255, \
+	      "DNS name length does not fit into mldap_record_t");
+
+typedef enum {
+	mldap_op_none = 0,	/**< read-only node */
+	mldap_op_store,		/**< create or replace whole record */
+	mldap_op_touch,		/**< update generation number only */
+	mldap_op_delete
+} mldap_op_t;
+
+/**
+ * Handle for one metaLDAP entry.
+ *
+ * Read-only nodes contain copy of committed record. Nodes for writing
+ * are staged in the open version and applied in the same order
+ * when the version is committed.
+ */
+struct mldap_node {
+	isc_mem_t		*mctx;
+	mldap_op_t		op;
+	mldap_record_t		record;
+	/** Storage for record.names in read-only nodes. */
+	unsigned char		namebuf[2 * DNS_NAME_MAXWIRE];
+	ISC_LINK(mldap_node_t)	link;
+};
+
+/**
+ * State of iteration over dead nodes.
+ */
+struct mldap_iter {
+	isc_mem_t		*mctx;
+	isc_uint32_t		generation;	/**< for sanity checks */
+	unsigned int		resizes;	/**< for sanity checks */
+	unsigned int		position;
 };
 
+/**
+ * Doubly linked list of used slots, linked by slot indices.
+ */
+typedef struct mldap_slotlist {
+	unsigned int		head;
+	unsigned int		tail;
+} mldap_slotlist_t;
+
 struct mldapdb {
-	isc_mem_t	*mctx;
-	metadb_t	*mdb;
-	isc_refcount_t	generation;
+	isc_mem_t		*mctx;
+	isc_refcount_t		generation;
+
+	/** Guards table and counters below. */
+	isc_rwlock_t		lock;
+	mldap_record_t		*table;
+	unsigned int		size;		/**< power of 2 */
+	unsigned int		count;		/**< used slots */
+	unsigned int		tombstones;	/**< deleted slots */
+	/** Slots promised to records staged in the open version. */
+	unsigned int		reserved;
+	/** Used slots with the current generation. */
+	mldap_slotlist_t	seen;
+	/** Used slots with generation older than the current one,
+	 *  i.e. candidates for dead node detection. */
+	mldap_slotlist_t	unseen;
+	unsigned int		resizes;
+
+	/**
+	 * Guard for newversion. Only one version can be open
+	 * for writing at any time. See functions newversion and closeversion.
+	 */
+	isc_mutex_t		newversion_lock;
+	ISC_LIST(mldap_node_t)	staged;
 };
 
 
+/**
+ * FNV-1a hash of raw UUID.
+ */
+static inline isc_uint32_t
+mldap_uuid_hash(const unsigned char *uuid) {
+	isc_uint32_t hash = 2166136261U;
+	unsigned int i;
+
+	for (i = 0; i < MLDAP_UUID_LEN; i++) {
+		hash ^= uuid[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/**
+ * Find slot with given UUID or the first free slot in its probe sequence.
+ *
+ * @retval ISC_R_SUCCESS  *slotp is used slot with given UUID.
+ * @retval ISC_R_NOTFOUND *slotp is the first empty or deleted slot
+ *                        where the UUID can be inserted.
+ *
+ * @pre Table is locked. At least one slot is empty.
+ */
+static isc_result_t
+mldap_table_find(mldapdb_t *mldap, const unsigned char *uuid,
+		 mldap_record_t **slotp) {
+	unsigned int mask = mldap->size - 1;
+	unsigned int i;
+	mldap_record_t *slot;
+	mldap_record_t *free_slot = NULL;
+
+	for (i = mldap_uuid_hash(uuid) & mask; ; i = (i + 1) & mask) {
+		slot = &mldap->table[i];
+		if (slot->state == mldap_slot_empty)
+			break;
+		if (slot->state == mldap_slot_deleted) {
+			if (free_slot == NULL)
+				free_slot = slot;
+			continue;
+		}
+		if (memcmp(slot->uuid, uuid, MLDAP_UUID_LEN) == 0) {
+			*slotp = slot;
+			return ISC_R_SUCCESS;
+		}
+	}
+
+	*slotp = (free_slot != NULL) ? free_slot : slot;
+	return ISC_R_NOTFOUND;
+}
+
+static void
+mldap_slotlist_init(mldap_slotlist_t *list) {
+	list->head = MLDAP_NOSLOT;
+	list->tail = MLDAP_NOSLOT;
+}
+
+/**
+ * Get list where a used slot with given generation number belongs.
+ */
+static mldap_slotlist_t *
+mldap_slotlist_get(mldapdb_t *mldap, isc_uint32_t generation) {
+	if (isc_serial_lt(generation, mldap_cur_generation_get(mldap)))
+		return &mldap->unseen;
+	return &mldap->seen;
+}
+
+/**
+ * Append used slot to the list for its generation.
+ *
+ * @pre Table is write-locked.
+ */
+static void
+mldap_slotlist_link(mldapdb_t *mldap, mldap_record_t *slot) {
+	mldap_slotlist_t *list = mldap_slotlist_get(mldap, slot->generation);
+	unsigned int idx = slot - mldap->table;
+
+	slot->prev = list->tail;
+	slot->next = MLDAP_NOSLOT;
+	if (list->tail == MLDAP_NOSLOT)
+		list->head = idx;
+	else
+		mldap->table[list->tail].next = idx;
+	list->tail = idx;
+}
+
+/**
+ * Remove used slot from the list for its generation.
+ *
+ * @pre Table is write-locked.
+ */
+static void
+mldap_slotlist_unlink(mldapdb_t *mldap, mldap_record_t *slot) {
+	mldap_slotlist_t *list = mldap_slotlist_get(mldap, slot->generation);
+
+	if (slot->prev == MLDAP_NOSLOT)
+		list->head = slot->next;
+	else
+		mldap->table[slot->prev].next = slot->next;
+	if (slot->next == MLDAP_NOSLOT)
+		list->tail = slot->prev;
+	else
+		mldap->table[slot->next].prev = slot->prev;
+}
+
+/**
+ * Re-hash all used records into a new table with newsize slots
+ * and drop all tombstones. Slot lists are rebuilt because
+ * slots move.
+ *
+ * @pre Table is write-locked.
+ */
+static isc_result_t
+mldap_table_resize(mldapdb_t *mldap, unsigned int newsize) {
+	isc_result_t result;
+	mldap_record_t *oldtable = mldap->table;
+	unsigned int oldsize = mldap->size;
+	mldap_record_t *slot = NULL;
+	unsigned int i;
+
+	CHECKED_MEM_GET(mldap->mctx, mldap->table, newsize * sizeof(*slot));
+	memset(mldap->table, 0, newsize * sizeof(*slot));
+	mldap->size = newsize;
+	mldap->tombstones = 0;
+	mldap->resizes++;
+	mldap_slotlist_init(&mldap->seen);
+	mldap_slotlist_init(&mldap->unseen);
+
+	for (i = 0; i < oldsize; i++) {
+		if (oldtable[i].state != mldap_slot_used)
+			continue;
+		INSIST(mldap_table_find(mldap, oldtable[i].uuid, &slot)
+		       == ISC_R_NOTFOUND);
+		*slot = oldtable[i];
+		mldap_slotlist_link(mldap, slot);
+	}
+	SAFE_MEM_PUT(mldap->mctx, oldtable, oldsize * sizeof(*slot));
+	return ISC_R_SUCCESS;
+
+cleanup:
+	mldap->table = oldtable;
+	return result;
+}
+
+/**
+ * Make sure that a record staged in the open version will have
+ * a free slot when the version is committed so commit cannot fail.
+ * Load factor including tombstones is kept under 3/4.
+ */
+static isc_result_t
+mldap_table_reserve(mldapdb_t *mldap) {
+	isc_result_t result = ISC_R_SUCCESS;
+	unsigned int needed;
+	unsigned int newsize;
+
+	RWLOCK(&mldap->lock, isc_rwlocktype_write);
+	needed = mldap->count + mldap->reserved + 1;
+	if ((needed + mldap->tombstones) * 4 > mldap->size * 3) {
+		/* grow only if tombstone removal would not be enough */
+		newsize = mldap->size;
+		while (needed * 2 > newsize)
+			newsize *= 2;
+		CHECK(mldap_table_resize(mldap, newsize));
+	}
+	mldap->reserved++;
+
+cleanup:
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_write);
+	return result;
+}
+
+/**
+ * Apply one staged change to the table.
+ *
+ * @pre Table is write-locked.
+ */
+static void
+mldap_table_apply(mldapdb_t *mldap, mldap_node_t *node) {
+	isc_result_t result;
+	mldap_record_t *slot = NULL;
+
+	result = mldap_table_find(mldap, node->record.uuid, &slot);
+	switch (node->op) {
+	case mldap_op_store:
+		if (result == ISC_R_SUCCESS) {
+			mldap_slotlist_unlink(mldap, slot);
+			SAFE_MEM_PUT(mldap->mctx, slot->names,
+				     slot->fqdn_len + slot->zone_len);
+		} else {
+			if (slot->state == mldap_slot_deleted)
+				mldap->tombstones--;
+			mldap->count++;
+		}
+		*slot = node->record;
+		slot->state = mldap_slot_used;
+		mldap_slotlist_link(mldap, slot);
+		/* names are owned by the table from now on */
+		node->record.names = NULL;
+		break;
+
+	case mldap_op_touch:
+		/* entry could have been deleted earlier in the same version */
+		if (result != ISC_R_SUCCESS)
+			break;
+		mldap_slotlist_unlink(mldap, slot);
+		slot->generation = node->record.generation;
+		mldap_slotlist_link(mldap, slot);
+		break;
+
+	case mldap_op_delete:
+		if (result != ISC_R_SUCCESS)
+			break;
+		mldap_slotlist_unlink(mldap, slot);
+		SAFE_MEM_PUT(mldap->mctx, slot->names,
+			     slot->fqdn_len + slot->zone_len);
+		ZERO_PTR(slot);
+		slot->state = mldap_slot_deleted;
+		mldap->count--;
+		mldap->tombstones++;
+		break;
+
+	default:
+		INSIST(0);
+	}
+}
+
+static isc_result_t
+mldap_node_new(mldapdb_t *mldap, const unsigned char *uuid, mldap_op_t op,
+	       mldap_node_t **nodep) {
+	isc_result_t result;
+	mldap_node_t *node = NULL;
+
+	CHECKED_MEM_GET_PTR(mldap->mctx, node);
+	ZERO_PTR(node);
+	isc_mem_attach(mldap->mctx, &node->mctx);
+	ISC_LINK_INIT(node, link);
+	node->op = op;
+	memcpy(node->record.uuid, uuid, MLDAP_UUID_LEN);
+
+	*nodep = node;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+static void
+mldap_node_free(mldap_node_t **nodep) {
+	mldap_node_t *node = *nodep;
+
+	if (node == NULL)
+		return;
+
+	if (node->record.names != node->namebuf)
+		SAFE_MEM_PUT(node->mctx, node->record.names,
+			     node->record.fqdn_len + node->record.zone_len);
+	MEM_PUT_AND_DETACH(node);
+	*nodep = NULL;
+}
+
+/**
+ * Fill read-only node with copy of committed record.
+ *
+ * @pre Table is locked.
+ */
+static void
+mldap_node_copy(mldap_node_t *node, const mldap_record_t *slot) {
+	node->record = *slot;
+	if (slot->names != NULL) {
+		memcpy(node->namebuf, slot->names,
+		       slot->fqdn_len + slot->zone_len);
+		node->record.names = node->namebuf;
+	}
+}
+
+/**
+ * Release node obtained from mldap_entry_read() or mldap_entry_create().
+ * Changes done using the node will be applied when the version is closed.
+ */
+void
+mldap_node_close(mldap_node_t **nodep) {
+	REQUIRE(nodep != NULL);
+
+	if (*nodep == NULL)
+		return;
+
+	/* staged nodes are owned by the open version */
+	if ((*nodep)->op == mldap_op_none)
+		mldap_node_free(nodep);
+	*nodep = NULL;
+}
+
+static void
+mldap_staged_free(mldapdb_t *mldap) {
+	mldap_node_t *node;
+
+	while ((node = HEAD(mldap->staged)) != NULL) {
+		UNLINK(mldap->staged, node, link);
+		mldap_node_free(&node);
+	}
+}
+
 isc_result_t
 mldap_new(isc_mem_t *mctx, mldapdb_t **mldapp) {
 	isc_result_t result;
 	mldapdb_t *mldap = NULL;
+	isc_boolean_t lock_ready = ISC_FALSE;
+	isc_boolean_t mutex_ready = ISC_FALSE;
 
 	REQUIRE(mldapp != NULL && *mldapp == NULL);
 
@@ -65,13 +472,27 @@ mldap_new(isc_mem_t *mctx, mldapdb_t **mldapp) {
 	isc_mem_attach(mctx, &mldap->mctx);
 
 	CHECK(isc_refcount_init(&mldap->generation, 0));
-	CHECK(metadb_new(mctx, &mldap->mdb));
+	CHECK(isc_rwlock_init(&mldap->lock, 0, 0));
+	lock_ready = ISC_TRUE;
+	CHECK(isc_mutex_init(&mldap->newversion_lock));
+	mutex_ready = ISC_TRUE;
+	ISC_LIST_INIT(mldap->staged);
+	mldap_slotlist_init(&mldap->seen);
+	mldap_slotlist_init(&mldap->unseen);
+
+	CHECKED_MEM_GET(mctx, mldap->table,
+			MLDAP_TABLE_MINSIZE * sizeof(*mldap->table));
+	memset(mldap->table, 0, MLDAP_TABLE_MINSIZE * sizeof(*mldap->table));
+	mldap->size = MLDAP_TABLE_MINSIZE;
 
 	*mldapp = mldap;
 	return result;
 
 cleanup:
-	metadb_destroy(&mldap->mdb);
+	if (mutex_ready == ISC_TRUE)
+		DESTROYLOCK(&mldap->newversion_lock);
+	if (lock_ready == ISC_TRUE)
+		isc_rwlock_destroy(&mldap->lock);
 	MEM_PUT_AND_DETACH(mldap);
 	return result;
 }
@@ -79,6 +500,7 @@ cleanup:
 void
 mldap_destroy(mldapdb_t **mldapp) {
 	mldapdb_t *mldap;
+	unsigned int i;
 
 	REQUIRE(mldapp != NULL);
 
@@ -86,29 +508,75 @@ mldap_destroy(mldapdb_t **mldapp) {
 	if (mldap == NULL)
 		return;
 
-	metadb_destroy(&mldap->mdb);
+	mldap_staged_free(mldap);
+	for (i = 0; i < mldap->size; i++)
+		if (mldap->table[i].state == mldap_slot_used)
+			SAFE_MEM_PUT(mldap->mctx, mldap->table[i].names,
+				     mldap->table[i].fqdn_len
+				     + mldap->table[i].zone_len);
+	SAFE_MEM_PUT(mldap->mctx, mldap->table,
+		     mldap->size * sizeof(*mldap->table));
+	DESTROYLOCK(&mldap->newversion_lock);
+	isc_rwlock_destroy(&mldap->lock);
 	MEM_PUT_AND_DETACH(mldap);
 
 	*mldapp = NULL;
 }
 
+/**
+ * Open new metaLDAP version for writing.
+ * Only one version can be open at any time.
+ */
 isc_result_t
 mldap_newversion(mldapdb_t *mldap) {
-	return metadb_newversion(mldap->mdb);
+	if (isc_mutex_trylock(&mldap->newversion_lock) != ISC_R_SUCCESS) {
+		log_bug("mldap newversion_lock is not open");
+		LOCK(&mldap->newversion_lock);
+	}
+	INSIST(EMPTY(mldap->staged));
+
+	return ISC_R_SUCCESS;
 }
 
+/**
+ * Close writeable metaLDAP version and commit/discard all changes.
+ */
 void
 mldap_closeversion(mldapdb_t *mldap, isc_boolean_t commit) {
-	return metadb_closeversion(mldap->mdb, commit);
+	mldap_node_t *node;
+
+	RWLOCK(&mldap->lock, isc_rwlocktype_write);
+	if (commit == ISC_TRUE)
+		for (node = HEAD(mldap->staged);
+		     node != NULL;
+		     node = NEXT(node, link))
+			mldap_table_apply(mldap, node);
+	mldap->reserved = 0;
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_write);
+
+	mldap_staged_free(mldap);
+	UNLOCK(&mldap->newversion_lock);
 }
 
 /**
  * Atomically increment MetaLDAP generation number.
+ * All existing entries become candidates for dead node detection.
  */
 void mldap_cur_generation_bump(mldapdb_t *mldap) {
 	REQUIRE(mldap != NULL);
 
+	RWLOCK(&mldap->lock, isc_rwlocktype_write);
 	isc_refcount_increment0(&mldap->generation, NULL);
+	/* append seen list to unseen list */
+	if (mldap->unseen.head == MLDAP_NOSLOT) {
+		mldap->unseen = mldap->seen;
+	} else if (mldap->seen.head != MLDAP_NOSLOT) {
+		mldap->table[mldap->unseen.tail].next = mldap->seen.head;
+		mldap->table[mldap->seen.head].prev = mldap->unseen.tail;
+		mldap->unseen.tail = mldap->seen.tail;
+	}
+	mldap_slotlist_init(&mldap->seen);
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_write);
 }
 
 /*
@@ -141,271 +609,231 @@ mldap_cur_generation_get(mldapdb_t *mldap) {
 	return (isc_uint32_t)isc_refcount_current(&mldap->generation);
 }
 
+isc_result_t
+mldap_class_get(mldap_node_t *node, ldap_entryclass_t *classp) {
+	REQUIRE(classp != NULL);
+
+	*classp = node->record.class;
+	return ISC_R_SUCCESS;
+}
+
 /**
- * Convert UUID to "01234567-89ab-cdef-0123-456789abcdef.uuid.ldap." DNS name.
+ * Get UUID of LDAP entry represented by metaLDAP node.
  *
- * @param[in]  beruuid
- * @param[out] nameuuid
+ * @param[out] uuid Pre-allocated struct berval of size == 16 bytes.
  */
 void
-ldap_uuid_to_mname(struct berval *beruuid, dns_name_t *nameuuid) {
-	/* UUID string representation according to RFC 4122 section 3 */
-	char label_buf[sizeof("01234567-89ab-cdef-0123-456789abcdef") + 1];
-	/* uncompressed label format, length 36 octets; RFC 1034 section 3.1 */
-	label_buf[0] = 36;
-
-	isc_region_t label_reg;
-	label_reg.base = (unsigned char *)label_buf;
-	label_reg.length = sizeof(label_buf) - 1; /* omit final \0 */
-
-	dns_name_t relative_name;
-	DNS_NAME_INIT(&relative_name, NULL);
-
-	/* RFC 4530 section 2.1 format = 16 octets is required */
-	REQUIRE(beruuid != NULL && beruuid->bv_len == 16);
-
-	/* fill-in string representation into label buffer */
-	uuid_unparse((*(const uuid_t *) beruuid->bv_val), label_buf + 1);
-	dns_name_fromregion(&relative_name, &label_reg);
-
-	INSIST(dns_name_concatenate(&relative_name, &uuid_rootname,
-				    nameuuid, NULL) == ISC_R_SUCCESS);
+mldap_uuid_get(mldap_node_t *node, struct berval *uuid) {
+	REQUIRE(uuid != NULL);
+	REQUIRE(uuid->bv_len == MLDAP_UUID_LEN && uuid->bv_val != NULL);
 
-	return;
+	memcpy(uuid->bv_val, node->record.uuid, MLDAP_UUID_LEN);
 }
 
-STATIC_ASSERT((sizeof(ldap_entryclass_t) <= sizeof(struct in6_addr)), \
-		"ldap_entryclass_t is too big for AAAA rdata type");
 /**
- * ldap_entryclass_t is stored inside AAAA record type
+ * Find out if LDAP entry has no own TTL, i.e. if its records
+ * use default TTL from zone settings.
  */
-static isc_result_t
-mldap_class_store(ldap_entryclass_t class, metadb_node_t *node) {
-	unsigned char buff[sizeof(struct in6_addr)];
-	isc_region_t region = { .base = buff, .length = sizeof(buff) };
-	dns_rdata_t rdata;
-
-	dns_rdata_init(&rdata);
-	memset(buff, 0, sizeof(buff));
-
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally.  2) Class is unsigned char. */
-	memcpy(buff, &class, sizeof(class));
-	dns_rdata_fromregion(&rdata, dns_rdataclass_in, dns_rdatatype_aaaa,
-			     &region);
-
-	return metadb_rdata_store(&rdata, node);
+isc_boolean_t
+mldap_defaultttl_get(mldap_node_t *node) {
+	return ISC_TF(node->record.defaultttl != 0);
 }
 
+/**
+ * Store FQDN and zone name into node staged by mldap_entry_create().
+ */
 isc_result_t
-mldap_class_get(metadb_node_t *node, ldap_entryclass_t *classp) {
+mldap_dnsname_store(dns_name_t *fqdn, dns_name_t *zone, mldap_node_t *node) {
 	isc_result_t result;
-	dns_rdataset_t rdataset;
-	dns_rdata_t rdata;
-	isc_region_t region;
+	isc_region_t fqdn_reg;
+	isc_region_t zone_reg;
+	unsigned char *names = NULL;
 
-	REQUIRE(classp != NULL);
+	REQUIRE(fqdn != NULL);
+	REQUIRE(zone != NULL);
+	REQUIRE(node->op == mldap_op_store);
 
-	dns_rdata_init(&rdata);
-	dns_rdataset_init(&rdataset);
+	dns_name_toregion(fqdn, &fqdn_reg);
+	dns_name_toregion(zone, &zone_reg);
+	CHECKED_MEM_GET(node->mctx, names, fqdn_reg.length + zone_reg.length);
+	memcpy(names, fqdn_reg.base, fqdn_reg.length);
+	memcpy(names + fqdn_reg.length, zone_reg.base, zone_reg.length);
 
-	CHECK(metadb_rdataset_get(node, dns_rdatatype_aaaa, &rdataset));
-	dns_rdataset_current(&rdataset, &rdata);
-	dns_rdata_toregion(&rdata, &region);
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally.  2) Class is unsigned char. */
-	memcpy(classp, region.base, sizeof(*classp));
+	SAFE_MEM_PUT(node->mctx, node->record.names,
+		     node->record.fqdn_len + node->record.zone_len);
+	node->record.names = names;
+	node->record.fqdn_len = fqdn_reg.length;
+	node->record.zone_len = zone_reg.length;
+	return ISC_R_SUCCESS;
 
 cleanup:
-	if (dns_rdataset_isassociated(&rdataset))
-		dns_rdataset_disassociate(&rdataset);
 	return result;
 }
 
 /**
- * mldapdb_t->generation is stored inside A record type
+ * Retrieve FQDN and zone name from metaLDAP node.
+ * @param[in]  node
+ * @param[out] fqdn
+ * @param[out] zone
+ *
+ * @retval ISC_R_NOTFOUND Entry does not represent any DNS name.
+ *
+ * @pre DNS names fqdn and zone have dedicated buffer.
  */
-static isc_result_t
-mldap_generation_store(mldapdb_t *mldap, metadb_node_t *node) {
-	isc_result_t result;
-	unsigned char buff[sizeof(mldap->generation)];
-	isc_region_t region = { .base = buff, .length = sizeof(buff) };
-	dns_rdata_t rdata;
-	isc_uint32_t generation;
-
-	STATIC_ASSERT(sizeof(mldap_cur_generation_get(mldap)) == sizeof(struct in_addr), \
-		      "mldapdb_t->generation value is too big for A rdata type");
-	STATIC_ASSERT(sizeof(mldap_cur_generation_get(mldap)) == sizeof(generation), \
-		      "mldapdb_t->generation and local generation sizes do not match");
-
-	dns_rdata_init(&rdata);
-
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally and always compared on this machine. */
-	generation = mldap_cur_generation_get(mldap);
-	memcpy(buff, &generation, sizeof(generation));
-	dns_rdata_fromregion(&rdata, dns_rdataclass_in, dns_rdatatype_a, &region);
-	CHECK(metadb_rdata_store(&rdata, node));
-
-cleanup:
-	return result;
-}
-
-static isc_result_t
-mldap_generation_get(metadb_node_t *node, isc_uint32_t *generationp) {
+isc_result_t
+mldap_dnsname_get(mldap_node_t *node, dns_name_t *fqdn, dns_name_t *zone) {
 	isc_result_t result;
-	dns_rdataset_t rdataset;
-	dns_rdata_t rdata;
 	isc_region_t region;
+	dns_name_t name;
 
-	REQUIRE(generationp != NULL);
+	REQUIRE(fqdn != NULL);
+	REQUIRE(zone != NULL);
 
-	dns_rdata_init(&rdata);
-	dns_rdataset_init(&rdataset);
+	if (node->record.names == NULL)
+		return ISC_R_NOTFOUND;
 
-	CHECK(metadb_rdataset_get(node, dns_rdatatype_a, &rdataset));
-	dns_rdataset_current(&rdataset, &rdata);
-	dns_rdata_toregion(&rdata, &region);
-	memcpy(generationp, region.base, sizeof(*generationp));
+	dns_name_init(&name, NULL);
+	region.base = node->record.names;
+	region.length = node->record.fqdn_len;
+	dns_name_fromregion(&name, &region);
+	CHECK(dns_name_copy(&name, fqdn, NULL));
+
+	dns_name_init(&name, NULL);
+	region.base = node->record.names + node->record.fqdn_len;
+	region.length = node->record.zone_len;
+	dns_name_fromregion(&name, &region);
+	CHECK(dns_name_copy(&name, zone, NULL));
 
 cleanup:
-	if (dns_rdataset_isassociated(&rdataset))
-		dns_rdataset_disassociate(&rdataset);
 	return result;
 }
 
 /**
- * FQDN and zone name are stored inside RP record type
+ * Stage information from LDAP entry for storing into meta-database.
+ * FQDN and zone name can be added using mldap_dnsname_store().
  */
 isc_result_t
-mldap_dnsname_store(dns_name_t *fqdn, dns_name_t *zone, metadb_node_t *node) {
+mldap_entry_create(ldap_entry_t *entry, mldapdb_t *mldap, mldap_node_t **nodep) {
 	isc_result_t result;
-	dns_rdata_rp_t rp;
-	dns_rdata_t rdata;
-	unsigned char wirebuf[2 * DNS_NAME_MAXWIRE];
-	isc_buffer_t rdatabuf;
+	mldap_node_t *node = NULL;
+	ldap_valuelist_t values;
 
-	REQUIRE(fqdn != NULL);
-	REQUIRE(zone != NULL);
-
-	dns_rdata_init(&rdata);
-	DNS_RDATACOMMON_INIT(&rp, dns_rdatatype_rp, dns_rdataclass_in);
-	isc_buffer_init(&rdatabuf, wirebuf, sizeof(wirebuf));
+	REQUIRE(nodep != NULL && *nodep == NULL);
+	/* RFC 4530 section 2.1 format = 16 octets is required */
+	REQUIRE(entry->uuid != NULL && entry->uuid->bv_len == MLDAP_UUID_LEN);
+
+	CHECK(mldap_table_reserve(mldap));
+	CHECK(mldap_node_new(mldap, (unsigned char *)entry->uuid->bv_val,
+			     mldap_op_store, &node));
+	node->record.class = entry->class;
+	node->record.defaultttl = (ldap_entry_getvalues(entry, "dnsTTL",
+							&values)
+				   != ISC_R_SUCCESS);
+	node->record.generation = mldap_cur_generation_get(mldap);
+	APPEND(mldap->staged, node, link);
 
-	/* Bytes should be in network-order but we do not care because:
-	 * 1) It is used only internally and always compared on this machine. */
-	rp.mail = *fqdn;
-	rp.text = *zone;
-	CHECK(dns_rdata_fromstruct(&rdata, dns_rdataclass_in, dns_rdatatype_rp,
-				   &rp, &rdatabuf));
-	CHECK(metadb_rdata_store(&rdata, node));
+	*nodep = node;
 
 cleanup:
 	return result;
 }
 
 /**
- * Retrieve FQDN and zone name from RP record in metaDB.
- * @param[in]  node
- * @param[out] fqdn
- * @param[out] zone
- *
- * @pre DNS names fqdn and zone have dedicated buffer.
+ * Open metaLDAP entry for reading. Node contains copy of the committed
+ * state of the entry and has to be closed using mldap_node_close().
  */
 isc_result_t
-mldap_dnsname_get(metadb_node_t *node, dns_name_t *fqdn, dns_name_t *zone) {
+mldap_entry_read(mldapdb_t *mldap, struct berval *uuid, mldap_node_t **nodep) {
 	isc_result_t result;
-	dns_rdata_rp_t rp;
-	dns_rdataset_t rdataset;
-	dns_rdata_t rdata;
+	mldap_node_t *node = NULL;
+	mldap_record_t *slot = NULL;
+	isc_boolean_t locked = ISC_FALSE;
 
-	REQUIRE(fqdn != NULL);
-	REQUIRE(zone != NULL);
+	REQUIRE(nodep != NULL && *nodep == NULL);
+	REQUIRE(uuid->bv_len == MLDAP_UUID_LEN);
 
-	dns_rdataset_init(&rdataset);
-	dns_rdata_init(&rdata);
+	CHECK(mldap_node_new(mldap, (unsigned char *)uuid->bv_val,
+			     mldap_op_none, &node));
 
-	CHECK(metadb_rdataset_get(node, dns_rdatatype_rp, &rdataset));
-	dns_rdataset_current(&rdataset, &rdata);
-	CHECK(dns_rdata_tostruct(&rdata, &rp, NULL));
-	CHECK(dns_name_copy(&rp.mail, fqdn, NULL));
-	CHECK(dns_name_copy(&rp.text, zone, NULL));
+	RWLOCK(&mldap->lock, isc_rwlocktype_read);
+	locked = ISC_TRUE;
+	CHECK(mldap_table_find(mldap, node->record.uuid, &slot));
+	mldap_node_copy(node, slot);
+
+	*nodep = node;
 
 cleanup:
-	if (dns_rdataset_isassociated(&rdataset))
-		dns_rdataset_disassociate(&rdataset);
+	if (locked == ISC_TRUE)
+		RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
+	if (result != ISC_R_SUCCESS)
+		mldap_node_free(&node);
 	return result;
 }
 
 /**
- * Store information from LDAP entry into meta-database.
+ * Stage change of existing metaLDAP entry.
+ *
+ * @retval ISC_R_SUCCESS  Change was staged in the open version.
+ * @retval ISC_R_NOTFOUND Entry with given UUID does not exist in metaLDAP.
+ * @retval other          Various errors.
  */
-isc_result_t
-mldap_entry_create(ldap_entry_t *entry, mldapdb_t *mldap, metadb_node_t **nodep) {
+static isc_result_t
+mldap_entry_stage(mldapdb_t *mldap, struct berval *uuid, mldap_op_t op) {
 	isc_result_t result;
-	metadb_node_t *node = NULL;
-	DECLARE_BUFFERED_NAME(mname);
-
-	REQUIRE(nodep != NULL && *nodep == NULL);
+	mldap_node_t *node = NULL;
+	mldap_record_t *slot = NULL;
 
-	INIT_BUFFERED_NAME(mname);
+	REQUIRE(uuid->bv_len == MLDAP_UUID_LEN);
 
-	ldap_uuid_to_mname(entry->uuid, &mname);
-	CHECK(metadb_writenode_create(mldap->mdb, &mname, &node));
+	CHECK(mldap_node_new(mldap, (unsigned char *)uuid->bv_val, op, &node));
 
-	CHECK(mldap_class_store(entry->class, node));
-	CHECK(mldap_generation_store(mldap, node));
+	RWLOCK(&mldap->lock, isc_rwlocktype_read);
+	result = mldap_table_find(mldap, node->record.uuid, &slot);
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
 
-	*nodep = node;
+	node->record.generation = mldap_cur_generation_get(mldap);
+	APPEND(mldap->staged, node, link);
+	node = NULL;
 
 cleanup:
-	if (result != ISC_R_SUCCESS)
-		metadb_node_close(&node);
+	mldap_node_free(&node);
 	return result;
 }
 
 /**
- * Open metaLDAP entry for reading.
- * All notes about metadb_readnode_open() apply equally here.
+ * Mark existing metaLDAP entry as alive in the current metaLDAP generation
+ * without changing any other information stored in it. This is used for
+ * entries which were reported as unchanged by LDAP server during SyncRepl
+ * refresh which was resumed from a cookie.
+ *
+ * @retval ISC_R_SUCCESS  Generation number in the entry was updated.
+ * @retval ISC_R_NOTFOUND Entry with given UUID does not exist in metaLDAP.
+ * @retval other          Various errors.
  */
 isc_result_t
-mldap_entry_read(mldapdb_t *mldap, struct berval *uuid, metadb_node_t **nodep) {
-	DECLARE_BUFFERED_NAME(mname);
-
-	INIT_BUFFERED_NAME(mname);
-
-	ldap_uuid_to_mname(uuid, &mname);
-
-	return metadb_readnode_open(mldap->mdb, &mname, nodep);
+mldap_entry_present(mldapdb_t *mldap, struct berval *uuid) {
+	return mldap_entry_stage(mldap, uuid, mldap_op_touch);
 }
 
 /**
  * Delete metaLDAP entry.
- * All notes about metadb_writenode_open() apply equally here.
+ *
+ * @retval ISC_R_NOTFOUND Entry with given UUID does not exist in metaLDAP.
  */
 isc_result_t
 mldap_entry_delete(mldapdb_t *mldap, struct berval *uuid) {
-	isc_result_t result;
-	metadb_node_t *node = NULL;
-	DECLARE_BUFFERED_NAME(mname);
-
-	INIT_BUFFERED_NAME(mname);
-
-	ldap_uuid_to_mname(uuid, &mname);
-
-	CHECK(metadb_writenode_open(mldap->mdb, &mname, &node));
-	CHECK(metadb_node_delete(&node));
-
-cleanup:
-	return result;
+	return mldap_entry_stage(mldap, uuid, mldap_op_delete);
 }
 
 /**
- * Start iteration over UUID's of dead nodes stored in uuid.ldap. sub-tree
- * of metaLDAP.
+ * Start iteration over UUID's of dead nodes in metaLDAP.
  *
  * Dead node is a node with generation number lower than global generation
- * number in in metaLDAP.
+ * number in in metaLDAP. Such nodes are linked in the unseen list so
+ * iteration visits only them. The node returned last can be deleted
+ * before the next call.
  *
  * @param[in]  mldap
  * @param[out] iterp
@@ -419,45 +847,40 @@ cleanup:
  *                       Iterp and uuid are invalid.
  * @retval other         Various errors.
  *
- * @warning MetaLDAP generation number cannot change during iteration.
- *          This is safety check to prevent hard-to-debug inconsistencies.
+ * @warning MetaLDAP generation number cannot change during iteration
+ *          and no new entries can be created. This is safety check
+ *          to prevent hard-to-debug inconsistencies.
  */
 isc_result_t
-mldap_iter_deadnodes_start(mldapdb_t *mldap, metadb_iter_t **iterp,
+mldap_iter_deadnodes_start(mldapdb_t *mldap, mldap_iter_t **iterp,
 			   struct berval *uuid) {
 	isc_result_t result;
-	metadb_iter_t *iter = NULL;
+	mldap_iter_t *iter = NULL;
 
 	REQUIRE(iterp != NULL && *iterp == NULL);
 
-	CHECK(metadb_iterator_create(mldap->mdb, &iter));
-	CHECKED_MEM_GET(mldap->mctx, iter->state, sizeof(isc_uint32_t));
-	result = dns_dbiterator_seek(iter->iter, &uuid_rootname);
-	if (result == ISC_R_NOTFOUND) /* metaLDAP is empty */
-		CLEANUP_WITH(ISC_R_NOMORE);
-	else if (result != ISC_R_SUCCESS)
-		goto cleanup;
-	/* store current generation value for sanity checking */
-	*(isc_uint32_t *)iter->state = mldap_cur_generation_get(mldap);
+	CHECKED_MEM_GET_PTR(mldap->mctx, iter);
+	ZERO_PTR(iter);
+	isc_mem_attach(mldap->mctx, &iter->mctx);
 
-	CHECK(mldap_iter_deadnodes_next(mldap, &iter, uuid));
+	RWLOCK(&mldap->lock, isc_rwlocktype_read);
+	/* store current state for sanity checking */
+	iter->generation = mldap_cur_generation_get(mldap);
+	iter->resizes = mldap->resizes;
+	iter->position = mldap->unseen.head;
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
 
-	*iterp = iter;
-	return result;
+	/* mldap_iter_deadnodes_next() destroys the iterator on failure */
+	result = mldap_iter_deadnodes_next(mldap, &iter, uuid);
+	if (result == ISC_R_SUCCESS)
+		*iterp = iter;
 
 cleanup:
-	if (iter != NULL) {
-		SAFE_MEM_PUT(mldap->mctx, iter->state, sizeof(isc_uint32_t));
-		iter->state = NULL;
-		metadb_iterator_destroy(&iter);
-	}
-
 	return result;
 }
 
 /**
- * Continue iteration over UUID's of dead nodes stored in uuid.ldap. sub-tree
- * of metaLDAP.
+ * Continue iteration over UUID's of dead nodes in metaLDAP.
  *
  * @param[in]     mldap
  * @param[in,out] iterp
@@ -470,71 +893,294 @@ cleanup:
  * @retval ISC_R_NOMORE  End of iteration. Iterp and uuid are no longer valid.
  * @retval other         Various errors.
  *
- * @warning MetaLDAP generation number cannot change during iteration.
- *          This is safety check to prevent hard-to-debug inconsistencies.
+ * @warning MetaLDAP generation number cannot change during iteration
+ *          and no new entries can be created. This is safety check
+ *          to prevent hard-to-debug inconsistencies.
  */
 isc_result_t
-mldap_iter_deadnodes_next(mldapdb_t *mldap, metadb_iter_t **iterp,
+mldap_iter_deadnodes_next(mldapdb_t *mldap, mldap_iter_t **iterp,
 		   struct berval *uuid) {
-	isc_result_t result;
-	dns_dbnode_t *rbt_node = NULL;
-	metadb_iter_t *iter = NULL;
-	isc_uint32_t node_generation;
+	isc_result_t result = ISC_R_NOMORE;
+	mldap_iter_t *iter;
+	mldap_record_t *slot;
 	isc_uint32_t cur_generation;
-	metadb_node_t metadb_node;
-	DECLARE_BUFFERED_NAME(name);
-	isc_region_t name_region;
 
+	REQUIRE(iterp != NULL && *iterp != NULL);
 	REQUIRE(uuid != NULL);
-	REQUIRE(uuid->bv_len == 16 && uuid->bv_val != NULL);
+	REQUIRE(uuid->bv_len == MLDAP_UUID_LEN && uuid->bv_val != NULL);
 
-	INIT_BUFFERED_NAME(name);
 	iter = *iterp;
 
-	/* create fake metaDB node for use with metaDB interface */
-	metadb_node.mctx = iter->mctx;
-	metadb_node.version = iter->version;
-	metadb_node.rbtdb = iter->rbtdb;
+	RWLOCK(&mldap->lock, isc_rwlocktype_read);
+	cur_generation = mldap_cur_generation_get(mldap);
+	/* sanity check: slots cannot move during iteration */
+	INSIST(iter->generation == cur_generation);
+	INSIST(iter->resizes == mldap->resizes);
+
+	if (iter->position != MLDAP_NOSLOT) {
+		slot = &mldap->table[iter->position];
+		/* position is remembered before the caller can delete
+		 * the returned node, anything else cannot change */
+		INSIST(slot->state == mldap_slot_used
+		       && isc_serial_lt(slot->generation, cur_generation));
+		memcpy(uuid->bv_val, slot->uuid, MLDAP_UUID_LEN);
+		iter->position = slot->next;
+		result = ISC_R_SUCCESS;
+	}
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
 
-	/* skip nodes which do not belong to UUID sub-tree or are 'fresh' */
-	while (ISC_TRUE) {
-		if (rbt_node != NULL)
-			dns_db_detachnode(iter->rbtdb, &rbt_node);
-		dns_name_reset(&name);
+	if (result != ISC_R_SUCCESS) {
+		MEM_PUT_AND_DETACH(iter);
+		*iterp = NULL;
+	}
+	return result;
+}
+
+/**
+ * Stop iteration before its end.
+ */
+void
+mldap_iter_destroy(mldap_iter_t **iterp) {
+	REQUIRE(iterp != NULL);
+
+	if (*iterp == NULL)
+		return;
+
+	MEM_PUT_AND_DETACH(*iterp);
+	*iterp = NULL;
+}
+
+/**
+ * Start iteration over all entries in metaLDAP.
+ *
+ * @param[out] nodep Read-only node with copy of the first entry.
+ *                   It has to be closed using mldap_node_close().
+ *
+ * @retval ISC_R_SUCCESS The first entry is in nodep.
+ * @retval ISC_R_NOMORE  MetaLDAP is empty. Iterp is invalid.
+ * @retval other         Various errors.
+ *
+ * @warning No new entries can be created during iteration.
+ *          This is safety check to prevent hard-to-debug inconsistencies.
+ */
+isc_result_t
+mldap_iter_entries_start(mldapdb_t *mldap, mldap_iter_t **iterp,
+			 mldap_node_t **nodep) {
+	isc_result_t result;
+	mldap_iter_t *iter = NULL;
+
+	REQUIRE(iterp != NULL && *iterp == NULL);
+
+	CHECKED_MEM_GET_PTR(mldap->mctx, iter);
+	ZERO_PTR(iter);
+	isc_mem_attach(mldap->mctx, &iter->mctx);
+
+	RWLOCK(&mldap->lock, isc_rwlocktype_read);
+	iter->resizes = mldap->resizes;
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
+
+	/* mldap_iter_entries_next() destroys the iterator on failure */
+	result = mldap_iter_entries_next(mldap, &iter, nodep);
+	if (result == ISC_R_SUCCESS)
+		*iterp = iter;
+
+cleanup:
+	return result;
+}
+
+/**
+ * Continue iteration over all entries in metaLDAP.
+ *
+ * @param[out] nodep Read-only node with copy of the next entry.
+ *                   It has to be closed using mldap_node_close().
+ *
+ * @retval ISC_R_SUCCESS The next entry is in nodep.
+ * @retval ISC_R_NOMORE  End of iteration. Iterp is no longer valid.
+ * @retval other         Various errors.
+ */
+isc_result_t
+mldap_iter_entries_next(mldapdb_t *mldap, mldap_iter_t **iterp,
+			mldap_node_t **nodep) {
+	isc_result_t result = ISC_R_NOMORE;
+	mldap_iter_t *iter;
+	mldap_node_t *node = NULL;
+	mldap_record_t *slot;
+
+	REQUIRE(iterp != NULL && *iterp != NULL);
+	REQUIRE(nodep != NULL && *nodep == NULL);
+
+	iter = *iterp;
 
-		CHECK(dns_dbiterator_next(iter->iter));
-		CHECK(dns_dbiterator_current(iter->iter, &rbt_node, &name));
-		if (dns_name_issubdomain(&name, &uuid_rootname) == ISC_FALSE)
+	RWLOCK(&mldap->lock, isc_rwlocktype_read);
+	/* sanity check: slots cannot move during iteration */
+	INSIST(iter->resizes == mldap->resizes);
+
+	while (iter->position < mldap->size) {
+		slot = &mldap->table[iter->position++];
+		if (slot->state != mldap_slot_used)
 			continue;
-		metadb_node.dbnode = rbt_node;
+		result = mldap_node_new(mldap, slot->uuid, mldap_op_none,
+					&node);
+		if (result == ISC_R_SUCCESS)
+			mldap_node_copy(node, slot);
+		break;
+	}
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
 
-		INSIST(mldap_generation_get(&metadb_node, &node_generation)
-		       == ISC_R_SUCCESS);
-		cur_generation = mldap_cur_generation_get(mldap);
-		/* sanity check: generation number cannot change during iteration */
-		INSIST(*(isc_uint32_t *)(*iterp)->state == cur_generation);
+	if (result == ISC_R_SUCCESS) {
+		*nodep = node;
+	} else {
+		MEM_PUT_AND_DETACH(iter);
+		*iterp = NULL;
+	}
+	return result;
+}
 
-		if (isc_serial_lt(node_generation, cur_generation))
-			break; /* this node is from previous mLDAP generation */
+/**
+ * Write all entries which represent DNS names to a file so they can be
+ * restored by mldap_restore() during next start. Configuration entries
+ * are omitted because they are fetched again from LDAP on every start.
+ *
+ * Each entry is written as UUID, class, defaultttl flag, lengths of FQDN and
+ * zone name followed by both names in wire format. The list is terminated
+ * by an entry with zero FQDN length.
+ */
+isc_result_t
+mldap_dump(mldapdb_t *mldap, FILE *fp) {
+	isc_result_t result = ISC_R_SUCCESS;
+	unsigned char hdr[MLDAP_DUMP_HDRLEN];
+	mldap_record_t *slot;
+	unsigned int i;
+
+	REQUIRE(fp != NULL);
+
+	RWLOCK(&mldap->lock, isc_rwlocktype_read);
+	for (i = 0; i < mldap->size; i++) {
+		slot = &mldap->table[i];
+		if (slot->state != mldap_slot_used || slot->names == NULL)
+			continue;
+		memcpy(hdr, slot->uuid, MLDAP_UUID_LEN);
+		hdr[MLDAP_UUID_LEN] = slot->class;
+		hdr[MLDAP_UUID_LEN + 1] = slot->defaultttl;
+		hdr[MLDAP_UUID_LEN + 2] = slot->fqdn_len;
+		hdr[MLDAP_UUID_LEN + 3] = slot->zone_len;
+		CHECK(isc_stdio_write(hdr, sizeof(hdr), 1, fp, NULL));
+		CHECK(isc_stdio_write(slot->names,
+				      slot->fqdn_len + slot->zone_len, 1, fp,
+				      NULL));
 	}
-	DNS_NAME_TOREGION(&name, &name_region);
-	/* parse UUID from DNS name
-	 * "$e4113e03-03b4-11e5-b478-c78116fa7f8b\004uuid\004ldap"
-	 * - first byte of any label is length
-	 * - names derived from UUID has to have constant length */
-	INSIST(name_region.length == 37 + sizeof(uuid_rootname_ndata));
-	INSIST(name_region.base[0] == 36);
-	name_region.base[37] = '\0';
-	INSIST(uuid_parse((const char *)name_region.base + 1,
-			  *(uuid_t *)(uuid->bv_val)) == 0);
+	memset(hdr, 0, sizeof(hdr));
+	CHECK(isc_stdio_write(hdr, sizeof(hdr), 1, fp, NULL));
 
 cleanup:
-	if (rbt_node != NULL)
-		dns_db_detachnode(iter->rbtdb, &rbt_node);
-	if (result != ISC_R_SUCCESS) {
-		SAFE_MEM_PUT(iter->mctx, iter->state, sizeof(isc_uint32_t));
-		iter->state = NULL;
-		metadb_iterator_destroy(iterp);
+	RWUNLOCK(&mldap->lock, isc_rwlocktype_read);
+	return result;
+}
+
+/**
+ * Check that names of one entry read from file written by mldap_dump()
+ * are uncompressed absolute names in wire format which fill exactly
+ * the given lengths and that FQDN belongs to the zone.
+ *
+ * @retval ISC_R_SUCCESS Names can be used by mldap_dnsname_get().
+ * @retval ISC_R_BADDB   Names are damaged.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+mldap_names_check(unsigned char *names, unsigned int fqdn_len,
+		  unsigned int zone_len) {
+	isc_result_t result;
+	isc_buffer_t source;
+	dns_decompress_t dctx;
+	dns_fixedname_t fqdn;
+	dns_fixedname_t zone;
+
+	dns_fixedname_init(&fqdn);
+	dns_fixedname_init(&zone);
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_NONE);
+	isc_buffer_init(&source, names, fqdn_len + zone_len);
+	isc_buffer_add(&source, fqdn_len + zone_len);
+
+	isc_buffer_setactive(&source, fqdn_len);
+	CHECK(dns_name_fromwire(dns_fixedname_name(&fqdn), &source, &dctx,
+				0, NULL));
+	if (isc_buffer_consumedlength(&source) != fqdn_len)
+		CLEANUP_WITH(ISC_R_BADDB);
+
+	isc_buffer_setactive(&source, zone_len);
+	CHECK(dns_name_fromwire(dns_fixedname_name(&zone), &source, &dctx,
+				0, NULL));
+	if (isc_buffer_remaininglength(&source) != 0)
+		CLEANUP_WITH(ISC_R_BADDB);
+
+	if (dns_name_issubdomain(dns_fixedname_name(&fqdn),
+				 dns_fixedname_name(&zone)) == ISC_FALSE)
+		CLEANUP_WITH(ISC_R_BADDB);
+
+cleanup:
+	dns_decompress_invalidate(&dctx);
+	if (result != ISC_R_SUCCESS)
+		result = ISC_R_BADDB;
+	return result;
+}
+
+/**
+ * Add entries written by mldap_dump() to metaLDAP. Restored entries get
+ * current generation number so they become candidates for dead node
+ * detection after the next mldap_cur_generation_bump().
+ *
+ * @pre MetaLDAP is empty.
+ *
+ * @retval ISC_R_SUCCESS       All entries were restored.
+ * @retval ISC_R_UNEXPECTEDEND File is truncated, nothing was restored.
+ * @retval ISC_R_BADDB         File is damaged, nothing was restored.
+ * @retval others              Various errors, nothing was restored.
+ */
+isc_result_t
+mldap_restore(mldapdb_t *mldap, FILE *fp) {
+	isc_result_t result;
+	unsigned char hdr[MLDAP_DUMP_HDRLEN];
+	mldap_node_t *node = NULL;
+	unsigned int fqdn_len;
+	unsigned int zone_len;
+
+	REQUIRE(fp != NULL);
+	REQUIRE(mldap->count == 0);
+
+	CHECK(mldap_newversion(mldap));
+	for (;;) {
+		CHECK(isc_stdio_read(hdr, sizeof(hdr), 1, fp, NULL));
+		fqdn_len = hdr[MLDAP_UUID_LEN + 2];
+		zone_len = hdr[MLDAP_UUID_LEN + 3];
+		if (fqdn_len == 0)
+			break;
+		/* the file is not trusted: it could be damaged on disk */
+		if (fqdn_len > DNS_NAME_MAXWIRE || zone_len == 0 ||
+		    zone_len > fqdn_len ||
+		    hdr[MLDAP_UUID_LEN] == LDAP_ENTRYCLASS_NONE ||
+		    hdr[MLDAP_UUID_LEN + 1] > 1)
+			CLEANUP_WITH(ISC_R_BADDB);
+
+		CHECK(mldap_table_reserve(mldap));
+		CHECK(mldap_node_new(mldap, hdr, mldap_op_store, &node));
+		node->record.class = hdr[MLDAP_UUID_LEN];
+		node->record.defaultttl = hdr[MLDAP_UUID_LEN + 1];
+		node->record.generation = mldap_cur_generation_get(mldap);
+		APPEND(mldap->staged, node, link);
+
+		CHECKED_MEM_GET(node->mctx, node->record.names,
+				fqdn_len + zone_len);
+		node->record.fqdn_len = fqdn_len;
+		node->record.zone_len = zone_len;
+		CHECK(isc_stdio_read(node->record.names, fqdn_len + zone_len,
+				     1, fp, NULL));
+		CHECK(mldap_names_check(node->record.names, fqdn_len,
+					zone_len));
+		node = NULL;
 	}
+
+cleanup:
+	if (result == ISC_R_EOF)
+		result = ISC_R_UNEXPECTEDEND;
+	mldap_closeversion(mldap, ISC_TF(result == ISC_R_SUCCESS));
 	return result;
 }
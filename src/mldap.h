@@ -6,8 +6,8 @@
 #define SRC_MLDAP_H_
 
 #include <ldap.h>
+#include <stdio.h>
 
-#include "metadb.h"
 #include "types.h"
 #include "util.h"
 
@@ -25,22 +25,34 @@ void ATTR_NONNULLS
 mldap_closeversion(mldapdb_t *mldap, isc_boolean_t commit);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_entry_read(mldapdb_t *mldap, struct berval *uuid, metadb_node_t **nodep);
+mldap_entry_read(mldapdb_t *mldap, struct berval *uuid, mldap_node_t **nodep);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_entry_create(ldap_entry_t *entry, mldapdb_t *mldap, metadb_node_t **nodep);
+mldap_entry_create(ldap_entry_t *entry, mldapdb_t *mldap, mldap_node_t **nodep);
+
+void ATTR_NONNULLS
+mldap_node_close(mldap_node_t **nodep);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+mldap_entry_present(mldapdb_t *mldap, struct berval *uuid);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
 mldap_entry_delete(mldapdb_t *mldap, struct berval *uuid);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_class_get(metadb_node_t *node, ldap_entryclass_t *class);
+mldap_class_get(mldap_node_t *node, ldap_entryclass_t *class);
+
+void ATTR_NONNULLS
+mldap_uuid_get(mldap_node_t *node, struct berval *uuid);
+
+isc_boolean_t ATTR_CHECKRESULT ATTR_NONNULLS
+mldap_defaultttl_get(mldap_node_t *node);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_dnsname_get(metadb_node_t *node, dns_name_t *fqdn, dns_name_t *zone);
+mldap_dnsname_get(mldap_node_t *node, dns_name_t *fqdn, dns_name_t *zone);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_dnsname_store(dns_name_t *fqdn, dns_name_t *zone, metadb_node_t *node);
+mldap_dnsname_store(dns_name_t *fqdn, dns_name_t *zone, mldap_node_t *node);
 
 void ATTR_NONNULLS
 mldap_cur_generation_bump(mldapdb_t *mldap);
@@ -49,11 +61,28 @@ isc_uint32_t ATTR_CHECKRESULT ATTR_NONNULLS
 mldap_cur_generation_get(mldapdb_t *mldap);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_iter_deadnodes_start(mldapdb_t *mldap, metadb_iter_t **iterp,
+mldap_iter_deadnodes_start(mldapdb_t *mldap, mldap_iter_t **iterp,
 			   struct berval *uuid);
 
 isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
-mldap_iter_deadnodes_next(mldapdb_t *mldap, metadb_iter_t **iterp,
+mldap_iter_deadnodes_next(mldapdb_t *mldap, mldap_iter_t **iterp,
 		   struct berval *uuid);
 
+void ATTR_NONNULLS
+mldap_iter_destroy(mldap_iter_t **iterp);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+mldap_iter_entries_start(mldapdb_t *mldap, mldap_iter_t **iterp,
+			 mldap_node_t **nodep);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+mldap_iter_entries_next(mldapdb_t *mldap, mldap_iter_t **iterp,
+			mldap_node_t **nodep);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+mldap_dump(mldapdb_t *mldap, FILE *fp);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+mldap_restore(mldapdb_t *mldap, FILE *fp);
+
 #endif /* SRC_MLDAP_H_ */
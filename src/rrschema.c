@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Table of DNS RR types which have their own attribute (e.g. URIRecord)
+ * in LDAP schema. Data of other RR types have to be written
+ * to attribute UnknownRecord;TYPE256 in generic (RFC 3597) format.
+ *
+ * The table is built from subschema entry of the LDAP server. An attribute
+ * is considered usable if it is defined in attributeTypes and allowed
+ * by object class idnsRecord (if the server publishes the class).
+ *
+ * The table is re-read whenever a connection to LDAP is (re)established
+ * and modifyTimestamp of the subschema entry changed. Until the table is
+ * loaded all RR types are considered to have their own attribute, i.e. the
+ * named attribute is tried first like before the table was introduced.
+ */
+
+#include <ldap.h>
+#include <ldap_schema.h>
+#include <string.h>
+#include <strings.h>
+
+#include <isc/boolean.h>
+#include <isc/mem.h>
+#include <isc/result.h>
+#include <isc/rwlock.h>
+#include <isc/util.h>
+
+#include <dns/rdatatype.h>
+
+#include "ldap_convert.h"
+#include "log.h"
+#include "rrschema.h"
+#include "util.h"
+
+/* One bit for each of 65536 RR types. */
+#define RRSCHEMA_BITMAP_SIZE	(65536 / 8)
+
+/* Object class which has to allow the record attributes. */
+#define RRSCHEMA_RECORD_CLASS	"idnsRecord"
+
+struct rrschema {
+	isc_mem_t		*mctx;
+
+	/** Guards all members below. */
+	isc_rwlock_t		lock;
+	isc_boolean_t		loaded;
+	/** modifyTimestamp of subschema entry the table was built from. */
+	char			*timestamp;
+	unsigned char		attrs[RRSCHEMA_BITMAP_SIZE];
+};
+
+#define RRSCHEMA_BIT_SET(map, type)				\
+	((map)[(type) / 8] |= (1 << ((type) % 8)))
+#define RRSCHEMA_BIT_ISSET(map, type)				\
+	(((map)[(type) / 8] & (1 << ((type) % 8))) != 0)
+
+isc_result_t
+rrschema_create(isc_mem_t *mctx, rrschema_t **schemap) {
+	isc_result_t result;
+	rrschema_t *schema = NULL;
+
+	REQUIRE(schemap != NULL && *schemap == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, schema);
+	ZERO_PTR(schema);
+	result = isc_rwlock_init(&schema->lock, 0, 0);
+	if (result != ISC_R_SUCCESS) {
+		SAFE_MEM_PUT_PTR(mctx, schema);
+		return result;
+	}
+	isc_mem_attach(mctx, &schema->mctx);
+
+	*schemap = schema;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+void
+rrschema_destroy(rrschema_t **schemap) {
+	rrschema_t *schema;
+
+	REQUIRE(schemap != NULL);
+
+	schema = *schemap;
+	if (schema == NULL)
+		return;
+
+	if (schema->timestamp != NULL)
+		isc_mem_free(schema->mctx, schema->timestamp);
+	isc_rwlock_destroy(&schema->lock);
+	MEM_PUT_AND_DETACH(schema);
+	*schemap = NULL;
+}
+
+/**
+ * Get RR type from name of attribute like "URIRecord".
+ * Unlike ldap_attribute_to_rdatatype() this does not log anything because
+ * schema contains many attributes which do not represent any RR type.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+rrschema_attr2type(const char *attr, dns_rdatatype_t *rdtype) {
+	size_t len;
+	isc_textregion_t region;
+
+	len = strlen(attr);
+	if (len <= LDAP_RDATATYPE_SUFFIX_LEN ||
+	    strcasecmp(attr + len - LDAP_RDATATYPE_SUFFIX_LEN,
+		       LDAP_RDATATYPE_SUFFIX) != 0)
+		return ISC_R_NOTFOUND;
+
+	DE_CONST(attr, region.base);
+	region.length = len - LDAP_RDATATYPE_SUFFIX_LEN;
+	return dns_rdatatype_fromtext(rdtype, &region);
+}
+
+/**
+ * Set bits for all RR types in list of attribute names.
+ */
+static void
+rrschema_setnames(unsigned char *map, char **names) {
+	dns_rdatatype_t rdtype;
+
+	for (; names != NULL && *names != NULL; names++) {
+		if (rrschema_attr2type(*names, &rdtype) == ISC_R_SUCCESS)
+			RRSCHEMA_BIT_SET(map, rdtype);
+	}
+}
+
+/**
+ * Read single-valued attribute 'attr' from entry 'dn'.
+ * Base object search is used.
+ *
+ * @param[out] valuep Newly allocated copy of the value.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+rrschema_getvalue(isc_mem_t *mctx, LDAP *ld, const char *dn, char *attr,
+		  char **valuep) {
+	isc_result_t result;
+	int ret;
+	char *attrs[] = { attr, NULL };
+	LDAPMessage *res = NULL;
+	LDAPMessage *entry;
+	struct berval **values = NULL;
+
+	ret = ldap_search_ext_s(ld, dn, LDAP_SCOPE_BASE, "(objectClass=*)",
+				attrs, 0, NULL, NULL, NULL, 1, &res);
+	if (ret != LDAP_SUCCESS) {
+		log_ldap_error(ld, "unable to read '%s' from '%s'", attr, dn);
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+	entry = ldap_first_entry(ld, res);
+	if (entry != NULL)
+		values = ldap_get_values_len(ld, entry, attr);
+	if (values == NULL || values[0] == NULL)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+
+	*valuep = isc_mem_allocate(mctx, values[0]->bv_len + 1);
+	if (*valuep == NULL)
+		CLEANUP_WITH(ISC_R_NOMEMORY);
+	memcpy(*valuep, values[0]->bv_val, values[0]->bv_len);
+	(*valuep)[values[0]->bv_len] = '\0';
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (values != NULL)
+		ldap_value_free_len(values);
+	if (res != NULL)
+		ldap_msgfree(res);
+	return result;
+}
+
+/**
+ * Build table of RR types from attributeTypes and objectClasses values
+ * in subschema entry 'dn'.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+rrschema_parse(isc_mem_t *mctx, LDAP *ld, const char *dn, unsigned char *map) {
+	isc_result_t result;
+	int ret;
+	int code;
+	const char *errp;
+	char *attrs[] = { "attributeTypes", "objectClasses", NULL };
+	LDAPMessage *res = NULL;
+	LDAPMessage *entry;
+	struct berval **values = NULL;
+	LDAPAttributeType *at;
+	LDAPObjectClass *oc;
+	unsigned char *allowed = NULL;
+	unsigned int i;
+	unsigned int j;
+
+	memset(map, 0, RRSCHEMA_BITMAP_SIZE);
+	ret = ldap_search_ext_s(ld, dn, LDAP_SCOPE_BASE,
+				"(objectClass=subschema)", attrs, 0, NULL,
+				NULL, NULL, 1, &res);
+	if (ret != LDAP_SUCCESS) {
+		log_ldap_error(ld, "unable to read subschema '%s'", dn);
+		CLEANUP_WITH(ISC_R_FAILURE);
+	}
+	entry = ldap_first_entry(ld, res);
+	if (entry == NULL)
+		CLEANUP_WITH(ISC_R_NOTFOUND);
+
+	values = ldap_get_values_len(ld, entry, "attributeTypes");
+	for (i = 0; values != NULL && values[i] != NULL; i++) {
+		at = ldap_str2attributetype(values[i]->bv_val, &code, &errp,
+					    LDAP_SCHEMA_ALLOW_ALL);
+		if (at == NULL)
+			continue;
+		rrschema_setnames(map, at->at_names);
+		ldap_attributetype_free(at);
+	}
+	if (values != NULL)
+		ldap_value_free_len(values);
+
+	/* Attributes not allowed by the object class would be rejected
+	 * with object class violation. */
+	values = ldap_get_values_len(ld, entry, "objectClasses");
+	for (i = 0; values != NULL && values[i] != NULL; i++) {
+		oc = ldap_str2objectclass(values[i]->bv_val, &code, &errp,
+					  LDAP_SCHEMA_ALLOW_ALL);
+		if (oc == NULL)
+			continue;
+		for (j = 0; oc->oc_names != NULL && oc->oc_names[j] != NULL;
+		     j++) {
+			if (strcasecmp(oc->oc_names[j],
+				       RRSCHEMA_RECORD_CLASS) != 0)
+				continue;
+			if (allowed == NULL) {
+				allowed = isc_mem_get(mctx,
+						      RRSCHEMA_BITMAP_SIZE);
+				if (allowed == NULL)
+					break;
+				memset(allowed, 0, RRSCHEMA_BITMAP_SIZE);
+			}
+			rrschema_setnames(allowed, oc->oc_at_oids_may);
+			rrschema_setnames(allowed, oc->oc_at_oids_must);
+		}
+		ldap_objectclass_free(oc);
+	}
+	if (allowed != NULL) {
+		for (i = 0; i < RRSCHEMA_BITMAP_SIZE; i++)
+			map[i] &= allowed[i];
+	}
+	result = ISC_R_SUCCESS;
+
+cleanup:
+	if (allowed != NULL)
+		SAFE_MEM_PUT(mctx, allowed, RRSCHEMA_BITMAP_SIZE);
+	if (values != NULL)
+		ldap_value_free_len(values);
+	if (res != NULL)
+		ldap_msgfree(res);
+	return result;
+}
+
+/**
+ * (Re)build the table from subschema published by the LDAP server
+ * if the subschema changed since the last load.
+ */
+isc_result_t
+rrschema_load(rrschema_t *schema, LDAP *ld) {
+	isc_result_t result;
+	char *dn = NULL;
+	char *timestamp = NULL;
+	unsigned char *map = NULL;
+	isc_boolean_t changed;
+	unsigned int count = 0;
+	unsigned int i;
+
+	CHECK(rrschema_getvalue(schema->mctx, ld, "", "subschemaSubentry",
+				&dn));
+	result = rrschema_getvalue(schema->mctx, ld, dn, "modifyTimestamp",
+				   &timestamp);
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOTFOUND)
+		goto cleanup;
+
+	RWLOCK(&schema->lock, isc_rwlocktype_read);
+	changed = ISC_TF(schema->loaded == ISC_FALSE || timestamp == NULL ||
+			 schema->timestamp == NULL ||
+			 strcmp(timestamp, schema->timestamp) != 0);
+	RWUNLOCK(&schema->lock, isc_rwlocktype_read);
+	if (changed == ISC_FALSE)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+
+	CHECKED_MEM_GET(schema->mctx, map, RRSCHEMA_BITMAP_SIZE);
+	CHECK(rrschema_parse(schema->mctx, ld, dn, map));
+
+	RWLOCK(&schema->lock, isc_rwlocktype_write);
+	memcpy(schema->attrs, map, RRSCHEMA_BITMAP_SIZE);
+	if (schema->timestamp != NULL)
+		isc_mem_free(schema->mctx, schema->timestamp);
+	schema->timestamp = timestamp;
+	timestamp = NULL;
+	schema->loaded = ISC_TRUE;
+	RWUNLOCK(&schema->lock, isc_rwlocktype_write);
+
+	for (i = 0; i < 65536; i++)
+		if (RRSCHEMA_BIT_ISSET(map, i))
+			count++;
+	log_debug(1, "LDAP schema '%s' defines attributes for %u RR types",
+		  dn, count);
+
+cleanup:
+	if (map != NULL)
+		SAFE_MEM_PUT(schema->mctx, map, RRSCHEMA_BITMAP_SIZE);
+	if (timestamp != NULL)
+		isc_mem_free(schema->mctx, timestamp);
+	if (dn != NULL)
+		isc_mem_free(schema->mctx, dn);
+	return result;
+}
+
+/**
+ * @retval ISC_TRUE  RR type has its own attribute in LDAP schema
+ *                   or the schema is not known.
+ * @retval ISC_FALSE RR type has to be stored in UnknownRecord attribute.
+ */
+isc_boolean_t
+rrschema_hasattr(rrschema_t *schema, dns_rdatatype_t rdtype) {
+	isc_boolean_t has;
+
+	RWLOCK(&schema->lock, isc_rwlocktype_read);
+	has = ISC_TF(schema->loaded == ISC_FALSE ||
+		     RRSCHEMA_BIT_ISSET(schema->attrs, rdtype));
+	RWUNLOCK(&schema->lock, isc_rwlocktype_read);
+
+	return has;
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#ifndef SRC_RRSCHEMA_H_
+#define SRC_RRSCHEMA_H_
+
+#include <ldap.h>
+
+#include <dns/types.h>
+
+#include "types.h"
+#include "util.h"
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+rrschema_create(isc_mem_t *mctx, rrschema_t **schemap);
+
+void
+rrschema_destroy(rrschema_t **schemap);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+rrschema_load(rrschema_t *schema, LDAP *ld);
+
+isc_boolean_t ATTR_CHECKRESULT ATTR_NONNULLS
+rrschema_hasattr(rrschema_t *schema, dns_rdatatype_t rdtype);
+
+#endif /* SRC_RRSCHEMA_H_ */
@@ -0,0 +1,613 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ *
+ * Templates in idnsTemplateAttribute values contain references
+ * to substitution variables in form \{variable_name\}. Templates are
+ * compiled once into a list of literal and variable tokens so rendering
+ * is only concatenation of strings, without any pattern matching.
+ *
+ * Compiled templates are cached in parsing contexts (ldap_parsectx_t),
+ * i.e. each cache is used by a single thread at a time and does not need
+ * any locking.
+ *
+ * Dependency index maps name of each variable to UUIDs of LDAP entries
+ * with templates which reference the variable. When value of a variable
+ * changes, UUIDs depending on it are moved to the set of pending entries
+ * and only these entries are re-read from LDAP and rendered again.
+ */
+
+#include <string.h>
+
+#include <isc/ht.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/result.h>
+#include <isc/util.h>
+
+#include "log.h"
+#include "rrtemplate.h"
+#include "settings.h"
+#include "util.h"
+
+/* Number of compiled templates kept in each parsing context. */
+#define RRTEMPLATE_CACHE_SIZE	16
+
+/* Hash tables for entries depending on a variable start with 2^MINBITS
+ * buckets and grow up to 2^MAXBITS buckets. */
+#define RRTEMPLATE_HT_MINBITS	4
+#define RRTEMPLATE_HT_MAXBITS	16
+
+typedef enum {
+	RRTEMPLATE_TOK_TEXT,
+	RRTEMPLATE_TOK_VAR
+} rrtemplate_toktype_t;
+
+typedef struct rrtemplate_tok {
+	rrtemplate_toktype_t	type;
+	/** Literal text or NUL-terminated variable name inside buf. */
+	const char		*str;
+	size_t			len;
+} rrtemplate_tok_t;
+
+struct rrtemplate {
+	/** Original template text. */
+	char			*text;
+	/** Copy of the text with NUL-terminated variable names. */
+	char			*buf;
+	size_t			buf_size;
+	unsigned int		ntokens;
+	rrtemplate_tok_t	*tokens;
+};
+
+struct rrtemplate_cache {
+	isc_mem_t		*mctx;
+	/** Slot which will be replaced by the next compiled template. */
+	unsigned int		next;
+	rrtemplate_t		*slots[RRTEMPLATE_CACHE_SIZE];
+};
+
+typedef struct rrtemplate_var rrtemplate_var_t;
+struct rrtemplate_var {
+	char				*name;
+	/** Keys are UUIDs of entries using the variable,
+	 *  NULL until the first entry is recorded. */
+	isc_ht_t			*uuids;
+	unsigned int			bits;
+};
+
+struct rrtemplate_deps {
+	isc_mem_t			*mctx;
+
+	/** Guards all members below. */
+	isc_mutex_t			lock;
+	/** Variable name -> rrtemplate_var_t. */
+	isc_ht_t			*vars;
+	/** UUIDs of entries which have to be rendered again,
+	 *  NULL if there are none. */
+	isc_ht_t			*pending;
+	unsigned int			pending_bits;
+};
+
+static inline isc_boolean_t
+rrtemplate_isnamechar(char c) {
+	return ISC_TF((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+		      || (c >= '0' && c <= '9') || c == '_' || c == '-');
+}
+
+/**
+ * Split template text into tokens. Matches the same references as regular
+ * expression "(^|[^\\])\\{([a-zA-Z0-9_-]+)\\}" applied repeatedly
+ * to the remaining part of the text, i.e. \{ must not be double-escaped.
+ *
+ * @param[in,out] buf    Template text. Variable names are NUL-terminated
+ *                       in place if tokens are requested.
+ * @param[out]    tokens Array for tokens or NULL if only the number of
+ *                       tokens should be computed.
+ *
+ * @return Number of tokens.
+ */
+static unsigned int
+rrtemplate_scan(char *buf, rrtemplate_tok_t *tokens) {
+	unsigned int n = 0;
+	size_t processed = 0;
+	size_t p, end;
+
+	for (p = 0; buf[p] != '\0'; p++) {
+		if (buf[p] != '\\' || buf[p + 1] != '{')
+			continue;
+		/* \\{ does not start a reference */
+		if (p != processed && buf[p - 1] == '\\')
+			continue;
+		for (end = p + 2; rrtemplate_isnamechar(buf[end]); end++)
+			;
+		if (end == p + 2 || buf[end] != '\\' || buf[end + 1] != '}')
+			continue;
+
+		if (p > processed) {
+			if (tokens != NULL) {
+				tokens[n].type = RRTEMPLATE_TOK_TEXT;
+				tokens[n].str = buf + processed;
+				tokens[n].len = p - processed;
+			}
+			n++;
+		}
+		if (tokens != NULL) {
+			tokens[n].type = RRTEMPLATE_TOK_VAR;
+			tokens[n].str = buf + p + 2;
+			tokens[n].len = end - (p + 2);
+			buf[end] = '\0';
+		}
+		n++;
+		processed = end + 2;
+		p = processed - 1;
+	}
+	if (p > processed) {
+		if (tokens != NULL) {
+			tokens[n].type = RRTEMPLATE_TOK_TEXT;
+			tokens[n].str = buf + processed;
+			tokens[n].len = p - processed;
+		}
+		n++;
+	}
+
+	return n;
+}
+
+/**
+ * Compile template text into list of tokens.
+ *
+ * Double-escaped strings \\{ \\} do not trigger substitution.
+ * Nested references will expand only innermost variable: \{\{var1\}\}
+ * Non-matching parentheses and other garbage will be copied verbatim
+ * without trigerring an error.
+ */
+isc_result_t
+rrtemplate_compile(isc_mem_t *mctx, const char *text, rrtemplate_t **tmplp) {
+	isc_result_t result;
+	rrtemplate_t *tmpl = NULL;
+
+	REQUIRE(tmplp != NULL && *tmplp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, tmpl);
+	ZERO_PTR(tmpl);
+	CHECKED_MEM_STRDUP(mctx, text, tmpl->text);
+	tmpl->buf_size = strlen(text) + 1;
+	CHECKED_MEM_GET(mctx, tmpl->buf, tmpl->buf_size);
+	memcpy(tmpl->buf, text, tmpl->buf_size);
+
+	tmpl->ntokens = rrtemplate_scan(tmpl->buf, NULL);
+	if (tmpl->ntokens > 0) {
+		CHECKED_MEM_GET(mctx, tmpl->tokens,
+				tmpl->ntokens * sizeof(*tmpl->tokens));
+		INSIST(rrtemplate_scan(tmpl->buf, tmpl->tokens)
+		       == tmpl->ntokens);
+	}
+
+	*tmplp = tmpl;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	rrtemplate_destroy(mctx, &tmpl);
+	return result;
+}
+
+void
+rrtemplate_destroy(isc_mem_t *mctx, rrtemplate_t **tmplp) {
+	rrtemplate_t *tmpl;
+
+	tmpl = *tmplp;
+	if (tmpl == NULL)
+		return;
+
+	if (tmpl->text != NULL)
+		isc_mem_free(mctx, tmpl->text);
+	SAFE_MEM_PUT(mctx, tmpl->buf, tmpl->buf_size);
+	SAFE_MEM_PUT(mctx, tmpl->tokens, tmpl->ntokens * sizeof(*tmpl->tokens));
+	SAFE_MEM_PUT_PTR(mctx, tmpl);
+	*tmplp = NULL;
+}
+
+const char *
+rrtemplate_text(const rrtemplate_t *tmpl) {
+	return tmpl->text;
+}
+
+/**
+ * Replace references to variables in compiled template with respective
+ * strings from settings tree. Output string is cleared first.
+ *
+ * @retval  ISC_R_SUCCESS  Output string is valid.
+ * @retval  ISC_R_IGNORE   Some variables used in the template are not defined
+ *                         in settings tree. Substitution was terminated
+ *                         prematurely and output is not available.
+ * @retval  others         Unexpected errors.
+ */
+isc_result_t
+rrtemplate_render(const rrtemplate_t *tmpl, const settings_set_t *set,
+		  ld_string_t *output) {
+	isc_result_t result = ISC_R_SUCCESS;
+	const rrtemplate_tok_t *tok;
+	setting_t *setting;
+
+	str_clear(output);
+	for (tok = tmpl->tokens; tok < tmpl->tokens + tmpl->ntokens; tok++) {
+		if (tok->type == RRTEMPLATE_TOK_TEXT) {
+			CHECK(str_cat_char_len(output, tok->str, tok->len));
+			continue;
+		}
+
+		/* find value for given variable name in settings tree */
+		setting = NULL;
+		result = setting_find(tok->str, set, isc_boolean_true,
+				      isc_boolean_true, &setting);
+		if (result != ISC_R_SUCCESS) {
+			log_debug(3, "setting '%s' is not defined so it "
+				  "cannot be substituted into template '%s'",
+				  tok->str, tmpl->text);
+			CLEANUP_WITH(ISC_R_IGNORE);
+		}
+		if (setting->type != ST_STRING) {
+			log_bug("setting '%s' it not string so it cannot be "
+				"substituted", tok->str);
+			CLEANUP_WITH(ISC_R_NOTIMPLEMENTED);
+		}
+		CHECK(str_cat_char(output, setting->value.value_char));
+	}
+
+cleanup:
+	return result;
+}
+
+isc_result_t
+rrtemplate_cache_create(isc_mem_t *mctx, rrtemplate_cache_t **cachep) {
+	isc_result_t result;
+	rrtemplate_cache_t *cache = NULL;
+
+	REQUIRE(cachep != NULL && *cachep == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, cache);
+	ZERO_PTR(cache);
+	isc_mem_attach(mctx, &cache->mctx);
+
+	*cachep = cache;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	return result;
+}
+
+void
+rrtemplate_cache_destroy(rrtemplate_cache_t **cachep) {
+	rrtemplate_cache_t *cache;
+	unsigned int i;
+
+	cache = *cachep;
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i < RRTEMPLATE_CACHE_SIZE; i++)
+		rrtemplate_destroy(cache->mctx, &cache->slots[i]);
+	MEM_PUT_AND_DETACH(cache);
+	*cachep = NULL;
+}
+
+/**
+ * Get compiled template for given text. Templates are compiled on first
+ * use and the least recently compiled template is evicted if the cache
+ * is full.
+ *
+ * @param[out] tmplp Compiled template owned by the cache. It is valid only
+ *                   until the next call of rrtemplate_cache_get().
+ */
+isc_result_t
+rrtemplate_cache_get(rrtemplate_cache_t *cache, const char *text,
+		     const rrtemplate_t **tmplp) {
+	isc_result_t result;
+	rrtemplate_t *tmpl = NULL;
+	unsigned int i;
+
+	for (i = 0; i < RRTEMPLATE_CACHE_SIZE; i++) {
+		if (cache->slots[i] != NULL &&
+		    strcmp(cache->slots[i]->text, text) == 0) {
+			*tmplp = cache->slots[i];
+			return ISC_R_SUCCESS;
+		}
+	}
+
+	CHECK(rrtemplate_compile(cache->mctx, text, &tmpl));
+	rrtemplate_destroy(cache->mctx, &cache->slots[cache->next]);
+	cache->slots[cache->next] = tmpl;
+	cache->next = (cache->next + 1) % RRTEMPLATE_CACHE_SIZE;
+	*tmplp = tmpl;
+
+cleanup:
+	return result;
+}
+
+static void
+rrtemplate_var_destroy(isc_mem_t *mctx, rrtemplate_var_t **varp) {
+	rrtemplate_var_t *var = *varp;
+
+	if (var == NULL)
+		return;
+
+	if (var->uuids != NULL)
+		isc_ht_destroy(&var->uuids);
+	if (var->name != NULL)
+		isc_mem_free(mctx, var->name);
+	SAFE_MEM_PUT_PTR(mctx, var);
+	*varp = NULL;
+}
+
+isc_result_t
+rrtemplate_deps_create(isc_mem_t *mctx, rrtemplate_deps_t **depsp) {
+	isc_result_t result;
+	rrtemplate_deps_t *deps = NULL;
+
+	REQUIRE(depsp != NULL && *depsp == NULL);
+
+	CHECKED_MEM_GET_PTR(mctx, deps);
+	ZERO_PTR(deps);
+	isc_mem_attach(mctx, &deps->mctx);
+	CHECK(isc_ht_init(&deps->vars, mctx, RRTEMPLATE_HT_MINBITS));
+	CHECK(isc_mutex_init(&deps->lock));
+
+	*depsp = deps;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	if (deps != NULL) {
+		if (deps->vars != NULL)
+			isc_ht_destroy(&deps->vars);
+		MEM_PUT_AND_DETACH(deps);
+	}
+	return result;
+}
+
+void
+rrtemplate_deps_destroy(rrtemplate_deps_t **depsp) {
+	rrtemplate_deps_t *deps;
+	rrtemplate_var_t *var;
+	isc_ht_iter_t *iter = NULL;
+	isc_result_t result;
+
+	deps = *depsp;
+	if (deps == NULL)
+		return;
+
+	RUNTIME_CHECK(isc_ht_iter_create(deps->vars, &iter) == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_delcurrent_next(iter)) {
+		var = NULL;
+		isc_ht_iter_current(iter, (void **)&var);
+		rrtemplate_var_destroy(deps->mctx, &var);
+	}
+	isc_ht_iter_destroy(&iter);
+	isc_ht_destroy(&deps->vars);
+	if (deps->pending != NULL)
+		isc_ht_destroy(&deps->pending);
+	DESTROYLOCK(&deps->lock);
+	MEM_PUT_AND_DETACH(deps);
+	*depsp = NULL;
+}
+
+/**
+ * Add UUID to a set of entries. The set is created on the first use
+ * and re-hashed into a bigger table when it grows, so variables used by
+ * a few entries do not occupy big tables.
+ */
+static isc_result_t
+rrtemplate_set_add(isc_mem_t *mctx, isc_ht_t **setp, unsigned int *bitsp,
+		   const unsigned char *uuid, size_t uuid_len) {
+	isc_result_t result;
+	isc_ht_t *newset = NULL;
+	isc_ht_iter_t *iter = NULL;
+	unsigned char *key;
+	size_t key_len;
+	unsigned int newbits;
+
+	if (*setp == NULL) {
+		CHECK(isc_ht_init(setp, mctx, RRTEMPLATE_HT_MINBITS));
+		*bitsp = RRTEMPLATE_HT_MINBITS;
+	} else if (*bitsp < RRTEMPLATE_HT_MAXBITS &&
+		   isc_ht_count(*setp) >= (1U << *bitsp)) {
+		newbits = ISC_MIN(*bitsp + 2, RRTEMPLATE_HT_MAXBITS);
+		CHECK(isc_ht_init(&newset, mctx, newbits));
+		CHECK(isc_ht_iter_create(*setp, &iter));
+		for (result = isc_ht_iter_first(iter);
+		     result == ISC_R_SUCCESS;
+		     result = isc_ht_iter_next(iter)) {
+			isc_ht_iter_currentkey(iter, &key, &key_len);
+			CHECK(isc_ht_add(newset, key, key_len, NULL));
+		}
+		if (result != ISC_R_NOMORE)
+			goto cleanup;
+		isc_ht_iter_destroy(&iter);
+		isc_ht_destroy(setp);
+		*setp = newset;
+		*bitsp = newbits;
+		newset = NULL;
+	}
+
+	result = isc_ht_add(*setp, uuid, uuid_len, NULL);
+	if (result == ISC_R_EXISTS)
+		result = ISC_R_SUCCESS;
+
+cleanup:
+	if (iter != NULL)
+		isc_ht_iter_destroy(&iter);
+	if (newset != NULL)
+		isc_ht_destroy(&newset);
+	return result;
+}
+
+/**
+ * Move all UUIDs from the set to the set of pending entries.
+ *
+ * @pre deps->lock is held.
+ */
+static isc_result_t
+rrtemplate_deps_addpending(rrtemplate_deps_t *deps, isc_ht_t **setp,
+			   unsigned int bits) {
+	isc_result_t result;
+	isc_ht_iter_t *iter = NULL;
+	unsigned char *uuid;
+	size_t uuid_len;
+
+	if (deps->pending == NULL) {
+		deps->pending = *setp;
+		deps->pending_bits = bits;
+		*setp = NULL;
+		return ISC_R_SUCCESS;
+	}
+
+	CHECK(isc_ht_iter_create(*setp, &iter));
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_next(iter)) {
+		isc_ht_iter_currentkey(iter, &uuid, &uuid_len);
+		CHECK(rrtemplate_set_add(deps->mctx, &deps->pending,
+					 &deps->pending_bits, uuid, uuid_len));
+	}
+	if (result != ISC_R_NOMORE)
+		goto cleanup;
+	result = ISC_R_SUCCESS;
+	isc_ht_destroy(setp);
+
+cleanup:
+	if (iter != NULL)
+		isc_ht_iter_destroy(&iter);
+	return result;
+}
+
+/**
+ * Record that LDAP entry with given UUID uses all variables referenced
+ * from the template.
+ *
+ * The dependency has to be recorded before the template is rendered
+ * so a concurrent change of a variable cannot be missed.
+ */
+isc_result_t
+rrtemplate_deps_add(rrtemplate_deps_t *deps, const rrtemplate_t *tmpl,
+		    struct berval *uuid) {
+	isc_result_t result = ISC_R_SUCCESS;
+	const rrtemplate_tok_t *tok;
+	rrtemplate_var_t *var;
+	rrtemplate_var_t *new_var = NULL;
+
+	LOCK(&deps->lock);
+	for (tok = tmpl->tokens; tok < tmpl->tokens + tmpl->ntokens; tok++) {
+		if (tok->type != RRTEMPLATE_TOK_VAR)
+			continue;
+
+		var = NULL;
+		result = isc_ht_find(deps->vars,
+				     (const unsigned char *)tok->str,
+				     strlen(tok->str), (void **)&var);
+		if (result == ISC_R_NOTFOUND) {
+			CHECKED_MEM_GET_PTR(deps->mctx, new_var);
+			ZERO_PTR(new_var);
+			CHECKED_MEM_STRDUP(deps->mctx, tok->str,
+					   new_var->name);
+			CHECK(isc_ht_add(deps->vars,
+					 (const unsigned char *)new_var->name,
+					 strlen(new_var->name), new_var));
+			var = new_var;
+			new_var = NULL;
+		} else if (result != ISC_R_SUCCESS) {
+			goto cleanup;
+		}
+
+		CHECK(rrtemplate_set_add(deps->mctx, &var->uuids, &var->bits,
+					 (unsigned char *)uuid->bv_val,
+					 uuid->bv_len));
+	}
+
+cleanup:
+	UNLOCK(&deps->lock);
+	rrtemplate_var_destroy(deps->mctx, &new_var);
+	return result;
+}
+
+/**
+ * Forget all dependencies of LDAP entry with given UUID.
+ * It has to be called when the entry is deleted or renamed,
+ * renamed entry records its dependencies again when it is rendered.
+ */
+void
+rrtemplate_deps_del(rrtemplate_deps_t *deps, struct berval *uuid) {
+	isc_result_t result;
+	isc_ht_iter_t *iter = NULL;
+	rrtemplate_var_t *var;
+
+	LOCK(&deps->lock);
+	if (isc_ht_count(deps->vars) == 0)
+		goto cleanup;
+
+	RUNTIME_CHECK(isc_ht_iter_create(deps->vars, &iter) == ISC_R_SUCCESS);
+	for (result = isc_ht_iter_first(iter);
+	     result == ISC_R_SUCCESS;
+	     result = isc_ht_iter_next(iter)) {
+		var = NULL;
+		isc_ht_iter_current(iter, (void **)&var);
+		if (var->uuids != NULL)
+			(void)isc_ht_delete(var->uuids,
+					    (unsigned char *)uuid->bv_val,
+					    uuid->bv_len);
+	}
+	isc_ht_iter_destroy(&iter);
+
+cleanup:
+	UNLOCK(&deps->lock);
+}
+
+/**
+ * Value of variable with given name changed: move UUIDs of all entries
+ * using the variable to the set of pending entries. Entries will record
+ * the dependency again when they are rendered.
+ */
+isc_result_t
+rrtemplate_deps_invalidate(rrtemplate_deps_t *deps, const char *name) {
+	isc_result_t result;
+	rrtemplate_var_t *var = NULL;
+
+	LOCK(&deps->lock);
+	result = isc_ht_find(deps->vars, (const unsigned char *)name,
+			     strlen(name), (void **)&var);
+	if (result == ISC_R_NOTFOUND)
+		CLEANUP_WITH(ISC_R_SUCCESS);
+	else if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	if (var->uuids != NULL)
+		CHECK(rrtemplate_deps_addpending(deps, &var->uuids, var->bits));
+	RUNTIME_CHECK(isc_ht_delete(deps->vars, (const unsigned char *)name,
+				    strlen(name)) == ISC_R_SUCCESS);
+	rrtemplate_var_destroy(deps->mctx, &var);
+
+cleanup:
+	UNLOCK(&deps->lock);
+	return result;
+}
+
+/**
+ * Take the set of entries which have to be rendered again.
+ *
+ * @param[out] uuidsp Hash table with raw entry UUIDs as keys.
+ *                    Caller has to destroy it using isc_ht_destroy().
+ *
+ * @retval ISC_R_SUCCESS  Some entries are pending.
+ * @retval ISC_R_NOTFOUND No entry has to be rendered again.
+ */
+isc_result_t
+rrtemplate_deps_pending(rrtemplate_deps_t *deps, isc_ht_t **uuidsp) {
+	REQUIRE(uuidsp != NULL && *uuidsp == NULL);
+
+	LOCK(&deps->lock);
+	*uuidsp = deps->pending;
+	deps->pending = NULL;
+	UNLOCK(&deps->lock);
+
+	return (*uuidsp != NULL) ? ISC_R_SUCCESS : ISC_R_NOTFOUND;
+}
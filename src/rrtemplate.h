@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2015  bind-dyndb-ldap authors; see COPYING for license
+ */
+
+#ifndef SRC_RRTEMPLATE_H_
+#define SRC_RRTEMPLATE_H_
+
+#include <isc/ht.h>
+#include <isc/types.h>
+
+#include <ldap.h>
+
+#include "str.h"
+#include "types.h"
+#include "util.h"
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+rrtemplate_compile(isc_mem_t *mctx, const char *text, rrtemplate_t **tmplp);
+
+void ATTR_NONNULLS
+rrtemplate_destroy(isc_mem_t *mctx, rrtemplate_t **tmplp);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+rrtemplate_render(const rrtemplate_t *tmpl, const settings_set_t *set,
+		  ld_string_t *output);
+
+const char * ATTR_CHECKRESULT ATTR_NONNULLS
+rrtemplate_text(const rrtemplate_t *tmpl);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+rrtemplate_cache_create(isc_mem_t *mctx, rrtemplate_cache_t **cachep);
+
+void ATTR_NONNULLS
+rrtemplate_cache_destroy(rrtemplate_cache_t **cachep);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+rrtemplate_cache_get(rrtemplate_cache_t *cache, const char *text,
+		     const rrtemplate_t **tmplp);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+rrtemplate_deps_create(isc_mem_t *mctx, rrtemplate_deps_t **depsp);
+
+void ATTR_NONNULLS
+rrtemplate_deps_destroy(rrtemplate_deps_t **depsp);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+rrtemplate_deps_add(rrtemplate_deps_t *deps, const rrtemplate_t *tmpl,
+		    struct berval *uuid);
+
+void ATTR_NONNULLS
+rrtemplate_deps_del(rrtemplate_deps_t *deps, struct berval *uuid);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+rrtemplate_deps_invalidate(rrtemplate_deps_t *deps, const char *name);
+
+isc_result_t ATTR_CHECKRESULT ATTR_NONNULLS
+rrtemplate_deps_pending(rrtemplate_deps_t *deps, isc_ht_t **uuidsp);
+
+#endif /* SRC_RRTEMPLATE_H_ */
@@ -32,6 +32,8 @@ static const setting_t settings_default[] = {
 	{ "default_ttl",		default_uint(86400)		}, /* Seconds */
 	{ "uri",			no_default_string		}, /* User have to set this */
 	{ "connections",		default_uint(2)			},
+	{ "connections_min",		default_uint(2)			},
+	{ "connection_idle_timeout",	default_uint(300)		}, /* seconds */
 	{ "reconnect_interval",		default_uint(60)		},
 	{ "timeout",			default_uint(10)		},
 	{ "timeout",			default_uint(10)		},
@@ -59,6 +61,13 @@ static const setting_t settings_default[] = {
 	{ "update_policy",		default_string("")		},
 	{ "verbose_checks",		default_boolean(ISC_FALSE)	},
 	{ "directory",			default_string("")		},
+	{ "warm_start",			default_boolean(ISC_FALSE)	},
+	{ "record_batch_size",		default_uint(100)		},
+	{ "sync_queue_limit",		default_uint(1000)		},
+	{ "sync_queue_high_watermark",	default_uint(256)		}, /* MiB */
+	{ "sync_queue_low_watermark",	default_uint(128)		}, /* MiB */
+	{ "serial_writeback_interval",	default_uint(1)			}, /* seconds */
+	{ "write_behind_limit",		default_uint(0)			}, /* 0 = disabled */
 	{ "server_id",			default_string("")		},
 	end_of_settings
 };
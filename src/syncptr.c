@@ -20,8 +20,10 @@
 
 #include "util.h"
 #include "ldap_convert.h"
+#include "ldap_driver.h"
 #include "ldap_entry.h"
 #include "ldap_helper.h"
+#include "syncrepl.h"
 #include "zone.h"
 #include "zone_register.h"
 
@@ -30,6 +32,8 @@
 #define SYNCPTR_PREF    "PTR record synchronization "
 #define SYNCPTR_FMTPRE  SYNCPTR_PREF "(%s) for '%s A/AAAA %s' "
 #define SYNCPTR_FMTPOST ldap_modop_str(mod_op), a_name_str, ip_str
+#define SYNCPTR_EVPOST(ev) ldap_modop_str((ev)->mod_op), (ev)->a_name_str, \
+			   (ev)->ip_str
 
 /*
  * Event for asynchronous PTR record synchronization.
@@ -38,6 +42,7 @@ typedef struct sync_ptrev sync_ptrev_t;
 struct sync_ptrev {
 	ISC_EVENT_COMMON(sync_ptrev_t);
 	isc_mem_t *mctx;
+	sync_ctx_t *sctx;
 	char a_name_str[DNS_NAME_FORMATSIZE];
 	char ip_str[INET6_ADDRSTRLEN + 1];
 	DECLARE_BUFFERED_NAME(a_name);
@@ -45,6 +50,7 @@ struct sync_ptrev {
 	dns_zone_t *ptr_zone;
 	int mod_op;
 	dns_ttl_t ttl;
+	isc_boolean_t done; /* skipped or already written to LDAP */
 };
 
 static void ATTR_NONNULLS
@@ -81,6 +87,10 @@ append_trailing_dot(char *str, unsigned int size) {
 /**
  * Find a reverse zone for given IP address.
  *
+ * The reverse zone index in zone register is consulted first. View's zone
+ * table is searched only if the index does not know the address, i.e. for
+ * addresses outside of LDAP reverse zones or for classless reverse zones.
+ *
  * @param[in]  zonetable Zone table from current DNS view
  * @param[in]  af        Address family
  * @param[in]  ip_str    IP address as a string (IPv4 or IPv6)
@@ -98,6 +108,7 @@ sync_ptr_find(dns_zt_t *zonetable, zone_register_t *zone_register, const int af,
 	      const char *ip_str, dns_name_t *ptr_name,
 	      settings_set_t **zsettings, dns_zone_t **zone) {
 	isc_result_t result;
+	dns_zone_t *view_zone = NULL;
 
 	REQUIRE(ip_str != NULL);
 
@@ -136,6 +147,20 @@ sync_ptr_find(dns_zt_t *zonetable, zone_register_t *zone_register, const int af,
 	 */
 	CHECK(dns_byaddr_createptrname2(&isc_ip, 0, ptr_name));
 
+	result = zr_find_ptr_zone(zone_register, &isc_ip, zone, zsettings);
+	if (result == ISC_R_SUCCESS) {
+		/* Zone from the index is used only if the view does not
+		 * contain a more specific zone from another source. */
+		result = dns_zt_find(zonetable, ptr_name, 0, NULL, &view_zone);
+		if ((result == ISC_R_SUCCESS || result == DNS_R_PARTIALMATCH)
+		    && view_zone == *zone)
+			CLEANUP_WITH(ISC_R_SUCCESS);
+		dns_zone_detach(zone);
+		*zsettings = NULL;
+	} else if (result != ISC_R_NOTFOUND) {
+		goto cleanup;
+	}
+
 	/* Find an active zone containing owner name of the PTR record. */
 	result = dns_zt_find(zonetable, ptr_name, 0, NULL, zone);
 	if (result != ISC_R_SUCCESS && result != DNS_R_PARTIALMATCH)
@@ -154,6 +179,8 @@ sync_ptr_find(dns_zt_t *zonetable, zone_register_t *zone_register, const int af,
 	}
 
 cleanup:
+	if (view_zone != NULL)
+		dns_zone_detach(&view_zone);
 	if (result != ISC_R_SUCCESS) {
 		if (*zone != NULL)
 			dns_zone_detach(zone);
@@ -359,6 +386,7 @@ sync_ptr_destroyev(sync_ptrev_t **eventp) {
  *
  * @pre Reverse zone allows dynamic updates.
  *
+ * @param[in]  sctx       Synchronization context of the LDAP instance
  * @param[in]  zonetable  Zone table from current DNS view
  * @param[in]  a_name  DNS domain of modified A/AAAA record
  * @param[in]  af      Address family
@@ -374,7 +402,7 @@ sync_ptr_destroyev(sync_ptrev_t **eventp) {
  * 			 is not active, or is not managed by this LDAP instance.
  */
 isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
-sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
+sync_ptr_init(isc_mem_t *mctx, sync_ctx_t *sctx, dns_zt_t * zonetable,
 	      zone_register_t *zone_register, dns_name_t *a_name, const int af,
 	      const char *ip_str, dns_ttl_t ttl, const int mod_op) {
 	isc_result_t result;
@@ -388,7 +416,7 @@ sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
 
 	REQUIRE(mod_op == LDAP_MOD_DELETE || mod_op == LDAP_MOD_ADD);
 
-	ev = (sync_ptrev_t *)isc_event_allocate(mctx, NULL,
+	ev = (sync_ptrev_t *)isc_event_allocate(mctx, sctx,
 						LDAPDB_EVENT_SYNCPTR,
 						sync_ptr_handler, NULL,
 						sizeof(sync_ptrev_t));
@@ -397,6 +425,7 @@ sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
 
 	ev->mctx = NULL;
 	isc_mem_attach(mctx, &ev->mctx);
+	ev->sctx = sctx;
 	INIT_BUFFERED_NAME(ev->a_name);
 	INIT_BUFFERED_NAME(ev->ptr_name);
 	CHECK(dns_name_copy(a_name, &ev->a_name, NULL));
@@ -405,6 +434,7 @@ sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
 	ev->ip_str[sizeof(ev->ip_str) - 1] = '\0';
 	ev->ptr_zone = NULL;
 	ev->ttl = ttl;
+	ev->done = ISC_FALSE;
 
 	/**
 	 * Get string representation of PTR record value.
@@ -434,7 +464,7 @@ sync_ptr_init(isc_mem_t *mctx, dns_zt_t * zonetable,
 
 	/* Run PTR record update asynchronously. */
 	dns_zone_gettask(ev->ptr_zone, &task);
-	isc_task_sendanddetach(&task, (isc_event_t **)&ev);
+	sync_task_send(sctx, &task, (isc_event_t **)&ev);
 
 cleanup:
 	sync_ptr_destroyev(&ev);
@@ -442,19 +472,21 @@ cleanup:
 }
 
 /**
- * Update PTR record to match A/AAAA record. This function is running
- * in context of the task associated with affected reverse zone.
+ * Update PTR record to match A/AAAA record in the open version
+ * of the reverse zone database.
+ *
+ * @param[in,out] diff All changes applied to the version so far.
  *
  * @retval ISC_R_SUCCESS PTR record matches A/AAAA record.
- * @retval other	 Synchronization failed: Old value in PTR record
- *                       doesn't match A/AAAA node name, etc.
+ * @retval ISC_R_IGNORE  Synchronization was refused, e.g. because old value
+ *                       in PTR record doesn't match A/AAAA node name.
+ *                       The version was not modified.
+ * @retval other	 Change could not be applied to the version.
  */
-static void ATTR_NONNULLS
-sync_ptr_handler(isc_task_t *task, isc_event_t *event) {
-	sync_ptrev_t *ev = (sync_ptrev_t *)event;
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_ptr_apply(sync_ptrev_t *ev, dns_db_t *ldapdb, dns_dbversion_t *version,
+	       dns_diff_t *diff) {
 	isc_result_t result;
-	dns_db_t *ldapdb = NULL;
-	dns_dbversion_t *version = NULL;
 
 	dns_rdataset_t old_rdataset;
 	dns_rdata_ptr_t new_ptr_rdata;
@@ -462,33 +494,30 @@ sync_ptr_handler(isc_task_t *task, isc_event_t *event) {
 	isc_buffer_t new_rdatabuf;
 	dns_rdata_t new_rdata;
 
-	dns_diff_t diff;
+	dns_diff_t ev_diff;
 	dns_difftuple_t *difftp = NULL;
 
-	UNUSED(task);
-
 	dns_rdataset_init(&old_rdataset);
 
 	DNS_RDATACOMMON_INIT(&new_ptr_rdata, dns_rdatatype_ptr, dns_rdataclass_in);
 	isc_buffer_init(&new_rdatabuf, new_buf, sizeof(new_buf));
 	dns_rdata_init(&new_rdata);
-	dns_diff_init(ev->mctx, &diff);
+	dns_diff_init(ev->mctx, &ev_diff);
 
-	CHECK(dns_zone_getdb(ev->ptr_zone, &ldapdb));
-	CHECK(dns_db_newversion(ldapdb, &version));
 	result = sync_ptr_validate(&ev->a_name, ev->a_name_str, ev->ip_str,
 				   &ev->ptr_name, ev->ptr_zone, ldapdb, version,
 				   ev->mod_op, &old_rdataset);
-	if (result == ISC_R_IGNORE)
-		CLEANUP_WITH(ISC_R_SUCCESS);
-	else if (result != ISC_R_SUCCESS)
-		goto cleanup;
+	if (result != ISC_R_SUCCESS) {
+		/* Errors were logged by sync_ptr_validate(). */
+		ev->done = ISC_TRUE;
+		CLEANUP_WITH(ISC_R_IGNORE);
+	}
 
 	/* Delete old PTR record if it exists in RBTDB. */
 	if (dns_rdataset_isassociated(&old_rdataset))
 		CHECK(rdataset_to_diff(ev->mctx, DNS_DIFFOP_DEL,
 				       &ev->ptr_name,
-				       &old_rdataset, &diff));
+				       &old_rdataset, &ev_diff));
 
 	if (ev->mod_op == LDAP_MOD_ADD) {
 		new_ptr_rdata.ptr = ev->a_name;
@@ -498,23 +527,94 @@ sync_ptr_handler(isc_task_t *task, isc_event_t *event) {
 		CHECK(dns_difftuple_create(ev->mctx, DNS_DIFFOP_ADD,
 					   &ev->ptr_name,
 					   ev->ttl, &new_rdata, &difftp));
-		dns_diff_appendminimal(&diff, &difftp);
+		dns_diff_appendminimal(&ev_diff, &difftp);
 	}
 
-	if (!EMPTY(diff.tuples)) {
-		CHECK(zone_soaserial_addtuple(ev->mctx, ldapdb, version, &diff,
-		      NULL));
-		CHECK(zone_journal_adddiff(ev->mctx, ev->ptr_zone, &diff));
+	/* Subsequent changes in the batch have to see this one. */
+	CHECK(dns_diff_apply(&ev_diff, ldapdb, version));
+	while ((difftp = HEAD(ev_diff.tuples)) != NULL) {
+		ISC_LIST_UNLINK(ev_diff.tuples, difftp, link);
+		dns_diff_appendminimal(diff, &difftp);
 	}
 
-	CHECK(dns_diff_apply(&diff, ldapdb, version));
-	dns_db_closeversion(ldapdb, &version, ISC_TRUE);
-
 cleanup:
 	if (dns_rdataset_isassociated(&old_rdataset))
 		dns_rdataset_disassociate(&old_rdataset);
 	if (difftp != NULL)
 		dns_difftuple_free(&difftp);
+	dns_diff_clear(&ev_diff);
+
+	return result;
+}
+
+/**
+ * Apply PTR record changes to a single reverse zone. All changes share
+ * one new version of the zone database, one SOA serial increment and one
+ * journal transaction.
+ *
+ * Changes refused by sync_ptr_validate() are skipped and marked as done.
+ * Each change is written to LDAP right after it is applied to the version
+ * and marked as done, so changes written before an error are not repeated.
+ * If any error occurs the version is rolled back and RBTDB receives changes
+ * already written to LDAP via SyncRepl.
+ *
+ * @param[in] batch Events with the same ptr_zone, in the order they
+ *                  were sent.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+sync_ptr_batch(dns_zone_t *zone, isc_eventlist_t *batch) {
+	isc_result_t result;
+	isc_mem_t *mctx = NULL;
+	isc_event_t *event;
+	sync_ptrev_t *ev;
+	dns_db_t *ldapdb = NULL;
+	dns_dbversion_t *version = NULL;
+	dns_diff_t diff;
+	dns_diff_t soa_diff;
+	unsigned int count = 0;
+
+	ev = (sync_ptrev_t *)HEAD(*batch);
+	isc_mem_attach(ev->mctx, &mctx);
+	dns_diff_init(mctx, &diff);
+	dns_diff_init(mctx, &soa_diff);
+
+	CHECK(dns_zone_getdb(zone, &ldapdb));
+	CHECK(dns_db_newversion(ldapdb, &version));
+	for (event = HEAD(*batch); event != NULL; event = NEXT(event, ev_link)) {
+		ev = (sync_ptrev_t *)event;
+		if (ev->done == ISC_TRUE)
+			continue;
+		result = sync_ptr_apply(ev, ldapdb, version, &diff);
+		if (result == ISC_R_IGNORE)
+			continue;
+		else if (result != ISC_R_SUCCESS)
+			goto cleanup;
+		CHECK(ldapdb_flush(ldapdb, version));
+		ev->done = ISC_TRUE;
+		count++;
+	}
+	result = ISC_R_SUCCESS;
+
+	if (!EMPTY(diff.tuples)) {
+		CHECK(zone_soaserial_addtuple(mctx, ldapdb, version, &soa_diff,
+					      NULL));
+		CHECK(dns_diff_apply(&soa_diff, ldapdb, version));
+		ISC_LIST_APPENDLIST(diff.tuples, soa_diff.tuples, link);
+		CHECK(zone_journal_adddiff(mctx, zone, &diff));
+	}
+
+	dns_db_closeversion(ldapdb, &version, ISC_TRUE);
+	if (count > 1)
+		dns_zone_log(zone, ISC_LOG_DEBUG(3), SYNCPTR_PREF
+			     "applied %u changes with single serial increment",
+			     count);
+
+cleanup:
+	if (result != ISC_R_SUCCESS && count > 0)
+		dns_zone_log(zone, ISC_LOG_WARNING, SYNCPTR_PREF
+			     "failed after %u changes were written to LDAP, "
+			     "they will be applied by SyncRepl", count);
+	dns_diff_clear(&soa_diff);
 	dns_diff_clear(&diff);
 	if (ldapdb != NULL) {
 		/* rollback if something bad happened */
@@ -522,9 +622,98 @@ cleanup:
 			dns_db_closeversion(ldapdb, &version, ISC_FALSE);
 		dns_db_detach(&ldapdb);
 	}
-	sync_ptr_destroyev(&ev);
+	isc_mem_detach(&mctx);
+
+	return result;
+}
+
+/**
+ * Update PTR records to match A/AAAA records. This function is running
+ * in context of the task associated with affected reverse zone.
+ *
+ * PTR synchronization events waiting at the head of the task's queue are
+ * processed together and grouped by reverse zone, see sync_ptr_batch().
+ * A DHCP renumbering of many addresses in one reverse zone results in one
+ * SOA serial increment instead of one increment per address.
+ * If a batch cannot be applied, changes which were not written to LDAP yet
+ * are applied one by one so a single bad change does not block the others.
+ */
+static void ATTR_NONNULLS
+sync_ptr_handler(isc_task_t *task, isc_event_t *event) {
+	isc_result_t result;
+	isc_eventlist_t events;
+	isc_eventlist_t batch;
+	isc_eventlist_t single;
+	isc_event_t *next = NULL;
+	sync_ptrev_t *ev = NULL;
+	dns_zone_t *zone = NULL;
+	unsigned int count;
+
+	ISC_LIST_INIT(events);
+	ISC_LIST_APPEND(events, event, ev_link);
+	/* Take only events which are not preceded by other events
+	 * from LDAP, e.g. record changes for the reverse zone. */
+	sync_event_unsendhead(((sync_ptrev_t *)event)->sctx, task,
+			      LDAPDB_EVENT_SYNCPTR, &events);
+
+	while ((event = HEAD(events)) != NULL) {
+		ISC_LIST_INIT(batch);
+		zone = ((sync_ptrev_t *)event)->ptr_zone;
+		count = 0;
+		for (; event != NULL; event = next) {
+			next = NEXT(event, ev_link);
+			if (((sync_ptrev_t *)event)->ptr_zone != zone)
+				continue;
+			ISC_LIST_UNLINK(events, event, ev_link);
+			ISC_LIST_APPEND(batch, event, ev_link);
+			count++;
+		}
+
+		result = sync_ptr_batch(zone, &batch);
+		if (result != ISC_R_SUCCESS && count > 1) {
+			dns_zone_log(zone, ISC_LOG_DEBUG(1), SYNCPTR_PREF
+				     "of %u changes failed: %s, applying "
+				     "changes one by one", count,
+				     isc_result_totext(result));
+			for (event = HEAD(batch);
+			     event != NULL;
+			     event = NEXT(event, ev_link)) {
+				ev = (sync_ptrev_t *)event;
+				if (ev->done == ISC_TRUE)
+					continue;
+				/* Temporarily move the event to own list. */
+				next = NEXT(event, ev_link);
+				ISC_LIST_UNLINK(batch, event, ev_link);
+				ISC_LIST_INIT(single);
+				ISC_LIST_APPEND(single, event, ev_link);
+				result = sync_ptr_batch(zone, &single);
+				if (result != ISC_R_SUCCESS)
+					dns_zone_log(zone, ISC_LOG_ERROR,
+						     SYNCPTR_FMTPRE "failed: "
+						     "%s", SYNCPTR_EVPOST(ev),
+						     isc_result_totext(result));
+				if (next != NULL)
+					ISC_LIST_INSERTBEFORE(batch, next,
+							      event, ev_link);
+				else
+					ISC_LIST_APPEND(batch, event, ev_link);
+			}
+		} else if (result != ISC_R_SUCCESS) {
+			ev = (sync_ptrev_t *)HEAD(batch);
+			dns_zone_log(zone, ISC_LOG_ERROR, SYNCPTR_FMTPRE
+				     "failed: %s", SYNCPTR_EVPOST(ev),
+				     isc_result_totext(result));
+		}
+
+		while ((event = HEAD(batch)) != NULL) {
+			ISC_LIST_UNLINK(batch, event, ev_link);
+			ev = (sync_ptrev_t *)event;
+			sync_ptr_destroyev(&ev);
+		}
+	}
 }
 
 #undef SYNCPTR_PREF
 #undef SYNCPTR_FMTPRE
 #undef SYNCPTR_FMTPOST
+#undef SYNCPTR_EVPOST
@@ -2,6 +2,7 @@
  * Copyright (C) 2013-2014  bind-dyndb-ldap authors; see COPYING for license
  */
 
+#include <stdint.h>
 #include <unistd.h>
 
 #include <isc/condition.h>
@@ -13,17 +14,58 @@
 
 #include "ldap_helper.h"
 #include "util.h"
-#include "semaphore.h"
 #include "syncrepl.h"
 
 #define LDAPDB_EVENT_SYNCREPL_BARRIER	(LDAPDB_EVENTCLASS + 2)
 #define LDAPDB_EVENT_SYNCREPL_FINISH	(LDAPDB_EVENTCLASS + 3)
+/** Last event type in LDAPDB event class. */
+#define LDAPDB_EVENT_LAST		(LDAPDB_EVENTCLASS + 0xffff)
 
-/** How many unprocessed LDAP events from syncrepl can be in event queue.
- *  Adding new events into the queue is blocked until some events
+/** Minimal number of unprocessed LDAP events from syncrepl which can be
+ *  in event queue. The limit adapts between this value and sync_queue_limit
+ *  setting. Adding new events into the queue is blocked until some events
  *  are processed. */
 #define LDAP_CONCURRENCY_LIMIT 100
 
+/** Average time an event can spend in queue before the limit on number
+ *  of queued events is lowered. In microseconds. */
+#define SYNC_QUEUE_LATENCY_TARGET (1000 * 1000)
+
+/**
+ * Limit on unprocessed syncrepl events and memory held by their LDAP entries.
+ *
+ * The limit on number of events adapts at runtime: it grows by one for each
+ * processed event while the producer is blocked and the average latency
+ * is below #SYNC_QUEUE_LATENCY_TARGET, and shrinks by one for each processed
+ * event while the average latency is above the target.
+ *
+ * Once memory held by queued entries reaches high watermark, producer
+ * is blocked until the memory drops below low watermark.
+ */
+typedef struct sync_queue sync_queue_t;
+struct sync_queue {
+	isc_mutex_t			lock;	/**< guards rest of the structure */
+	isc_condition_t			cond;	/**< signalled when an event
+						     was processed */
+	isc_uint32_t			depth;	/**< number of queued events */
+	size_t				bytes;	/**< memory held by queued
+						     events */
+	isc_uint32_t			limit;	/**< current limit on depth */
+	isc_uint32_t			limit_min;
+	isc_uint32_t			limit_max;
+	size_t				high_watermark;
+	size_t				low_watermark;
+	isc_boolean_t			over_watermark;
+	isc_boolean_t			waiting; /**< producer is blocked */
+	isc_uint64_t			latency_avg; /**< moving average of
+							  time in queue (us) */
+
+	/* Statistics, see sync_queue_log(). */
+	isc_uint32_t			depth_max;
+	isc_uint32_t			stall_cnt;
+	isc_uint64_t			stall_time; /**< in microseconds */
+};
+
 typedef struct task_element task_element_t;
 struct task_element {
 	isc_task_t			*task;
@@ -66,6 +108,13 @@ static const isc_interval_t shutdown_timeout = { 3, 0 };
  * events. As a result, all events generated before sync_barrier_wait() call
  * are processed before the call returns.
  *
+ * Data synchronization after reconnection is resumed from the cookie
+ * obtained in previous LDAP_SYNC_REFRESH_AND_PERSIST session. Entries which
+ * did not change are reported with LDAP_SYNC_CAPI_PRESENT phase and only
+ * their generation number in metaLDAP is updated. With warm_start enabled,
+ * the cookie is saved during shutdown together with metaLDAP and zone
+ * snapshots so the synchronization is resumed after restart, too.
+ *
  * @warning There are three assumptions:
  * 	@li Each task processes events in FIFO order.
  * 	@li The task assigned to a LDAP instance or a DNS zone never changes.
@@ -84,7 +133,7 @@ struct sync_ctx {
 	isc_mem_t			*mctx;
 	/** limit number of unprocessed LDAP events in queue
 	 *  (memory consumption is one of problems) */
-	semaphore_t			concurr_limit;
+	sync_queue_t			queue;
 
 	isc_mutex_t			mutex;	/**< guards rest of the structure */
 	isc_condition_t			cond;	/**< for signal when task_cnt == 0 */
@@ -97,6 +146,9 @@ struct sync_ctx {
 	isc_uint32_t			last_id;  /**< last processed event */
 };
 
+static void
+sync_queue_log(sync_ctx_t *sctx);
+
 /**
  * @brief This event is used to separate event queue for particular task to
  * part 'before' and 'after' this event.
@@ -148,8 +200,10 @@ finish(isc_task_t *task, isc_event_t *event) {
 	sync_state_change(bev->sctx, new_state, ISC_FALSE);
 	BROADCAST(&bev->sctx->cond);
 	UNLOCK(&bev->sctx->mutex);
-	if (new_state == sync_finished)
+	if (new_state == sync_finished) {
+		sync_queue_log(bev->sctx);
 		activate_zones(task, bev->inst);
+	}
 
 	if (result != ISC_R_SUCCESS)
 		log_error_r("syncrepl finish() failed");
@@ -268,6 +322,8 @@ sync_ctx_init(isc_mem_t *mctx, ldap_instance_t *inst, sync_ctx_t **sctxp) {
 	isc_boolean_t lock_ready = ISC_FALSE;
 	isc_boolean_t cond_ready = ISC_FALSE;
 	isc_boolean_t refcount_ready = ISC_FALSE;
+	isc_boolean_t queue_lock_ready = ISC_FALSE;
+	isc_boolean_t queue_cond_ready = ISC_FALSE;
 
 	REQUIRE(sctxp != NULL && *sctxp == NULL);
 
@@ -291,12 +347,26 @@ sync_ctx_init(isc_mem_t *mctx, ldap_instance_t *inst, sync_ctx_t **sctxp) {
 	sctx->state = sync_configinit;
 	CHECK(sync_task_add(sctx, ldap_instance_gettask(sctx->inst)));
 
-	CHECK(semaphore_init(&sctx->concurr_limit, LDAP_CONCURRENCY_LIMIT));
+	CHECK(isc_mutex_init(&sctx->queue.lock));
+	queue_lock_ready = ISC_TRUE;
+	CHECK(isc_condition_init(&sctx->queue.cond));
+	queue_cond_ready = ISC_TRUE;
+	/* Real values are set by sync_concurr_limit_set(). */
+	sctx->queue.limit = LDAP_CONCURRENCY_LIMIT;
+	sctx->queue.limit_min = LDAP_CONCURRENCY_LIMIT;
+	sctx->queue.limit_max = LDAP_CONCURRENCY_LIMIT;
+	sctx->queue.high_watermark = SIZE_MAX;
+	sctx->queue.low_watermark = SIZE_MAX;
 
 	*sctxp = sctx;
 	return ISC_R_SUCCESS;
 
 cleanup:
+	if (queue_lock_ready == ISC_TRUE)
+		DESTROYLOCK(&sctx->queue.lock);
+	if (queue_cond_ready == ISC_TRUE)
+		RUNTIME_CHECK(isc_condition_destroy(&sctx->queue.cond)
+			      == ISC_R_SUCCESS);
 	if (lock_ready == ISC_TRUE)
 		DESTROYLOCK(&sctx->mutex);
 	if (cond_ready == ISC_TRUE)
@@ -337,6 +407,10 @@ sync_ctx_free(sync_ctx_t **sctxp) {
 	isc_refcount_destroy(&sctx->task_cnt);
 	UNLOCK(&sctx->mutex);
 
+	sync_queue_log(sctx);
+	DESTROYLOCK(&sctx->queue.lock);
+	RUNTIME_CHECK(isc_condition_destroy(&sctx->queue.cond)
+		      == ISC_R_SUCCESS);
 	DESTROYLOCK(&(*sctxp)->mutex);
 	MEM_PUT_AND_DETACH(*sctxp);
 }
@@ -539,46 +613,174 @@ cleanup:
 	return result;
 }
 
+/**
+ * Set limits for syncrepl 'queue', see struct sync_queue.
+ *
+ * @param[in] limit          Maximal number of unprocessed events.
+ * @param[in] high_watermark Memory held by queued events (in bytes) which
+ *                           blocks adding new events.
+ * @param[in] low_watermark  Memory held by queued events (in bytes) which
+ *                           unblocks adding new events.
+ */
+void
+sync_concurr_limit_set(sync_ctx_t *sctx, isc_uint32_t limit,
+		       size_t high_watermark, size_t low_watermark) {
+	REQUIRE(sctx != NULL);
+	REQUIRE(limit > 0);
+	REQUIRE(low_watermark <= high_watermark);
+
+	LOCK(&sctx->queue.lock);
+	sctx->queue.limit_max = limit;
+	sctx->queue.limit_min = ISC_MIN(limit, LDAP_CONCURRENCY_LIMIT);
+	sctx->queue.limit = sctx->queue.limit_min;
+	sctx->queue.high_watermark = high_watermark;
+	sctx->queue.low_watermark = low_watermark;
+	BROADCAST(&sctx->queue.cond);
+	UNLOCK(&sctx->queue.lock);
+}
+
 /**
  * Wait until there is a free slot in syncrepl 'queue' - this limits number
- * of unprocessed ISC events to #LDAP_CONCURRENCY_LIMIT.
+ * of unprocessed ISC events and memory held by them.
  *
- * End of syncrepl event processing has to be signalled by
- * sync_concurr_limit_signal() call.
+ * The slot is taken by sync_event_send() and has to be released by
+ * sync_concurr_limit_signal() call at the end of event processing.
  */
 isc_result_t
 sync_concurr_limit_wait(sync_ctx_t *sctx) {
 	isc_result_t result;
 	isc_time_t abs_timeout;
+	isc_time_t start;
+	isc_time_t end;
+	sync_queue_t *queue;
+	isc_boolean_t stalled = ISC_FALSE;
 
 	REQUIRE(sctx != NULL);
 
-	while (ldap_instance_isexiting(sctx->inst) == ISC_FALSE) {
+	queue = &sctx->queue;
+	LOCK(&queue->lock);
+	while (queue->depth >= queue->limit || queue->over_watermark) {
+		if (ldap_instance_isexiting(sctx->inst) == ISC_TRUE)
+			CLEANUP_WITH(ISC_R_SHUTTINGDOWN);
+		if (stalled == ISC_FALSE) {
+			stalled = ISC_TRUE;
+			queue->waiting = ISC_TRUE;
+			queue->stall_cnt++;
+			TIME_NOW(&start);
+		}
+
 		result = isc_time_nowplusinterval(&abs_timeout,
 						  &shutdown_timeout);
 		INSIST(result == ISC_R_SUCCESS);
 
-		result = semaphore_wait_timed(&sctx->concurr_limit,
-					      &shutdown_timeout);
-		if (result == ISC_R_SUCCESS)
-			goto cleanup;
+		(void)WAITUNTIL(&queue->cond, &queue->lock, &abs_timeout);
 	}
 
-	result = ISC_R_SHUTTINGDOWN;
+	result = ISC_R_SUCCESS;
 
 cleanup:
+	if (stalled == ISC_TRUE) {
+		queue->waiting = ISC_FALSE;
+		TIME_NOW(&end);
+		queue->stall_time += isc_time_microdiff(&end, &start);
+	}
+	UNLOCK(&queue->lock);
 	return result;
 }
 
+/**
+ * Account event which is going to be sent to a task.
+ */
+static void
+sync_concurr_limit_take(sync_ctx_t *sctx, ldap_syncreplevent_t *ev) {
+	sync_queue_t *queue = &sctx->queue;
+
+	TIME_NOW(&ev->queued);
+
+	LOCK(&queue->lock);
+	queue->depth++;
+	queue->bytes += ev->size;
+	if (queue->bytes >= queue->high_watermark)
+		queue->over_watermark = ISC_TRUE;
+	if (queue->depth > queue->depth_max)
+		queue->depth_max = queue->depth;
+	UNLOCK(&queue->lock);
+}
+
 /**
  * Signal that syncrepl event was processed and the slot in concurrency limit
- * can be freed.
+ * can be freed. Time spent by the event in queue is used for adaptation
+ * of the limit.
  */
 void
-sync_concurr_limit_signal(sync_ctx_t *sctx) {
+sync_concurr_limit_signal(sync_ctx_t *sctx, ldap_syncreplevent_t *ev) {
+	sync_queue_t *queue;
+	isc_time_t now;
+	isc_uint64_t latency;
+
+	REQUIRE(sctx != NULL);
+	REQUIRE(ev != NULL);
+
+	queue = &sctx->queue;
+	TIME_NOW(&now);
+	latency = isc_time_microdiff(&now, &ev->queued);
+
+	LOCK(&queue->lock);
+	INSIST(queue->depth > 0);
+	INSIST(queue->bytes >= ev->size);
+	queue->depth--;
+	queue->bytes -= ev->size;
+	if (queue->over_watermark == ISC_TRUE &&
+	    queue->bytes <= queue->low_watermark)
+		queue->over_watermark = ISC_FALSE;
+
+	queue->latency_avg = (7 * queue->latency_avg + latency) / 8;
+	if (queue->latency_avg > SYNC_QUEUE_LATENCY_TARGET) {
+		if (queue->limit > queue->limit_min) {
+			queue->limit--;
+			log_debug(10, "syncrepl queue latency %" ISC_PRINT_QUADFORMAT
+				  "u us, limit lowered to %u",
+				  queue->latency_avg, queue->limit);
+		}
+	} else if (queue->waiting == ISC_TRUE &&
+		   queue->limit < queue->limit_max) {
+		queue->limit++;
+	}
+	BROADCAST(&queue->cond);
+	UNLOCK(&queue->lock);
+}
+
+/**
+ * Find out if all events sent by sync_event_send() were processed.
+ */
+isc_boolean_t
+sync_queue_isempty(sync_ctx_t *sctx) {
+	isc_boolean_t empty;
+
 	REQUIRE(sctx != NULL);
 
-	semaphore_signal(&sctx->concurr_limit);
+	LOCK(&sctx->queue.lock);
+	empty = ISC_TF(sctx->queue.depth == 0);
+	UNLOCK(&sctx->queue.lock);
+	return empty;
+}
+
+/**
+ * Log statistics for syncrepl 'queue' so limits can be tuned.
+ */
+static void
+sync_queue_log(sync_ctx_t *sctx) {
+	sync_queue_t *queue = &sctx->queue;
+
+	LOCK(&queue->lock);
+	log_info("syncrepl queue: %u events and %zu bytes queued, "
+		 "maximal depth %u, limit %u (%u-%u), producer blocked %u "
+		 "times for %" ISC_PRINT_QUADFORMAT "u ms, average latency %"
+		 ISC_PRINT_QUADFORMAT "u ms",
+		 queue->depth, queue->bytes, queue->depth_max, queue->limit,
+		 queue->limit_min, queue->limit_max, queue->stall_cnt,
+		 queue->stall_time / 1000, queue->latency_avg / 1000);
+	UNLOCK(&queue->lock);
 }
 
 /**
@@ -603,6 +805,7 @@ sync_event_send(sync_ctx_t *sctx, isc_task_t *task, ldap_syncreplevent_t **ev,
 	/* overflow is not a problem as long as the modulo is smaller than
 	 * constant used by sync_concurr_limit_wait() */
 	(*ev)->seqid = seqid = ++sctx->next_id % 0xffffffff;
+	sync_concurr_limit_take(sctx, *ev);
 	isc_task_send(task, (isc_event_t **)ev);
 	while (synchronous == ISC_TRUE && sctx->last_id != seqid) {
 		if (ldap_instance_isexiting(sctx->inst) == ISC_TRUE)
@@ -635,3 +838,59 @@ sync_event_signal(sync_ctx_t *sctx, ldap_syncreplevent_t *ev) {
 	BROADCAST(&sctx->cond);
 	UNLOCK(&sctx->mutex);
 }
+
+/**
+ * Send event which is not a syncrepl event to a task associated with a zone.
+ *
+ * The event has to have sctx as sender. It is sent under the same lock
+ * as syncrepl events so sync_event_unsendhead() sees a stable order.
+ */
+void
+sync_task_send(sync_ctx_t *sctx, isc_task_t **taskp, isc_event_t **evp) {
+	REQUIRE(sctx != NULL);
+	REQUIRE((*evp)->ev_sender == sctx);
+
+	LOCK(&sctx->mutex);
+	isc_task_sendanddetach(taskp, evp);
+	UNLOCK(&sctx->mutex);
+}
+
+/**
+ * Take events of given type which are waiting at the head of task's queue.
+ *
+ * All events sent by this synchronization context are removed from the task
+ * and the leading run of events of given type is appended to 'events'.
+ * The first event of another type, e.g. a sync barrier, and all events
+ * behind it are sent back to the task in the original order, so events
+ * taken by the caller never overtake them.
+ *
+ * Events with sctx as sender are sent only under sctx->mutex, see
+ * sync_event_send(), sync_task_send() and sync_barrier_wait(), so no new
+ * event can get between events sent back. Events from other senders
+ * (e.g. BIND itself) may end up in front of events sent back; none
+ * of them depends on order of our events.
+ */
+void
+sync_event_unsendhead(sync_ctx_t *sctx, isc_task_t *task,
+		      isc_eventtype_t type, isc_eventlist_t *events) {
+	isc_eventlist_t queued;
+	isc_event_t *ev = NULL;
+
+	REQUIRE(sctx != NULL);
+	REQUIRE(type >= LDAPDB_EVENTCLASS && type <= LDAPDB_EVENT_LAST);
+
+	ISC_LIST_INIT(queued);
+	LOCK(&sctx->mutex);
+	/* Events are returned in the order they were sent. */
+	(void)isc_task_unsendrange(task, sctx, LDAPDB_EVENTCLASS,
+				   LDAPDB_EVENT_LAST, NULL, &queued);
+	while ((ev = HEAD(queued)) != NULL && ev->ev_type == type) {
+		UNLINK(queued, ev, ev_link);
+		APPEND(*events, ev, ev_link);
+	}
+	while ((ev = HEAD(queued)) != NULL) {
+		UNLINK(queued, ev, ev_link);
+		isc_task_send(task, &ev);
+	}
+	UNLOCK(&sctx->mutex);
+}
@@ -51,11 +51,18 @@ sync_task_add(sync_ctx_t *sctx, isc_task_t *task) ATTR_NONNULLS ATTR_CHECKRESULT
 isc_result_t
 sync_barrier_wait(sync_ctx_t *sctx, ldap_instance_t *inst) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+void
+sync_concurr_limit_set(sync_ctx_t *sctx, isc_uint32_t limit,
+		       size_t high_watermark, size_t low_watermark) ATTR_NONNULLS;
+
 isc_result_t
 sync_concurr_limit_wait(sync_ctx_t *sctx) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 void
-sync_concurr_limit_signal(sync_ctx_t *sctx) ATTR_NONNULLS;
+sync_concurr_limit_signal(sync_ctx_t *sctx, ldap_syncreplevent_t *ev) ATTR_NONNULLS;
+
+isc_boolean_t
+sync_queue_isempty(sync_ctx_t *sctx) ATTR_NONNULLS ATTR_CHECKRESULT;
 
 isc_result_t
 sync_event_send(sync_ctx_t *sctx, isc_task_t *task, ldap_syncreplevent_t **ev,
@@ -64,4 +71,11 @@ sync_event_send(sync_ctx_t *sctx, isc_task_t *task, ldap_syncreplevent_t **ev,
 void
 sync_event_signal(sync_ctx_t *sctx, ldap_syncreplevent_t *ev) ATTR_NONNULLS;
 
+void
+sync_task_send(sync_ctx_t *sctx, isc_task_t **taskp, isc_event_t **evp) ATTR_NONNULLS;
+
+void
+sync_event_unsendhead(sync_ctx_t *sctx, isc_task_t *task,
+		      isc_eventtype_t type, isc_eventlist_t *events) ATTR_NONNULLS;
+
 #endif /* SYNCREPL_H_ */
@@ -9,6 +9,7 @@
 #include <isc/event.h>
 #include <isc/int.h>
 #include <isc/refcount.h>
+#include <isc/time.h>
 #include <dns/name.h>
 
 #include "util.h"
@@ -34,13 +35,21 @@ typedef struct enum_txt_assoc {
 } enum_txt_assoc_t;
 
 typedef struct ldap_instance	ldap_instance_t;
+typedef struct ldap_modbatch	ldap_modbatch_t;
 typedef struct zone_register	zone_register_t;
 typedef struct mldapdb		mldapdb_t;
+typedef struct mldap_node	mldap_node_t;
+typedef struct mldap_iter	mldap_iter_t;
+typedef struct rrschema		rrschema_t;
+typedef struct rrtemplate	rrtemplate_t;
+typedef struct rrtemplate_cache	rrtemplate_cache_t;
+typedef struct rrtemplate_deps	rrtemplate_deps_t;
 typedef struct ldap_entry	ldap_entry_t;
 typedef struct settings_set	settings_set_t;
 
 
 #define LDAPDB_EVENT_SYNCREPL_UPDATE	(LDAPDB_EVENTCLASS + 1)
+#define LDAPDB_EVENT_SYNCREPL_RECORD	(LDAPDB_EVENTCLASS + 6)
 typedef struct ldap_syncreplevent ldap_syncreplevent_t;
 struct ldap_syncreplevent {
 	ISC_EVENT_COMMON(ldap_syncreplevent_t);
@@ -50,6 +59,8 @@ struct ldap_syncreplevent {
 	int chgtype;
 	ldap_entry_t *entry;
 	isc_uint32_t seqid;
+	size_t size;		/**< memory held by entry, for sync_queue */
+	isc_time_t queued;	/**< time when the event was sent */
 };
 
 #endif /* !_LD_TYPES_H_ */
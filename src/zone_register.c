@@ -3,16 +3,23 @@
  */
 
 #include <isc/mem.h>
+#include <isc/mutex.h>
 #include <isc/rwlock.h>
 #include <isc/util.h>
 #include <isc/md5.h>
+#include <isc/netaddr.h>
 #include <isc/string.h>
 
 #include <dns/db.h>
+#include <dns/fixedname.h>
 #include <dns/rbt.h>
 #include <dns/result.h>
 #include <dns/zone.h>
 
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
 #include "fs.h"
 #include "ldap_driver.h"
 #include "log.h"
@@ -36,24 +43,73 @@
  * of the particular zone.
  */
 
+/* Maximal number of owner names in DN cache of a single zone. */
+#define ZR_DNCACHE_SIZE 1024
+
+/**
+ * Owner name -> DN of the LDAP entry with records of the owner name,
+ * see zr_get_owner_dn().
+ */
+typedef struct dncache_entry dncache_entry_t;
+struct dncache_entry {
+	dns_fixedname_t			owner;
+	char				*dn;
+	isc_boolean_t			real;	/* DN received from LDAP */
+	ISC_LINK(dncache_entry_t)	link;
+};
+
+/* Index of reverse zones, see zr_find_ptr_zone(). */
+#define ZR_PTRINDEX_INET	0
+#define ZR_PTRINDEX_INET6	1
+#define ZR_PTRINDEX_MAXDEPTH	32	/* nibbles in IPv6 address */
+
+typedef struct ptrindex_node ptrindex_node_t;
+struct ptrindex_node {
+	ptrindex_node_t	*child[16];	/* indexed by next nibble */
+	struct zone_info *zinfo;	/* zone with this prefix or NULL */
+	unsigned int	unindexed;	/* zones under this prefix which
+					   cannot be indexed, e.g. RFC 2317 */
+};
+
 struct zone_register {
 	isc_mem_t	*mctx;
 	isc_rwlock_t	rwlock;
 	dns_rbt_t	*rbt;
+	ptrindex_node_t	*ptrindex[2];	/* IPv4 and IPv6 reverse zones */
 	settings_set_t	*global_settings;
 	ldap_instance_t *ldap_inst;
 };
 
-typedef struct {
+typedef struct zone_info {
 	dns_zone_t	*raw;
 	dns_zone_t	*secure;
 	char		*dn;
 	settings_set_t	*settings;
 	dns_db_t	*ldapdb;
+
+	/* SOA serial write-back to LDAP, see ldap_serial_writeback(). */
+	isc_uint32_t	serial_pending;
+	isc_boolean_t	serial_dirty;	/* serial_pending waits for write */
+	isc_uint32_t	serial_written;	/* last serial written by us */
+	isc_boolean_t	serial_written_valid;
+
+	/* Zone entry processed last time, see ldap_entry_digest(). */
+	unsigned char	entry_digest[ISC_MD5_DIGESTLENGTH];
+	isc_boolean_t	entry_digest_valid;
+
+	/* DN cache, see zr_get_owner_dn(). */
+	isc_mutex_t	dncache_lock;
+	dns_rbt_t	*dncache;
+	ISC_LIST(dncache_entry_t) dncache_lru; /* least recently used first */
+	unsigned int	dncache_count;
 } zone_info_t;
 
 /* Callback for dns_rbt_create(). */
 static void delete_zone_info(void *arg1, void *arg2);
+static void delete_dncache_entry(void *arg1, void *arg2);
+
+static void ptrindex_prune(isc_mem_t *mctx, ptrindex_node_t **nodep,
+			   const unsigned char *nibbles, unsigned int len);
 
 /**
  * Zone specific settings from idnsZone object:
@@ -170,6 +226,8 @@ zr_destroy(zone_register_t **zrp)
 
 	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
 	dns_rbt_destroy(&zr->rbt);
+	ptrindex_prune(zr->mctx, &zr->ptrindex[ZR_PTRINDEX_INET], NULL, 0);
+	ptrindex_prune(zr->mctx, &zr->ptrindex[ZR_PTRINDEX_INET6], NULL, 0);
 	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
 	isc_rwlock_destroy(&zr->rwlock);
 	MEM_PUT_AND_DETACH(zr);
@@ -276,6 +334,14 @@ create_zone_info(isc_mem_t * const mctx, dns_zone_t * const raw,
 	CHECKED_MEM_GET_PTR(mctx, zinfo);
 	ZERO_PTR(zinfo);
 	CHECKED_MEM_STRDUP(mctx, dn, zinfo->dn);
+	ISC_LIST_INIT(zinfo->dncache_lru);
+	CHECK(dns_rbt_create(mctx, delete_dncache_entry, mctx,
+			     &zinfo->dncache));
+	result = isc_mutex_init(&zinfo->dncache_lock);
+	if (result != ISC_R_SUCCESS) {
+		dns_rbt_destroy(&zinfo->dncache);
+		goto cleanup;
+	}
 	dns_zone_attach(raw, &zinfo->raw);
 	if (secure != NULL)
 		dns_zone_attach(secure, &zinfo->secure);
@@ -325,6 +391,10 @@ delete_zone_info(void *arg1, void *arg2)
 		return;
 
 	settings_set_free(&zinfo->settings);
+	if (zinfo->dncache != NULL) {
+		dns_rbt_destroy(&zinfo->dncache);
+		DESTROYLOCK(&zinfo->dncache_lock);
+	}
 	if (zinfo->dn != NULL)
 		isc_mem_free(mctx, zinfo->dn);
 	if (zinfo->raw != NULL)
@@ -336,6 +406,24 @@ delete_zone_info(void *arg1, void *arg2)
 	SAFE_MEM_PUT_PTR(mctx, zinfo);
 }
 
+/**
+ * Delete a DN cache entry. The entry has to be unlinked from LRU list
+ * before it is deleted from the tree.
+ */
+static void ATTR_NONNULL(2)
+delete_dncache_entry(void *arg1, void *arg2)
+{
+	dncache_entry_t *entry = arg1;
+	isc_mem_t *mctx = arg2;
+
+	if (entry == NULL)
+		return;
+
+	if (entry->dn != NULL)
+		isc_mem_free(mctx, entry->dn);
+	SAFE_MEM_PUT_PTR(mctx, entry);
+}
+
 /**
  * Find a zone in ZR with origin exactly matching 'name'.
  *
@@ -359,6 +447,203 @@ getzinfo(zone_register_t * const zr, dns_name_t *name, zone_info_t **zinfo) {
 	return result;
 }
 
+/**
+ * Check that label is equal to given text, case-insensitive.
+ */
+static isc_boolean_t ATTR_NONNULLS ATTR_CHECKRESULT
+label_equal(const dns_label_t *label, const char *text) {
+	REQUIRE(label->length >= 1);
+
+	return ISC_TF(label->length - 1 == strlen(text) &&
+		      strncasecmp((const char *)label->base + 1, text,
+				  label->length - 1) == 0);
+}
+
+/**
+ * Convert origin of a reverse zone to address prefix, one nibble
+ * per element of nibbles array. E.g. 2.0.192.in-addr.arpa. is converted
+ * to IPv4 nibbles c,0,0,0,0,2 and 8.b.d.0.1.0.0.2.ip6.arpa. to IPv6
+ * nibbles 2,0,0,1,0,d,b,8.
+ *
+ * @param[out] familyp ZR_PTRINDEX_INET or ZR_PTRINDEX_INET6.
+ * @param[out] lenp    Number of valid nibbles.
+ *
+ * @retval ISC_R_SUCCESS       Zone covers the whole prefix.
+ * @retval DNS_R_PARTIALMATCH  Zone is a reverse zone but its origin cannot
+ *                             be converted to a prefix, e.g. classless
+ *                             delegation 0/25.2.0.192.in-addr.arpa.
+ *                             Nibbles contain the longest prefix above it.
+ * @retval ISC_R_NOTFOUND      Zone is not a reverse zone.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ptrindex_prefix(dns_name_t *origin, unsigned int *familyp,
+		unsigned char nibbles[ZR_PTRINDEX_MAXDEPTH],
+		unsigned int *lenp) {
+	unsigned int labels;
+	unsigned int len = 0;
+	int i;
+	unsigned int j;
+	unsigned int octet;
+	dns_label_t label;
+	const unsigned char *text;
+
+	*lenp = 0;
+	labels = dns_name_countlabels(origin);
+	if (labels < 3)
+		return ISC_R_NOTFOUND;
+	dns_name_getlabel(origin, labels - 2, &label);
+	if (!label_equal(&label, "arpa"))
+		return ISC_R_NOTFOUND;
+	dns_name_getlabel(origin, labels - 3, &label);
+	if (label_equal(&label, "in-addr"))
+		*familyp = ZR_PTRINDEX_INET;
+	else if (label_equal(&label, "ip6"))
+		*familyp = ZR_PTRINDEX_INET6;
+	else
+		return ISC_R_NOTFOUND;
+
+	/* Labels closest to the root are the most significant ones. */
+	for (i = labels - 4; i >= 0; i--) {
+		*lenp = len;
+		dns_name_getlabel(origin, i, &label);
+		text = label.base + 1;
+		if (*familyp == ZR_PTRINDEX_INET6) {
+			if (label.length != 2 || len >= ZR_PTRINDEX_MAXDEPTH ||
+			    !isxdigit(text[0]))
+				return DNS_R_PARTIALMATCH;
+			nibbles[len++] = isdigit(text[0]) ? text[0] - '0'
+					 : tolower(text[0]) - 'a' + 10;
+			continue;
+		}
+
+		/* Decimal octet without leading zeros. */
+		if (label.length < 2 || label.length > 4 || len >= 8 ||
+		    (label.length > 2 && text[0] == '0'))
+			return DNS_R_PARTIALMATCH;
+		octet = 0;
+		for (j = 0; j < label.length - 1U; j++) {
+			if (!isdigit(text[j]))
+				return DNS_R_PARTIALMATCH;
+			octet = octet * 10 + (text[j] - '0');
+		}
+		if (octet > 255)
+			return DNS_R_PARTIALMATCH;
+		nibbles[len++] = octet >> 4;
+		nibbles[len++] = octet & 0x0f;
+	}
+	*lenp = len;
+
+	return ISC_R_SUCCESS;
+}
+
+/**
+ * Free nodes on the path given by nibbles which do not hold any information.
+ * Whole subtree is freed if nibbles are NULL.
+ *
+ * @pre Zone register is locked for writing.
+ */
+static void
+ptrindex_prune(isc_mem_t *mctx, ptrindex_node_t **nodep,
+	       const unsigned char *nibbles, unsigned int len) {
+	ptrindex_node_t *node = *nodep;
+	unsigned int i;
+
+	if (node == NULL)
+		return;
+
+	if (nibbles == NULL) {
+		for (i = 0; i < 16; i++)
+			ptrindex_prune(mctx, &node->child[i], NULL, 0);
+		node->zinfo = NULL;
+		node->unindexed = 0;
+	} else if (len > 0) {
+		ptrindex_prune(mctx, &node->child[nibbles[0]], nibbles + 1,
+			       len - 1);
+	}
+
+	if (node->zinfo != NULL || node->unindexed > 0)
+		return;
+	for (i = 0; i < 16; i++)
+		if (node->child[i] != NULL)
+			return;
+	SAFE_MEM_PUT_PTR(mctx, node);
+	*nodep = NULL;
+}
+
+/**
+ * Add zone to reverse zone index. Other zones are ignored.
+ *
+ * @pre Zone register is locked for writing.
+ */
+static isc_result_t ATTR_NONNULLS ATTR_CHECKRESULT
+ptrindex_add(zone_register_t *zr, dns_name_t *origin, zone_info_t *zinfo) {
+	isc_result_t result;
+	isc_result_t prefix_result;
+	unsigned char nibbles[ZR_PTRINDEX_MAXDEPTH];
+	unsigned int family;
+	unsigned int len;
+	unsigned int i;
+	ptrindex_node_t **nodep;
+
+	prefix_result = ptrindex_prefix(origin, &family, nibbles, &len);
+	if (prefix_result == ISC_R_NOTFOUND)
+		return ISC_R_SUCCESS;
+
+	nodep = &zr->ptrindex[family];
+	for (i = 0; ; i++) {
+		if (*nodep == NULL) {
+			CHECKED_MEM_GET_PTR(zr->mctx, *nodep);
+			ZERO_PTR(*nodep);
+		}
+		if (i == len)
+			break;
+		nodep = &(*nodep)->child[nibbles[i]];
+	}
+
+	if (prefix_result == DNS_R_PARTIALMATCH)
+		(*nodep)->unindexed++;
+	else
+		(*nodep)->zinfo = zinfo;
+	return ISC_R_SUCCESS;
+
+cleanup:
+	ptrindex_prune(zr->mctx, &zr->ptrindex[family], nibbles, len);
+	return result;
+}
+
+/**
+ * Remove zone from reverse zone index.
+ *
+ * @pre Zone register is locked for writing.
+ */
+static void ATTR_NONNULLS
+ptrindex_del(zone_register_t *zr, dns_name_t *origin, zone_info_t *zinfo) {
+	isc_result_t prefix_result;
+	unsigned char nibbles[ZR_PTRINDEX_MAXDEPTH];
+	unsigned int family;
+	unsigned int len;
+	unsigned int i;
+	ptrindex_node_t *node;
+
+	prefix_result = ptrindex_prefix(origin, &family, nibbles, &len);
+	if (prefix_result == ISC_R_NOTFOUND)
+		return;
+
+	node = zr->ptrindex[family];
+	for (i = 0; node != NULL && i < len; i++)
+		node = node->child[nibbles[i]];
+	if (node == NULL)
+		return;
+
+	if (prefix_result == DNS_R_PARTIALMATCH) {
+		INSIST(node->unindexed > 0);
+		node->unindexed--;
+	} else if (node->zinfo == zinfo) {
+		node->zinfo = NULL;
+	}
+	ptrindex_prune(zr->mctx, &zr->ptrindex[family], nibbles, len);
+}
+
 /**
  * Add 'zone' to the zone register 'zr' with LDAP DN 'dn'. Origin of the zone
  * must be absolute and the zone cannot already be in the zone register.
@@ -395,7 +680,12 @@ zr_add_zone(zone_register_t * const zr, dns_db_t * const ldapdb,
 
 	CHECK(create_zone_info(zr->mctx, raw, secure, dn, zr->global_settings,
 			       zr->ldap_inst, ldapdb, &new_zinfo));
-	CHECK(dns_rbt_addname(zr->rbt, name, new_zinfo));
+	CHECK(ptrindex_add(zr, name, new_zinfo));
+	result = dns_rbt_addname(zr->rbt, name, new_zinfo);
+	if (result != ISC_R_SUCCESS) {
+		ptrindex_del(zr, name, new_zinfo);
+		goto cleanup;
+	}
 
 cleanup:
 	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
@@ -412,12 +702,15 @@ isc_result_t
 zr_del_zone(zone_register_t *zr, dns_name_t *origin)
 {
 	isc_result_t result;
+	zone_info_t *zinfo = NULL;
 
 	REQUIRE(zr != NULL);
 	REQUIRE(origin != NULL);
 
 	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
 
+	CHECK(getzinfo(zr, origin, &zinfo));
+	ptrindex_del(zr, origin, zinfo);
 	CHECK(dns_rbt_deletename(zr->rbt, origin, ISC_FALSE));
 
 cleanup:
@@ -560,6 +853,414 @@ zr_get_zone_settings(zone_register_t *zr, dns_name_t *name, settings_set_t **set
 	return result;
 }
 
+/**
+ * Find the most specific active reverse zone containing PTR record for
+ * given IP address. The lookup walks a prefix tree of reverse zones
+ * registered in the zone register, so PTR owner name is not needed.
+ *
+ * Only zones from this LDAP instance are indexed. The view can contain
+ * a more specific zone from another source, so caller has to confirm
+ * that the zone is the one found in view's zone table.
+ *
+ * Zones which cannot be represented as an address prefix (RFC 2317
+ * classless delegations) are not indexed. Lookup returns ISC_R_NOTFOUND
+ * for addresses which could belong to such zone and caller has to fall back
+ * to name-based lookup.
+ *
+ * @param[out] zonep Zone published in the view (secure zone if inline
+ *                   signing is enabled). Caller has to detach it.
+ * @param[out] setp  Settings of the zone.
+ *
+ * @retval ISC_R_SUCCESS
+ * @retval ISC_R_NOTFOUND Zone was not found in the index.
+ */
+isc_result_t
+zr_find_ptr_zone(zone_register_t *zr, const isc_netaddr_t *addr,
+		 dns_zone_t **zonep, settings_set_t **setp)
+{
+	isc_result_t result;
+	zone_info_t *candidates[ZR_PTRINDEX_MAXDEPTH + 1];
+	unsigned int count = 0;
+	const unsigned char *bytes;
+	unsigned int maxdepth;
+	unsigned int i;
+	ptrindex_node_t *node;
+	isc_boolean_t active;
+	zone_info_t *zinfo;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(addr != NULL);
+	REQUIRE(zonep != NULL && *zonep == NULL);
+	REQUIRE(setp != NULL && *setp == NULL);
+
+	switch (addr->family) {
+	case AF_INET:
+		bytes = (const unsigned char *)&addr->type.in;
+		maxdepth = 8;
+		i = ZR_PTRINDEX_INET;
+		break;
+	case AF_INET6:
+		bytes = (const unsigned char *)&addr->type.in6;
+		maxdepth = 32;
+		i = ZR_PTRINDEX_INET6;
+		break;
+	default:
+		return ISC_R_NOTFOUND;
+	}
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+
+	node = zr->ptrindex[i];
+	for (i = 0; node != NULL; i++) {
+		if (node->unindexed > 0)
+			CLEANUP_WITH(ISC_R_NOTFOUND);
+		if (node->zinfo != NULL)
+			candidates[count++] = node->zinfo;
+		if (i == maxdepth)
+			break;
+		node = node->child[(i % 2 == 0) ? bytes[i / 2] >> 4
+						: bytes[i / 2] & 0x0f];
+	}
+
+	/* Disabled zones are not published, parent zone is used instead. */
+	result = ISC_R_NOTFOUND;
+	while (count > 0) {
+		zinfo = candidates[--count];
+		if (setting_get_bool("active", zinfo->settings,
+				     &active) != ISC_R_SUCCESS ||
+		    active == ISC_FALSE)
+			continue;
+		dns_zone_attach((zinfo->secure != NULL) ? zinfo->secure
+							: zinfo->raw, zonep);
+		*setp = zinfo->settings;
+		result = ISC_R_SUCCESS;
+		break;
+	}
+
+cleanup:
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+
+	return result;
+}
+
+/**
+ * Remember SOA serial which has to be written to LDAP. Newer serial
+ * replaces serial which was not written yet.
+ *
+ * @param[out] queuedp ISC_TRUE if the zone already waits for serial write.
+ */
+isc_result_t
+zr_serial_setpending(zone_register_t *zr, dns_name_t *name,
+		     isc_uint32_t serial, isc_boolean_t *queuedp)
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(name != NULL);
+	REQUIRE(queuedp != NULL);
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
+
+	result = getzinfo(zr, name, &zinfo);
+	if (result == ISC_R_SUCCESS) {
+		*queuedp = zinfo->serial_dirty;
+		zinfo->serial_pending = serial;
+		zinfo->serial_dirty = ISC_TRUE;
+	}
+
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
+
+	return result;
+}
+
+/**
+ * Take SOA serial which waits for write to LDAP.
+ *
+ * @retval ISC_R_NOTFOUND The zone is not registered or no serial waits.
+ */
+isc_result_t
+zr_serial_takepending(zone_register_t *zr, dns_name_t *name,
+		      isc_uint32_t *serialp)
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(name != NULL);
+	REQUIRE(serialp != NULL);
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
+
+	result = getzinfo(zr, name, &zinfo);
+	if (result == ISC_R_SUCCESS) {
+		if (zinfo->serial_dirty == ISC_TRUE) {
+			*serialp = zinfo->serial_pending;
+			zinfo->serial_dirty = ISC_FALSE;
+		} else {
+			result = ISC_R_NOTFOUND;
+		}
+	}
+
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
+
+	return result;
+}
+
+/**
+ * Remember SOA serial written to LDAP by this instance
+ * so the change notification for the write can be recognized.
+ */
+isc_result_t
+zr_serial_setwritten(zone_register_t *zr, dns_name_t *name,
+		     isc_uint32_t serial)
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(name != NULL);
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
+
+	result = getzinfo(zr, name, &zinfo);
+	if (result == ISC_R_SUCCESS) {
+		zinfo->serial_written = serial;
+		zinfo->serial_written_valid = ISC_TRUE;
+	}
+
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
+
+	return result;
+}
+
+/**
+ * Remember digest of the zone entry which was successfully processed.
+ */
+isc_result_t
+zr_set_entry_digest(zone_register_t *zr, dns_name_t *name,
+		    const unsigned char digest[ISC_MD5_DIGESTLENGTH])
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(name != NULL);
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_write);
+
+	result = getzinfo(zr, name, &zinfo);
+	if (result == ISC_R_SUCCESS) {
+		memcpy(zinfo->entry_digest, digest, ISC_MD5_DIGESTLENGTH);
+		zinfo->entry_digest_valid = ISC_TRUE;
+	}
+
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_write);
+
+	return result;
+}
+
+/**
+ * Detect zone entry which differs from the last processed entry only by
+ * SOA serial written by this instance, i.e. change notification caused
+ * by our own serial write-back.
+ *
+ * @param[in] serial Value of idnsSOAserial from the entry.
+ * @param[in] digest Digest of the entry without idnsSOAserial.
+ */
+isc_boolean_t
+zr_serial_isecho(zone_register_t *zr, dns_name_t *name, isc_uint32_t serial,
+		 const unsigned char digest[ISC_MD5_DIGESTLENGTH])
+{
+	zone_info_t *zinfo = NULL;
+	isc_boolean_t echo = ISC_FALSE;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(name != NULL);
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+
+	if (getzinfo(zr, name, &zinfo) == ISC_R_SUCCESS)
+		echo = ISC_TF(zinfo->serial_written_valid == ISC_TRUE &&
+			      zinfo->serial_written == serial &&
+			      zinfo->entry_digest_valid == ISC_TRUE &&
+			      memcmp(zinfo->entry_digest, digest,
+				     ISC_MD5_DIGESTLENGTH) == 0);
+
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+
+	return echo;
+}
+
+/**
+ * Find DN of the LDAP entry with records of 'owner' in DN cache.
+ * The cache contains DNs computed from owner names by dnsname_to_dn()
+ * and DNs of entries received from LDAP, which take precedence.
+ *
+ * @param[out] dn DN of the entry.
+ *
+ * @retval ISC_R_NOTFOUND The zone is not registered or the owner name
+ *                        is not in the cache.
+ */
+isc_result_t
+zr_get_owner_dn(zone_register_t *zr, dns_name_t *zone, dns_name_t *owner,
+		ld_string_t *dn)
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+	dncache_entry_t *entry = NULL;
+	void *data = NULL;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(zone != NULL);
+	REQUIRE(owner != NULL);
+	REQUIRE(dn != NULL);
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+
+	CHECK(getzinfo(zr, zone, &zinfo));
+	LOCK(&zinfo->dncache_lock);
+	result = dns_rbt_findname(zinfo->dncache, owner, 0, NULL, &data);
+	if (result == ISC_R_SUCCESS) {
+		entry = data;
+		ISC_LIST_UNLINK(zinfo->dncache_lru, entry, link);
+		ISC_LIST_APPEND(zinfo->dncache_lru, entry, link);
+		str_clear(dn);
+		result = str_cat_char(dn, entry->dn);
+	} else if (result == DNS_R_PARTIALMATCH) {
+		result = ISC_R_NOTFOUND;
+	}
+	UNLOCK(&zinfo->dncache_lock);
+
+cleanup:
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+
+	return result;
+}
+
+/**
+ * Store DN of the LDAP entry with records of 'owner' in DN cache.
+ * The least recently used owner name is dropped if the cache is full.
+ *
+ * @param[in] real ISC_TRUE if the DN was received from LDAP. Such DN is not
+ *                 replaced by DN computed from the owner name.
+ */
+isc_result_t
+zr_set_owner_dn(zone_register_t *zr, dns_name_t *zone, dns_name_t *owner,
+		const char *dn, isc_boolean_t real)
+{
+	isc_result_t result;
+	zone_info_t *zinfo = NULL;
+	dncache_entry_t *entry = NULL;
+	void *data = NULL;
+	char *new_dn = NULL;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(zone != NULL);
+	REQUIRE(owner != NULL);
+	REQUIRE(dn != NULL);
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+
+	CHECK(getzinfo(zr, zone, &zinfo));
+	LOCK(&zinfo->dncache_lock);
+	result = dns_rbt_findname(zinfo->dncache, owner, 0, NULL, &data);
+	if (result == ISC_R_SUCCESS) {
+		entry = data;
+		ISC_LIST_UNLINK(zinfo->dncache_lru, entry, link);
+		ISC_LIST_APPEND(zinfo->dncache_lru, entry, link);
+		if ((real == ISC_TRUE || entry->real == ISC_FALSE) &&
+		    strcmp(entry->dn, dn) != 0) {
+			new_dn = isc_mem_strdup(zr->mctx, dn);
+			if (new_dn == NULL) {
+				result = ISC_R_NOMEMORY;
+			} else {
+				isc_mem_free(zr->mctx, entry->dn);
+				entry->dn = new_dn;
+			}
+		}
+		if (result == ISC_R_SUCCESS && real == ISC_TRUE)
+			entry->real = ISC_TRUE;
+		goto unlock;
+	}
+
+	entry = isc_mem_get(zr->mctx, sizeof(*entry));
+	if (entry == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto unlock;
+	}
+	ZERO_PTR(entry);
+	ISC_LINK_INIT(entry, link);
+	dns_fixedname_init(&entry->owner);
+	entry->real = real;
+	entry->dn = isc_mem_strdup(zr->mctx, dn);
+	if (entry->dn == NULL)
+		result = ISC_R_NOMEMORY;
+	else
+		result = dns_name_copy(owner, dns_fixedname_name(&entry->owner),
+				       NULL);
+	if (result == ISC_R_SUCCESS)
+		result = dns_rbt_addname(zinfo->dncache, owner, entry);
+	if (result != ISC_R_SUCCESS) {
+		delete_dncache_entry(entry, zr->mctx);
+		goto unlock;
+	}
+	ISC_LIST_APPEND(zinfo->dncache_lru, entry, link);
+	zinfo->dncache_count++;
+
+	/* Drop the least recently used owner name. */
+	if (zinfo->dncache_count > ZR_DNCACHE_SIZE) {
+		entry = ISC_LIST_HEAD(zinfo->dncache_lru);
+		ISC_LIST_UNLINK(zinfo->dncache_lru, entry, link);
+		RUNTIME_CHECK(dns_rbt_deletename(zinfo->dncache,
+				dns_fixedname_name(&entry->owner),
+				ISC_FALSE) == ISC_R_SUCCESS);
+		zinfo->dncache_count--;
+	}
+
+unlock:
+	UNLOCK(&zinfo->dncache_lock);
+
+cleanup:
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+
+	return result;
+}
+
+/**
+ * Forget DN of the LDAP entry with records of 'owner',
+ * e.g. because the entry was deleted.
+ */
+void
+zr_del_owner_dn(zone_register_t *zr, dns_name_t *zone, dns_name_t *owner)
+{
+	zone_info_t *zinfo = NULL;
+	dncache_entry_t *entry = NULL;
+	void *data = NULL;
+
+	REQUIRE(zr != NULL);
+	REQUIRE(zone != NULL);
+	REQUIRE(owner != NULL);
+
+	RWLOCK(&zr->rwlock, isc_rwlocktype_read);
+
+	if (getzinfo(zr, zone, &zinfo) == ISC_R_SUCCESS) {
+		LOCK(&zinfo->dncache_lock);
+		if (dns_rbt_findname(zinfo->dncache, owner, 0, NULL,
+				     &data) == ISC_R_SUCCESS) {
+			entry = data;
+			ISC_LIST_UNLINK(zinfo->dncache_lru, entry, link);
+			RUNTIME_CHECK(dns_rbt_deletename(zinfo->dncache, owner,
+							 ISC_FALSE)
+				      == ISC_R_SUCCESS);
+			zinfo->dncache_count--;
+		}
+		UNLOCK(&zinfo->dncache_lock);
+	}
+
+	RWUNLOCK(&zr->rwlock, isc_rwlocktype_read);
+}
+
 /**
  * Delete a zone from plain BIND. LDAP zones require further steps for complete
  * removal, like deletion from zone register etc.
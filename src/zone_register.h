@@ -5,6 +5,8 @@
 #ifndef _LD_ZONE_REGISTER_H_
 #define _LD_ZONE_REGISTER_H_
 
+#include <isc/md5.h>
+#include <isc/netaddr.h>
 #include <dns/zt.h>
 
 #include "settings.h"
@@ -42,6 +44,41 @@ zr_get_zone_ptr(zone_register_t * const zr, dns_name_t * const name,
 isc_result_t
 zr_get_zone_settings(zone_register_t *zr, dns_name_t *name, settings_set_t **set) ATTR_NONNULLS ATTR_CHECKRESULT;
 
+isc_result_t
+zr_find_ptr_zone(zone_register_t *zr, const isc_netaddr_t *addr,
+		 dns_zone_t **zonep, settings_set_t **setp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+zr_serial_setpending(zone_register_t *zr, dns_name_t *name,
+		     isc_uint32_t serial, isc_boolean_t *queuedp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+zr_serial_takepending(zone_register_t *zr, dns_name_t *name,
+		      isc_uint32_t *serialp) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+zr_serial_setwritten(zone_register_t *zr, dns_name_t *name,
+		     isc_uint32_t serial) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+zr_set_entry_digest(zone_register_t *zr, dns_name_t *name,
+		    const unsigned char digest[ISC_MD5_DIGESTLENGTH]) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_boolean_t
+zr_serial_isecho(zone_register_t *zr, dns_name_t *name, isc_uint32_t serial,
+		 const unsigned char digest[ISC_MD5_DIGESTLENGTH]) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+zr_get_owner_dn(zone_register_t *zr, dns_name_t *zone, dns_name_t *owner,
+		ld_string_t *dn) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+isc_result_t
+zr_set_owner_dn(zone_register_t *zr, dns_name_t *zone, dns_name_t *owner,
+		const char *dn, isc_boolean_t real) ATTR_NONNULLS ATTR_CHECKRESULT;
+
+void
+zr_del_owner_dn(zone_register_t *zr, dns_name_t *zone, dns_name_t *owner) ATTR_NONNULLS;
+
 isc_result_t
 zr_get_zone_path(isc_mem_t *mctx, settings_set_t *settings,
 		 dns_name_t *zone_name, const char *last_component,